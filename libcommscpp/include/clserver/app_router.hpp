@@ -0,0 +1,156 @@
+//--------------------------------------------------------------------------------
+// Route ApplicationMsg messages to subscribers by appid.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_APP_ROUTER_HH
+#define CLSERVER_APP_ROUTER_HH
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "worker_write_generated.h"
+#include "clserver/rcu.hpp"
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// AppRouter is the publish/subscribe registry for ApplicationMsg. Each of the
+// 65536 appids has a slot in a flat table holding an immutable list of
+// subscribers, so routing a message is an index, an atomic load and a call per
+// subscriber with no lock and no hashing.
+//
+// Subscribing or unsubscribing copies the list for one appid, publishes the
+// copy and waits, RCU style, until no route() can still see the old list
+// before freeing it. Registration is therefore slow and may block briefly; it
+// can be done from any thread but not from within a handler called by the same
+// router.
+//
+// An AppRouter can be the visitor of a MsgDispatcher:
+//
+//     MsgDispatcher<AppRouter&> dispatcher{router};
+// -------------------------------------------------------------------------------
+
+class AppRouter
+{
+public:
+    using handler_t = std::function<void(const ClingoServer::ApplicationMsg&,
+                                         const ClingoServer::Message&)>;
+    using subscription_t = uint64_t;
+
+    static constexpr std::size_t num_appids = 65536;
+
+    AppRouter();
+
+    AppRouter(AppRouter&&) = delete;
+    AppRouter(const AppRouter&) = delete;
+    ~AppRouter();
+
+    AppRouter& operator=(const AppRouter&) = delete;
+
+    // Add a handler for an appid. The returned id is needed to unsubscribe.
+    subscription_t subscribe(uint16_t appid, handler_t h);
+
+    // Remove a handler. Returns false if it was not subscribed.
+    bool unsubscribe(uint16_t appid, subscription_t id);
+
+    // Call every handler subscribed to the message's appid. Returns the number
+    // of handlers called.
+    std::size_t route(const ClingoServer::ApplicationMsg& m,
+                      const ClingoServer::Message& frame) const;
+
+    void operator()(const ClingoServer::ApplicationMsg& m,
+                    const ClingoServer::Message& frame) const
+    { route(m, frame); }
+
+    bool has_subscribers(uint16_t appid) const
+    { return slots_[appid].load(std::memory_order_acquire) != nullptr; }
+
+private:
+    struct _Subscriber
+    {
+        subscription_t id_;
+        handler_t handler_;
+    };
+    using _Subscribers = std::vector<_Subscriber>;
+
+    void _publish(uint16_t appid, std::unique_ptr<_Subscribers> next);
+
+    std::unique_ptr<std::atomic<const _Subscribers*>[]> slots_;
+    mutable RcuDomain rcu_;
+    std::mutex writer_;
+    subscription_t next_id_;
+};
+
+//-------------------------------------------------------------------------------
+// AppRouter member functions
+//-------------------------------------------------------------------------------
+
+inline AppRouter::AppRouter() :
+    slots_{new std::atomic<const _Subscribers*>[num_appids]}, next_id_{1}
+{
+    for (std::size_t i = 0; i < num_appids; ++i)
+        slots_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+inline AppRouter::~AppRouter()
+{
+    for (std::size_t i = 0; i < num_appids; ++i)
+        delete slots_[i].load(std::memory_order_relaxed);
+}
+
+inline AppRouter::subscription_t AppRouter::subscribe(uint16_t appid, handler_t h)
+{
+    std::lock_guard<std::mutex> lock{writer_};
+    auto current = slots_[appid].load(std::memory_order_relaxed);
+    std::unique_ptr<_Subscribers> next{current ? new _Subscribers(*current)
+                                               : new _Subscribers()};
+    auto id = next_id_++;
+    next->push_back(_Subscriber{id, std::move(h)});
+    _publish(appid, std::move(next));
+    return id;
+}
+
+inline bool AppRouter::unsubscribe(uint16_t appid, subscription_t id)
+{
+    std::lock_guard<std::mutex> lock{writer_};
+    auto current = slots_[appid].load(std::memory_order_relaxed);
+    if (!current) return false;
+
+    std::unique_ptr<_Subscribers> next{new _Subscribers};
+    for (const auto& s : *current)
+        if (s.id_ != id) next->push_back(s);
+    if (next->size() == current->size()) return false;
+    if (next->empty()) next.reset();
+    _publish(appid, std::move(next));
+    return true;
+}
+
+inline std::size_t AppRouter::route(const ClingoServer::ApplicationMsg& m,
+                                    const ClingoServer::Message& frame) const
+{
+    auto guard = rcu_.read_lock();
+    auto subs = slots_[m.appid()].load(std::memory_order_acquire);
+    if (!subs) return 0;
+    for (const auto& s : *subs) s.handler_(m, frame);
+    return subs->size();
+}
+
+//------------------------------------------------------------------------------
+// Swap in the new list and free the old one once no reader can hold it.
+// -----------------------------------------------------------------------------
+
+inline void AppRouter::_publish(uint16_t appid, std::unique_ptr<_Subscribers> next)
+{
+    std::unique_ptr<const _Subscribers> old{
+        slots_[appid].exchange(next.release(), std::memory_order_seq_cst)};
+    rcu_.synchronize();
+}
+
+}
+
+#endif // CLSERVER_APP_ROUTER_HH
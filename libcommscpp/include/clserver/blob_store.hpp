@@ -0,0 +1,335 @@
+//--------------------------------------------------------------------------------
+// Server side store of content-addressed blobs: programs and fact files.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_BLOB_STORE_HH
+#define CLSERVER_BLOB_STORE_HH
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include "clserver/chunker.hpp"
+#include "clserver/sha256.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clserver
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// A read-only mapping of a stored blob. Workers give the mapping to clingo
+// rather than reading the file into memory, so a blob used by many jobs is
+// held once, in the page cache.
+// -------------------------------------------------------------------------------
+
+class BlobView
+{
+public:
+    BlobView() : data_{nullptr}, size_{0} { }
+    BlobView(BlobView&& other) : data_{other.data_}, size_{other.size_}
+    { other.data_ = nullptr; other.size_ = 0; }
+    BlobView(const BlobView&) = delete;
+    ~BlobView() { _unmap(); }
+
+    BlobView& operator=(BlobView&& other);
+    BlobView& operator=(const BlobView&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    friend class BlobStore;
+    BlobView(const uint8_t* data, std::size_t size) : data_{data}, size_{size} { }
+    void _unmap();
+
+    const uint8_t* data_;
+    std::size_t size_;
+};
+
+struct BlobStoreStats
+{
+    std::size_t chunks_stored = 0;
+    std::size_t chunk_bytes = 0;   // Bytes received in stored chunks
+    std::size_t chunks_rejected = 0;   // Chunks whose content didn't match the hash
+    std::size_t blobs_assembled = 0;
+    std::size_t blob_bytes = 0;    // Bytes of assembled blobs
+};
+
+//-------------------------------------------------------------------------------
+// BlobStore keeps the chunks that clients upload, each under its hash, and
+// the blobs assembled from them, each under the hash of its content. A client
+// offers the manifests of the blobs a job uses, uploads only the chunks that
+// missing_chunks() reports, and then names the blobs in its job request; a
+// blob that was uploaded before costs only its id. Chunks are kept after a
+// blob is assembled so that a later version of a file can reuse those it
+// shares with this one.
+//
+// Ids and hashes are checked to be 64 lower case hex digits before they are
+// used as file names. Files are written under a temporary name and renamed
+// into place, so workers reading the store never see a partial file.
+// -------------------------------------------------------------------------------
+
+class BlobStore
+{
+public:
+    // Workers open the store in the directory this names
+    static constexpr const char* dir_env = "CLINGOSERVER_BLOB_STORE";
+
+    explicit BlobStore(const std::string& dir) :
+        dir_{dir}, chunk_dir_{dir + "/chunks"}, blob_dir_{dir + "/blobs"} { }
+
+    BlobStore(BlobStore&&) = delete;
+    BlobStore(const BlobStore&) = delete;
+
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    // Create the store's directories if they don't exist
+    void open(bsys::error_code& ec);
+
+    bool has_blob(const std::string& id) const { return _exists(blob_path(id)); }
+    bool has_chunk(const std::string& hash) const { return _exists(_chunk_path(hash)); }
+
+    // The chunks of a manifest that are not stored, without repeats. Empty if
+    // the blob itself is stored.
+    std::vector<std::string> missing_chunks(const Manifest& manifest) const;
+
+    // Store an uploaded chunk after checking its content against the hash
+    void put_chunk(const std::string& hash, const void* data, std::size_t size,
+                   bsys::error_code& ec);
+
+    // Concatenate a blob's chunks and store it if its content matches the id
+    void assemble(const Manifest& manifest, bsys::error_code& ec);
+
+    // Store a whole blob, such as one the server produced itself. Returns the id.
+    std::string put_blob(const void* data, std::size_t size, bsys::error_code& ec);
+
+    BlobView map(const std::string& id, bsys::error_code& ec) const;
+
+    // The file of a blob, for workers that open it themselves
+    std::string blob_path(const std::string& id) const
+    { return valid_id(id) ? blob_dir_ + "/" + id : std::string{}; }
+
+    const BlobStoreStats& stats() const { return stats_; }
+
+    static bool valid_id(const std::string& id);
+
+private:
+    std::string _chunk_path(const std::string& hash) const
+    { return valid_id(hash) ? chunk_dir_ + "/" + hash : std::string{}; }
+
+    static bool _exists(const std::string& path);
+    static bsys::error_code _errno()
+    { return bsys::error_code{errno ? errno : EIO, bsys::system_category()}; }
+
+    // Write the pieces to path through a temporary file
+    static void _write(const std::string& path,
+                       const std::vector<std::pair<const void*, std::size_t>>& pieces,
+                       bsys::error_code& ec);
+
+    std::string dir_;
+    std::string chunk_dir_;
+    std::string blob_dir_;
+    BlobStoreStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// BlobView member functions
+//-------------------------------------------------------------------------------
+
+inline BlobView& BlobView::operator=(BlobView&& other)
+{
+    if (this == &other) return *this;
+    _unmap();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+}
+
+inline void BlobView::_unmap()
+{
+    if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+//-------------------------------------------------------------------------------
+// BlobStore public member functions
+//-------------------------------------------------------------------------------
+
+inline void BlobStore::open(bsys::error_code& ec)
+{
+    for (const auto* dir : {&dir_, &chunk_dir_, &blob_dir_})
+    {
+        if (::mkdir(dir->c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            ec = _errno();
+            return;
+        }
+    }
+}
+
+inline std::vector<std::string> BlobStore::missing_chunks(const Manifest& manifest) const
+{
+    std::vector<std::string> missing;
+    if (has_blob(manifest.id)) return missing;
+    for (const auto& c : manifest.chunks)
+    {
+        if (has_chunk(c.hash)) continue;
+        if (std::find(missing.begin(), missing.end(), c.hash) == missing.end())
+            missing.push_back(c.hash);
+    }
+    return missing;
+}
+
+inline void BlobStore::put_chunk(const std::string& hash, const void* data, std::size_t size,
+                                 bsys::error_code& ec)
+{
+    if (!valid_id(hash) || Sha256::hex_digest(data, size) != hash)
+    {
+        ++stats_.chunks_rejected;
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return;
+    }
+    if (has_chunk(hash)) return;
+    _write(_chunk_path(hash), {{data, size}}, ec);
+    if (ec) return;
+    ++stats_.chunks_stored;
+    stats_.chunk_bytes += size;
+}
+
+//------------------------------------------------------------------------------
+// The chunks are mapped rather than read, and written out in one go. The
+// content is hashed as a whole before anything is stored.
+// -----------------------------------------------------------------------------
+
+inline void BlobStore::assemble(const Manifest& manifest, bsys::error_code& ec)
+{
+    if (!valid_id(manifest.id))
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::invalid_argument);
+        return;
+    }
+    if (has_blob(manifest.id)) return;
+
+    std::vector<BlobView> views;
+    std::vector<std::pair<const void*, std::size_t>> pieces;
+    Sha256 h;
+    uint64_t size = 0;
+    for (const auto& c : manifest.chunks)
+    {
+        int fd = valid_id(c.hash) ? ::open(_chunk_path(c.hash).c_str(), O_RDONLY | O_CLOEXEC) : -1;
+        if (fd < 0)
+        {
+            ec = bsys::errc::make_error_code(bsys::errc::no_such_file_or_directory);
+            return;
+        }
+        struct stat st;
+        void* map = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) continue;
+
+        views.push_back(BlobView{static_cast<const uint8_t*>(map),
+                                 static_cast<std::size_t>(st.st_size)});
+        h.update(views.back().data(), views.back().size());
+        pieces.emplace_back(views.back().data(), views.back().size());
+        size += views.back().size();
+    }
+
+    if (size != manifest.size || Sha256::hex(h.finish()) != manifest.id)
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return;
+    }
+    _write(blob_path(manifest.id), pieces, ec);
+    if (ec) return;
+    ++stats_.blobs_assembled;
+    stats_.blob_bytes += size;
+}
+
+inline std::string BlobStore::put_blob(const void* data, std::size_t size, bsys::error_code& ec)
+{
+    auto id = Sha256::hex_digest(data, size);
+    if (has_blob(id)) return id;
+    _write(blob_path(id), {{data, size}}, ec);
+    if (ec) return std::string{};
+    ++stats_.blobs_assembled;
+    stats_.blob_bytes += size;
+    return id;
+}
+
+inline BlobView BlobStore::map(const std::string& id, bsys::error_code& ec) const
+{
+    int fd = valid_id(id) ? ::open(blob_path(id).c_str(), O_RDONLY | O_CLOEXEC) : -1;
+    if (fd < 0)
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::no_such_file_or_directory);
+        return BlobView{};
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) != 0) ec = _errno();
+    else if (st.st_size > 0)
+    {
+        map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) ec = _errno();
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) return BlobView{};
+    return BlobView{static_cast<const uint8_t*>(map), static_cast<std::size_t>(st.st_size)};
+}
+
+inline bool BlobStore::valid_id(const std::string& id)
+{
+    if (id.size() != 64) return false;
+    for (char c : id)
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    return true;
+}
+
+//-------------------------------------------------------------------------------
+// BlobStore internal member functions
+//-------------------------------------------------------------------------------
+
+inline bool BlobStore::_exists(const std::string& path)
+{
+    struct stat st;
+    return !path.empty() && ::stat(path.c_str(), &st) == 0;
+}
+
+inline void BlobStore::_write(const std::string& path,
+                              const std::vector<std::pair<const void*, std::size_t>>& pieces,
+                              bsys::error_code& ec)
+{
+    auto tmp = path + ".tmp." + std::to_string(::getpid());
+    auto f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        ec = _errno();
+        return;
+    }
+    bool ok = true;
+    for (const auto& p : pieces)
+        ok = ok && std::fwrite(p.first, 1, p.second, f) == p.second;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        ec = _errno();
+        std::remove(tmp.c_str());
+    }
+}
+
+}
+
+#endif // CLSERVER_BLOB_STORE_HH
@@ -0,0 +1,509 @@
+//--------------------------------------------------------------------------------
+// Topic based publish/subscribe of frames to client connections.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_BROKER_HH
+#define CLSERVER_BROKER_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/connection.hpp"
+#include "clserver/rcu.hpp"
+#include "clserver/ring_queue.hpp"
+#include "clserver/shared_frame.hpp"
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// Topics are '/' separated levels, for example "job/42/models". Subscriptions
+// use MQTT style filters where '+' matches exactly one level and a trailing '#'
+// matches any number of levels, including none: "job/+/stats" or "job/42/#".
+// -------------------------------------------------------------------------------
+
+bool valid_topic_filter(const std::string& filter);
+bool topic_matches(const std::string& filter, const std::string& topic);
+
+//-------------------------------------------------------------------------------
+// The receiving end of a subscription. deliver() may be called from any thread
+// and must not block. The topic key is the same for every frame published to
+// the same topic; it is a hash of the topic name.
+// -------------------------------------------------------------------------------
+
+class SubscriberBase
+{
+public:
+    virtual ~SubscriberBase() { }
+    virtual void deliver(std::size_t topic_key, const SharedFrame& frame) = 0;
+    virtual bool closed() const = 0;
+};
+
+//-------------------------------------------------------------------------------
+// What a Subscriber does with a frame when its queue is full:
+//
+//  - DropOldest: discard the oldest queued frame to make room.
+//  - DropNewest: discard the new frame.
+//  - Disconnect: close the subscriber and call its on_disconnect callback.
+//  - Conflate:   a new frame replaces any queued frame of the same topic, so
+//                only the latest of each topic is sent; if the queue is still
+//                full the oldest frame is discarded.
+// -------------------------------------------------------------------------------
+
+enum class OverflowPolicy { DropOldest, DropNewest, Disconnect, Conflate };
+
+struct SubscriberStats
+{
+    std::size_t sent;           // Frames sent on the connection
+    std::size_t dropped;        // Frames discarded because the queue was full
+    std::size_t conflated;      // Queued frames replaced by a newer one
+    std::size_t queued;         // Frames waiting now
+    std::size_t max_queued;     // The most frames that have waited at once
+    bool disconnected;          // Closed by the Disconnect policy
+};
+
+//-------------------------------------------------------------------------------
+// Subscriber sends delivered frames on a Connection. Each send shares the
+// frame's buffer rather than copying it.
+//
+// Delivered frames wait in a bounded queue and at most max_in_flight of them
+// are handed to the connection at a time, so a slow client only ever holds
+// max_queued frames and never backs up into the publisher or other
+// subscribers of the topic. The queue is protected by a mutex that is only
+// contended between the publisher and the connection's executor.
+//
+// Once close() is called, or a send fails, further frames are dropped. The
+// connection must outlive the subscriber or be closed through it first.
+// -------------------------------------------------------------------------------
+
+template<typename Stream>
+class Subscriber : public SubscriberBase,
+                   public std::enable_shared_from_this<Subscriber<Stream>>
+{
+public:
+    struct Options
+    {
+        std::size_t max_queued = 1024;
+        std::size_t max_in_flight = 2;
+        OverflowPolicy policy = OverflowPolicy::DropOldest;
+
+        // Called on the connection's executor when the Disconnect policy
+        // closes the subscriber, to close the connection itself
+        std::function<void()> on_disconnect;
+    };
+
+    static std::shared_ptr<Subscriber> create(Connection<Stream>& conn,
+                                              Options opts = Options{})
+    { return std::shared_ptr<Subscriber>{new Subscriber{conn, std::move(opts)}}; }
+
+    Subscriber(Subscriber&&) = delete;
+    Subscriber(const Subscriber&) = delete;
+
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    void deliver(std::size_t topic_key, const SharedFrame& frame) override;
+    bool closed() const override { return closed_.load(std::memory_order_acquire); }
+    void close();
+
+    std::size_t frames_sent() const { return sent_.load(std::memory_order_relaxed); }
+    SubscriberStats stats() const;
+
+private:
+    struct _Entry
+    {
+        std::size_t key_;
+        SharedFrame frame_;
+    };
+
+    Subscriber(Connection<Stream>& conn, Options opts);
+
+    void _pump();
+    void _on_sent(const bsys::error_code& ec);
+    void _disconnect();
+
+    Connection<Stream>& conn_;
+    Options opts_;
+    std::atomic<bool> closed_;
+
+    // Guards queue_, pump_pending_ and max_queued_
+    mutable std::mutex mutex_;
+    RingQueue<_Entry> queue_;
+    bool pump_pending_;
+    std::size_t max_queued_;
+
+    // Only accessed from the connection's executor
+    std::size_t in_flight_;
+
+    std::atomic<std::size_t> sent_;
+    std::atomic<std::size_t> dropped_;
+    std::atomic<std::size_t> conflated_;
+    std::atomic<bool> disconnected_;
+};
+
+//-------------------------------------------------------------------------------
+// Broker fans published frames out to the subscribers of matching topics.
+//
+// The subscription table is an immutable snapshot behind an RcuPtr, so
+// publish() runs without locks from any thread: an exact topic is one hash
+// lookup and wildcard filters are matched in turn. subscribe() and
+// unsubscribe() copy the table and wait for a grace period, so they are
+// comparatively slow and must not be called from within deliver().
+// -------------------------------------------------------------------------------
+
+class Broker
+{
+public:
+    using subscription_t = uint64_t;
+
+    Broker() : table_{rcu_, std::unique_ptr<_Table>{new _Table}}, next_id_{1} { }
+
+    Broker(Broker&&) = delete;
+    Broker(const Broker&) = delete;
+
+    Broker& operator=(const Broker&) = delete;
+
+    // Returns a non-zero id, or 0 if the filter is malformed
+    subscription_t subscribe(const std::string& filter,
+                             std::shared_ptr<SubscriberBase> sub);
+    bool unsubscribe(subscription_t id);
+
+    // Remove every subscription of sub, such as when its connection closes.
+    // Returns the number removed.
+    std::size_t unsubscribe_all(const SubscriberBase* sub);
+
+    // Deliver the frame to every open subscriber with a matching filter and
+    // return how many there were. A subscriber with several matching filters
+    // receives the frame once per filter.
+    std::size_t publish(const std::string& topic, const SharedFrame& frame) const;
+
+private:
+    struct _Subscription
+    {
+        subscription_t id_;
+        std::string filter_;
+        std::shared_ptr<SubscriberBase> sub_;
+    };
+
+    struct _Table
+    {
+        // Filters without wildcards by topic, and the rest
+        std::unordered_map<std::string, std::vector<_Subscription>> exact_;
+        std::vector<_Subscription> wildcard_;
+    };
+
+    mutable RcuDomain rcu_;
+    RcuPtr<_Table> table_;
+    std::atomic<subscription_t> next_id_;
+};
+
+//-------------------------------------------------------------------------------
+// Topic filter matching
+//-------------------------------------------------------------------------------
+
+inline bool valid_topic_filter(const std::string& filter)
+{
+    if (filter.empty()) return false;
+    std::size_t start = 0;
+    for (;;)
+    {
+        std::size_t end = filter.find('/', start);
+        if (end == std::string::npos) end = filter.size();
+        std::string::size_type len = end - start;
+        for (std::size_t i = start; i < end; ++i)
+        {
+            if ((filter[i] == '+' || filter[i] == '#') && len != 1) return false;
+        }
+        if (len == 1 && filter[start] == '#' && end != filter.size()) return false;
+        if (end == filter.size()) return true;
+        start = end + 1;
+    }
+}
+
+inline bool topic_matches(const std::string& filter, const std::string& topic)
+{
+    std::size_t f = 0, t = 0;
+    for (;;)
+    {
+        std::size_t fend = filter.find('/', f);
+        if (fend == std::string::npos) fend = filter.size();
+
+        // '#' also matches the parent level: "a/#" matches "a"
+        if (fend - f == 1 && filter[f] == '#') return true;
+
+        std::size_t tend = topic.find('/', t);
+        if (tend == std::string::npos) tend = topic.size();
+
+        if (!(fend - f == 1 && filter[f] == '+') &&
+            filter.compare(f, fend - f, topic, t, tend - t) != 0) return false;
+
+        bool flast = fend == filter.size();
+        bool tlast = tend == topic.size();
+        if (flast || tlast)
+        {
+            if (flast && tlast) return true;
+            // Only "a/#" against "a" can still match
+            return tlast && filter.compare(fend, std::string::npos, "/#") == 0;
+        }
+        f = fend + 1;
+        t = tend + 1;
+    }
+}
+
+//-------------------------------------------------------------------------------
+// Subscriber member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream>
+Subscriber<Stream>::Subscriber(Connection<Stream>& conn, Options opts) :
+    conn_{conn}, opts_{std::move(opts)}, closed_{false},
+    queue_{std::min<std::size_t>(opts_.max_queued, 64)}, pump_pending_{false},
+    max_queued_{0}, in_flight_{0}, sent_{0}, dropped_{0}, conflated_{0},
+    disconnected_{false}
+{ }
+
+//------------------------------------------------------------------------------
+// Queue a frame according to the overflow policy and make sure a pump is
+// scheduled on the connection's executor to send it.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+void Subscriber<Stream>::deliver(std::size_t topic_key, const SharedFrame& frame)
+{
+    if (closed()) return;
+
+    bool schedule = false;
+    bool overflow = false;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (opts_.policy == OverflowPolicy::Conflate)
+        {
+            for (std::size_t i = 0; i < queue_.size(); ++i)
+            {
+                if (queue_[i].key_ != topic_key) continue;
+                queue_[i].frame_ = frame;
+                conflated_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        if (queue_.size() >= opts_.max_queued)
+        {
+            switch (opts_.policy)
+            {
+            case OverflowPolicy::DropNewest:
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            case OverflowPolicy::Disconnect:
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                overflow = true;
+                break;
+            case OverflowPolicy::DropOldest:
+            case OverflowPolicy::Conflate:
+                queue_.pop_front();
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        if (queue_.size() < opts_.max_queued)
+        {
+            queue_.emplace_back(_Entry{topic_key, frame});
+            max_queued_ = std::max(max_queued_, queue_.size());
+            schedule = !pump_pending_;
+            pump_pending_ = true;
+        }
+    }
+
+    auto self = this->shared_from_this();
+    if (overflow)
+    {
+        if (!disconnected_.exchange(true))
+            asio::dispatch(conn_.get_executor(), [self]() { self->_disconnect(); });
+    }
+    else if (schedule)
+    {
+        asio::dispatch(conn_.get_executor(), [self]() { self->_pump(); });
+    }
+}
+
+template<typename Stream>
+void Subscriber<Stream>::close()
+{
+    closed_.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock{mutex_};
+    while (!queue_.empty()) queue_.pop_front();
+}
+
+template<typename Stream>
+SubscriberStats Subscriber<Stream>::stats() const
+{
+    SubscriberStats st;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        st.queued = queue_.size();
+        st.max_queued = max_queued_;
+    }
+    st.sent = sent_.load(std::memory_order_relaxed);
+    st.dropped = dropped_.load(std::memory_order_relaxed);
+    st.conflated = conflated_.load(std::memory_order_relaxed);
+    st.disconnected = disconnected_.load(std::memory_order_relaxed);
+    return st;
+}
+
+//------------------------------------------------------------------------------
+// Hand queued frames to the connection until max_in_flight are outstanding.
+// Called on the connection's executor.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+void Subscriber<Stream>::_pump()
+{
+    auto self = this->shared_from_this();
+    for (;;)
+    {
+        SharedFrame frame;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            pump_pending_ = false;
+            if (closed() || queue_.empty() || in_flight_ >= opts_.max_in_flight) return;
+            frame = std::move(queue_.front().frame_);
+            queue_.pop_front();
+        }
+
+        ++in_flight_;
+        auto buf = frame.buffer();
+        conn_.async_send_message(buf, [self, frame](const bsys::error_code& ec, std::size_t)
+                                 {
+                                     self->_on_sent(ec);
+                                 });
+    }
+}
+
+template<typename Stream>
+void Subscriber<Stream>::_on_sent(const bsys::error_code& ec)
+{
+    --in_flight_;
+    if (ec) { close(); return; }
+    sent_.fetch_add(1, std::memory_order_relaxed);
+    _pump();
+}
+
+//------------------------------------------------------------------------------
+// The queue overflowed under the Disconnect policy. The frames still queued
+// are counted as dropped along with those that did not fit.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+void Subscriber<Stream>::_disconnect()
+{
+    std::size_t queued;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        queued = queue_.size();
+    }
+    dropped_.fetch_add(queued, std::memory_order_relaxed);
+    close();
+    if (opts_.on_disconnect) opts_.on_disconnect();
+}
+
+//-------------------------------------------------------------------------------
+// Broker member functions
+//-------------------------------------------------------------------------------
+
+inline Broker::subscription_t Broker::subscribe(const std::string& filter,
+                                                std::shared_ptr<SubscriberBase> sub)
+{
+    if (!sub || !valid_topic_filter(filter)) return 0;
+    auto id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    _Subscription s{id, filter, std::move(sub)};
+    bool exact = filter.find_first_of("+#") == std::string::npos;
+    table_.modify([&](_Table& t)
+    {
+        if (exact) t.exact_[filter].push_back(std::move(s));
+        else t.wildcard_.push_back(std::move(s));
+    });
+    return id;
+}
+
+inline bool Broker::unsubscribe(subscription_t id)
+{
+    bool found = false;
+    table_.modify([&](_Table& t)
+    {
+        auto remove = [&](std::vector<_Subscription>& v)
+        {
+            for (auto it = v.begin(); it != v.end(); ++it)
+            {
+                if (it->id_ != id) continue;
+                v.erase(it);
+                found = true;
+                return;
+            }
+        };
+        remove(t.wildcard_);
+        for (auto it = t.exact_.begin(); !found && it != t.exact_.end(); ++it)
+        {
+            remove(it->second);
+            if (!found) continue;
+            if (it->second.empty()) t.exact_.erase(it);
+            break;
+        }
+    });
+    return found;
+}
+
+inline std::size_t Broker::unsubscribe_all(const SubscriberBase* sub)
+{
+    std::size_t removed = 0;
+    table_.modify([&](_Table& t)
+    {
+        auto remove = [&](std::vector<_Subscription>& v)
+        {
+            auto size = v.size();
+            v.erase(std::remove_if(v.begin(), v.end(), [sub](const _Subscription& s)
+                                   { return s.sub_.get() == sub; }), v.end());
+            removed += size - v.size();
+        };
+        remove(t.wildcard_);
+        for (auto it = t.exact_.begin(); it != t.exact_.end(); )
+        {
+            remove(it->second);
+            it = it->second.empty() ? t.exact_.erase(it) : std::next(it);
+        }
+    });
+    return removed;
+}
+
+inline std::size_t Broker::publish(const std::string& topic, const SharedFrame& frame) const
+{
+    std::size_t delivered = 0;
+    std::size_t key = std::hash<std::string>{}(topic);
+    auto deliver = [&](const _Subscription& s)
+    {
+        if (s.sub_->closed()) return;
+        s.sub_->deliver(key, frame);
+        ++delivered;
+    };
+
+    auto guard = rcu_.read_lock();
+    const _Table* t = table_.load();
+    auto it = t->exact_.find(topic);
+    if (it != t->exact_.end())
+        for (const auto& s : it->second) deliver(s);
+    for (const auto& s : t->wildcard_)
+        if (topic_matches(s.filter_, topic)) deliver(s);
+    return delivered;
+}
+
+}
+
+#endif // CLSERVER_BROKER_HH
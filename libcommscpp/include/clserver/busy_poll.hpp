@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------------
+// Opt-in low latency run mode for connection I/O threads.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_BUSY_POLL_HH
+#define CLSERVER_BUSY_POLL_HH
+
+#include <chrono>
+#include <thread>
+#include <boost/asio.hpp>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#endif
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// Options for run_busy_poll(). After the last handler ran the thread keeps
+// polling for spin_time, then polls and yields for yield_time, and only then
+// blocks in the reactor for up to sleep_time at a time. Any handler that runs
+// resets the thread to spinning.
+//
+// cpu pins the running thread to a core; a negative value leaves it unpinned.
+// -------------------------------------------------------------------------------
+
+struct BusyPollOptions
+{
+    std::chrono::microseconds spin_time{200};
+    std::chrono::microseconds yield_time{2000};
+    std::chrono::microseconds sleep_time{10000};
+    int cpu = -1;
+};
+
+//-------------------------------------------------------------------------------
+// Run the io_context like io_context::run() but trade CPU for latency. A
+// handler that becomes ready while spinning runs without the thread having to
+// be woken by the scheduler. Returns the number of handlers run; returns when
+// the io_context is stopped or runs out of work.
+// -------------------------------------------------------------------------------
+
+std::size_t run_busy_poll(asio::io_context& ioc,
+                          const BusyPollOptions& opts = BusyPollOptions{});
+
+// Pin the calling thread to a cpu. Not supported on all platforms.
+bool pin_current_thread(int cpu);
+
+//-------------------------------------------------------------------------------
+// Set the socket options for a latency critical TCP link: disable Nagle and, on
+// Linux, ask the kernel to busy poll the device queue for up to busy_poll_us on
+// a blocking receive. Raising SO_BUSY_POLL above the system default needs
+// CAP_NET_ADMIN so failing to set it is reported but is not fatal.
+// -------------------------------------------------------------------------------
+
+template<typename Socket>
+void set_low_latency(Socket& socket, int busy_poll_us, bsys::error_code& ec);
+
+//-------------------------------------------------------------------------------
+// Implementation
+//-------------------------------------------------------------------------------
+
+inline std::size_t run_busy_poll(asio::io_context& ioc, const BusyPollOptions& opts)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (opts.cpu >= 0) pin_current_thread(opts.cpu);
+
+    std::size_t count = 0;
+    auto idle_since = clock::now();
+    while (!ioc.stopped())
+    {
+        std::size_t n = ioc.poll();
+        if (n)
+        {
+            count += n;
+            idle_since = clock::now();
+            continue;
+        }
+
+        auto idle = clock::now() - idle_since;
+        if (idle < opts.spin_time) continue;
+        if (idle < opts.spin_time + opts.yield_time)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Backed off; block until there is a handler to run or the timeout
+        n = ioc.run_one_for(opts.sleep_time);
+        if (n)
+        {
+            count += n;
+            idle_since = clock::now();
+        }
+    }
+    return count;
+}
+
+inline bool pin_current_thread(int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+template<typename Socket>
+void set_low_latency(Socket& socket, int busy_poll_us, bsys::error_code& ec)
+{
+    socket.set_option(asio::ip::tcp::no_delay(true), ec);
+    if (ec) return;
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    using busy_poll = asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>;
+    socket.set_option(busy_poll(busy_poll_us), ec);
+#else
+    (void)busy_poll_us;
+#endif
+}
+
+}
+
+#endif // CLSERVER_BUSY_POLL_HH
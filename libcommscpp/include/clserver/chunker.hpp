@@ -0,0 +1,141 @@
+//--------------------------------------------------------------------------------
+// Content-defined chunking of blobs for deduplicated upload.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_CHUNKER_HH
+#define CLSERVER_CHUNKER_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "clserver/sha256.hpp"
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// Chunk boundaries are chosen by a rolling gear hash over the content, so an
+// edit only changes the chunks around it: inserting a line into a fact file
+// leaves the chunks before and after it, and their hashes, as they were. The
+// average chunk size is a power of two; chunks are never smaller than
+// min_size, except the last, or larger than max_size.
+//
+// Client and server don't have to agree on the options, as the server checks
+// chunks only by their hashes, but changing them loses the deduplication
+// against blobs uploaded before.
+// -------------------------------------------------------------------------------
+
+struct ChunkerOptions
+{
+    std::size_t min_size = 16 * 1024;
+    std::size_t avg_size = 64 * 1024;
+    std::size_t max_size = 256 * 1024;
+};
+
+struct ChunkInfo
+{
+    std::string hash;              // Hex SHA-256 of the chunk
+    std::size_t size;
+};
+
+//-------------------------------------------------------------------------------
+// The client's description of a blob, as sent in a BlobManifest (blob.fbs)
+// -------------------------------------------------------------------------------
+
+struct Manifest
+{
+    std::string id;                // Hex SHA-256 of the whole blob
+    uint64_t size;
+    std::vector<ChunkInfo> chunks;
+};
+
+// The sizes of the chunks that data splits into
+std::vector<std::size_t> chunk_sizes(const void* data, std::size_t size,
+                                     const ChunkerOptions& opts = ChunkerOptions{});
+
+// Chunk and hash a blob
+Manifest make_manifest(const void* data, std::size_t size,
+                       const ChunkerOptions& opts = ChunkerOptions{});
+
+//-------------------------------------------------------------------------------
+// Implementation
+//-------------------------------------------------------------------------------
+
+namespace detail
+{
+
+// A fixed table of random values, one for each byte value. It is generated
+// with splitmix64 so that every build chunks the same way.
+inline const uint64_t* gear_table()
+{
+    static const struct Table
+    {
+        uint64_t values[256];
+        Table()
+        {
+            uint64_t x = 0x636c696e676f6364ull;
+            for (auto& v : values)
+            {
+                uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                v = z ^ (z >> 31);
+            }
+        }
+    } table;
+    return table.values;
+}
+
+}
+
+inline std::vector<std::size_t> chunk_sizes(const void* data, std::size_t size,
+                                            const ChunkerOptions& opts)
+{
+    auto gear = detail::gear_table();
+    auto p = static_cast<const uint8_t*>(data);
+
+    // The high bits of the hash depend on the most bytes, so test those
+    uint64_t mask = 0;
+    for (std::size_t avg = opts.avg_size; avg > 1; avg >>= 1) mask = (mask >> 1) | (1ull << 63);
+
+    std::vector<std::size_t> sizes;
+    std::size_t start = 0;
+    while (start < size)
+    {
+        std::size_t remaining = size - start;
+        std::size_t len = remaining <= opts.min_size ? remaining
+                        : std::min(remaining, opts.max_size);
+        uint64_t h = 0;
+        for (std::size_t i = opts.min_size; i < len; ++i)
+        {
+            h = (h << 1) + gear[p[start + i]];
+            if (!(h & mask))
+            {
+                len = i + 1;
+                break;
+            }
+        }
+        sizes.push_back(len);
+        start += len;
+    }
+    return sizes;
+}
+
+inline Manifest make_manifest(const void* data, std::size_t size, const ChunkerOptions& opts)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    Manifest m;
+    m.id = Sha256::hex_digest(data, size);
+    m.size = size;
+    for (auto len : chunk_sizes(data, size, opts))
+    {
+        m.chunks.push_back(ChunkInfo{Sha256::hex_digest(p, len), len});
+        p += len;
+    }
+    return m;
+}
+
+}
+
+#endif // CLSERVER_CHUNKER_HH
@@ -6,7 +6,12 @@
 #define CLSERVER_CONNECTION_HH
 
 #include <boost/asio.hpp>
-#include <deque>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "clserver/inplace_function.hpp"
+#include "clserver/ring_queue.hpp"
 
 namespace clserver
 {
@@ -22,6 +27,10 @@ namespace sp=std::placeholders;
 //
 // At the start of a connection both sides of the connection must both send and
 // receive a specific string to establishes a legitimate connection.
+//
+// Once validated, a send/receive loop does no heap allocation: the request
+// queues reuse their storage, queued handlers are stored inline and the
+// internal asio operations use asio's recycling handler allocator.
 // -------------------------------------------------------------------------------
 
 template<typename Stream>
@@ -46,14 +55,39 @@ public:
     template<typename Handler>
     void async_send_message(const asio::streambuf& sb, Handler h);
 
+    // Send a contiguous buffer, such as a finished flatbuffer, without first
+    // copying it into a streambuf. The buffer must remain valid until h is called.
+    template<typename Handler>
+    void async_send_message(asio::const_buffer buf, Handler h);
+
+    // Send a buffer that only matters in its latest form, such as progress or
+    // statistics. If a frame with the same (channel, key) is still queued it is
+    // replaced in place, keeping its position in the queue, and its handler is
+    // called with operation_aborted. So each key has at most one pending frame.
+    template<typename Handler>
+    void async_send_latest(uint32_t channel, uint32_t key, asio::const_buffer buf,
+                           Handler h);
+
+    // Send data that is already framed, one or more complete size-prefixed
+    // frames such as a range of a TopicLog segment, as is. The buffer must
+    // remain valid until h is called.
+    template<typename Handler>
+    void async_send_frames(asio::const_buffer frames, Handler h);
+
+    // Number of queued frames replaced by async_send_latest()
+    std::size_t conflated() const { return conflated_; }
+
+    // The executor that the handlers are called from
+    auto get_executor() { return sw_->stream_.get_executor(); }
+
 //    Stream &stream();
 private:
     //---------------------------------------------------------------------------
     // Definitions
     //---------------------------------------------------------------------------
 
-    using rw_handler_t = std::function<void(const bsys::error_code&, std::size_t)>;
-    using validate_handler_t = std::function<void(const bsys::error_code&)>;
+    using rw_handler_t = InplaceFunction<void(const bsys::error_code&, std::size_t)>;
+    using validate_handler_t = InplaceFunction<void(const bsys::error_code&)>;
 
     //---------------------------------------------------------------------------
     // Internal member functions
@@ -92,14 +126,28 @@ private:
             streambuf_{sb}, handler_{h} {}
     };
 
+    // A streambuf is only looked at when its write starts, as before
     struct _WriteReq
     {
-        const asio::streambuf& streambuf_;
+        const asio::streambuf* streambuf_;
+        asio::const_buffer buffer_;
         rw_handler_t handler_;
 
+        // Set for async_send_latest() frames
+        bool latest_;
+        uint64_t latest_key_;
+
+        // Set for async_send_frames() data which has no size block to write
+        bool framed_;
+
         template<typename Handler>
-        _WriteReq(const asio::streambuf& sb, Handler h) :
-            streambuf_{sb}, handler_{h} {}
+        _WriteReq(const asio::streambuf* sb, asio::const_buffer buf, Handler h,
+                  bool latest = false, uint64_t latest_key = 0, bool framed = false) :
+            streambuf_{sb}, buffer_{buf}, handler_{h},
+            latest_{latest}, latest_key_{latest_key}, framed_{framed} {}
+
+        asio::const_buffer data() const
+        { return streambuf_ ? asio::const_buffer{streambuf_->data()} : buffer_; }
     };
 
     //-------------------------------------------------------------------------------
@@ -134,8 +182,12 @@ private:
     bool wactive_;
 
     // Read and write queues - items pushed onto the back and popped from the front
-    std::deque<_ReadReq> rqueue_;
-    std::deque<_WriteReq> wqueue_;
+    RingQueue<_ReadReq> rqueue_;
+    RingQueue<_WriteReq> wqueue_;
+
+    // Number of async_send_latest() frames in wqueue_ and replaced so far
+    std::size_t latest_queued_;
+    std::size_t conflated_;
 };
 
 //-------------------------------------------------------------------------------
@@ -147,7 +199,8 @@ Connection<Stream>::Connection(Stream stream,
                                const std::string& validate_id) :
     sw_{std::make_unique<_StreamWrapper>(std::move(stream))},
     validate_id_{validate_id}, validated_{false},
-    rsize_{0}, wsize_{0}, ractive_{false}, wactive_{false}
+    rsize_{0}, wsize_{0}, ractive_{false}, wactive_{false},
+    latest_queued_{0}, conflated_{0}
 { }
 
 template<typename Stream>
@@ -194,7 +247,55 @@ template<typename Stream>
 template<typename Handler>
 void Connection<Stream>::async_send_message(const asio::streambuf& sb, Handler h)
 {
-    wqueue_.emplace_back(sb,h);
+    wqueue_.emplace_back(&sb, asio::const_buffer{}, h);
+    _check_wqueue();
+}
+
+template<typename Stream>
+template<typename Handler>
+void Connection<Stream>::async_send_message(asio::const_buffer buf, Handler h)
+{
+    wqueue_.emplace_back(nullptr, buf, h);
+    _check_wqueue();
+}
+
+template<typename Stream>
+template<typename Handler>
+void Connection<Stream>::async_send_frames(asio::const_buffer frames, Handler h)
+{
+    wqueue_.emplace_back(nullptr, frames, h, false, 0, true);
+    _check_wqueue();
+}
+
+//---------------------------------------------------------------------------
+// Replace a queued frame with the same key, skipping the front request if its
+// write has already started. Only the latest frames are searched for so bulk
+// traffic costs nothing unless such frames are queued.
+// ---------------------------------------------------------------------------
+
+template<typename Stream>
+template<typename Handler>
+void Connection<Stream>::async_send_latest(uint32_t channel, uint32_t key,
+                                           asio::const_buffer buf, Handler h)
+{
+    uint64_t latest_key = (static_cast<uint64_t>(channel) << 32) | key;
+    for (std::size_t i = wactive_ ? 1 : 0; latest_queued_ && i < wqueue_.size(); ++i)
+    {
+        auto& req = wqueue_[i];
+        if (!req.latest_ || req.latest_key_ != latest_key) continue;
+
+        asio::post(get_executor(), [old=std::move(req.handler_)]()
+                   {
+                       old(asio::error::operation_aborted, 0);
+                   });
+        req.buffer_ = buf;
+        req.handler_ = rw_handler_t{std::move(h)};
+        ++conflated_;
+        return;
+    }
+
+    wqueue_.emplace_back(nullptr, buf, h, true, latest_key);
+    ++latest_queued_;
     _check_wqueue();
 }
 
@@ -233,7 +334,14 @@ void Connection<Stream>::_check_wqueue()
     if (!validated_ || wactive_ || wqueue_.empty()) return;
 
     wactive_ = true;
-    wsize_ = htonl(wqueue_.front().streambuf_.size());
+    if (wqueue_.front().framed_)
+    {
+        asio::async_write(sw_->stream_, wqueue_.front().data(),
+                          std::bind(&Connection<Stream>::_on_send_message_body,
+                                    this, sp::_1, sp::_2));
+        return;
+    }
+    wsize_ = htonl(wqueue_.front().data().size());
 
     // Perform async write for a message size frame
     asio::async_write(sw_->stream_, asio::buffer(&wsize_, 4),
@@ -302,8 +410,9 @@ void Connection<Stream>::_receive_error(const bsys::error_code& ec, std::size_t
 //    std::cerr << "---- Stream read error: " << ec.value() << std::endl;
     while (!rqueue_.empty())
     {
-        rqueue_.front().handler_(ec,s);
+        auto handler = std::move(rqueue_.front().handler_);
         rqueue_.pop_front();
+        handler(ec,s);
     }
 }
 
@@ -317,8 +426,10 @@ void Connection<Stream>::_send_error(const bsys::error_code& ec, std::size_t s)
 //    std::cerr << "---- Stream write error: " << ec.value() << std::endl;
     while (!wqueue_.empty())
     {
-        wqueue_.front().handler_(ec,s);
+        auto handler = std::move(wqueue_.front().handler_);
+        if (wqueue_.front().latest_) --latest_queued_;
         wqueue_.pop_front();
+        handler(ec,s);
     }
 }
 
@@ -350,9 +461,11 @@ void Connection<Stream>::_on_receive_message_body(const bsys::error_code& ec,
     // On error clear the queue and call all the handler queued handlers.
     if (ec) { _receive_error(ec,s); return; }
 
-    // Clean up and start the next async read if necessary
-    rqueue_.front().handler_(ec,s);
+    // Clean up and start the next async read if necessary. The request is
+    // popped first as the handler may queue another one and grow the queue.
+    auto handler = std::move(rqueue_.front().handler_);
     rqueue_.pop_front();
+    handler(ec,s);
     ractive_ = false;
     _check_rqueue();            // check if we have more reads
 }
@@ -365,8 +478,7 @@ void Connection<Stream>::_on_send_message_size(const bsys::error_code& ec,
     if (ec) { _send_error(ec,s); return; }
 
     // Write the message body
-    auto& sb = wqueue_.front().streambuf_;
-    asio::async_write(sw_->stream_, sb.data(),
+    asio::async_write(sw_->stream_, wqueue_.front().data(),
                       std::bind(&Connection<Stream>::_on_send_message_body,
                                 this, sp::_1, sp::_2));
 }
@@ -378,10 +490,14 @@ void Connection<Stream>::_on_send_message_body(const bsys::error_code& ec,
     // On error clear the queue and call all the handler queued handlers.
     if (ec) { _send_error(ec,s); return; }
 
-    // Clean up and start the next async write if necessary
-    wqueue_.front().handler_(ec,s);
+    // Clean up and start the next async write if necessary. The write is
+    // over before the handler runs, so that a send it queues is not taken to
+    // be in flight by async_send_latest().
+    auto handler = std::move(wqueue_.front().handler_);
+    if (wqueue_.front().latest_) --latest_queued_;
     wqueue_.pop_front();
     wactive_ = false;
+    handler(ec,s);
     _check_wqueue();          // check if we have more writes
 }
 
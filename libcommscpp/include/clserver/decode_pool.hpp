@@ -0,0 +1,315 @@
+//--------------------------------------------------------------------------------
+// Verify and decode large received messages off the io thread.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_DECODE_POOL_HH
+#define CLSERVER_DECODE_POOL_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/connection.hpp"
+#include "clserver/inplace_function.hpp"
+#include "clserver/ring_queue.hpp"
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// DecodePool is a fixed set of threads with a bounded job queue. When the queue
+// is full try_post() fails instead of blocking so that the caller can fall back
+// to doing the work itself; an io thread is never made to wait on the pool.
+// -------------------------------------------------------------------------------
+
+class DecodePool
+{
+public:
+    using job_t = InplaceFunction<void()>;
+
+    DecodePool(std::size_t num_threads, std::size_t max_queued);
+
+    DecodePool(DecodePool&&) = delete;
+    DecodePool(const DecodePool&) = delete;
+    ~DecodePool();
+
+    DecodePool& operator=(const DecodePool&) = delete;
+
+    bool try_post(job_t job);
+
+private:
+    void _run();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    RingQueue<job_t> queue_;
+    std::size_t max_queued_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+};
+
+//-------------------------------------------------------------------------------
+// DecodingReceiver is a receive policy for a Connection. It keeps a receive
+// outstanding and passes every frame through a Decoder; frames of at least
+// threshold bytes are decoded on a DecodePool while smaller ones are decoded
+// inline. Either way the handler sees the frames in the order they arrived, on
+// the connection's executor, so a large frame holds up only the frames queued
+// behind it on the same connection and never the io thread.
+//
+// The Decoder is called as decoder(const uint8_t* data, std::size_t size) and
+// may be called concurrently from several pool threads. Its result type must
+// be default constructible. The handler is called as
+//
+//     handler(ec, const uint8_t* data, std::size_t size, const Result& result)
+//
+// and the data is only valid for the duration of the call. A receive error is
+// reported once, after all earlier frames have been delivered, and stops the
+// receiver. At most max_pending frames are buffered before receiving pauses.
+//
+// The receiver must outlive any decode still running on the pool; after an
+// error has been reported it is safe to destroy.
+// -------------------------------------------------------------------------------
+
+template<typename Stream, typename Decoder>
+class DecodingReceiver
+{
+public:
+    using result_type = typename std::decay<decltype(std::declval<const Decoder&>()(
+        std::declval<const uint8_t*>(), std::size_t{}))>::type;
+    using handler_t = std::function<void(const bsys::error_code&, const uint8_t*,
+                                         std::size_t, const result_type&)>;
+
+    DecodingReceiver(Connection<Stream>& conn, DecodePool& pool, Decoder decoder,
+                     std::size_t threshold, std::size_t max_pending = 64);
+
+    DecodingReceiver(DecodingReceiver&&) = delete;
+    DecodingReceiver(const DecodingReceiver&) = delete;
+
+    DecodingReceiver& operator=(const DecodingReceiver&) = delete;
+
+    void start(handler_t h);
+
+    // Number of frames offloaded to the pool and decoded inline so far
+    std::size_t offloaded() const { return offloaded_; }
+    std::size_t inlined() const { return inlined_; }
+
+private:
+    //---------------------------------------------------------------------------
+    // Inner classes
+    //---------------------------------------------------------------------------
+
+    // Heap allocated so a pool thread can hold on to it while the queue moves
+    struct _Frame
+    {
+        asio::streambuf streambuf_;
+        result_type result_;
+        bool ready_;
+
+        const uint8_t* data() const
+        { return static_cast<const uint8_t*>(streambuf_.data().data()); }
+        std::size_t size() const { return streambuf_.size(); }
+    };
+
+    //---------------------------------------------------------------------------
+    // Internal member functions
+    //---------------------------------------------------------------------------
+
+    void _receive();
+    void _on_received(const bsys::error_code& ec, std::size_t s);
+    void _on_decoded(_Frame* f);
+    void _deliver();
+
+    //---------------------------------------------------------------------------
+    // Internal member variables
+    //---------------------------------------------------------------------------
+    Connection<Stream>& conn_;
+    DecodePool& pool_;
+    Decoder decoder_;
+    std::size_t threshold_;
+    std::size_t max_pending_;
+    handler_t handler_;
+
+    // Frames in arrival order waiting to be decoded or delivered
+    RingQueue<std::unique_ptr<_Frame>> pending_;
+    std::vector<std::unique_ptr<_Frame>> free_;
+
+    bool receiving_;
+    bsys::error_code error_;
+    std::size_t offloaded_;
+    std::size_t inlined_;
+};
+
+//-------------------------------------------------------------------------------
+// DecodePool member functions
+//-------------------------------------------------------------------------------
+
+inline DecodePool::DecodePool(std::size_t num_threads, std::size_t max_queued) :
+    queue_{max_queued}, max_queued_{max_queued}, stopping_{false}
+{
+    for (std::size_t i = 0; i < num_threads; ++i)
+        threads_.emplace_back(&DecodePool::_run, this);
+}
+
+inline DecodePool::~DecodePool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+inline bool DecodePool::try_post(job_t job)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (stopping_ || queue_.size() >= max_queued_) return false;
+        queue_.emplace_back(std::move(job));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+inline void DecodePool::_run()
+{
+    for (;;)
+    {
+        job_t job;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            cv_.wait(lock, [this](){ return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        job();
+    }
+}
+
+//-------------------------------------------------------------------------------
+// DecodingReceiver member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream, typename Decoder>
+DecodingReceiver<Stream, Decoder>::DecodingReceiver(
+    Connection<Stream>& conn, DecodePool& pool, Decoder decoder,
+    std::size_t threshold, std::size_t max_pending) :
+    conn_{conn}, pool_{pool}, decoder_{std::move(decoder)},
+    threshold_{threshold}, max_pending_{max_pending}, pending_{max_pending},
+    receiving_{false}, offloaded_{0}, inlined_{0}
+{ }
+
+template<typename Stream, typename Decoder>
+void DecodingReceiver<Stream, Decoder>::start(handler_t h)
+{
+    handler_ = std::move(h);
+    _receive();
+}
+
+template<typename Stream, typename Decoder>
+void DecodingReceiver<Stream, Decoder>::_receive()
+{
+    if (receiving_ || error_ || pending_.size() >= max_pending_) return;
+
+    if (free_.empty()) free_.emplace_back(new _Frame);
+    pending_.emplace_back(std::move(free_.back()));
+    free_.pop_back();
+    pending_.back()->ready_ = false;
+
+    receiving_ = true;
+    conn_.async_receive_message(pending_.back()->streambuf_,
+                                std::bind(&DecodingReceiver::_on_received,
+                                          this, sp::_1, sp::_2));
+}
+
+//------------------------------------------------------------------------------
+// A frame has arrived at the back of the pending queue. Decode it here or on
+// the pool and try to receive the next one straight away.
+// -----------------------------------------------------------------------------
+
+template<typename Stream, typename Decoder>
+void DecodingReceiver<Stream, Decoder>::_on_received(const bsys::error_code& ec,
+                                                     std::size_t s)
+{
+    receiving_ = false;
+    _Frame* f = pending_.back().get();
+    if (ec)
+    {
+        error_ = ec;
+        f->streambuf_.consume(f->streambuf_.size());
+        free_.emplace_back(std::move(pending_.back()));
+        pending_.pop_back();
+        _deliver();
+        return;
+    }
+
+    f->streambuf_.commit(s);
+
+    auto ex = conn_.get_executor();
+    if (s >= threshold_ &&
+        pool_.try_post([this, f, ex]()
+                       {
+                           f->result_ = decoder_(f->data(), f->size());
+                           asio::post(ex, std::bind(&DecodingReceiver::_on_decoded,
+                                                    this, f));
+                       }))
+    {
+        ++offloaded_;
+    }
+    else
+    {
+        ++inlined_;
+        f->result_ = decoder_(f->data(), f->size());
+        f->ready_ = true;
+    }
+
+    _receive();
+    _deliver();
+}
+
+template<typename Stream, typename Decoder>
+void DecodingReceiver<Stream, Decoder>::_on_decoded(_Frame* f)
+{
+    f->ready_ = true;
+    _deliver();
+}
+
+//------------------------------------------------------------------------------
+// Hand decoded frames at the front of the queue to the handler. The frame being
+// received into, if any, is always at the back and is never ready. An error is
+// reported once everything before it has been delivered.
+// -----------------------------------------------------------------------------
+
+template<typename Stream, typename Decoder>
+void DecodingReceiver<Stream, Decoder>::_deliver()
+{
+    while (!pending_.empty() && pending_.front()->ready_)
+    {
+        auto f = std::move(pending_.front());
+        pending_.pop_front();
+        handler_(bsys::error_code{}, f->data(), f->size(), f->result_);
+        f->streambuf_.consume(f->streambuf_.size());
+        f->result_ = result_type{};
+        free_.emplace_back(std::move(f));
+    }
+
+    if (!error_)
+    {
+        _receive();
+    }
+    else if (pending_.empty() && handler_)
+    {
+        auto h = std::move(handler_);
+        handler_ = nullptr;
+        h(error_, nullptr, 0, result_type{});
+    }
+}
+
+}
+
+#endif // CLSERVER_DECODE_POOL_HH
@@ -0,0 +1,340 @@
+//--------------------------------------------------------------------------------
+// Building and reading FactSets: facts in binary form (facts.fbs).
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_FACT_SET_HH
+#define CLSERVER_FACT_SET_HH
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "facts_generated.h"
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// An argument of a fact: a number, or an index into the dictionary or the
+// function terms of the FactSetBuilder that made it.
+// -------------------------------------------------------------------------------
+
+struct FactArg
+{
+    ClingoServer::ArgType type;
+    int32_t value;
+};
+
+//-------------------------------------------------------------------------------
+// FactSetBuilder collects facts built in a program and encodes them as a
+// FactSet. Every name and string is stored once, in the dictionary, and facts
+// of the same predicate and argument types are stored as one block of
+// integers, so a large fact base is a few flat arrays that the worker can
+// walk without parsing.
+//
+// add(predicate, args) looks up the block for each fact. When adding many
+// facts of one shape, get the block once and add rows of values to it:
+//
+//     auto edge = b.block("edge", {ArgType_Number, ArgType_Number});
+//     for (auto& e : edges) b.add(edge, {e.from, e.to});
+//
+// Identical function terms are stored once.
+// -------------------------------------------------------------------------------
+
+class FactSetBuilder
+{
+public:
+    using block_t = uint32_t;
+
+    FactSetBuilder() : facts_{0} { }
+
+    FactSetBuilder(FactSetBuilder&&) = delete;
+    FactSetBuilder(const FactSetBuilder&) = delete;
+
+    FactSetBuilder& operator=(const FactSetBuilder&) = delete;
+
+    // Arguments
+    static FactArg number(int32_t n) { return FactArg{ClingoServer::ArgType_Number, n}; }
+    FactArg string(const std::string& s)
+    { return FactArg{ClingoServer::ArgType_String, static_cast<int32_t>(intern(s))}; }
+    FactArg constant(const std::string& name)
+    { return FactArg{ClingoServer::ArgType_Constant, static_cast<int32_t>(intern(name))}; }
+    FactArg function(const std::string& name, const std::vector<FactArg>& args);
+    FactArg tuple(const std::vector<FactArg>& args) { return function(std::string{}, args); }
+
+    // Add one fact
+    void add(const std::string& predicate, const std::vector<FactArg>& args,
+             bool negative = false);
+
+    // The block of facts of a predicate with these argument types
+    block_t block(const std::string& predicate, const std::vector<ClingoServer::ArgType>& types,
+                  bool negative = false);
+
+    // Add a fact to a block. There must be one value for each argument type.
+    void add(block_t block, const int32_t* values);
+    void add(block_t block, std::initializer_list<int32_t> values) { add(block, values.begin()); }
+
+    // The dictionary index of a string, adding it if needed
+    uint32_t intern(const std::string& s);
+
+    // Encode the facts as the finished root of fbb
+    void finish(fbs::FlatBufferBuilder& fbb) const;
+
+    void clear();
+
+    std::size_t facts() const { return facts_; }
+
+private:
+    struct _Function
+    {
+        uint32_t name_;
+        std::vector<uint8_t> types_;
+        std::vector<int32_t> values_;
+    };
+
+    struct _Block
+    {
+        uint32_t name_;
+        bool negative_;
+        std::vector<uint8_t> types_;
+        std::vector<int32_t> values_;
+        uint32_t count_;
+    };
+
+    std::vector<std::string> dictionary_;
+    std::unordered_map<std::string, uint32_t> strings_;
+    std::vector<_Function> functions_;
+    std::unordered_map<std::string, int32_t> function_index_;
+    std::vector<_Block> blocks_;
+    std::unordered_map<std::string, block_t> block_index_;
+    std::size_t facts_;
+};
+
+//-------------------------------------------------------------------------------
+// Write the facts of a FactSet as clingo program text, one per line. This is
+// the text that a worker without binary fact support would be sent. Returns
+// false if the FactSet refers to a dictionary entry or function that it does
+// not have.
+// -------------------------------------------------------------------------------
+
+bool facts_to_text(const ClingoServer::FactSet& set, std::string& out);
+
+//-------------------------------------------------------------------------------
+// FactSetBuilder member functions
+//-------------------------------------------------------------------------------
+
+inline uint32_t FactSetBuilder::intern(const std::string& s)
+{
+    auto it = strings_.find(s);
+    if (it != strings_.end()) return it->second;
+    auto index = static_cast<uint32_t>(dictionary_.size());
+    dictionary_.push_back(s);
+    strings_.emplace(s, index);
+    return index;
+}
+
+inline FactArg FactSetBuilder::function(const std::string& name, const std::vector<FactArg>& args)
+{
+    _Function f{intern(name), {}, {}};
+    for (const auto& a : args)
+    {
+        f.types_.push_back(static_cast<uint8_t>(a.type));
+        f.values_.push_back(a.value);
+    }
+
+    std::string key(reinterpret_cast<const char*>(&f.name_), sizeof(f.name_));
+    key.append(reinterpret_cast<const char*>(f.types_.data()), f.types_.size());
+    key.append(reinterpret_cast<const char*>(f.values_.data()), f.values_.size() * sizeof(int32_t));
+
+    auto it = function_index_.find(key);
+    if (it != function_index_.end()) return FactArg{ClingoServer::ArgType_Function, it->second};
+    auto index = static_cast<int32_t>(functions_.size());
+    functions_.push_back(std::move(f));
+    function_index_.emplace(std::move(key), index);
+    return FactArg{ClingoServer::ArgType_Function, index};
+}
+
+inline void FactSetBuilder::add(const std::string& predicate, const std::vector<FactArg>& args,
+                                bool negative)
+{
+    std::vector<ClingoServer::ArgType> types;
+    std::vector<int32_t> values;
+    for (const auto& a : args)
+    {
+        types.push_back(a.type);
+        values.push_back(a.value);
+    }
+    add(block(predicate, types, negative), values.data());
+}
+
+inline FactSetBuilder::block_t FactSetBuilder::block(
+    const std::string& predicate, const std::vector<ClingoServer::ArgType>& types, bool negative)
+{
+    std::string key = predicate;
+    key += '\0';
+    key += negative ? '-' : '+';
+    for (auto t : types) key += static_cast<char>(t);
+
+    auto it = block_index_.find(key);
+    if (it != block_index_.end()) return it->second;
+    auto index = static_cast<block_t>(blocks_.size());
+    blocks_.push_back(_Block{intern(predicate), negative, {}, {}, 0});
+    for (auto t : types) blocks_.back().types_.push_back(static_cast<uint8_t>(t));
+    block_index_.emplace(std::move(key), index);
+    return index;
+}
+
+inline void FactSetBuilder::add(block_t block, const int32_t* values)
+{
+    auto& b = blocks_[block];
+    b.values_.insert(b.values_.end(), values, values + b.types_.size());
+    ++b.count_;
+    ++facts_;
+}
+
+inline void FactSetBuilder::finish(fbs::FlatBufferBuilder& fbb) const
+{
+    auto dictionary = fbb.CreateVectorOfStrings(dictionary_);
+
+    std::vector<fbs::Offset<ClingoServer::FunctionTerm>> functions;
+    functions.reserve(functions_.size());
+    for (const auto& f : functions_)
+        functions.push_back(ClingoServer::CreateFunctionTerm(
+            fbb, f.name_, fbb.CreateVector(f.types_), fbb.CreateVector(f.values_)));
+
+    std::vector<fbs::Offset<ClingoServer::FactBlock>> blocks;
+    blocks.reserve(blocks_.size());
+    for (const auto& b : blocks_)
+        blocks.push_back(ClingoServer::CreateFactBlock(
+            fbb, b.name_, b.negative_, fbb.CreateVector(b.types_),
+            fbb.CreateVector(b.values_), b.count_));
+
+    auto set = ClingoServer::CreateFactSet(fbb, dictionary, fbb.CreateVector(functions),
+                                           fbb.CreateVector(blocks));
+    ClingoServer::FinishFactSetBuffer(fbb, set);
+}
+
+inline void FactSetBuilder::clear()
+{
+    dictionary_.clear();
+    strings_.clear();
+    functions_.clear();
+    function_index_.clear();
+    blocks_.clear();
+    block_index_.clear();
+    facts_ = 0;
+}
+
+//-------------------------------------------------------------------------------
+// Text output
+//-------------------------------------------------------------------------------
+
+namespace detail
+{
+
+struct FactTextWriter
+{
+    const ClingoServer::FactSet& set_;
+    std::string& out_;
+
+    bool name(uint32_t index)
+    {
+        auto dict = set_.dictionary();
+        if (!dict || index >= dict->size()) return false;
+        out_ += dict->Get(index)->str();
+        return true;
+    }
+
+    bool quoted(uint32_t index)
+    {
+        auto dict = set_.dictionary();
+        if (!dict || index >= dict->size()) return false;
+        out_ += '"';
+        for (char c : dict->Get(index)->str())
+        {
+            if (c == '"' || c == '\\') out_ += '\\';
+            if (c == '\n') { out_ += "\\n"; continue; }
+            out_ += c;
+        }
+        out_ += '"';
+        return true;
+    }
+
+    // limit is the number of function terms that an argument may refer to
+    bool arg(uint8_t type, int32_t value, uint32_t limit)
+    {
+        switch (type)
+        {
+        case ClingoServer::ArgType_Number:
+            out_ += std::to_string(value);
+            return true;
+        case ClingoServer::ArgType_String:
+            return value >= 0 && quoted(static_cast<uint32_t>(value));
+        case ClingoServer::ArgType_Constant:
+            return value >= 0 && name(static_cast<uint32_t>(value));
+        case ClingoServer::ArgType_Function:
+        {
+            if (value < 0 || static_cast<uint32_t>(value) >= limit) return false;
+            auto f = set_.functions()->Get(static_cast<uint32_t>(value));
+            auto n = f->types() ? f->types()->size() : 0;
+            if (n != (f->values() ? f->values()->size() : 0)) return false;
+            return term(f->name(), f->types(), f->values(), 0, n,
+                        static_cast<uint32_t>(value));
+        }
+        default:
+            return false;
+        }
+    }
+
+    // A name applied to n arguments starting at offset. A tuple has the empty
+    // name and a one element tuple needs a trailing comma.
+    bool term(uint32_t fname, const fbs::Vector<uint8_t>* types,
+              const fbs::Vector<int32_t>* values, uint32_t offset, uint32_t n, uint32_t limit)
+    {
+        if (!name(fname)) return false;
+        bool is_tuple = set_.dictionary()->Get(fname)->size() == 0;
+        if (n == 0 && !is_tuple) return true;
+        out_ += '(';
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (i) out_ += ',';
+            if (!arg(types->Get(i), values->Get(offset + i), limit)) return false;
+        }
+        if (is_tuple && n == 1) out_ += ',';
+        out_ += ')';
+        return true;
+    }
+};
+
+}
+
+inline bool facts_to_text(const ClingoServer::FactSet& set, std::string& out)
+{
+    detail::FactTextWriter w{set, out};
+    uint32_t functions = set.functions() ? set.functions()->size() : 0;
+    if (!set.blocks()) return true;
+
+    for (auto b : *set.blocks())
+    {
+        uint32_t arity = b->types() ? b->types()->size() : 0;
+        uint32_t values = b->values() ? b->values()->size() : 0;
+        if (static_cast<uint64_t>(arity) * b->count() != values) return false;
+        for (uint32_t row = 0; row < b->count(); ++row)
+        {
+            if (b->negative()) out += '-';
+            if (!w.term(b->name(), b->types(), b->values(), row * arity, arity, functions))
+                return false;
+            out += ".\n";
+        }
+    }
+    return true;
+}
+
+}
+
+#endif // CLSERVER_FACT_SET_HH
@@ -0,0 +1,270 @@
+//--------------------------------------------------------------------------------
+// Spawn worker processes from a small helper process.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_FORK_SERVER_HH
+#define CLSERVER_FORK_SERVER_HH
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/system/error_code.hpp>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace clserver
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// ForkServer starts worker processes on behalf of the server. start() forks a
+// helper process while the server is still small and single threaded; from
+// then on spawn() asks the helper, over a socket pair, to fork and exec the
+// worker executable. This keeps the server from forking itself once it has
+// many threads and a large address space.
+//
+// Each worker is told its instance name through the CLINGOSERVER_WORKER_INSTANCE
+// environment variable and sends it back to the server in its Init message.
+// spawn() returns the worker's pid once exec has succeeded, or an error if the
+// fork or the exec failed. The helper reaps the workers; their exit is seen by
+// the server through the worker's connection.
+//
+// spawn() blocks for the length of a fork and exec in the helper, which is
+// small, so it can be called from an executor.
+// -------------------------------------------------------------------------------
+
+class ForkServer
+{
+public:
+    static constexpr const char* instance_env = "CLINGOSERVER_WORKER_INSTANCE";
+
+    ForkServer() : fd_{-1}, pid_{-1} { }
+
+    ForkServer(ForkServer&&) = delete;
+    ForkServer(const ForkServer&) = delete;
+    ~ForkServer() { stop(); }
+
+    ForkServer& operator=(const ForkServer&) = delete;
+
+    // Start the helper process that runs path with the given arguments. Should
+    // be called before the server starts any threads.
+    void start(const std::string& path, const std::vector<std::string>& args,
+               bsys::error_code& ec);
+
+    // Start a worker with the given instance name and return its pid
+    pid_t spawn(const std::string& instance, bsys::error_code& ec);
+
+    // Stop the helper. Running workers are not affected.
+    void stop();
+
+    bool running() const { return fd_ >= 0; }
+    pid_t pid() const { return pid_; }
+
+private:
+    static constexpr std::size_t max_instance = 255;
+
+    [[noreturn]] static void _serve(int fd, const char* path, char* const* argv);
+    static pid_t _spawn_worker(const char* instance, const char* path, char* const* argv);
+
+    static bool _read_all(int fd, void* buf, std::size_t size);
+    static bool _write_all(int fd, const void* buf, std::size_t size);
+
+    int fd_;
+    pid_t pid_;
+};
+
+//-------------------------------------------------------------------------------
+// ForkServer member functions
+//-------------------------------------------------------------------------------
+
+inline void ForkServer::start(const std::string& path, const std::vector<std::string>& args,
+                              bsys::error_code& ec)
+{
+    if (running())
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::already_connected);
+        return;
+    }
+
+    // Build argv before forking so the helper does not need to allocate
+    std::vector<std::string> strings{path};
+    strings.insert(strings.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (auto& s : strings) argv.push_back(&s[0]);
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        ec = bsys::error_code{errno, bsys::system_category()};
+        return;
+    }
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        ec = bsys::error_code{errno, bsys::system_category()};
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return;
+    }
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        _serve(fds[1], argv[0], argv.data());
+    }
+
+    ::close(fds[1]);
+    fd_ = fds[0];
+    pid_ = pid;
+}
+
+//------------------------------------------------------------------------------
+// A request is the instance name prefixed by its length; the reply is the pid
+// or a negated errno.
+// -----------------------------------------------------------------------------
+
+inline pid_t ForkServer::spawn(const std::string& instance, bsys::error_code& ec)
+{
+    if (!running())
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::not_connected);
+        return -1;
+    }
+    if (instance.empty() || instance.size() > max_instance)
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::invalid_argument);
+        return -1;
+    }
+
+    char request[max_instance + 1];
+    request[0] = static_cast<char>(instance.size());
+    std::memcpy(request + 1, instance.data(), instance.size());
+    int32_t reply;
+    if (!_write_all(fd_, request, instance.size() + 1) ||
+        !_read_all(fd_, &reply, sizeof(reply)))
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::broken_pipe);
+        stop();
+        return -1;
+    }
+    if (reply < 0)
+    {
+        ec = bsys::error_code{-reply, bsys::system_category()};
+        return -1;
+    }
+    return static_cast<pid_t>(reply);
+}
+
+inline void ForkServer::stop()
+{
+    if (fd_ < 0) return;
+    ::close(fd_);
+    fd_ = -1;
+    while (::waitpid(pid_, nullptr, 0) < 0 && errno == EINTR) { }
+    pid_ = -1;
+}
+
+//------------------------------------------------------------------------------
+// The helper's loop. It exits when the server closes its end of the socket.
+// -----------------------------------------------------------------------------
+
+inline void ForkServer::_serve(int fd, const char* path, char* const* argv)
+{
+    // Drop the descriptors inherited from the server, so that workers don't
+    // hold its sockets open. Workers are reaped automatically.
+    for (long i = 3, n = ::sysconf(_SC_OPEN_MAX); i < n; ++i)
+        if (i != fd) ::close(static_cast<int>(i));
+    ::signal(SIGCHLD, SIG_IGN);
+
+    char instance[max_instance + 1];
+    for (;;)
+    {
+        uint8_t len;
+        if (!_read_all(fd, &len, 1) || !_read_all(fd, instance, len)) ::_exit(0);
+        instance[len] = '\0';
+
+        int32_t reply = static_cast<int32_t>(_spawn_worker(instance, path, argv));
+        if (!_write_all(fd, &reply, sizeof(reply))) ::_exit(0);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Fork and exec a worker. A close-on-exec pipe reports whether exec worked: it
+// reads as closed on success and holds the errno on failure.
+// -----------------------------------------------------------------------------
+
+inline pid_t ForkServer::_spawn_worker(const char* instance, const char* path,
+                                       char* const* argv)
+{
+    int status[2];
+    if (::pipe2(status, O_CLOEXEC) != 0) return -errno;
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        int err = errno;
+        ::close(status[0]);
+        ::close(status[1]);
+        return -err;
+    }
+    if (pid == 0)
+    {
+        ::close(status[0]);
+        ::signal(SIGCHLD, SIG_DFL);
+        ::setenv(instance_env, instance, 1);
+        ::execv(path, argv);
+        int err = errno;
+        _write_all(status[1], &err, sizeof(err));
+        ::_exit(127);
+    }
+
+    ::close(status[1]);
+    int err = 0;
+    bool failed = _read_all(status[0], &err, sizeof(err));
+    ::close(status[0]);
+    return failed ? -err : pid;
+}
+
+inline bool ForkServer::_read_all(int fd, void* buf, std::size_t size)
+{
+    auto p = static_cast<char*>(buf);
+    while (size)
+    {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+inline bool ForkServer::_write_all(int fd, const void* buf, std::size_t size)
+{
+    auto p = static_cast<const char*>(buf);
+    while (size)
+    {
+        // A broken socket must not raise SIGPIPE in the server
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+}
+
+#endif // CLSERVER_FORK_SERVER_HH
@@ -0,0 +1,199 @@
+//--------------------------------------------------------------------------------
+// Hand frames built on one thread to the I/O thread through pooled builders.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_FRAME_CHANNEL_HH
+#define CLSERVER_FRAME_CHANNEL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/spsc_queue.hpp"
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+struct FrameChannelStats
+{
+    std::size_t published = 0;
+    std::size_t waits = 0;         // Times the producer waited for a free builder
+};
+
+//-------------------------------------------------------------------------------
+// FrameChannel carries finished flatbuffers from a producer thread, such as a
+// worker's solver, to the I/O thread that sends them. It owns a fixed pool of
+// FlatBufferBuilders that circulate between two SPSC queues: the producer
+// acquires a free builder, builds a frame directly in it and publishes it; the
+// consumer sends the frame and releases the builder once the send completes.
+//
+//     producer                             consumer (I/O thread)
+//     b = acquire()                        drain([](b) { send b, then release(b) })
+//     ...build and Finish in b...
+//     if (publish(b)) wake the consumer
+//
+// publish() returns true when the consumer has to be told to drain, which only
+// happens once per run of frames, so a busy producer costs the I/O thread one
+// wakeup, not one per frame. Neither side takes a lock in steady state.
+//
+// The pool is the back-pressure: when every builder is queued or being sent,
+// acquire() waits until one is released. A producer that has to pause rather
+// than block can call try_acquire() instead. close() wakes a waiting acquire()
+// for good, eg when the connection has gone.
+// -------------------------------------------------------------------------------
+
+class FrameChannel
+{
+public:
+    struct Options
+    {
+        std::size_t builders = 16;
+        std::size_t initial_size = 16 * 1024;
+    };
+
+    FrameChannel() : FrameChannel{Options{}} { }
+    explicit FrameChannel(Options opts);
+
+    FrameChannel(FrameChannel&&) = delete;
+    FrameChannel(const FrameChannel&) = delete;
+    ~FrameChannel() = default;
+
+    FrameChannel& operator=(const FrameChannel&) = delete;
+
+    // Producer side. acquire() returns nullptr once closed.
+    fbs::FlatBufferBuilder* try_acquire();
+    fbs::FlatBufferBuilder* acquire();
+    bool publish(fbs::FlatBufferBuilder* b);
+
+    // Consumer side. drain() calls f(builder) for each published frame, in order.
+    template<typename F> void drain(F&& f);
+    void release(fbs::FlatBufferBuilder* b);
+
+    // Any thread
+    void close();
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+    // Only to be read by the producer
+    const FrameChannelStats& stats() const { return stats_; }
+
+private:
+    std::vector<std::unique_ptr<fbs::FlatBufferBuilder>> builders_;
+    SpscQueue<fbs::FlatBufferBuilder*> free_;
+    SpscQueue<fbs::FlatBufferBuilder*> frames_;
+
+    // Set while a drain is due, so that the producer only wakes the consumer
+    // once per run of frames
+    std::atomic<bool> scheduled_;
+
+    // The producer waits for a free builder under the mutex
+    std::atomic<bool> waiting_;
+    std::atomic<bool> closed_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    FrameChannelStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// FrameChannel member functions
+//-------------------------------------------------------------------------------
+
+inline FrameChannel::FrameChannel(Options opts) :
+    free_{opts.builders}, frames_{opts.builders},
+    scheduled_{false}, waiting_{false}, closed_{false}
+{
+    for (std::size_t i = 0; i < opts.builders; ++i)
+    {
+        builders_.emplace_back(new fbs::FlatBufferBuilder{opts.initial_size});
+        auto b = builders_.back().get();
+        free_.try_push(std::move(b));
+    }
+}
+
+inline fbs::FlatBufferBuilder* FrameChannel::try_acquire()
+{
+    fbs::FlatBufferBuilder* b = nullptr;
+    if (closed() || !free_.try_pop(b)) return nullptr;
+    return b;
+}
+
+//------------------------------------------------------------------------------
+// The waiting flag is set before the queue is looked at again, and release()
+// pushes before it looks at the flag, so one of them sees the other.
+// -----------------------------------------------------------------------------
+
+inline fbs::FlatBufferBuilder* FrameChannel::acquire()
+{
+    if (auto b = try_acquire()) return b;
+
+    ++stats_.waits;
+    std::unique_lock<std::mutex> lock{mutex_};
+    fbs::FlatBufferBuilder* b = nullptr;
+    cv_.wait(lock, [this, &b]()
+    {
+        waiting_.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return closed() || free_.try_pop(b);
+    });
+    waiting_.store(false, std::memory_order_relaxed);
+
+    // Closing is for good, so a builder taken after it is simply dropped
+    return closed() ? nullptr : b;
+}
+
+inline bool FrameChannel::publish(fbs::FlatBufferBuilder* b)
+{
+    // Never fails: there are only as many builders as slots
+    frames_.try_push(std::move(b));
+    ++stats_.published;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !scheduled_.exchange(true, std::memory_order_seq_cst);
+}
+
+//------------------------------------------------------------------------------
+// Clear the scheduled flag and look once more, so a frame published while the
+// flag was still set is not left behind.
+// -----------------------------------------------------------------------------
+
+template<typename F>
+void FrameChannel::drain(F&& f)
+{
+    fbs::FlatBufferBuilder* b = nullptr;
+    while (true)
+    {
+        while (frames_.try_pop(b)) f(b);
+        scheduled_.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (frames_.empty() || scheduled_.exchange(true, std::memory_order_seq_cst)) return;
+    }
+}
+
+inline void FrameChannel::release(fbs::FlatBufferBuilder* b)
+{
+    b->Clear();
+    free_.try_push(std::move(b));
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiting_.load(std::memory_order_seq_cst)) return;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+    }
+    cv_.notify_one();
+}
+
+inline void FrameChannel::close()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        closed_.store(true, std::memory_order_release);
+    }
+    cv_.notify_all();
+}
+
+}
+
+#endif // CLSERVER_FRAME_CHANNEL_HH
@@ -0,0 +1,254 @@
+//--------------------------------------------------------------------------------
+// Single-flight table of running jobs, so that identical jobs run only once.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_INFLIGHT_JOBS_HH
+#define CLSERVER_INFLIGHT_JOBS_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "clserver/broker.hpp"
+#include "clserver/shared_frame.hpp"
+
+namespace clserver
+{
+
+struct InflightStats
+{
+    std::size_t started = 0;       // Submissions that started a job
+    std::size_t joined = 0;        // Submissions attached to a running job
+    std::size_t caught_up = 0;     // Recorded frames replayed to joiners
+    std::size_t completed = 0;
+    std::size_t aborted = 0;
+    std::size_t unshared = 0;      // Jobs whose output outgrew the record
+};
+
+//-------------------------------------------------------------------------------
+// The outcome of submit(). If started is true the caller must run the job;
+// otherwise the subscriber has been attached to the job that is already
+// running for the key.
+// -------------------------------------------------------------------------------
+
+struct InflightSubmission
+{
+    uint64_t job_id;
+    bool started;
+};
+
+//-------------------------------------------------------------------------------
+// A job that has finished. frames is the whole output, in order, unless the
+// job outgrew the record, in which case complete is false and it must not be
+// cached.
+// -------------------------------------------------------------------------------
+
+struct InflightResult
+{
+    std::string key;
+    std::vector<SharedFrame> frames;
+    bool complete;
+};
+
+//-------------------------------------------------------------------------------
+// InflightJobs lets identical jobs that are submitted while one of them is
+// running share that one run. Jobs are keyed by JobSpec::key(). The first
+// submission of a key starts a job; later ones attach their subscriber to it
+// and are first given every frame the job has produced so far, then the rest
+// as they are published, so each subscriber sees the whole result stream.
+//
+// The frames of a running job are kept, sharing their buffers with the
+// subscribers, up to max_record_bytes. A job that produces more than that can
+// no longer be joined: a later submission of its key starts a new job.
+//
+// Submissions with CachePolicy::Bypass should not be deduplicated. The table
+// is used from a single executor, the one that handles the workers' results.
+// -------------------------------------------------------------------------------
+
+class InflightJobs
+{
+public:
+    using job_id_t = uint64_t;
+
+    struct Options
+    {
+        std::size_t max_record_bytes = 64 * 1024 * 1024;
+    };
+
+    InflightJobs() : InflightJobs{Options{}} { }
+    explicit InflightJobs(Options opts) : opts_{opts}, next_id_{1} { }
+
+    InflightJobs(InflightJobs&&) = delete;
+    InflightJobs(const InflightJobs&) = delete;
+
+    InflightJobs& operator=(const InflightJobs&) = delete;
+
+    // Start a job for key or attach sub to the running one
+    InflightSubmission submit(const std::string& key, std::shared_ptr<SubscriberBase> sub);
+
+    // Record a frame of a job's output and deliver it to the job's open
+    // subscribers. Returns the number delivered to.
+    std::size_t publish(job_id_t job, const SharedFrame& frame);
+
+    // Remove a subscriber, for example when its client goes away. Returns the
+    // number of subscribers the job has left, so the caller can cancel a job
+    // nobody is waiting for.
+    std::size_t detach(job_id_t job, const SubscriberBase* sub);
+
+    // Remove a finished job and return its output, for the result cache
+    InflightResult complete(job_id_t job);
+
+    // Remove a job that failed or was cancelled. Returns false if there was none.
+    bool abort(job_id_t job);
+
+    // The running job for key, or 0
+    job_id_t find(const std::string& key) const;
+
+    std::size_t size() const { return jobs_.size(); }
+    std::size_t subscribers(job_id_t job) const;
+    const InflightStats& stats() const { return stats_; }
+
+private:
+    struct _Job
+    {
+        std::string key_;
+        std::size_t topic_key_;
+        std::vector<std::shared_ptr<SubscriberBase>> subs_;
+        std::vector<SharedFrame> frames_;
+        std::size_t bytes_;
+        bool shared_;
+    };
+
+    void _unshare(_Job& job);
+
+    Options opts_;
+    job_id_t next_id_;
+    std::unordered_map<job_id_t, _Job> jobs_;
+    std::unordered_map<std::string, job_id_t> by_key_;
+    InflightStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// InflightJobs member functions
+//-------------------------------------------------------------------------------
+
+inline InflightSubmission InflightJobs::submit(const std::string& key,
+                                               std::shared_ptr<SubscriberBase> sub)
+{
+    auto it = by_key_.find(key);
+    if (it != by_key_.end())
+    {
+        auto& job = jobs_.at(it->second);
+        for (const auto& f : job.frames_) sub->deliver(job.topic_key_, f);
+        stats_.caught_up += job.frames_.size();
+        job.subs_.push_back(std::move(sub));
+        ++stats_.joined;
+        return InflightSubmission{it->second, false};
+    }
+
+    auto id = next_id_++;
+    auto& job = jobs_[id];
+    job.key_ = key;
+    job.topic_key_ = std::hash<std::string>{}(key);
+    job.subs_.push_back(std::move(sub));
+    job.bytes_ = 0;
+    job.shared_ = true;
+    by_key_.emplace(key, id);
+    ++stats_.started;
+    return InflightSubmission{id, true};
+}
+
+inline std::size_t InflightJobs::publish(job_id_t id, const SharedFrame& frame)
+{
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return 0;
+    auto& job = it->second;
+
+    if (job.shared_)
+    {
+        job.bytes_ += frame.size();
+        if (job.bytes_ > opts_.max_record_bytes) _unshare(job);
+        else job.frames_.push_back(frame);
+    }
+
+    std::size_t count = 0;
+    for (const auto& sub : job.subs_)
+    {
+        if (sub->closed()) continue;
+        sub->deliver(job.topic_key_, frame);
+        ++count;
+    }
+    return count;
+}
+
+inline std::size_t InflightJobs::detach(job_id_t id, const SubscriberBase* sub)
+{
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return 0;
+    auto& subs = it->second.subs_;
+    subs.erase(std::remove_if(subs.begin(), subs.end(),
+                              [sub](const std::shared_ptr<SubscriberBase>& s)
+                              { return s.get() == sub; }),
+               subs.end());
+    return subs.size();
+}
+
+inline InflightResult InflightJobs::complete(job_id_t id)
+{
+    InflightResult result{std::string{}, {}, false};
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return result;
+
+    auto& job = it->second;
+    if (job.shared_) by_key_.erase(job.key_);
+    result.key = std::move(job.key_);
+    result.frames = std::move(job.frames_);
+    result.complete = job.shared_;
+    jobs_.erase(it);
+    ++stats_.completed;
+    return result;
+}
+
+inline bool InflightJobs::abort(job_id_t id)
+{
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return false;
+    if (it->second.shared_) by_key_.erase(it->second.key_);
+    jobs_.erase(it);
+    ++stats_.aborted;
+    return true;
+}
+
+inline InflightJobs::job_id_t InflightJobs::find(const std::string& key) const
+{
+    auto it = by_key_.find(key);
+    return it == by_key_.end() ? 0 : it->second;
+}
+
+inline std::size_t InflightJobs::subscribers(job_id_t id) const
+{
+    auto it = jobs_.find(id);
+    return it == jobs_.end() ? 0 : it->second.subs_.size();
+}
+
+//------------------------------------------------------------------------------
+// Stop recording a job that has produced too much to replay and take it out
+// of the key index, so it can't be joined.
+// -----------------------------------------------------------------------------
+
+inline void InflightJobs::_unshare(_Job& job)
+{
+    job.shared_ = false;
+    job.frames_.clear();
+    job.frames_.shrink_to_fit();
+    by_key_.erase(job.key_);
+    ++stats_.unshared;
+}
+
+}
+
+#endif // CLSERVER_INFLIGHT_JOBS_HH
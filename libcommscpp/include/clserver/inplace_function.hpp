@@ -0,0 +1,194 @@
+//--------------------------------------------------------------------------------
+// A std::function replacement that stores small callables without allocating.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_INPLACE_FUNCTION_HH
+#define CLSERVER_INPLACE_FUNCTION_HH
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace clserver
+{
+
+template<typename Signature, std::size_t Capacity = 64>
+class InplaceFunction;
+
+//-------------------------------------------------------------------------------
+// InplaceFunction has the copy/call semantics of std::function but has a much
+// larger small object buffer. Completion handlers are typically a member
+// function pointer bound to an object plus a little state, which is too big
+// for the libstdc++ std::function buffer (16 bytes) and so would cost a heap
+// allocation for every queued read or write. Callables that don't fit in
+// Capacity bytes still work but are stored on the heap.
+// -------------------------------------------------------------------------------
+
+template<typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+public:
+    InplaceFunction() noexcept : vtable_{nullptr} {}
+    InplaceFunction(std::nullptr_t) noexcept : vtable_{nullptr} {}
+
+    template<typename F,
+             typename = typename std::enable_if<
+                 !std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+    InplaceFunction(F&& f);
+
+    InplaceFunction(const InplaceFunction& other);
+    InplaceFunction(InplaceFunction&& other) noexcept;
+    ~InplaceFunction() { _reset(); }
+
+    InplaceFunction& operator=(const InplaceFunction& other);
+    InplaceFunction& operator=(InplaceFunction&& other) noexcept;
+    InplaceFunction& operator=(std::nullptr_t) noexcept { _reset(); return *this; }
+
+    explicit operator bool() const noexcept { return vtable_ != nullptr; }
+
+    R operator()(Args... args) const;
+
+    // True if a callable of type F is stored without a heap allocation
+    template<typename F>
+    static constexpr bool fits_inline()
+    {
+        return sizeof(F) <= Capacity && alignof(F) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible<F>::value;
+    }
+
+private:
+    //---------------------------------------------------------------------------
+    // Definitions
+    //---------------------------------------------------------------------------
+
+    using storage_t = typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type;
+
+    struct _VTable
+    {
+        R (*invoke_)(void*, Args&&...);
+        void (*copy_)(void* dst, const void* src);
+        void (*move_)(void* dst, void* src);
+        void (*destroy_)(void*);
+    };
+
+    // Operations for a callable stored in the buffer itself
+    template<typename F>
+    struct _Inline
+    {
+        static R invoke(void* p, Args&&... args)
+        { return (*static_cast<F*>(p))(std::forward<Args>(args)...); }
+        static void copy(void* dst, const void* src)
+        { new (dst) F(*static_cast<const F*>(src)); }
+        static void move(void* dst, void* src)
+        { new (dst) F(std::move(*static_cast<F*>(src))); static_cast<F*>(src)->~F(); }
+        static void destroy(void* p) { static_cast<F*>(p)->~F(); }
+        static constexpr _VTable vtable{&invoke, &copy, &move, &destroy};
+    };
+
+    // Operations for a callable that is too big and the buffer holds a pointer
+    template<typename F>
+    struct _Heap
+    {
+        static F*& ptr(void* p) { return *static_cast<F**>(p); }
+        static R invoke(void* p, Args&&... args)
+        { return (*ptr(p))(std::forward<Args>(args)...); }
+        static void copy(void* dst, const void* src)
+        { new (dst) F*(new F(**static_cast<F* const*>(src))); }
+        static void move(void* dst, void* src)
+        { new (dst) F*(ptr(src)); }
+        static void destroy(void* p) { delete ptr(p); }
+        static constexpr _VTable vtable{&invoke, &copy, &move, &destroy};
+    };
+
+    void _reset() noexcept
+    {
+        if (vtable_) vtable_->destroy_(&storage_);
+        vtable_ = nullptr;
+    }
+
+    //---------------------------------------------------------------------------
+    // Internal member variables
+    //---------------------------------------------------------------------------
+    mutable storage_t storage_;
+    const _VTable* vtable_;
+};
+
+template<typename R, typename... Args, std::size_t Capacity>
+template<typename F>
+constexpr typename InplaceFunction<R(Args...), Capacity>::_VTable
+InplaceFunction<R(Args...), Capacity>::_Inline<F>::vtable;
+
+template<typename R, typename... Args, std::size_t Capacity>
+template<typename F>
+constexpr typename InplaceFunction<R(Args...), Capacity>::_VTable
+InplaceFunction<R(Args...), Capacity>::_Heap<F>::vtable;
+
+//-------------------------------------------------------------------------------
+// InplaceFunction member functions
+//-------------------------------------------------------------------------------
+
+template<typename R, typename... Args, std::size_t Capacity>
+template<typename F, typename>
+InplaceFunction<R(Args...), Capacity>::InplaceFunction(F&& f)
+{
+    using fn_t = typename std::decay<F>::type;
+    if (fits_inline<fn_t>())
+    {
+        new (&storage_) fn_t(std::forward<F>(f));
+        vtable_ = &_Inline<fn_t>::vtable;
+    }
+    else
+    {
+        new (&storage_) fn_t*(new fn_t(std::forward<F>(f)));
+        vtable_ = &_Heap<fn_t>::vtable;
+    }
+}
+
+template<typename R, typename... Args, std::size_t Capacity>
+InplaceFunction<R(Args...), Capacity>::InplaceFunction(const InplaceFunction& other) :
+    vtable_{other.vtable_}
+{
+    if (vtable_) vtable_->copy_(&storage_, &other.storage_);
+}
+
+template<typename R, typename... Args, std::size_t Capacity>
+InplaceFunction<R(Args...), Capacity>::InplaceFunction(InplaceFunction&& other) noexcept :
+    vtable_{other.vtable_}
+{
+    if (vtable_) vtable_->move_(&storage_, &other.storage_);
+    other.vtable_ = nullptr;
+}
+
+template<typename R, typename... Args, std::size_t Capacity>
+InplaceFunction<R(Args...), Capacity>&
+InplaceFunction<R(Args...), Capacity>::operator=(const InplaceFunction& other)
+{
+    if (this == &other) return *this;
+    InplaceFunction tmp{other};
+    return *this = std::move(tmp);
+}
+
+template<typename R, typename... Args, std::size_t Capacity>
+InplaceFunction<R(Args...), Capacity>&
+InplaceFunction<R(Args...), Capacity>::operator=(InplaceFunction&& other) noexcept
+{
+    if (this == &other) return *this;
+    _reset();
+    vtable_ = other.vtable_;
+    if (vtable_) vtable_->move_(&storage_, &other.storage_);
+    other.vtable_ = nullptr;
+    return *this;
+}
+
+template<typename R, typename... Args, std::size_t Capacity>
+R InplaceFunction<R(Args...), Capacity>::operator()(Args... args) const
+{
+    if (!vtable_) throw std::bad_function_call();
+    return vtable_->invoke_(&storage_, std::forward<Args>(args)...);
+}
+
+}
+
+#endif // CLSERVER_INPLACE_FUNCTION_HH
@@ -0,0 +1,743 @@
+//--------------------------------------------------------------------------------
+// In-process message passing with the Connection interface.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_LOCAL_CONNECTION_HH
+#define CLSERVER_LOCAL_CONNECTION_HH
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/connection.hpp"
+#include "clserver/inplace_function.hpp"
+#include "clserver/ring_queue.hpp"
+#include "clserver/spsc_queue.hpp"
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+class LocalStream;
+class LocalChannel;
+
+//-------------------------------------------------------------------------------
+// Create a connected pair of in-process streams. Each end is serviced by its
+// own io_context (which may be the same one). The capacity is the number of
+// in-flight messages in each direction before the sender has to wait.
+// -------------------------------------------------------------------------------
+
+std::pair<LocalStream, LocalStream>
+make_local_stream_pair(asio::io_context& ioc1, asio::io_context& ioc2,
+                       std::size_t capacity = 1024);
+
+//-------------------------------------------------------------------------------
+// LocalBufferPool recycles the buffers that streambuf and const_buffer sends
+// are copied into, so that steady traffic over a local link does not allocate.
+// Buffers are rounded up to a power of two and handed out as DetachedBuffers
+// with the pool as their allocator.
+//
+// Only the sending end calls allocate(). A buffer comes back when the
+// DetachedBuffer holding it is destroyed, on whatever thread that happens, and
+// the sender takes the returned buffers in one batch when it runs out, so the
+// lock is only taken once per batch. Buffers bigger than max_size are not
+// kept. The pool deletes itself once released by its channel and every buffer
+// it handed out has come back.
+// -------------------------------------------------------------------------------
+
+class LocalBufferPool : public fbs::Allocator
+{
+public:
+    static constexpr std::size_t min_size = 64;
+    static constexpr std::size_t max_size = 64 * 1024;
+    static constexpr std::size_t max_cached = 64;       // Per size
+
+    LocalBufferPool() : refs_{1} { }
+
+    LocalBufferPool(LocalBufferPool&&) = delete;
+    LocalBufferPool(const LocalBufferPool&) = delete;
+
+    LocalBufferPool& operator=(const LocalBufferPool&) = delete;
+
+    // A buffer of at least size bytes; its actual size is capacity(size)
+    uint8_t* allocate(std::size_t size) override;
+    void deallocate(uint8_t* p, std::size_t size) override;
+
+    // The size of the buffer allocate() gives for size bytes
+    static std::size_t capacity(std::size_t size);
+
+    // The channel is done with the pool
+    void release() { _unref(); }
+
+private:
+    static constexpr std::size_t classes_ = 11;         // min_size to max_size
+
+    ~LocalBufferPool();
+
+    static std::size_t _class(std::size_t capacity);
+    void _unref();
+
+    std::atomic<std::size_t> refs_;
+
+    // Only used by the sender. taken_ swaps storage with returned_.
+    std::array<std::vector<uint8_t*>, classes_> free_;
+    std::vector<std::pair<uint8_t*, std::size_t>> taken_;
+
+    std::mutex mutex_;
+    std::vector<std::pair<uint8_t*, std::size_t>> returned_;
+};
+
+//-------------------------------------------------------------------------------
+// LocalChannel is the state shared by the two ends of an in-process link. Each
+// end owns an inbox that only the peer pushes onto, so every queue has exactly
+// one producer and one consumer.
+// -------------------------------------------------------------------------------
+
+class LocalChannel
+{
+public:
+    struct End
+    {
+        asio::io_context::executor_type executor_;
+        SpscQueue<fbs::DetachedBuffer> inbox_;
+
+        // Coalesce wake-ups so a burst of messages costs a single post
+        std::atomic<bool> notify_pending_;
+
+        // Set when the sender found the peer's inbox full
+        std::atomic<bool> blocked_;
+
+        std::atomic<bool> closed_;
+
+        // The validate id is written once before validate_sent_ is set
+        std::string validate_id_;
+        std::atomic<bool> validate_sent_;
+
+        // The owning connection; only accessed from executor_
+        void* conn_;
+
+        // Buffers the peer copies its messages into
+        LocalBufferPool* pool_;
+
+        End(asio::io_context& ioc, std::size_t capacity) :
+            executor_{ioc.get_executor()}, inbox_{capacity},
+            notify_pending_{false}, blocked_{false}, closed_{false},
+            validate_sent_{false}, conn_{nullptr}, pool_{new LocalBufferPool} {}
+
+        // The inbox goes first, as it may hold buffers from the pool
+        ~End()
+        {
+            while (inbox_.front()) inbox_.pop();
+            pool_->release();
+        }
+    };
+
+    LocalChannel(asio::io_context& ioc1, asio::io_context& ioc2, std::size_t capacity) :
+        end1_{ioc1, capacity}, end2_{ioc2, capacity} {}
+
+    End& end(int side) { return side == 0 ? end1_ : end2_; }
+
+private:
+    End end1_;
+    End end2_;
+};
+
+//-------------------------------------------------------------------------------
+// LocalStream is a movable handle to one end of a LocalChannel. It is only
+// useful as the Stream parameter of a Connection.
+// -------------------------------------------------------------------------------
+
+class LocalStream
+{
+public:
+    using executor_type = asio::io_context::executor_type;
+
+    LocalStream(std::shared_ptr<LocalChannel> channel, int side) :
+        channel_{std::move(channel)}, side_{side} {}
+
+    executor_type get_executor() { return channel_->end(side_).executor_; }
+
+private:
+    friend class Connection<LocalStream>;
+
+    std::shared_ptr<LocalChannel> channel_;
+    int side_;
+};
+
+//-------------------------------------------------------------------------------
+// LocalBufferPool member functions
+//-------------------------------------------------------------------------------
+
+inline LocalBufferPool::~LocalBufferPool()
+{
+    for (auto& buffers : free_)
+        for (auto p : buffers) delete[] p;
+    for (auto& r : returned_) delete[] r.first;
+}
+
+inline std::size_t LocalBufferPool::capacity(std::size_t size)
+{
+    if (size > max_size) return size;
+    std::size_t c = min_size;
+    while (c < size) c <<= 1;
+    return c;
+}
+
+inline uint8_t* LocalBufferPool::allocate(std::size_t size)
+{
+    refs_.fetch_add(1, std::memory_order_relaxed);
+    auto c = capacity(size);
+    if (c > max_size) return new uint8_t[c];
+
+    auto& buffers = free_[_class(c)];
+    if (buffers.empty())
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            taken_.swap(returned_);
+        }
+        for (auto& r : taken_)
+        {
+            auto& to = free_[_class(r.second)];
+            if (to.size() < max_cached) to.push_back(r.first);
+            else delete[] r.first;
+        }
+        taken_.clear();
+    }
+    if (buffers.empty()) return new uint8_t[c];
+    auto p = buffers.back();
+    buffers.pop_back();
+    return p;
+}
+
+inline void LocalBufferPool::deallocate(uint8_t* p, std::size_t size)
+{
+    if (size > max_size)
+    {
+        delete[] p;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        returned_.emplace_back(p, size);
+    }
+    _unref();
+}
+
+inline std::size_t LocalBufferPool::_class(std::size_t capacity)
+{
+    std::size_t i = 0;
+    for (auto c = min_size; c < capacity; c <<= 1) ++i;
+    return i;
+}
+
+inline void LocalBufferPool::_unref()
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+}
+
+inline std::pair<LocalStream, LocalStream>
+make_local_stream_pair(asio::io_context& ioc1, asio::io_context& ioc2,
+                       std::size_t capacity)
+{
+    auto channel = std::make_shared<LocalChannel>(ioc1, ioc2, capacity);
+    return std::make_pair(LocalStream{channel, 0}, LocalStream{channel, 1});
+}
+
+//-------------------------------------------------------------------------------
+// Connection specialisation for in-process links. It keeps the send/receive
+// contract of the stream based Connection (validate first, messages delivered
+// whole and in order, handlers called from the io_context of this end) but
+// never serialises onto a byte stream.
+//
+// Messages can additionally be passed as finished flatbuffers. These are moved
+// through the channel so a message built on one thread is read on the other
+// with no copy and no system call. The streambuf and const_buffer overloads
+// copy the message once, into a buffer from the peer's LocalBufferPool, so that
+// code written against the stream based Connection works as is.
+// -------------------------------------------------------------------------------
+
+template<>
+class Connection<LocalStream>
+{
+
+public:
+    Connection(LocalStream stream, const std::string& validate_id);
+
+    Connection(Connection&&) = delete;               // non movable
+    Connection(const Connection&) = delete;          // non copy-constructible
+    ~Connection();
+
+    Connection& operator=(const Connection&) = delete; // non copyable
+
+    // Start a connect send/receive sequence to validate the connection
+    template<typename Handler> void validate(Handler h);
+
+    template<typename Handler>
+    void async_receive_message(asio::streambuf& sb, Handler h);
+
+    template<typename Handler>
+    void async_send_message(const asio::streambuf& sb, Handler h);
+
+    template<typename Handler>
+    void async_send_message(asio::const_buffer buf, Handler h);
+
+    // Zero-copy variants. The received buffer replaces the contents of db.
+    template<typename Handler>
+    void async_receive_message(fbs::DetachedBuffer& db, Handler h);
+
+    template<typename Handler>
+    void async_send_message(fbs::DetachedBuffer db, Handler h);
+
+    // Replace a still queued frame with the same (channel, key), as for the
+    // stream based Connection
+    template<typename Handler>
+    void async_send_latest(uint32_t channel, uint32_t key, asio::const_buffer buf,
+                           Handler h);
+
+    std::size_t conflated() const { return conflated_; }
+
+    // The executor that the handlers are called from
+    LocalStream::executor_type get_executor() { return stream_.get_executor(); }
+
+private:
+    //---------------------------------------------------------------------------
+    // Definitions
+    //---------------------------------------------------------------------------
+
+    using rw_handler_t = InplaceFunction<void(const bsys::error_code&, std::size_t)>;
+    using validate_handler_t = InplaceFunction<void(const bsys::error_code&)>;
+    using End = LocalChannel::End;
+
+    //---------------------------------------------------------------------------
+    // Internal member functions
+    //---------------------------------------------------------------------------
+
+    // Schedule _on_notify() to run on the io_context of the given end
+    void _notify(int side);
+    static void _run_notify(const std::shared_ptr<LocalChannel>& channel, int side);
+
+    // Progress validation and the read/write queues
+    void _on_notify();
+    void _check_validate();
+    void _check_rqueue();
+    void _check_wqueue();
+
+    // Pending operations count as outstanding work on the io_context, as they
+    // do for sockets, so that run() does not return while waiting on the peer.
+    void _update_work();
+
+    // When there is an error we need to clear the queues and propagate the error
+    void _receive_error(const bsys::error_code& ec, std::size_t s);
+    void _send_error(const bsys::error_code& ec, std::size_t s);
+
+    End& _self() { return stream_.channel_->end(stream_.side_); }
+    End& _peer() { return stream_.channel_->end(1 - stream_.side_); }
+
+    //---------------------------------------------------------------------------
+    // Inner classes
+    //---------------------------------------------------------------------------
+
+    struct _ReadReq
+    {
+        asio::streambuf* streambuf_;
+        fbs::DetachedBuffer* detached_;
+        rw_handler_t handler_;
+
+        template<typename Handler>
+        _ReadReq(asio::streambuf* sb, fbs::DetachedBuffer* db, Handler h) :
+            streambuf_{sb}, detached_{db}, handler_{h} {}
+    };
+
+    // A streambuf or const_buffer write is copied into detached_, in a buffer
+    // from the peer's pool, the first time it is tried
+    struct _WriteReq
+    {
+        const asio::streambuf* streambuf_;
+        asio::const_buffer buffer_;
+        bool copy_;
+        fbs::DetachedBuffer detached_;
+        rw_handler_t handler_;
+
+        // Set for async_send_latest() frames
+        bool latest_;
+        uint64_t latest_key_;
+
+        template<typename Handler>
+        _WriteReq(const asio::streambuf* sb, fbs::DetachedBuffer db, Handler h) :
+            streambuf_{sb}, copy_{sb != nullptr}, detached_{std::move(db)}, handler_{h},
+            latest_{false}, latest_key_{0} {}
+
+        template<typename Handler>
+        _WriteReq(asio::const_buffer buf, Handler h, bool latest = false,
+                  uint64_t latest_key = 0) :
+            streambuf_{nullptr}, buffer_{buf}, copy_{true}, handler_{h},
+            latest_{latest}, latest_key_{latest_key} {}
+    };
+
+    //---------------------------------------------------------------------------
+    // Internal member variable
+    //---------------------------------------------------------------------------
+    LocalStream stream_;
+
+    // The connection validation identifier that establishes a valid connection
+    std::string validate_id_;
+    validate_handler_t validate_handler_;
+    bool validated_;
+
+    // Read and write queues - items pushed onto the back and popped from the front
+    RingQueue<_ReadReq> rqueue_;
+    RingQueue<_WriteReq> wqueue_;
+
+    // Number of async_send_latest() frames in wqueue_ and replaced so far
+    std::size_t latest_queued_;
+    std::size_t conflated_;
+
+    bool has_work_;
+};
+
+//-------------------------------------------------------------------------------
+// Connection<LocalStream> public member functions
+//-------------------------------------------------------------------------------
+
+inline Connection<LocalStream>::Connection(LocalStream stream,
+                                           const std::string& validate_id) :
+    stream_{std::move(stream)}, validate_id_{validate_id}, validated_{false},
+    latest_queued_{0}, conflated_{0}, has_work_{false}
+{
+    _self().conn_ = this;
+}
+
+//-------------------------------------------------------------------------------
+// Closing one end fails the peer's pending and future reads once it has drained
+// the messages already in its inbox. Handlers still queued here are completed
+// with operation_aborted, as happens when a socket is destroyed.
+// -------------------------------------------------------------------------------
+
+inline Connection<LocalStream>::~Connection()
+{
+    auto ex = _self().executor_;
+    _self().conn_ = nullptr;
+    _self().closed_.store(true, std::memory_order_release);
+    _notify(1 - stream_.side_);
+
+    bsys::error_code ec = asio::error::operation_aborted;
+    for (; !rqueue_.empty(); rqueue_.pop_front())
+        asio::post(ex, [h=std::move(rqueue_.front().handler_), ec](){ h(ec, 0); });
+    for (; !wqueue_.empty(); wqueue_.pop_front())
+        asio::post(ex, [h=std::move(wqueue_.front().handler_), ec](){ h(ec, 0); });
+    if (validate_handler_)
+        asio::post(ex, [h=std::move(validate_handler_), ec](){ h(ec); });
+    if (has_work_) ex.on_work_finished();
+}
+
+//---------------------------------------------------------------------------
+// Publish our validate_id_ to the peer. The comparison happens on our own
+// io_context once both sides have published.
+// ---------------------------------------------------------------------------
+
+template<typename Handler>
+void Connection<LocalStream>::validate(Handler h)
+{
+    if (validated_)
+    {
+        h(bsys::errc::make_error_code(bsys::errc::already_connected));
+        return;
+    }
+
+    validate_handler_ = h;
+    _self().validate_id_ = validate_id_;
+    _self().validate_sent_.store(true, std::memory_order_release);
+    _notify(1 - stream_.side_);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+//---------------------------------------------------------------------------
+// Async read/write functions.
+// ---------------------------------------------------------------------------
+
+template<typename Handler>
+void Connection<LocalStream>::async_receive_message(asio::streambuf& sb, Handler h)
+{
+    rqueue_.emplace_back(&sb, nullptr, h);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+template<typename Handler>
+void Connection<LocalStream>::async_send_message(const asio::streambuf& sb, Handler h)
+{
+    wqueue_.emplace_back(&sb, fbs::DetachedBuffer{}, h);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+template<typename Handler>
+void Connection<LocalStream>::async_send_message(asio::const_buffer buf, Handler h)
+{
+    wqueue_.emplace_back(buf, h);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+//---------------------------------------------------------------------------
+// Queued writes are only copied and pushed from _check_wqueue(), so any of
+// them can be replaced, including the front one.
+// ---------------------------------------------------------------------------
+
+template<typename Handler>
+void Connection<LocalStream>::async_send_latest(uint32_t channel, uint32_t key,
+                                                asio::const_buffer buf, Handler h)
+{
+    uint64_t latest_key = (static_cast<uint64_t>(channel) << 32) | key;
+    for (std::size_t i = 0; latest_queued_ && i < wqueue_.size(); ++i)
+    {
+        auto& req = wqueue_[i];
+        if (!req.latest_ || req.latest_key_ != latest_key) continue;
+
+        asio::post(_self().executor_, [old=std::move(req.handler_)]()
+                   {
+                       old(asio::error::operation_aborted, 0);
+                   });
+        req.buffer_ = buf;
+        req.copy_ = true;
+        req.detached_ = fbs::DetachedBuffer{};
+        req.handler_ = rw_handler_t{std::move(h)};
+        ++conflated_;
+        return;
+    }
+
+    wqueue_.emplace_back(buf, h, true, latest_key);
+    ++latest_queued_;
+    _update_work();
+    _notify(stream_.side_);
+}
+
+template<typename Handler>
+void Connection<LocalStream>::async_receive_message(fbs::DetachedBuffer& db, Handler h)
+{
+    rqueue_.emplace_back(nullptr, &db, h);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+template<typename Handler>
+void Connection<LocalStream>::async_send_message(fbs::DetachedBuffer db, Handler h)
+{
+    wqueue_.emplace_back(nullptr, std::move(db), h);
+    _update_work();
+    _notify(stream_.side_);
+}
+
+//------------------------------------------------------------------------------
+// Connection<LocalStream> internal member functions
+// ------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Wake up an end. Only the first notification after the end last ran is
+// posted; later ones are picked up by that same run. The posted function holds
+// the channel alive and looks up the connection on the end's own executor so a
+// connection that has since been destroyed is never touched.
+// -----------------------------------------------------------------------------
+
+inline void Connection<LocalStream>::_notify(int side)
+{
+    auto& end = stream_.channel_->end(side);
+    if (end.notify_pending_.exchange(true, std::memory_order_acq_rel)) return;
+    asio::post(end.executor_,
+               std::bind(&Connection<LocalStream>::_run_notify, stream_.channel_, side));
+}
+
+inline void Connection<LocalStream>::_run_notify(
+    const std::shared_ptr<LocalChannel>& channel, int side)
+{
+    auto& end = channel->end(side);
+    end.notify_pending_.store(false, std::memory_order_release);
+    if (end.conn_) static_cast<Connection<LocalStream>*>(end.conn_)->_on_notify();
+}
+
+inline void Connection<LocalStream>::_on_notify()
+{
+    _check_validate();
+    _check_rqueue();
+    _check_wqueue();
+    _update_work();
+}
+
+inline void Connection<LocalStream>::_update_work()
+{
+    bool pending = validate_handler_ || !rqueue_.empty() || !wqueue_.empty();
+    if (pending == has_work_) return;
+    has_work_ = pending;
+    if (pending) _self().executor_.on_work_started();
+    else _self().executor_.on_work_finished();
+}
+
+//------------------------------------------------------------------------------
+// Complete validation once the peer has published its validate id.
+// -----------------------------------------------------------------------------
+
+inline void Connection<LocalStream>::_check_validate()
+{
+    if (validated_ || !validate_handler_) return;
+
+    auto& peer = _peer();
+    if (!peer.validate_sent_.load(std::memory_order_acquire))
+    {
+        if (!peer.closed_.load(std::memory_order_acquire)) return;
+        auto h = std::move(validate_handler_);
+        validate_handler_ = nullptr;
+        h(asio::error::eof);
+        return;
+    }
+
+    auto h = std::move(validate_handler_);
+    validate_handler_ = nullptr;
+    if (peer.validate_id_ != validate_id_)
+    {
+        h(bsys::errc::make_error_code(bsys::errc::bad_message));
+        return;
+    }
+    validated_ = true;
+    h(bsys::error_code{});
+}
+
+//------------------------------------------------------------------------------
+// Match queued reads against the inbox. The request is popped before its
+// handler is called so the handler can queue the next read.
+// -----------------------------------------------------------------------------
+
+inline void Connection<LocalStream>::_check_rqueue()
+{
+    if (!validated_) return;
+
+    auto& self = _self();
+    auto& peer = _peer();
+    while (!rqueue_.empty())
+    {
+        auto* db = self.inbox_.front();
+        if (!db)
+        {
+            // Check closed before re-checking the inbox to not miss a final push
+            if (!peer.closed_.load(std::memory_order_acquire)) return;
+            if (self.inbox_.front()) continue;
+            _receive_error(asio::error::eof, 0);
+            return;
+        }
+
+        auto req = std::move(rqueue_.front());
+        rqueue_.pop_front();
+
+        std::size_t size = db->size();
+        if (req.detached_)
+        {
+            *req.detached_ = std::move(*db);
+        }
+        else
+        {
+            auto mbt = req.streambuf_->prepare(size);
+            asio::buffer_copy(mbt, asio::buffer(db->data(), size));
+        }
+        self.inbox_.pop();
+
+        // The sender found the inbox full so let it know there is space now.
+        // The pop must be ordered before blocked is looked at, as the sender
+        // sets blocked before it looks at the inbox again; one of the two
+        // then sees the other.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (self.blocked_.exchange(false, std::memory_order_seq_cst))
+            _notify(1 - stream_.side_);
+
+        req.handler_(bsys::error_code{}, size);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Move queued writes into the peer's inbox until it is full.
+// -----------------------------------------------------------------------------
+
+inline void Connection<LocalStream>::_check_wqueue()
+{
+    if (!validated_) return;
+
+    auto& peer = _peer();
+    bool pushed = false;
+    while (!wqueue_.empty())
+    {
+        if (peer.closed_.load(std::memory_order_acquire))
+        {
+            _send_error(asio::error::broken_pipe, 0);
+            break;
+        }
+
+        auto& req = wqueue_.front();
+        if (req.copy_)
+        {
+            asio::const_buffer cbt = req.streambuf_ ? req.streambuf_->data() : req.buffer_;
+            auto size = cbt.size();
+            auto buf = peer.pool_->allocate(size);
+            asio::buffer_copy(asio::buffer(buf, size), cbt);
+            req.detached_ = fbs::DetachedBuffer(peer.pool_, false, buf,
+                                                LocalBufferPool::capacity(size), buf, size);
+            req.copy_ = false;
+        }
+
+        std::size_t size = req.detached_.size();
+        if (!peer.inbox_.try_push(std::move(req.detached_)))
+        {
+            // Set blocked then retry in case the peer drained in between. The
+            // fence keeps the store from being ordered after the retry's
+            // load of the inbox head.
+            peer.blocked_.store(true, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!peer.inbox_.try_push(std::move(req.detached_))) break;
+            peer.blocked_.store(false, std::memory_order_release);
+        }
+        pushed = true;
+
+        auto handler = std::move(req.handler_);
+        if (req.latest_) --latest_queued_;
+        wqueue_.pop_front();
+        handler(bsys::error_code{}, size);
+    }
+    if (pushed) _notify(1 - stream_.side_);
+}
+
+//---------------------------------------------------------------------------
+// On a message read/write error
+//---------------------------------------------------------------------------
+
+inline void Connection<LocalStream>::_receive_error(const bsys::error_code& ec,
+                                                    std::size_t s)
+{
+    while (!rqueue_.empty())
+    {
+        auto handler = std::move(rqueue_.front().handler_);
+        rqueue_.pop_front();
+        handler(ec,s);
+    }
+}
+
+inline void Connection<LocalStream>::_send_error(const bsys::error_code& ec,
+                                                 std::size_t s)
+{
+    while (!wqueue_.empty())
+    {
+        auto handler = std::move(wqueue_.front().handler_);
+        if (wqueue_.front().latest_) --latest_queued_;
+        wqueue_.pop_front();
+        handler(ec,s);
+    }
+}
+
+}
+
+#endif // CLSERVER_LOCAL_CONNECTION_HH
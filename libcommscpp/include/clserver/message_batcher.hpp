@@ -0,0 +1,314 @@
+//--------------------------------------------------------------------------------
+// Adaptive batching of outgoing worker messages.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_MESSAGE_BATCHER_HH
+#define CLSERVER_MESSAGE_BATCHER_HH
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <flatbuffers/flatbuffers.h>
+#include "worker_write_generated.h"
+#include "clserver/connection.hpp"
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// MessageBatcher packs the messages a worker sends into MessageBatch frames.
+//
+// When nothing is in flight on the connection a message is sent straight away,
+// so a quiet link pays no extra latency. While a frame is in flight further
+// messages accumulate and are sent together as soon as the link is idle again,
+// once max_bytes have accumulated, or once the oldest has waited max_delay,
+// whichever comes first. A flush of a single message sends a plain Message
+// rather than a batch of one.
+//
+// Messages are built directly in the batcher's builder:
+//
+//     auto& b = batcher.builder();
+//     auto app = ClingoServer::CreateApplicationMsg(b, appid, b.CreateVector(...));
+//     batcher.add(ClingoServer::Msg_App, app.Union());
+//
+// Every frame carries the WorkerHandle the server assigned in its InitReply.
+// The builders are pooled and reused so steady state batching does not
+// allocate. Must only be used from the connection's executor.
+//
+// If a send fails the messages accumulated since are dropped, as the link
+// they were meant for is gone, and counted by messages_dropped(). The batcher
+// may be destroyed while sends are in flight: the builders they read from are
+// kept until the connection is done with them, and the completions that
+// arrive afterwards do nothing.
+// -------------------------------------------------------------------------------
+
+template<typename Stream>
+class MessageBatcher
+{
+public:
+    struct Options
+    {
+        std::chrono::microseconds max_delay{200};
+        std::size_t max_bytes = 64 * 1024;
+    };
+
+    MessageBatcher(Connection<Stream>& conn, uint32_t handle,
+                   Options opts = Options{});
+
+    MessageBatcher(MessageBatcher&&) = delete;
+    MessageBatcher(const MessageBatcher&) = delete;
+    ~MessageBatcher();
+
+    MessageBatcher& operator=(const MessageBatcher&) = delete;
+
+    // The builder to create the next message in
+    fbs::FlatBufferBuilder& builder() { return *current_; }
+
+    // Add a message that was created in builder()
+    void add(ClingoServer::Msg type, fbs::Offset<void> msg);
+
+    // Convenience function to add an ApplicationMsg
+    void add_app(uint16_t appid, const uint8_t* data, std::size_t size);
+
+    // Send whatever has accumulated now
+    void flush();
+
+    // Number of frames sent and messages that went into them
+    std::size_t frames_sent() const { return frames_sent_; }
+    std::size_t messages_sent() const { return messages_sent_; }
+
+    // Messages dropped because a send failed, and the error it failed with
+    std::size_t messages_dropped() const { return messages_dropped_; }
+    const bsys::error_code& error() const { return error_; }
+
+private:
+    //---------------------------------------------------------------------------
+    // Internal member functions
+    //---------------------------------------------------------------------------
+
+    using _Builders = std::vector<std::unique_ptr<fbs::FlatBufferBuilder>>;
+
+    // What the completion handlers share with the batcher. owner_ is cleared
+    // when the batcher goes away, but the in flight builders stay until sent.
+    struct _Shared
+    {
+        MessageBatcher* owner_;
+        _Builders in_flight_;
+    };
+
+    void _arm_timer();
+    void _disarm_timer();
+    void _on_timer(uint64_t generation, const bsys::error_code& ec);
+    void _on_sent(const bsys::error_code& ec);
+    void _drop(const bsys::error_code& ec);
+    std::unique_ptr<fbs::FlatBufferBuilder> _take_builder();
+
+    static void _sent(const std::shared_ptr<_Shared>& shared, fbs::FlatBufferBuilder* b,
+                      const bsys::error_code& ec);
+
+    //---------------------------------------------------------------------------
+    // Internal member variables
+    //---------------------------------------------------------------------------
+    Connection<Stream>& conn_;
+    ClingoServer::WorkerHandle handle_;
+    Options opts_;
+    asio::steady_timer timer_;
+    bool timer_armed_;
+    uint64_t timer_generation_;        // Bumped when the timer is disarmed
+
+    // The builder being filled and the messages added to it
+    std::unique_ptr<fbs::FlatBufferBuilder> current_;
+    std::vector<uint8_t> types_;
+    std::vector<fbs::Offset<void>> msgs_;
+
+    // Builders handed to the connection and those free for reuse
+    std::shared_ptr<_Shared> shared_;
+    _Builders free_;
+
+    std::size_t frames_sent_;
+    std::size_t messages_sent_;
+    std::size_t messages_dropped_;
+    bsys::error_code error_;
+};
+
+//-------------------------------------------------------------------------------
+// MessageBatcher member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream>
+MessageBatcher<Stream>::MessageBatcher(Connection<Stream>& conn,
+                                       uint32_t handle, Options opts) :
+    conn_{conn}, handle_{handle}, opts_{opts},
+    timer_{conn.get_executor()}, timer_armed_{false}, timer_generation_{0},
+    shared_{std::make_shared<_Shared>()},
+    frames_sent_{0}, messages_sent_{0}, messages_dropped_{0}
+{
+    shared_->owner_ = this;
+    current_ = _take_builder();
+}
+
+template<typename Stream>
+MessageBatcher<Stream>::~MessageBatcher()
+{
+    shared_->owner_ = nullptr;
+    _disarm_timer();
+}
+
+template<typename Stream>
+void MessageBatcher<Stream>::add(ClingoServer::Msg type, fbs::Offset<void> msg)
+{
+    types_.push_back(type);
+    msgs_.push_back(msg);
+
+    if (shared_->in_flight_.empty() || current_->GetSize() >= opts_.max_bytes)
+    {
+        flush();
+        return;
+    }
+    if (!timer_armed_) _arm_timer();
+}
+
+template<typename Stream>
+void MessageBatcher<Stream>::add_app(uint16_t appid, const uint8_t* data, std::size_t size)
+{
+    auto& b = builder();
+    auto app = ClingoServer::CreateApplicationMsg(b, appid, b.CreateVector(data, size));
+    add(ClingoServer::Msg_App, app.Union());
+}
+
+//---------------------------------------------------------------------------
+// Finish the current builder as a Message and hand it to the connection.
+//---------------------------------------------------------------------------
+
+template<typename Stream>
+void MessageBatcher<Stream>::flush()
+{
+    if (msgs_.empty()) return;
+    _disarm_timer();
+
+    auto& b = *current_;
+    if (msgs_.size() == 1)
+    {
+        auto type = static_cast<ClingoServer::Msg>(types_.front());
+        b.Finish(ClingoServer::CreateMessage(b, type, msgs_.front(), &handle_));
+    }
+    else
+    {
+        auto batch = ClingoServer::CreateMessageBatch(b, b.CreateVector(types_),
+                                                      b.CreateVector(msgs_));
+        b.Finish(ClingoServer::CreateMessage(b, ClingoServer::Msg_Batch,
+                                             batch.Union(), &handle_));
+    }
+
+    ++frames_sent_;
+    messages_sent_ += msgs_.size();
+    types_.clear();
+    msgs_.clear();
+
+    auto sent = current_.get();
+    shared_->in_flight_.emplace_back(std::move(current_));
+    current_ = _take_builder();
+    auto shared = shared_;
+    conn_.async_send_message(asio::buffer(sent->GetBufferPointer(), sent->GetSize()),
+                             [shared, sent](const bsys::error_code& ec, std::size_t)
+                             { _sent(shared, sent, ec); });
+}
+
+//---------------------------------------------------------------------------
+// MessageBatcher internal member functions
+//---------------------------------------------------------------------------
+
+// A wait that completes after the timer was disarmed, even if it was already
+// queued when cancel() was called, is recognised by its stale generation so
+// that it doesn't flush the next batch early.
+template<typename Stream>
+void MessageBatcher<Stream>::_arm_timer()
+{
+    timer_armed_ = true;
+    timer_.expires_after(opts_.max_delay);
+    auto shared = shared_;
+    auto generation = timer_generation_;
+    timer_.async_wait([shared, generation](const bsys::error_code& ec)
+    {
+        if (shared->owner_) shared->owner_->_on_timer(generation, ec);
+    });
+}
+
+template<typename Stream>
+void MessageBatcher<Stream>::_disarm_timer()
+{
+    if (!timer_armed_) return;
+    timer_armed_ = false;
+    ++timer_generation_;
+    timer_.cancel();
+}
+
+template<typename Stream>
+void MessageBatcher<Stream>::_on_timer(uint64_t generation, const bsys::error_code& ec)
+{
+    if (ec || generation != timer_generation_) return;
+    timer_armed_ = false;
+    flush();
+}
+
+//---------------------------------------------------------------------------
+// Recycle the builder, or free it if the batcher is gone, and pass the result
+// on to the batcher.
+//---------------------------------------------------------------------------
+
+template<typename Stream>
+void MessageBatcher<Stream>::_sent(const std::shared_ptr<_Shared>& shared,
+                                   fbs::FlatBufferBuilder* b, const bsys::error_code& ec)
+{
+    auto& in_flight = shared->in_flight_;
+    for (auto it = in_flight.begin(); it != in_flight.end(); ++it)
+    {
+        if (it->get() != b) continue;
+        auto done = std::move(*it);
+        in_flight.erase(it);
+        if (!shared->owner_) return;
+        done->Clear();
+        shared->owner_->free_.emplace_back(std::move(done));
+        break;
+    }
+    if (shared->owner_) shared->owner_->_on_sent(ec);
+}
+
+// If the link is now idle send what has accumulated. After an error nothing
+// more will get through, so what has accumulated is dropped instead.
+template<typename Stream>
+void MessageBatcher<Stream>::_on_sent(const bsys::error_code& ec)
+{
+    if (ec) _drop(ec);
+    else if (shared_->in_flight_.empty()) flush();
+}
+
+template<typename Stream>
+void MessageBatcher<Stream>::_drop(const bsys::error_code& ec)
+{
+    error_ = ec;
+    if (msgs_.empty()) return;
+    _disarm_timer();
+    messages_dropped_ += msgs_.size();
+    types_.clear();
+    msgs_.clear();
+    current_->Clear();
+}
+
+template<typename Stream>
+std::unique_ptr<fbs::FlatBufferBuilder> MessageBatcher<Stream>::_take_builder()
+{
+    if (free_.empty()) return std::unique_ptr<fbs::FlatBufferBuilder>{
+            new fbs::FlatBufferBuilder{opts_.max_bytes + 1024}};
+    auto b = std::move(free_.back());
+    free_.pop_back();
+    return b;
+}
+
+}
+
+#endif // CLSERVER_MESSAGE_BATCHER_HH
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------------
+// Helpers for the ClingoServer flatbuffers messages.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_MESSAGES_HH
+#define CLSERVER_MESSAGES_HH
+
+#include <cstdint>
+#include <flatbuffers/flatbuffers.h>
+#include "worker_write_generated.h"
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// Decoder for a received ClingoServer::Message frame, suitable for use with a
+// DecodingReceiver. Returns nullptr if the frame fails verification. It holds no
+// state so can be called from any number of threads.
+// -------------------------------------------------------------------------------
+
+struct MessageDecoder
+{
+    const ClingoServer::Message* operator()(const uint8_t* data, std::size_t size) const
+    {
+        fbs::Verifier verifier{data, size};
+        if (!ClingoServer::VerifyMessageBuffer(verifier)) return nullptr;
+        return ClingoServer::GetMessage(data);
+    }
+};
+
+//-------------------------------------------------------------------------------
+// Call f(ClingoServer::Msg type, const void* msg) for each message carried by a
+// Message frame: once for a single message or once per entry of a batch. The
+// entries are read in place from the received buffer.
+// -------------------------------------------------------------------------------
+
+template<typename F>
+void for_each_msg(const ClingoServer::Message& message, F&& f)
+{
+    if (message.msg_type() != ClingoServer::Msg_Batch)
+    {
+        f(message.msg_type(), message.msg());
+        return;
+    }
+
+    auto batch = message.msg_as_Batch();
+    auto types = batch->msgs_type();
+    auto msgs = batch->msgs();
+    if (!types || !msgs) return;
+    for (fbs::uoffset_t i = 0; i < msgs->size(); ++i)
+        f(static_cast<ClingoServer::Msg>(types->Get(i)), msgs->Get(i));
+}
+
+}
+
+#endif // CLSERVER_MESSAGES_HH
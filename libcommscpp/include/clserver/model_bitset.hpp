@@ -0,0 +1,239 @@
+//--------------------------------------------------------------------------------
+// Models as bitsets over a job's symbol IDs, and the kernels to work on them.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_MODEL_BITSET_HH
+#define CLSERVER_MODEL_BITSET_HH
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// A model sent as a bitset has bit i set, bit i % 64 of word i / 64, if the
+// symbol with ID i is in it. The universe is every ID the job's dictionary
+// holds when the model is sent, so the bitset has a fixed size at any point
+// in the job and can be combined word by word with a mask built against the
+// same dictionary. A mask or model built earlier in the job is shorter; the
+// words past its end count as zero.
+//
+// The kernels are picked when compiling: AVX2 if it is enabled, otherwise
+// SSSE3 or SSE2, otherwise plain 64-bit code. They all give the same results
+// and none of them needs the words to be aligned.
+// -------------------------------------------------------------------------------
+
+// Words needed for a universe of the given number of IDs
+inline std::size_t bitset_words(std::size_t universe) { return (universe + 63) / 64; }
+
+// Whether a model of size IDs out of universe is smaller as a bitset than as
+// a vector of 32-bit IDs
+inline bool prefer_bitset(std::size_t size, std::size_t universe)
+{
+    return bitset_words(universe) * 8 < size * 4;
+}
+
+// Replace words with the bitset of the given IDs, all less than universe
+void bitset_from_ids(const uint32_t* ids, std::size_t size, std::size_t universe,
+                     std::vector<uint64_t>& words);
+
+// Append the IDs of the set bits to out, in increasing order
+void bitset_to_ids(const uint64_t* words, std::size_t size, std::vector<uint32_t>& out);
+
+// Call f(id) for each set bit, in increasing order
+template<typename F>
+void bitset_for_each(const uint64_t* words, std::size_t size, F f);
+
+// Number of set bits
+std::size_t bitset_count(const uint64_t* words, std::size_t size);
+
+// out = a & b, over size words of each; out may be a or b
+void bitset_and(const uint64_t* a, const uint64_t* b, uint64_t* out, std::size_t size);
+
+// Number of set bits in a & b, without storing it
+std::size_t bitset_and_count(const uint64_t* a, const uint64_t* b, std::size_t size);
+
+//-------------------------------------------------------------------------------
+// Implementation
+//-------------------------------------------------------------------------------
+
+namespace detail
+{
+
+#if defined(__AVX2__)
+
+//------------------------------------------------------------------------------
+// Count the bits of each byte with two nibble lookups and sum the bytes of
+// each 64-bit lane, as in Mula, Kurz and Lemire's "Faster Population Counts".
+// -----------------------------------------------------------------------------
+
+inline __m256i popcount_lanes(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+inline std::size_t sum_lanes(__m256i v)
+{
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return static_cast<std::size_t>(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+#elif defined(__SSSE3__)
+
+inline __m128i popcount_lanes(__m128i v)
+{
+    const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low = _mm_set1_epi8(0x0f);
+    __m128i lo = _mm_shuffle_epi8(lookup, _mm_and_si128(v, low));
+    __m128i hi = _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(v, 4), low));
+    return _mm_sad_epu8(_mm_add_epi8(lo, hi), _mm_setzero_si128());
+}
+
+inline std::size_t sum_lanes(__m128i v)
+{
+    return static_cast<std::size_t>(_mm_cvtsi128_si64(v) +
+                                    _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v)));
+}
+
+#endif
+
+inline std::size_t popcount64(uint64_t w)
+{
+    return static_cast<std::size_t>(__builtin_popcountll(w));
+}
+
+// Where the scan for set bits can skip: the next word from i that is not zero,
+// or size. Models over a large universe are mostly runs of zero words.
+inline std::size_t next_nonzero(const uint64_t* words, std::size_t i, std::size_t size)
+{
+#if defined(__AVX2__)
+    for (; i + 4 <= size; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        if (!_mm256_testz_si256(v, v)) break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= size; i += 2)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff) break;
+    }
+#endif
+    while (i < size && !words[i]) ++i;
+    return i;
+}
+
+}
+
+inline void bitset_from_ids(const uint32_t* ids, std::size_t size, std::size_t universe,
+                            std::vector<uint64_t>& words)
+{
+    words.assign(bitset_words(universe), 0);
+    for (std::size_t i = 0; i < size; ++i) words[ids[i] >> 6] |= uint64_t{1} << (ids[i] & 63);
+}
+
+template<typename F>
+void bitset_for_each(const uint64_t* words, std::size_t size, F f)
+{
+    for (std::size_t i = detail::next_nonzero(words, 0, size); i < size;
+         i = detail::next_nonzero(words, i + 1, size))
+    {
+        for (uint64_t w = words[i]; w; w &= w - 1)
+            f(static_cast<uint32_t>(i * 64 + static_cast<std::size_t>(__builtin_ctzll(w))));
+    }
+}
+
+inline void bitset_to_ids(const uint64_t* words, std::size_t size, std::vector<uint32_t>& out)
+{
+    out.reserve(out.size() + bitset_count(words, size));
+    bitset_for_each(words, size, [&out](uint32_t id) { out.push_back(id); });
+}
+
+inline std::size_t bitset_count(const uint64_t* words, std::size_t size)
+{
+    std::size_t i = 0, n = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= size; i += 4)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        acc = _mm256_add_epi64(acc, detail::popcount_lanes(v));
+    }
+    n = detail::sum_lanes(acc);
+#elif defined(__SSSE3__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 2 <= size; i += 2)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        acc = _mm_add_epi64(acc, detail::popcount_lanes(v));
+    }
+    n = detail::sum_lanes(acc);
+#endif
+    for (; i < size; ++i) n += detail::popcount64(words[i]);
+    return n;
+}
+
+inline void bitset_and(const uint64_t* a, const uint64_t* b, uint64_t* out, std::size_t size)
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 4 <= size; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(va, vb));
+    }
+#elif defined(__SSE2__)
+    for (; i + 2 <= size; i += 2)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(va, vb));
+    }
+#endif
+    for (; i < size; ++i) out[i] = a[i] & b[i];
+}
+
+inline std::size_t bitset_and_count(const uint64_t* a, const uint64_t* b, std::size_t size)
+{
+    std::size_t i = 0, n = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 4 <= size; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi64(acc, detail::popcount_lanes(_mm256_and_si256(va, vb)));
+    }
+    n = detail::sum_lanes(acc);
+#elif defined(__SSSE3__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 2 <= size; i += 2)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi64(acc, detail::popcount_lanes(_mm_and_si128(va, vb)));
+    }
+    n = detail::sum_lanes(acc);
+#endif
+    for (; i < size; ++i) n += detail::popcount64(a[i] & b[i]);
+    return n;
+}
+
+}
+
+#endif // CLSERVER_MODEL_BITSET_HH
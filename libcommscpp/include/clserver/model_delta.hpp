@@ -0,0 +1,348 @@
+//--------------------------------------------------------------------------------
+// Delta encoding of consecutive models as sorted, varint coded ID lists.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_MODEL_DELTA_HH
+#define CLSERVER_MODEL_DELTA_HH
+
+#include <cstdint>
+#include <vector>
+#include <boost/system/error_code.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace clserver
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// A sorted list of symbol IDs is coded as the gaps between consecutive IDs,
+// the first counted from 0, each as an LEB128 varint: seven bits a byte, low
+// bits first, the top bit set on every byte but the last. Models are mostly
+// runs of nearby IDs, so most gaps take a single byte.
+// -------------------------------------------------------------------------------
+
+// Append the coded list to out
+void encode_sorted_ids(const uint32_t* ids, std::size_t size, std::vector<uint8_t>& out);
+
+// Append the decoded IDs to out. Returns false if the data ends in the middle
+// of a varint or a varint does not fit 32 bits.
+bool decode_sorted_ids(const uint8_t* data, std::size_t size, std::vector<uint32_t>& out);
+
+struct ModelDeltaStats
+{
+    std::size_t keyframes = 0;
+    std::size_t deltas = 0;
+    std::size_t bytes = 0;         // Coded bytes of both kinds
+};
+
+//-------------------------------------------------------------------------------
+// ModelDeltaEncoder is the worker's side of the Delta model encoding. Each
+// model is coded as the IDs added to and removed from the previous one, or,
+// as a keyframe, in full (as added to the empty model). A keyframe is sent
+// for the first model, after every keyframe_interval models, and whenever the
+// delta would hold as many IDs as the model itself, so that a client that
+// joins late or loses its place can resynchronise.
+// -------------------------------------------------------------------------------
+
+class ModelDeltaEncoder
+{
+public:
+    struct Options
+    {
+        std::size_t keyframe_interval = 64;
+    };
+
+    ModelDeltaEncoder() : ModelDeltaEncoder{Options{}} { }
+    explicit ModelDeltaEncoder(Options opts) : opts_{opts}, since_keyframe_{0}, started_{false} { }
+
+    ModelDeltaEncoder(ModelDeltaEncoder&&) = delete;
+    ModelDeltaEncoder(const ModelDeltaEncoder&) = delete;
+
+    ModelDeltaEncoder& operator=(const ModelDeltaEncoder&) = delete;
+
+    // Code the next model, whose IDs must be sorted and distinct, replacing
+    // the contents of added and removed. Returns whether it is a keyframe.
+    bool encode(const uint32_t* ids, std::size_t size,
+                std::vector<uint8_t>& added, std::vector<uint8_t>& removed);
+
+    // Make the next model a keyframe
+    void reset() { started_ = false; }
+
+    const ModelDeltaStats& stats() const { return stats_; }
+
+private:
+    Options opts_;
+    std::size_t since_keyframe_;
+    bool started_;
+    std::vector<uint32_t> previous_;
+    std::vector<uint32_t> added_;
+    std::vector<uint32_t> removed_;
+    ModelDeltaStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// ModelDeltaDecoder is the client's side. Deltas are decoded as they arrive
+// but only merged into a full model when model() is called, and a keyframe
+// drops any deltas that have not been merged yet, so a client that only looks
+// at some of the models does not pay for rebuilding the others.
+//
+// A delta is only applied on top of the model it was made against. After a
+// gap the decoder is out of sync, and ignores deltas until the next keyframe.
+// -------------------------------------------------------------------------------
+
+class ModelDeltaDecoder
+{
+public:
+    ModelDeltaDecoder() : number_{0}, synced_{false}, pending_{0} { }
+
+    ModelDeltaDecoder(ModelDeltaDecoder&&) = default;
+    ModelDeltaDecoder(const ModelDeltaDecoder&) = delete;
+
+    ModelDeltaDecoder& operator=(ModelDeltaDecoder&&) = default;
+    ModelDeltaDecoder& operator=(const ModelDeltaDecoder&) = delete;
+
+    // Take model number, which is a delta against model base unless it is a
+    // keyframe. Returns whether it was applied; ec is set if the data is
+    // corrupt, which also leaves the decoder out of sync.
+    bool apply(uint64_t number, uint64_t base, bool keyframe,
+               const uint8_t* added, std::size_t added_size,
+               const uint8_t* removed, std::size_t removed_size, bsys::error_code& ec);
+
+    // The sorted IDs of the last model applied
+    const std::vector<uint32_t>& model();
+
+    uint64_t number() const { return number_; }
+    bool synced() const { return synced_; }
+
+    // Deltas waiting to be merged
+    std::size_t pending() const { return pending_; }
+
+private:
+    struct _Delta
+    {
+        std::vector<uint32_t> added;
+        std::vector<uint32_t> removed;
+    };
+
+    void _merge(const _Delta& delta);
+
+    std::vector<uint32_t> model_;
+    std::vector<uint32_t> scratch_;
+    std::vector<_Delta> deltas_;       // The first pending_ are in use
+    uint64_t number_;
+    bool synced_;
+    std::size_t pending_;
+};
+
+//-------------------------------------------------------------------------------
+// Varint coding
+//-------------------------------------------------------------------------------
+
+inline void encode_sorted_ids(const uint32_t* ids, std::size_t size, std::vector<uint8_t>& out)
+{
+    uint32_t previous = 0;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        uint32_t gap = ids[i] - previous;
+        previous = ids[i];
+        while (gap >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(gap | 0x80));
+            gap >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(gap));
+    }
+}
+
+namespace detail
+{
+
+#if defined(__SSE2__)
+
+//------------------------------------------------------------------------------
+// Decode 16 single byte gaps: a prefix sum of the bytes, in 16-bit lanes,
+// which cannot overflow as each gap is below 128, then widened to 32 bits and
+// offset by the last ID. Returns the last ID decoded.
+// -----------------------------------------------------------------------------
+
+inline uint32_t decode_16_gaps(__m128i bytes, uint32_t previous, uint32_t* out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+    hi = _mm_add_epi16(hi, _mm_set1_epi16(static_cast<short>(_mm_extract_epi16(lo, 7))));
+
+    const __m128i base = _mm_set1_epi32(static_cast<int>(previous));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                     _mm_add_epi32(base, _mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4),
+                     _mm_add_epi32(base, _mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8),
+                     _mm_add_epi32(base, _mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12),
+                     _mm_add_epi32(base, _mm_unpackhi_epi16(hi, zero)));
+    return out[15];
+}
+
+#endif
+
+}
+
+//------------------------------------------------------------------------------
+// With SSE2, whenever the next 16 bytes have no continuation bits set they are
+// 16 whole gaps and are decoded together; otherwise one varint is decoded at a
+// time until they are.
+// -----------------------------------------------------------------------------
+
+inline bool decode_sorted_ids(const uint8_t* data, std::size_t size, std::vector<uint32_t>& out)
+{
+    uint32_t previous = 0;
+    std::size_t i = 0;
+    while (i < size)
+    {
+#if defined(__SSE2__)
+        if (size - i >= 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if (_mm_movemask_epi8(bytes) == 0)
+            {
+                auto n = out.size();
+                out.resize(n + 16);
+                previous = detail::decode_16_gaps(bytes, previous, out.data() + n);
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        uint32_t gap = 0;
+        for (unsigned shift = 0; ; shift += 7)
+        {
+            if (i == size || shift > 28) return false;
+            uint8_t byte = data[i++];
+            if (shift == 28 && byte > 0x0f) return false;
+            gap |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        previous += gap;
+        out.push_back(previous);
+    }
+    return true;
+}
+
+//-------------------------------------------------------------------------------
+// ModelDeltaEncoder member functions
+//-------------------------------------------------------------------------------
+
+inline bool ModelDeltaEncoder::encode(const uint32_t* ids, std::size_t size,
+                                      std::vector<uint8_t>& added, std::vector<uint8_t>& removed)
+{
+    added.clear();
+    removed.clear();
+    added_.clear();
+    removed_.clear();
+
+    // Both lists are sorted, so one merge finds what changed
+    std::size_t i = 0, j = 0;
+    while (i < size || j < previous_.size())
+    {
+        if (j == previous_.size() || (i < size && ids[i] < previous_[j])) added_.push_back(ids[i++]);
+        else if (i == size || previous_[j] < ids[i]) removed_.push_back(previous_[j++]);
+        else { ++i; ++j; }
+    }
+
+    bool keyframe = !started_ || since_keyframe_ + 1 >= opts_.keyframe_interval ||
+        added_.size() + removed_.size() >= size;
+    if (keyframe)
+    {
+        encode_sorted_ids(ids, size, added);
+        since_keyframe_ = 0;
+        started_ = true;
+        ++stats_.keyframes;
+    }
+    else
+    {
+        encode_sorted_ids(added_.data(), added_.size(), added);
+        encode_sorted_ids(removed_.data(), removed_.size(), removed);
+        ++since_keyframe_;
+        ++stats_.deltas;
+    }
+    stats_.bytes += added.size() + removed.size();
+    previous_.assign(ids, ids + size);
+    return keyframe;
+}
+
+//-------------------------------------------------------------------------------
+// ModelDeltaDecoder member functions
+//-------------------------------------------------------------------------------
+
+inline bool ModelDeltaDecoder::apply(uint64_t number, uint64_t base, bool keyframe,
+                                     const uint8_t* added, std::size_t added_size,
+                                     const uint8_t* removed, std::size_t removed_size,
+                                     bsys::error_code& ec)
+{
+    if (keyframe)
+    {
+        pending_ = 0;
+        model_.clear();
+        synced_ = decode_sorted_ids(added, added_size, model_);
+    }
+    else
+    {
+        if (!synced_ || base != number_) { synced_ = false; return false; }
+        if (deltas_.size() == pending_) deltas_.emplace_back();
+        auto& delta = deltas_[pending_++];
+        delta.added.clear();
+        delta.removed.clear();
+        synced_ = decode_sorted_ids(added, added_size, delta.added) &&
+            decode_sorted_ids(removed, removed_size, delta.removed);
+    }
+    if (!synced_)
+    {
+        pending_ = 0;
+        model_.clear();
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return false;
+    }
+    number_ = number;
+    return true;
+}
+
+inline const std::vector<uint32_t>& ModelDeltaDecoder::model()
+{
+    for (std::size_t i = 0; i < pending_; ++i) _merge(deltas_[i]);
+    pending_ = 0;
+    return model_;
+}
+
+// The model without the removed IDs and with the added ones, in one pass
+inline void ModelDeltaDecoder::_merge(const _Delta& delta)
+{
+    scratch_.clear();
+    std::size_t i = 0, a = 0, r = 0;
+    while (i < model_.size() || a < delta.added.size())
+    {
+        if (a == delta.added.size() || (i < model_.size() && model_[i] < delta.added[a]))
+        {
+            while (r < delta.removed.size() && delta.removed[r] < model_[i]) ++r;
+            if (r == delta.removed.size() || delta.removed[r] != model_[i]) scratch_.push_back(model_[i]);
+            ++i;
+        }
+        else scratch_.push_back(delta.added[a++]);
+    }
+    model_.swap(scratch_);
+}
+
+}
+
+#endif // CLSERVER_MODEL_DELTA_HH
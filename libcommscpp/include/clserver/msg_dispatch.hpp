@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------------------
+// Compile-time dispatch of the messages in the ClingoServer::Msg union.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_MSG_DISPATCH_HH
+#define CLSERVER_MSG_DISPATCH_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <boost/asio.hpp>
+#include "worker_write_generated.h"
+#include "clserver/messages.hpp"
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// The union member types that a MsgDispatcher knows about. Each type's Msg value
+// is taken from the generated ClingoServer::MsgTraits, so adding a member to the
+// Msg union only needs the type added here.
+// -------------------------------------------------------------------------------
+
+template<typename... Ts> struct MsgTypeList { };
+
+using WorkerMsgTypes = MsgTypeList<ClingoServer::WorkerReadyMsg,
+                                   ClingoServer::ApplicationMsg,
+                                   ClingoServer::WorkerStoppedMsg,
+                                   ClingoServer::SnapshotReadyMsg,
+                                   ClingoServer::ModelMsg,
+                                   ClingoServer::SolveDoneMsg,
+                                   ClingoServer::SymbolDictMsg>;
+
+namespace detail
+{
+
+// The type in the list whose Msg value is E, or void if there is none
+template<unsigned E, typename List> struct MsgTypeFor { using type = void; };
+
+template<unsigned E, typename T, typename... Ts>
+struct MsgTypeFor<E, MsgTypeList<T, Ts...>>
+{
+    using type = typename std::conditional<
+        static_cast<unsigned>(ClingoServer::MsgTraits<T>::enum_value) == E, T,
+        typename MsgTypeFor<E, MsgTypeList<Ts...>>::type>::type;
+};
+
+// Overload ranking: prefer v(msg, message), then v(msg), then ignore
+template<int N> struct Rank : Rank<N - 1> { };
+template<> struct Rank<0> { };
+
+template<typename V, typename T>
+auto invoke_msg(V& v, const T& m, const ClingoServer::Message& message, Rank<2>)
+    -> decltype(v(m, message), void())
+{ v(m, message); }
+
+template<typename V, typename T>
+auto invoke_msg(V& v, const T& m, const ClingoServer::Message&, Rank<1>)
+    -> decltype(v(m), void())
+{ v(m); }
+
+template<typename V, typename T>
+void invoke_msg(V&, const T&, const ClingoServer::Message&, Rank<0>) { }
+
+template<typename V>
+auto invoke_error(V& v, const bsys::error_code& ec, Rank<1>) -> decltype(v(ec), void())
+{ v(ec); }
+
+template<typename V>
+void invoke_error(V&, const bsys::error_code&, Rank<0>) { }
+
+template<typename Visitor>
+using msg_fn_t = void (*)(Visitor&, const void*, const ClingoServer::Message&);
+
+template<typename Visitor, typename T>
+struct MsgEntry
+{
+    static void call(Visitor& v, const void* m, const ClingoServer::Message& message)
+    { invoke_msg(v, *static_cast<const T*>(m), message, Rank<2>{}); }
+};
+
+template<typename Visitor>
+struct MsgEntry<Visitor, void>
+{
+    static void call(Visitor&, const void*, const ClingoServer::Message&) { }
+};
+
+template<typename Visitor, typename List, typename Seq> struct MsgJumpTable;
+
+template<typename Visitor, typename List, std::size_t... I>
+struct MsgJumpTable<Visitor, List, std::index_sequence<I...>>
+{
+    static constexpr msg_fn_t<Visitor> fns[sizeof...(I)] = {
+        &MsgEntry<Visitor, typename MsgTypeFor<I, List>::type>::call... };
+};
+
+template<typename Visitor, typename List, std::size_t... I>
+constexpr msg_fn_t<Visitor>
+MsgJumpTable<Visitor, List, std::index_sequence<I...>>::fns[sizeof...(I)];
+
+}
+
+//-------------------------------------------------------------------------------
+// MsgDispatcher calls a visitor with the concrete type of each received message.
+// The visitor is any object with call operators for the types it cares about:
+//
+//     struct Visitor
+//     {
+//         void operator()(const ClingoServer::ApplicationMsg& m, const ClingoServer::Message& frame);
+//         void operator()(const ClingoServer::WorkerStoppedMsg& m);
+//         void operator()(const bsys::error_code& ec);
+//     };
+//
+// For each type the (msg, frame) form is preferred over the (msg) form, and
+// types without a matching operator are ignored, as are union values that the
+// type list does not know about. Batches are expanded. The jump table from Msg
+// value to handler is built at compile time so dispatch is a bounds check and
+// one indirect call.
+//
+// A dispatcher can be used as the handler of a DecodingReceiver with a
+// MessageDecoder, or as a Connection receive handler through receive_handler().
+// Receive errors and frames that fail verification are passed to the visitor's
+// error_code operator, if it has one.
+// -------------------------------------------------------------------------------
+
+template<typename Visitor, typename TypeList = WorkerMsgTypes>
+class MsgDispatcher
+{
+public:
+    // Visitor may be a reference type to dispatch to an existing object
+    explicit MsgDispatcher(Visitor v = Visitor{}) : visitor_(std::forward<Visitor>(v)) { }
+
+    Visitor& visitor() { return visitor_; }
+    const Visitor& visitor() const { return visitor_; }
+
+    // Dispatch a single union value carried by message
+    void dispatch(ClingoServer::Msg type, const void* msg,
+                  const ClingoServer::Message& message)
+    {
+        auto t = static_cast<std::size_t>(type);
+        if (!msg || t >= num_types) return;
+        table_t::fns[t](visitor_, msg, message);
+    }
+
+    // Dispatch every message of a frame
+    void operator()(const ClingoServer::Message& message)
+    {
+        for_each_msg(message, [this, &message](ClingoServer::Msg type, const void* msg)
+        {
+            dispatch(type, msg, message);
+        });
+    }
+
+    // DecodingReceiver handler for use with a MessageDecoder
+    void operator()(const bsys::error_code& ec, const uint8_t*, std::size_t,
+                    const ClingoServer::Message* const& message)
+    {
+        if (ec) { _error(ec); return; }
+        if (!message)
+        {
+            _error(bsys::errc::make_error_code(bsys::errc::bad_message));
+            return;
+        }
+        (*this)(*message);
+    }
+
+    // A handler for Connection::async_receive_message(sb, ...). It commits the
+    // received frame, verifies and dispatches it, then consumes it.
+    auto receive_handler(asio::streambuf& sb)
+    {
+        return [this, &sb](const bsys::error_code& ec, std::size_t s)
+        {
+            if (ec) { _error(ec); return; }
+            sb.commit(s);
+            auto data = static_cast<const uint8_t*>(sb.data().data());
+            (*this)(ec, data, s, MessageDecoder{}(data, s));
+            sb.consume(s);
+        };
+    }
+
+private:
+    static constexpr std::size_t num_types =
+        static_cast<std::size_t>(ClingoServer::Msg_MAX) + 1;
+    using table_t = detail::MsgJumpTable<Visitor, TypeList,
+                                         std::make_index_sequence<num_types>>;
+
+    void _error(const bsys::error_code& ec)
+    { detail::invoke_error(visitor_, ec, detail::Rank<1>{}); }
+
+    Visitor visitor_;
+};
+
+template<typename Visitor, typename TypeList>
+constexpr std::size_t MsgDispatcher<Visitor, TypeList>::num_types;
+
+template<typename Visitor>
+MsgDispatcher<typename std::decay<Visitor>::type> make_msg_dispatcher(Visitor&& v)
+{
+    return MsgDispatcher<typename std::decay<Visitor>::type>{std::forward<Visitor>(v)};
+}
+
+}
+
+#endif // CLSERVER_MSG_DISPATCH_HH
@@ -0,0 +1,165 @@
+//--------------------------------------------------------------------------------
+// Read-copy-update for data that is read far more often than it is changed.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_RCU_HH
+#define CLSERVER_RCU_HH
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// RcuDomain lets readers access shared data without locks while writers
+// publish a new version and wait until no reader can still see the old one.
+//
+// Readers register against one of two counters selected by the low bit of an
+// epoch. synchronize() advances the epoch, so new readers use the other
+// counter, then waits for the counter of the old epoch to drain. A reader costs
+// two atomic increments on a cache line shared only with other readers.
+//
+// Concurrent calls to synchronize() are serialised. It must not be called from
+// inside a read-side section of the same domain or it waits forever.
+// -------------------------------------------------------------------------------
+
+class RcuDomain
+{
+public:
+    class ReadGuard
+    {
+    public:
+        ReadGuard(ReadGuard&& o) : counter_{o.counter_} { o.counter_ = nullptr; }
+        ReadGuard(const ReadGuard&) = delete;
+        ~ReadGuard() { if (counter_) counter_->fetch_sub(1, std::memory_order_release); }
+
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+    private:
+        friend class RcuDomain;
+        explicit ReadGuard(std::atomic<std::size_t>* counter) : counter_{counter} { }
+
+        std::atomic<std::size_t>* counter_;
+    };
+
+    RcuDomain() : epoch_{0} { readers_[0].count_ = 0; readers_[1].count_ = 0; }
+
+    RcuDomain(RcuDomain&&) = delete;
+    RcuDomain(const RcuDomain&) = delete;
+
+    RcuDomain& operator=(const RcuDomain&) = delete;
+
+    // Enter a read-side section that lasts as long as the guard
+    ReadGuard read_lock() const;
+
+    // Wait until every read-side section that started before the call has ended
+    void synchronize();
+
+private:
+    struct alignas(64) _Counter { std::atomic<std::size_t> count_; };
+
+    mutable _Counter readers_[2];
+    alignas(64) std::atomic<std::size_t> epoch_;
+    std::mutex writer_;
+};
+
+//-------------------------------------------------------------------------------
+// RcuPtr holds the current version of an immutable T. Readers get a pointer
+// that stays valid while their guard is held; update() publishes a new version
+// and deletes the old one once no reader can be using it. Updates are
+// serialised internally.
+//
+//     auto guard = domain.read_lock();
+//     const T* snapshot = ptr.load();
+// -------------------------------------------------------------------------------
+
+template<typename T>
+class RcuPtr
+{
+public:
+    explicit RcuPtr(RcuDomain& domain, std::unique_ptr<T> initial = nullptr) :
+        domain_{domain}, ptr_{initial.release()} { }
+
+    RcuPtr(RcuPtr&&) = delete;
+    RcuPtr(const RcuPtr&) = delete;
+    ~RcuPtr() { delete ptr_.load(std::memory_order_relaxed); }
+
+    RcuPtr& operator=(const RcuPtr&) = delete;
+
+    // Only valid within a read-side section of the domain
+    const T* load() const { return ptr_.load(std::memory_order_acquire); }
+
+    // Publish a new version and return once the old one has been deleted
+    void update(std::unique_ptr<T> next);
+
+    // Build the next version from a copy of the current one
+    template<typename F> void modify(F&& f);
+
+private:
+    RcuDomain& domain_;
+    std::atomic<T*> ptr_;
+    std::mutex writer_;
+};
+
+//-------------------------------------------------------------------------------
+// RcuDomain member functions
+//-------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+// Increment the counter for the current epoch and check that the epoch did not
+// move in the meantime. If it did the writer may already have found the counter
+// empty, so back out and use the counter of the new epoch instead.
+// -----------------------------------------------------------------------------
+
+inline RcuDomain::ReadGuard RcuDomain::read_lock() const
+{
+    for (;;)
+    {
+        std::size_t e = epoch_.load(std::memory_order_seq_cst);
+        auto& counter = readers_[e & 1].count_;
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        if (epoch_.load(std::memory_order_seq_cst) == e) return ReadGuard{&counter};
+        counter.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+inline void RcuDomain::synchronize()
+{
+    std::lock_guard<std::mutex> lock{writer_};
+    std::size_t e = epoch_.load(std::memory_order_relaxed);
+    epoch_.store(e + 1, std::memory_order_seq_cst);
+    auto& counter = readers_[e & 1].count_;
+    while (counter.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+}
+
+//-------------------------------------------------------------------------------
+// RcuPtr member functions
+//-------------------------------------------------------------------------------
+
+template<typename T>
+void RcuPtr<T>::update(std::unique_ptr<T> next)
+{
+    std::lock_guard<std::mutex> lock{writer_};
+    std::unique_ptr<T> old{ptr_.exchange(next.release(), std::memory_order_seq_cst)};
+    domain_.synchronize();
+}
+
+template<typename T>
+template<typename F>
+void RcuPtr<T>::modify(F&& f)
+{
+    std::lock_guard<std::mutex> lock{writer_};
+    const T* current = ptr_.load(std::memory_order_relaxed);
+    std::unique_ptr<T> next{current ? new T(*current) : new T()};
+    f(*next);
+    std::unique_ptr<T> old{ptr_.exchange(next.release(), std::memory_order_seq_cst)};
+    domain_.synchronize();
+}
+
+}
+
+#endif // CLSERVER_RCU_HH
@@ -0,0 +1,460 @@
+//--------------------------------------------------------------------------------
+// Cache of completed job result streams keyed by the job's content.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_RESULT_CACHE_HH
+#define CLSERVER_RESULT_CACHE_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/sha256.hpp"
+#include "clserver/shared_frame.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace clserver
+{
+
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// How a job uses the result cache. Refresh runs the job and replaces the
+// cached result; Bypass runs it without reading or writing the cache.
+// -------------------------------------------------------------------------------
+
+enum class CachePolicy { Use, Refresh, Bypass };
+
+//-------------------------------------------------------------------------------
+// The parts of a job that determine its result. key() hashes a canonical form
+// of them: line endings and trailing blanks in the program are normalised,
+// facts are trimmed, sorted and deduplicated, and empty options are dropped.
+// Option order is kept as it can matter to clingo.
+// -------------------------------------------------------------------------------
+
+struct JobSpec
+{
+    std::string program;
+    std::vector<std::string> facts;
+    std::vector<std::string> options;
+    std::string solve_mode;
+
+    std::string key() const;
+};
+
+struct ResultCacheStats
+{
+    std::size_t hits = 0;          // Served from memory
+    std::size_t disk_hits = 0;     // Served from a spilled result
+    std::size_t misses = 0;
+    std::size_t bypassed = 0;      // Lookups skipped by Refresh or Bypass
+    std::size_t inserted = 0;
+    std::size_t evicted = 0;       // Dropped from memory for the budget
+    std::size_t spilled = 0;       // Written to disk when evicted
+    std::size_t invalidated = 0;
+};
+
+//-------------------------------------------------------------------------------
+// ResultCache keeps the frames of completed jobs so that a repeat of a job is
+// answered by replaying them, without a worker. Results are held as
+// SharedFrames, so a replay to any number of clients shares the buffers.
+//
+// Memory is an LRU bounded by max_bytes. If spill_dir is set, results evicted
+// from memory are written there, as length-prefixed frames, and read back on a
+// later hit; the spill directory is an LRU bounded by max_spill_bytes and is
+// picked up again when the cache is recreated. Results older than max_age, if
+// it is not zero, are treated as missing.
+//
+// Only complete result streams should be inserted. ResultCache is used from a
+// single executor.
+// -------------------------------------------------------------------------------
+
+class ResultCache
+{
+public:
+    using frames_t = std::vector<SharedFrame>;
+    using result_t = std::shared_ptr<const frames_t>;
+    using clock_type = std::chrono::system_clock;
+
+    struct Options
+    {
+        std::size_t max_bytes = 256 * 1024 * 1024;
+        std::string spill_dir;
+        std::size_t max_spill_bytes = std::size_t{4} * 1024 * 1024 * 1024;
+        std::chrono::seconds max_age{0};
+    };
+
+    explicit ResultCache(Options opts);
+
+    ResultCache(ResultCache&&) = delete;
+    ResultCache(const ResultCache&) = delete;
+
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // The cached result for a job, or nullptr if there is none or the policy
+    // does not read the cache
+    result_t lookup(const std::string& key, CachePolicy policy = CachePolicy::Use,
+                    clock_type::time_point now = clock_type::now());
+
+    // Store the complete result of a job unless the policy is Bypass
+    void insert(const std::string& key, frames_t frames,
+                CachePolicy policy = CachePolicy::Use,
+                clock_type::time_point now = clock_type::now());
+
+    // Drop a result from memory and disk. Returns false if there was none.
+    bool invalidate(const std::string& key);
+
+    // Drop every result
+    void clear();
+
+    std::size_t size() const { return index_.size(); }
+    std::size_t bytes() const { return bytes_; }
+    std::size_t spill_bytes() const { return spill_bytes_; }
+    const ResultCacheStats& stats() const { return stats_; }
+
+private:
+    struct _Entry
+    {
+        std::string key_;
+        result_t frames_;
+        std::size_t bytes_;
+        clock_type::time_point created_;
+    };
+
+    struct _Spilled
+    {
+        std::string key_;
+        std::size_t bytes_;
+        clock_type::time_point created_;
+    };
+
+    // Most recently used first
+    using _Lru = std::list<_Entry>;
+    using _SpillLru = std::list<_Spilled>;
+
+    bool _expired(clock_type::time_point created, clock_type::time_point now) const
+    { return opts_.max_age.count() && now - created > opts_.max_age; }
+
+    bool _erase(const std::string& key);
+    void _add(const std::string& key, result_t frames, std::size_t bytes,
+              clock_type::time_point created);
+    void _evict();
+
+    void _scan_spill_dir();
+    void _spill(const _Entry& e);
+    result_t _unspill(const std::string& key, clock_type::time_point now);
+    bool _drop_spilled(const std::string& key);
+    std::string _spill_path(const std::string& key) const
+    { return opts_.spill_dir + "/" + key + ".res"; }
+
+    static std::size_t _size(const frames_t& frames);
+
+    Options opts_;
+    _Lru lru_;
+    std::unordered_map<std::string, _Lru::iterator> index_;
+    std::size_t bytes_;
+
+    _SpillLru spilled_;
+    std::unordered_map<std::string, _SpillLru::iterator> spill_index_;
+    std::size_t spill_bytes_;
+
+    ResultCacheStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// JobSpec member functions
+//-------------------------------------------------------------------------------
+
+inline std::string JobSpec::key() const
+{
+    auto trim = [](const std::string& s)
+    {
+        auto b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string::npos) return std::string{};
+        return s.substr(b, s.find_last_not_of(" \t\r\n") - b + 1);
+    };
+
+    // Normalise the program line by line
+    std::string canonical;
+    canonical.reserve(program.size());
+    std::size_t start = 0;
+    while (start <= program.size())
+    {
+        auto end = program.find('\n', start);
+        if (end == std::string::npos) end = program.size();
+        auto line = program.substr(start, end - start);
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        canonical += line;
+        canonical += '\n';
+        start = end + 1;
+    }
+    canonical.erase(canonical.find_last_not_of('\n') + 1);
+
+    std::vector<std::string> sorted;
+    for (const auto& f : facts)
+    {
+        auto t = trim(f);
+        if (!t.empty()) sorted.push_back(std::move(t));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    Sha256 h;
+    h.add_field(canonical);
+    h.add_field(std::to_string(sorted.size()));
+    for (const auto& f : sorted) h.add_field(f);
+    for (const auto& o : options)
+    {
+        auto t = trim(o);
+        if (!t.empty()) h.add_field(t);
+    }
+    h.add_field(std::string{"\0mode", 5});
+    h.add_field(solve_mode);
+    return Sha256::hex(h.finish());
+}
+
+//-------------------------------------------------------------------------------
+// ResultCache public member functions
+//-------------------------------------------------------------------------------
+
+inline ResultCache::ResultCache(Options opts) :
+    opts_{std::move(opts)}, bytes_{0}, spill_bytes_{0}
+{
+    if (!opts_.spill_dir.empty()) _scan_spill_dir();
+}
+
+inline ResultCache::result_t ResultCache::lookup(const std::string& key, CachePolicy policy,
+                                                 clock_type::time_point now)
+{
+    if (policy != CachePolicy::Use)
+    {
+        ++stats_.bypassed;
+        return nullptr;
+    }
+
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+        if (_expired(it->second->created_, now))
+        {
+            _erase(key);
+            ++stats_.misses;
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++stats_.hits;
+        return it->second->frames_;
+    }
+
+    auto frames = _unspill(key, now);
+    if (!frames) ++stats_.misses;
+    return frames;
+}
+
+inline void ResultCache::insert(const std::string& key, frames_t frames, CachePolicy policy,
+                                clock_type::time_point now)
+{
+    if (policy == CachePolicy::Bypass) return;
+    _erase(key);
+
+    auto bytes = _size(frames);
+    _add(key, std::make_shared<const frames_t>(std::move(frames)), bytes, now);
+    ++stats_.inserted;
+}
+
+inline bool ResultCache::invalidate(const std::string& key)
+{
+    if (!_erase(key)) return false;
+    ++stats_.invalidated;
+    return true;
+}
+
+inline void ResultCache::clear()
+{
+    // The keys are copied, as erasing an entry frees its own
+    while (!lru_.empty()) invalidate(std::string{lru_.back().key_});
+    while (!spilled_.empty()) invalidate(std::string{spilled_.back().key_});
+}
+
+//-------------------------------------------------------------------------------
+// ResultCache internal member functions
+//-------------------------------------------------------------------------------
+
+inline bool ResultCache::_erase(const std::string& key)
+{
+    bool found = _drop_spilled(key);
+    auto it = index_.find(key);
+    if (it != index_.end())
+    {
+        bytes_ -= it->second->bytes_;
+        lru_.erase(it->second);
+        index_.erase(it);
+        found = true;
+    }
+    return found;
+}
+
+inline void ResultCache::_add(const std::string& key, result_t frames, std::size_t bytes,
+                              clock_type::time_point created)
+{
+    lru_.push_front(_Entry{key, std::move(frames), bytes, created});
+    index_.emplace(key, lru_.begin());
+    bytes_ += bytes;
+    _evict();
+}
+
+// Results are spilled as they leave memory, unless they are too big for the
+// spill directory as well
+inline void ResultCache::_evict()
+{
+    while (bytes_ > opts_.max_bytes && !lru_.empty())
+    {
+        auto& victim = lru_.back();
+        if (!opts_.spill_dir.empty() && victim.bytes_ <= opts_.max_spill_bytes) _spill(victim);
+        bytes_ -= victim.bytes_;
+        index_.erase(victim.key_);
+        lru_.pop_back();
+        ++stats_.evicted;
+    }
+}
+
+inline void ResultCache::_scan_spill_dir()
+{
+    DIR* d = ::opendir(opts_.spill_dir.c_str());
+    if (!d) return;
+
+    std::vector<_Spilled> found;
+    while (auto entry = ::readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.size() != 64 + 4 || name.compare(64, 4, ".res") != 0) continue;
+        struct stat st;
+        if (::stat((opts_.spill_dir + "/" + name).c_str(), &st) != 0) continue;
+        found.push_back(_Spilled{name.substr(0, 64), static_cast<std::size_t>(st.st_size),
+                                 clock_type::from_time_t(st.st_mtime)});
+    }
+    ::closedir(d);
+
+    // Newest first, as if most recently used
+    std::sort(found.begin(), found.end(), [](const _Spilled& a, const _Spilled& b)
+              { return a.created_ > b.created_; });
+    for (auto& s : found)
+    {
+        spill_bytes_ += s.bytes_;
+        spilled_.push_back(std::move(s));
+        spill_index_.emplace(spilled_.back().key_, std::prev(spilled_.end()));
+    }
+}
+
+inline void ResultCache::_spill(const _Entry& e)
+{
+    _drop_spilled(e.key_);
+    auto path = _spill_path(e.key_);
+    auto tmp = path + ".tmp";
+    auto f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return;
+
+    bool ok = true;
+    std::size_t size = 0;
+    for (const auto& frame : *e.frames_)
+    {
+        uint8_t len[4] = {static_cast<uint8_t>(frame.size() >> 24),
+                          static_cast<uint8_t>(frame.size() >> 16),
+                          static_cast<uint8_t>(frame.size() >> 8),
+                          static_cast<uint8_t>(frame.size())};
+        ok = ok && std::fwrite(len, 1, 4, f) == 4 &&
+             std::fwrite(frame.data(), 1, frame.size(), f) == frame.size();
+        size += 4 + frame.size();
+    }
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return;
+    }
+
+    spilled_.push_front(_Spilled{e.key_, size, e.created_});
+    spill_index_.emplace(e.key_, spilled_.begin());
+    spill_bytes_ += size;
+    ++stats_.spilled;
+    while (spill_bytes_ > opts_.max_spill_bytes && spilled_.size() > 1)
+        _drop_spilled(spilled_.back().key_);
+}
+
+//------------------------------------------------------------------------------
+// Read a spilled result back into memory. A file that can't be read is
+// dropped.
+// -----------------------------------------------------------------------------
+
+inline ResultCache::result_t ResultCache::_unspill(const std::string& key,
+                                                   clock_type::time_point now)
+{
+    auto it = spill_index_.find(key);
+    if (it == spill_index_.end()) return nullptr;
+    auto created = it->second->created_;
+    if (_expired(created, now))
+    {
+        _drop_spilled(key);
+        return nullptr;
+    }
+
+    auto f = std::fopen(_spill_path(key).c_str(), "rb");
+    if (!f)
+    {
+        _drop_spilled(key);
+        return nullptr;
+    }
+
+    frames_t frames;
+    bool ok = true;
+    uint8_t len[4];
+    while (ok && std::fread(len, 1, 4, f) == 4)
+    {
+        std::size_t size = (std::size_t(len[0]) << 24) | (std::size_t(len[1]) << 16) |
+                           (std::size_t(len[2]) << 8) | std::size_t(len[3]);
+        auto p = new uint8_t[size ? size : 1];
+        ok = std::fread(p, 1, size, f) == size;
+        frames.emplace_back(fbs::DetachedBuffer{nullptr, false, p, size, p, size});
+    }
+    ok = ok && std::feof(f);
+    std::fclose(f);
+    _drop_spilled(key);
+    if (!ok) return nullptr;
+
+    auto bytes = _size(frames);
+    auto result = std::make_shared<const frames_t>(std::move(frames));
+    _add(key, result, bytes, created);
+    ++stats_.disk_hits;
+    return result;
+}
+
+inline bool ResultCache::_drop_spilled(const std::string& key)
+{
+    auto it = spill_index_.find(key);
+    if (it == spill_index_.end()) return false;
+    std::remove(_spill_path(key).c_str());
+    spill_bytes_ -= it->second->bytes_;
+    spilled_.erase(it->second);
+    spill_index_.erase(it);
+    return true;
+}
+
+inline std::size_t ResultCache::_size(const frames_t& frames)
+{
+    std::size_t bytes = 0;
+    for (const auto& f : frames) bytes += f.size();
+    return bytes;
+}
+
+}
+
+#endif // CLSERVER_RESULT_CACHE_HH
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------
+// Growable FIFO queue that reuses its storage.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_RING_QUEUE_HH
+#define CLSERVER_RING_QUEUE_HH
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// RingQueue is a single-threaded circular buffer used in place of std::deque for
+// the Connection request queues. A std::deque allocates and frees a block every
+// few hundred push/pop pairs even when its size stays constant. RingQueue only
+// allocates when it has to grow beyond its largest size so far.
+// -------------------------------------------------------------------------------
+
+template<typename T>
+class RingQueue
+{
+public:
+    explicit RingQueue(std::size_t capacity = 16);
+
+    RingQueue(RingQueue&&) = delete;
+    RingQueue(const RingQueue&) = delete;
+    ~RingQueue();
+
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    template<typename... Args> void emplace_back(Args&&... args);
+
+    T& front() { return *_slot(head_); }
+    const T& front() const { return *_slot(head_); }
+    T& back() { return *_slot(head_ + size_ - 1); }
+    void pop_front();
+    void pop_back();
+
+    // Element access relative to the front of the queue
+    T& operator[](std::size_t i) { return *_slot(head_ + i); }
+    const T& operator[](std::size_t i) const { return *_slot(head_ + i); }
+
+    bool empty() const { return size_ == 0; }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    using storage_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    T* _slot(std::size_t i) const
+    { return reinterpret_cast<T*>(&slots_[i & mask_]); }
+    void _grow();
+
+    std::size_t mask_;
+    std::unique_ptr<storage_t[]> slots_;
+    std::size_t head_;
+    std::size_t size_;
+};
+
+//-------------------------------------------------------------------------------
+// RingQueue member functions
+//-------------------------------------------------------------------------------
+
+template<typename T>
+RingQueue<T>::RingQueue(std::size_t capacity) : head_{0}, size_{0}
+{
+    std::size_t c = 1;
+    while (c < capacity) c <<= 1;
+    mask_ = c - 1;
+    slots_.reset(new storage_t[c]);
+}
+
+template<typename T>
+RingQueue<T>::~RingQueue()
+{
+    while (!empty()) pop_front();
+}
+
+template<typename T>
+template<typename... Args>
+void RingQueue<T>::emplace_back(Args&&... args)
+{
+    if (size_ > mask_) _grow();
+    new (_slot(head_ + size_)) T(std::forward<Args>(args)...);
+    ++size_;
+}
+
+template<typename T>
+void RingQueue<T>::pop_front()
+{
+    _slot(head_)->~T();
+    head_ = (head_ + 1) & mask_;
+    --size_;
+}
+
+template<typename T>
+void RingQueue<T>::pop_back()
+{
+    _slot(head_ + size_ - 1)->~T();
+    --size_;
+}
+
+template<typename T>
+void RingQueue<T>::_grow()
+{
+    std::size_t capacity = (mask_ + 1) * 2;
+    std::unique_ptr<storage_t[]> slots{new storage_t[capacity]};
+    for (std::size_t i = 0; i < size_; ++i)
+    {
+        T* src = _slot(head_ + i);
+        new (&slots[i]) T(std::move(*src));
+        src->~T();
+    }
+    slots_ = std::move(slots);
+    mask_ = capacity - 1;
+    head_ = 0;
+}
+
+}
+
+#endif // CLSERVER_RING_QUEUE_HH
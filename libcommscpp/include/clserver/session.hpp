@@ -0,0 +1,657 @@
+//--------------------------------------------------------------------------------
+// Resumable sessions over a Connection.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SESSION_HH
+#define CLSERVER_SESSION_HH
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/connection.hpp"
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// The frames that a Session sends over its Connection. All integers are
+// big-endian.
+//
+//   Hello: type, token (8), count (4), count x [channel (4), last received (8)]
+//   Data:  type, channel (4), seq (8), body
+//   Ack:   type, channel (4), seq (8)
+// -------------------------------------------------------------------------------
+
+enum class SessionFrameType : uint8_t { Hello = 1, Data = 2, Ack = 3 };
+
+namespace detail
+{
+
+template<typename T>
+inline void put_be(uint8_t* p, T v)
+{
+    for (std::size_t i = sizeof(T); i > 0; --i) { p[i - 1] = static_cast<uint8_t>(v); v >>= 8; }
+}
+
+template<typename T>
+inline T get_be(const uint8_t* p)
+{
+    T v = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) v = static_cast<T>((v << 8) | p[i]);
+    return v;
+}
+
+constexpr std::size_t session_header_size = 13;
+
+// The connection latest channel that session acks are conflated on
+constexpr uint32_t session_ack_channel = 0xffffffff;
+
+}
+
+template<typename Stream> class SessionManager;
+
+//-------------------------------------------------------------------------------
+// A Session carries numbered frames on any number of channels and survives the
+// loss of its Connection. Every frame sent gets the next sequence number of its
+// channel and is kept until the peer acknowledges it. The receiver acks
+// cumulatively, every ack_every frames of a channel and on flush_acks(), and
+// acks are sent with async_send_latest() so at most one per channel is queued.
+//
+// When a Connection drops, the session is detached and sending carries on into
+// the retransmit queue. Attaching a new Connection starts with an exchange of
+// Hello frames holding the session token and the last sequence number received
+// on each channel. Each side then discards what the other already has and
+// retransmits only the unacked tail. Frames that arrive twice, because an ack
+// was lost with the old connection, are discarded.
+//
+// The client side calls connect() on each new Connection; the server side is
+// handed its sessions by a SessionManager. If the server no longer knows the
+// token a new session is started: the client's state is reset and the connect
+// handler is told that the session was not resumed.
+//
+// A Session is used from a single executor and must outlive the Connections it
+// is attached to. It may be destroyed while operations it started on a
+// Connection it has left are still outstanding: their handlers find that the
+// session has gone and do nothing.
+// -------------------------------------------------------------------------------
+
+template<typename Stream>
+class Session
+{
+public:
+    using token_t = uint64_t;
+    using receive_handler_t = std::function<void(uint32_t channel, uint64_t seq,
+                                                 asio::const_buffer body)>;
+    using detach_handler_t = std::function<void(const bsys::error_code&)>;
+
+    struct Options
+    {
+        std::size_t max_unacked_bytes = 64 * 1024 * 1024;
+        std::size_t ack_every = 16;
+    };
+
+    Session() : Session{Options{}} { }
+    explicit Session(Options opts);
+
+    Session(Session&&) = delete;
+    Session(const Session&) = delete;
+    ~Session() { detach(); }
+
+    Session& operator=(const Session&) = delete;
+
+    // Called for each new frame received, in sequence order per channel
+    void on_receive(receive_handler_t h) { receive_handler_ = std::move(h); }
+
+    // Called when the Connection fails and the session is detached
+    void on_detach(detach_handler_t h) { detach_handler_ = std::move(h); }
+
+    // Client side: attach to a Connection and resume the session. The handler
+    // is called as h(ec, resumed) once the server has replied.
+    template<typename Handler>
+    void connect(Connection<Stream>& conn, Handler h);
+
+    // Send a frame on a channel and return its sequence number. The body is
+    // copied. Fails with no_buffer_space if too much is waiting for an ack.
+    uint64_t send(uint32_t channel, asio::const_buffer body, bsys::error_code& ec);
+
+    // Acknowledge everything received so far
+    void flush_acks();
+
+    // Stop using the current Connection. Unacked frames are kept.
+    void detach();
+
+    token_t token() const { return token_; }
+    bool attached() const { return link_ && link_->ready_; }
+
+    // Number and size of frames sent but not yet acknowledged
+    std::size_t unacked() const;
+    std::size_t unacked_bytes() const { return unacked_bytes_; }
+
+    uint64_t last_received(uint32_t channel) const;
+    uint64_t last_acked(uint32_t channel) const;
+
+    // Number of frames sent again after a resume
+    std::size_t retransmitted() const { return retransmitted_; }
+
+    // When the session was last detached, for expiry by a SessionManager
+    std::chrono::steady_clock::time_point detached_at() const { return detached_at_; }
+
+private:
+    friend class SessionManager<Stream>;
+
+    //---------------------------------------------------------------------------
+    // Inner classes
+    //---------------------------------------------------------------------------
+
+    using _Frame = std::shared_ptr<const std::vector<uint8_t>>;
+
+    struct _Channel
+    {
+        uint64_t next_seq_ = 1;
+        uint64_t acked_ = 0;
+        uint64_t received_ = 0;
+        std::size_t since_ack_ = 0;
+        std::deque<std::pair<uint64_t, _Frame>> unacked_;
+    };
+
+    // One attachment to a Connection. Handlers hold on to it, and check its
+    // session before touching it: the session is cleared when the session
+    // leaves the connection or is destroyed, so those of a connection it has
+    // left can tell and do nothing.
+    struct _Link
+    {
+        Session* session_;
+        Connection<Stream>* conn_;
+        asio::streambuf sb_;
+        bool ready_;
+
+        _Link(Session& session, Connection<Stream>& conn) :
+            session_{&session}, conn_{&conn}, ready_{false} { }
+    };
+    using _LinkPtr = std::shared_ptr<_Link>;
+
+    //---------------------------------------------------------------------------
+    // Internal member functions
+    //---------------------------------------------------------------------------
+
+    _Frame _hello() const;
+    static bool _parse_hello(asio::const_buffer buf, token_t& token,
+                             std::vector<std::pair<uint32_t, uint64_t>>& received);
+
+    // Apply the peer's Hello and start using the link
+    void _resume(const _LinkPtr& link,
+                 const std::vector<std::pair<uint32_t, uint64_t>>& peer_received);
+    void _reset(token_t token);
+
+    void _write(const _LinkPtr& link, const _Frame& frame);
+    void _send_ack(uint32_t channel, _Channel& ch);
+    void _on_ack(uint32_t channel, uint64_t seq);
+
+    void _receive(const _LinkPtr& link);
+    void _on_receive(const _LinkPtr& link, const bsys::error_code& ec, std::size_t s);
+    void _detach(const _LinkPtr& link, const bsys::error_code& ec);
+
+    static token_t _new_token();
+
+    //---------------------------------------------------------------------------
+    // Internal member variables
+    //---------------------------------------------------------------------------
+    Options opts_;
+    token_t token_;
+    std::map<uint32_t, _Channel> channels_;
+    std::size_t unacked_bytes_;
+    std::size_t retransmitted_;
+    _LinkPtr link_;
+    receive_handler_t receive_handler_;
+    detach_handler_t detach_handler_;
+    std::chrono::steady_clock::time_point detached_at_;
+};
+
+//-------------------------------------------------------------------------------
+// SessionManager is the server side registry of sessions by token. accept()
+// reads the client's Hello from a new Connection and resumes the matching
+// session, or starts a new one. A session whose client has not come back
+// within a time limit can be dropped with expire().
+// -------------------------------------------------------------------------------
+
+template<typename Stream>
+class SessionManager
+{
+public:
+    using session_t = Session<Stream>;
+    using token_t = typename session_t::token_t;
+
+    SessionManager() : SessionManager{typename session_t::Options{}} { }
+    explicit SessionManager(typename session_t::Options opts) : opts_{opts} { }
+
+    SessionManager(SessionManager&&) = delete;
+    SessionManager(const SessionManager&) = delete;
+
+    SessionManager& operator=(const SessionManager&) = delete;
+
+    // Read the Hello from a new Connection and call h(ec, session, resumed).
+    // The handler of a new session should set its receive handler; no frames
+    // are delivered before the handler returns.
+    template<typename Handler>
+    void accept(Connection<Stream>& conn, Handler h);
+
+    session_t* find(token_t token) const;
+    bool remove(token_t token) { return sessions_.erase(token) != 0; }
+
+    // Remove the sessions that have been detached for longer than max_idle
+    std::size_t expire(std::chrono::steady_clock::duration max_idle,
+                       std::chrono::steady_clock::time_point now =
+                       std::chrono::steady_clock::now());
+
+    std::size_t size() const { return sessions_.size(); }
+
+private:
+    typename session_t::Options opts_;
+    std::unordered_map<token_t, std::unique_ptr<session_t>> sessions_;
+};
+
+//-------------------------------------------------------------------------------
+// Session public member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream>
+Session<Stream>::Session(Options opts) :
+    opts_{opts}, token_{0}, unacked_bytes_{0}, retransmitted_{0},
+    detached_at_{std::chrono::steady_clock::now()}
+{ }
+
+//------------------------------------------------------------------------------
+// Send the Hello and wait for the server's reply before sending anything else,
+// since a reply with a different token means the old session is gone.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+template<typename Handler>
+void Session<Stream>::connect(Connection<Stream>& conn, Handler h)
+{
+    detach();
+    auto link = std::make_shared<_Link>(*this, conn);
+    link_ = link;
+    _write(link, _hello());
+    conn.async_receive_message(link->sb_,
+        [this, link, h](const bsys::error_code& ec, std::size_t s) mutable
+        {
+            if (!link->session_) { h(asio::error::operation_aborted, false); return; }
+            if (ec) { _detach(link, ec); h(ec, false); return; }
+
+            link->sb_.commit(s);
+            token_t token;
+            std::vector<std::pair<uint32_t, uint64_t>> received;
+            if (!_parse_hello(link->sb_.data(), token, received))
+            {
+                auto bad = bsys::errc::make_error_code(bsys::errc::bad_message);
+                _detach(link, bad);
+                h(bad, false);
+                return;
+            }
+            link->sb_.consume(s);
+
+            bool resumed = token_ != 0 && token == token_;
+            if (!resumed)
+            {
+                _reset(token);
+                received.clear();
+            }
+            _resume(link, received);
+            h(bsys::error_code{}, resumed);
+            if (link->session_) _receive(link);
+        });
+}
+
+template<typename Stream>
+uint64_t Session<Stream>::send(uint32_t channel, asio::const_buffer body,
+                               bsys::error_code& ec)
+{
+    if (unacked_bytes_ + body.size() > opts_.max_unacked_bytes)
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::no_buffer_space);
+        return 0;
+    }
+
+    auto& ch = channels_[channel];
+    auto seq = ch.next_seq_++;
+    auto frame = std::make_shared<std::vector<uint8_t>>(detail::session_header_size +
+                                                        body.size());
+    auto p = frame->data();
+    p[0] = static_cast<uint8_t>(SessionFrameType::Data);
+    detail::put_be<uint32_t>(p + 1, channel);
+    detail::put_be<uint64_t>(p + 5, seq);
+    if (body.size()) std::memcpy(p + detail::session_header_size, body.data(), body.size());
+
+    ch.unacked_.emplace_back(seq, frame);
+    unacked_bytes_ += body.size();
+    if (attached()) _write(link_, frame);
+    return seq;
+}
+
+template<typename Stream>
+void Session<Stream>::flush_acks()
+{
+    if (!attached()) return;
+    for (auto& kv : channels_)
+        if (kv.second.since_ack_) _send_ack(kv.first, kv.second);
+}
+
+template<typename Stream>
+void Session<Stream>::detach()
+{
+    if (!link_) return;
+    link_->session_ = nullptr;
+    link_.reset();
+    detached_at_ = std::chrono::steady_clock::now();
+}
+
+template<typename Stream>
+std::size_t Session<Stream>::unacked() const
+{
+    std::size_t count = 0;
+    for (const auto& kv : channels_) count += kv.second.unacked_.size();
+    return count;
+}
+
+template<typename Stream>
+uint64_t Session<Stream>::last_received(uint32_t channel) const
+{
+    auto it = channels_.find(channel);
+    return it == channels_.end() ? 0 : it->second.received_;
+}
+
+template<typename Stream>
+uint64_t Session<Stream>::last_acked(uint32_t channel) const
+{
+    auto it = channels_.find(channel);
+    return it == channels_.end() ? 0 : it->second.acked_;
+}
+
+//-------------------------------------------------------------------------------
+// Session internal member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream>
+typename Session<Stream>::_Frame Session<Stream>::_hello() const
+{
+    auto frame = std::make_shared<std::vector<uint8_t>>(13 + 12 * channels_.size());
+    auto p = frame->data();
+    p[0] = static_cast<uint8_t>(SessionFrameType::Hello);
+    detail::put_be<uint64_t>(p + 1, token_);
+    detail::put_be<uint32_t>(p + 9, static_cast<uint32_t>(channels_.size()));
+    p += 13;
+    for (const auto& kv : channels_)
+    {
+        detail::put_be<uint32_t>(p, kv.first);
+        detail::put_be<uint64_t>(p + 4, kv.second.received_);
+        p += 12;
+    }
+    return frame;
+}
+
+template<typename Stream>
+bool Session<Stream>::_parse_hello(asio::const_buffer buf, token_t& token,
+                                   std::vector<std::pair<uint32_t, uint64_t>>& received)
+{
+    auto p = static_cast<const uint8_t*>(buf.data());
+    if (buf.size() < 13 || p[0] != static_cast<uint8_t>(SessionFrameType::Hello))
+        return false;
+    token = detail::get_be<uint64_t>(p + 1);
+    auto count = detail::get_be<uint32_t>(p + 9);
+    if (buf.size() != 13 + 12 * static_cast<std::size_t>(count)) return false;
+    p += 13;
+    received.clear();
+    for (uint32_t i = 0; i < count; ++i, p += 12)
+        received.emplace_back(detail::get_be<uint32_t>(p), detail::get_be<uint64_t>(p + 4));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// What the peer has received counts as acked. Everything after it is sent
+// again, channel by channel, ahead of any new frames.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+void Session<Stream>::_resume(const _LinkPtr& link,
+                              const std::vector<std::pair<uint32_t, uint64_t>>& peer_received)
+{
+    for (const auto& r : peer_received) _on_ack(r.first, r.second);
+
+    link->ready_ = true;
+    for (auto& kv : channels_)
+    {
+        kv.second.since_ack_ = 0;
+        for (const auto& u : kv.second.unacked_)
+        {
+            _write(link, u.second);
+            ++retransmitted_;
+        }
+    }
+}
+
+template<typename Stream>
+void Session<Stream>::_reset(token_t token)
+{
+    token_ = token;
+    channels_.clear();
+    unacked_bytes_ = 0;
+}
+
+template<typename Stream>
+void Session<Stream>::_write(const _LinkPtr& link, const _Frame& frame)
+{
+    link->conn_->async_send_message(asio::buffer(*frame),
+        [link, frame](const bsys::error_code& ec, std::size_t)
+        {
+            if (ec && link->session_) link->session_->_detach(link, ec);
+        });
+}
+
+template<typename Stream>
+void Session<Stream>::_send_ack(uint32_t channel, _Channel& ch)
+{
+    ch.since_ack_ = 0;
+    auto frame = std::make_shared<std::array<uint8_t, detail::session_header_size>>();
+    auto p = frame->data();
+    p[0] = static_cast<uint8_t>(SessionFrameType::Ack);
+    detail::put_be<uint32_t>(p + 1, channel);
+    detail::put_be<uint64_t>(p + 5, ch.received_);
+
+    auto link = link_;
+    link->conn_->async_send_latest(detail::session_ack_channel, channel, asio::buffer(*frame),
+        [link, frame](const bsys::error_code& ec, std::size_t)
+        {
+            if (ec && ec != asio::error::operation_aborted && link->session_)
+                link->session_->_detach(link, ec);
+        });
+}
+
+template<typename Stream>
+void Session<Stream>::_on_ack(uint32_t channel, uint64_t seq)
+{
+    auto it = channels_.find(channel);
+    if (it == channels_.end()) return;
+    auto& ch = it->second;
+    while (!ch.unacked_.empty() && ch.unacked_.front().first <= seq)
+    {
+        unacked_bytes_ -= ch.unacked_.front().second->size() - detail::session_header_size;
+        ch.unacked_.pop_front();
+    }
+    if (seq > ch.acked_) ch.acked_ = seq;
+}
+
+template<typename Stream>
+void Session<Stream>::_receive(const _LinkPtr& link)
+{
+    link->conn_->async_receive_message(link->sb_,
+        [link](const bsys::error_code& ec, std::size_t s)
+        {
+            if (link->session_) link->session_->_on_receive(link, ec, s);
+        });
+}
+
+//------------------------------------------------------------------------------
+// Handle a Data or Ack frame. A Data frame must be the next in its channel or
+// one that was received before; a gap means the peer has lost track.
+// -----------------------------------------------------------------------------
+
+template<typename Stream>
+void Session<Stream>::_on_receive(const _LinkPtr& link, const bsys::error_code& ec,
+                                  std::size_t s)
+{
+    if (link != link_) return;
+    if (ec) { _detach(link, ec); return; }
+
+    link->sb_.commit(s);
+    auto p = static_cast<const uint8_t*>(link->sb_.data().data());
+    auto type = s ? static_cast<SessionFrameType>(p[0]) : SessionFrameType::Hello;
+    if (s < detail::session_header_size ||
+        (type != SessionFrameType::Data && type != SessionFrameType::Ack))
+    {
+        link->sb_.consume(s);
+        _detach(link, bsys::errc::make_error_code(bsys::errc::bad_message));
+        return;
+    }
+
+    auto channel = detail::get_be<uint32_t>(p + 1);
+    auto seq = detail::get_be<uint64_t>(p + 5);
+    if (type == SessionFrameType::Ack)
+    {
+        _on_ack(channel, seq);
+    }
+    else
+    {
+        auto& ch = channels_[channel];
+        if (seq > ch.received_ + 1)
+        {
+            link->sb_.consume(s);
+            _detach(link, bsys::errc::make_error_code(bsys::errc::bad_message));
+            return;
+        }
+        if (seq == ch.received_ + 1)
+        {
+            ch.received_ = seq;
+            if (receive_handler_)
+                receive_handler_(channel, seq,
+                                 asio::const_buffer{p + detail::session_header_size,
+                                                    s - detail::session_header_size});
+            // The handler may have detached or even destroyed the session
+            if (!link->session_)
+            {
+                link->sb_.consume(s);
+                return;
+            }
+            if (++ch.since_ack_ >= opts_.ack_every) _send_ack(channel, ch);
+        }
+    }
+    link->sb_.consume(s);
+    _receive(link);
+}
+
+template<typename Stream>
+void Session<Stream>::_detach(const _LinkPtr& link, const bsys::error_code& ec)
+{
+    if (link != link_) return;
+    detach();
+    if (detach_handler_) detach_handler_(ec);
+}
+
+template<typename Stream>
+typename Session<Stream>::token_t Session<Stream>::_new_token()
+{
+    static thread_local std::mt19937_64 gen{std::random_device{}()};
+    token_t token;
+    do { token = gen(); } while (token == 0);
+    return token;
+}
+
+//-------------------------------------------------------------------------------
+// SessionManager member functions
+//-------------------------------------------------------------------------------
+
+template<typename Stream>
+template<typename Handler>
+void SessionManager<Stream>::accept(Connection<Stream>& conn, Handler h)
+{
+    auto sb = std::make_shared<asio::streambuf>();
+    conn.async_receive_message(*sb,
+        [this, &conn, sb, h](const bsys::error_code& ec, std::size_t s) mutable
+        {
+            if (ec) { h(ec, nullptr, false); return; }
+
+            sb->commit(s);
+            token_t token;
+            std::vector<std::pair<uint32_t, uint64_t>> received;
+            if (!session_t::_parse_hello(sb->data(), token, received))
+            {
+                h(bsys::errc::make_error_code(bsys::errc::bad_message), nullptr, false);
+                return;
+            }
+
+            // An unknown token gets a new session and the client starts over
+            session_t* session = find(token);
+            bool resumed = session != nullptr;
+            if (!resumed)
+            {
+                do { token = session_t::_new_token(); } while (sessions_.count(token));
+                auto created = std::make_unique<session_t>(opts_);
+                created->token_ = token;
+                session = created.get();
+                sessions_.emplace(token, std::move(created));
+                received.clear();
+            }
+
+            session->detach();
+            auto link = std::make_shared<typename session_t::_Link>(*session, conn);
+            session->link_ = link;
+            session->_write(link, session->_hello());
+            session->_resume(link, received);
+            h(bsys::error_code{}, session, resumed);
+            if (link->session_) link->session_->_receive(link);
+        });
+}
+
+template<typename Stream>
+typename SessionManager<Stream>::session_t*
+SessionManager<Stream>::find(token_t token) const
+{
+    if (token == 0) return nullptr;
+    auto it = sessions_.find(token);
+    return it == sessions_.end() ? nullptr : it->second.get();
+}
+
+template<typename Stream>
+std::size_t SessionManager<Stream>::expire(std::chrono::steady_clock::duration max_idle,
+                                           std::chrono::steady_clock::time_point now)
+{
+    std::size_t removed = 0;
+    for (auto it = sessions_.begin(); it != sessions_.end(); )
+    {
+        auto& s = *it->second;
+        if (!s.link_ && now - s.detached_at() > max_idle)
+        {
+            it = sessions_.erase(it);
+            ++removed;
+        }
+        else ++it;
+    }
+    return removed;
+}
+
+}
+
+#endif // CLSERVER_SESSION_HH
@@ -0,0 +1,176 @@
+//--------------------------------------------------------------------------------
+// SHA-256 content hashing.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SHA256_HH
+#define CLSERVER_SHA256_HH
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// Sha256 computes the SHA-256 digest of data given to update() in any number of
+// pieces. It is used to key caches by the content of their inputs. add_field()
+// writes a length before the data so that a sequence of fields hashes the same
+// only if every field is the same.
+// -------------------------------------------------------------------------------
+
+class Sha256
+{
+public:
+    using digest_t = std::array<uint8_t, 32>;
+
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const void* data, std::size_t size);
+    void update(const std::string& s) { update(s.data(), s.size()); }
+
+    // Hash a length prefixed field
+    void add_field(const void* data, std::size_t size);
+    void add_field(const std::string& s) { add_field(s.data(), s.size()); }
+
+    // Finish and return the digest. The object must be reset() to be reused.
+    digest_t finish();
+
+    static std::string hex(const digest_t& digest);
+
+    // The digest of a single buffer as lower case hex
+    static std::string hex_digest(const void* data, std::size_t size);
+
+private:
+    void _block(const uint8_t* p);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    std::size_t buffered_;
+    uint64_t length_;
+};
+
+//-------------------------------------------------------------------------------
+// Sha256 member functions
+//-------------------------------------------------------------------------------
+
+inline void Sha256::reset()
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    std::memcpy(state_, init, sizeof(state_));
+    buffered_ = 0;
+    length_ = 0;
+}
+
+inline void Sha256::update(const void* data, std::size_t size)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    length_ += size;
+    if (buffered_)
+    {
+        std::size_t n = std::min(size, 64 - buffered_);
+        std::memcpy(buffer_ + buffered_, p, n);
+        buffered_ += n;
+        p += n;
+        size -= n;
+        if (buffered_ < 64) return;
+        _block(buffer_);
+        buffered_ = 0;
+    }
+    for (; size >= 64; p += 64, size -= 64) _block(p);
+    if (size) std::memcpy(buffer_, p, size);
+    buffered_ = size;
+}
+
+inline void Sha256::add_field(const void* data, std::size_t size)
+{
+    uint8_t len[8];
+    for (int i = 7; i >= 0; --i) len[7 - i] = static_cast<uint8_t>(uint64_t(size) >> (8 * i));
+    update(len, sizeof(len));
+    update(data, size);
+}
+
+inline Sha256::digest_t Sha256::finish()
+{
+    uint64_t bits = length_ * 8;
+    uint8_t pad[72] = {0x80};
+    std::size_t padlen = (buffered_ < 56 ? 56 : 120) - buffered_;
+    for (int i = 0; i < 8; ++i) pad[padlen + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    update(pad, padlen + 8);
+
+    digest_t digest;
+    for (int i = 0; i < 8; ++i)
+    {
+        digest[4 * i] = static_cast<uint8_t>(state_[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(state_[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(state_[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(state_[i]);
+    }
+    return digest;
+}
+
+inline std::string Sha256::hex(const digest_t& digest)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string s(64, '0');
+    for (std::size_t i = 0; i < digest.size(); ++i)
+    {
+        s[2 * i] = digits[digest[i] >> 4];
+        s[2 * i + 1] = digits[digest[i] & 0xf];
+    }
+    return s;
+}
+
+inline std::string Sha256::hex_digest(const void* data, std::size_t size)
+{
+    Sha256 h;
+    h.update(data, size);
+    return hex(h.finish());
+}
+
+inline void Sha256::_block(const uint8_t* p)
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t(p[4 * i]) << 24) | (uint32_t(p[4 * i + 1]) << 16) |
+               (uint32_t(p[4 * i + 2]) << 8) | uint32_t(p[4 * i + 3]);
+    for (int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state_[0] += a; state_[1] += b; state_[2] += c; state_[3] += d;
+    state_[4] += e; state_[5] += f; state_[6] += g; state_[7] += h;
+}
+
+}
+
+#endif // CLSERVER_SHA256_HH
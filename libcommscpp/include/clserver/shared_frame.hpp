@@ -0,0 +1,53 @@
+//--------------------------------------------------------------------------------
+// An immutable, reference counted message frame.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SHARED_FRAME_HH
+#define CLSERVER_SHARED_FRAME_HH
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <boost/asio.hpp>
+#include <flatbuffers/flatbuffers.h>
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// SharedFrame owns a finished flatbuffer that many connections send at once.
+// Copying a SharedFrame only bumps a reference count, so fanning a frame out to
+// N subscribers shares one buffer; the buffer is freed when the last send that
+// uses it has completed. An empty SharedFrame has a null buffer.
+// -------------------------------------------------------------------------------
+
+class SharedFrame
+{
+public:
+    SharedFrame() = default;
+
+    explicit SharedFrame(fbs::DetachedBuffer db) :
+        db_{std::make_shared<const fbs::DetachedBuffer>(std::move(db))} { }
+
+    // Release the builder's finished buffer into a new frame
+    explicit SharedFrame(fbs::FlatBufferBuilder& b) : SharedFrame{b.Release()} { }
+
+    const uint8_t* data() const { return db_ ? db_->data() : nullptr; }
+    std::size_t size() const { return db_ ? db_->size() : 0; }
+    asio::const_buffer buffer() const { return asio::const_buffer{data(), size()}; }
+
+    explicit operator bool() const { return db_ != nullptr; }
+
+    // Number of SharedFrames sharing the buffer
+    long use_count() const { return db_.use_count(); }
+
+private:
+    std::shared_ptr<const fbs::DetachedBuffer> db_;
+};
+
+}
+
+#endif // CLSERVER_SHARED_FRAME_HH
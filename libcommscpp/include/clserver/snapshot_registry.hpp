@@ -0,0 +1,191 @@
+//--------------------------------------------------------------------------------
+// Server side table of grounded base program snapshots.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SNAPSHOT_REGISTRY_HH
+#define CLSERVER_SNAPSHOT_REGISTRY_HH
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace clserver
+{
+
+struct SnapshotStats
+{
+    std::size_t hits = 0;          // Jobs forked from a loaded snapshot
+    std::size_t misses = 0;        // Jobs whose base had no snapshot
+    std::size_t evicted = 0;       // Snapshots dropped to stay within the budget
+};
+
+//-------------------------------------------------------------------------------
+// SnapshotRegistry tracks the snapshot workers that hold a grounded base
+// program, keyed by base program name. A job for a base with a snapshot is
+// forked from that worker instead of grounding the base again.
+//
+// Each snapshot is charged the resident size its worker reports. When the
+// total goes over the memory budget the least recently used snapshots are
+// evicted and returned to the caller, which should stop those workers. Jobs
+// already forked from an evicted snapshot are not affected, as they hold their
+// own copy of any page that is freed. The most recently inserted or used
+// snapshot is never evicted, even if it alone is over the budget.
+//
+// Worker is whatever the server uses to refer to a connected worker, such as a
+// WorkerRegistry handle.
+// -------------------------------------------------------------------------------
+
+template<typename Worker>
+class SnapshotRegistry
+{
+public:
+    explicit SnapshotRegistry(std::size_t budget_bytes) :
+        budget_{budget_bytes}, bytes_{0} { }
+
+    SnapshotRegistry(SnapshotRegistry&&) = delete;
+    SnapshotRegistry(const SnapshotRegistry&) = delete;
+
+    SnapshotRegistry& operator=(const SnapshotRegistry&) = delete;
+
+    // The snapshot worker for a base, marking it most recently used, or
+    // nullptr. Counts a hit or a miss.
+    const Worker* lookup(const std::string& base);
+
+    // Add the snapshot for a base, replacing any existing one, and return the
+    // workers that must be stopped: the replaced one and any evicted.
+    std::vector<Worker> insert(const std::string& base, Worker worker,
+                               std::size_t bytes);
+
+    // Update the size charged to a snapshot and return the evicted workers
+    std::vector<Worker> resize(const std::string& base, std::size_t bytes);
+
+    // Remove a snapshot, for example when its worker has gone away. Returns
+    // false if there was none.
+    bool erase(const std::string& base);
+
+    // Change the budget and return the evicted workers
+    std::vector<Worker> set_budget(std::size_t budget_bytes);
+
+    bool contains(const std::string& base) const { return index_.count(base) != 0; }
+    std::size_t size() const { return index_.size(); }
+    std::size_t bytes() const { return bytes_; }
+    std::size_t budget() const { return budget_; }
+    const SnapshotStats& stats() const { return stats_; }
+
+private:
+    struct _Entry
+    {
+        std::string base_;
+        Worker worker_;
+        std::size_t bytes_;
+    };
+
+    // Most recently used first
+    using _Lru = std::list<_Entry>;
+
+    void _evict(std::vector<Worker>& evicted);
+
+    std::size_t budget_;
+    std::size_t bytes_;
+    _Lru lru_;
+    std::unordered_map<std::string, typename _Lru::iterator> index_;
+    SnapshotStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// SnapshotRegistry member functions
+//-------------------------------------------------------------------------------
+
+template<typename Worker>
+const Worker* SnapshotRegistry<Worker>::lookup(const std::string& base)
+{
+    auto it = index_.find(base);
+    if (it == index_.end())
+    {
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->worker_;
+}
+
+template<typename Worker>
+std::vector<Worker> SnapshotRegistry<Worker>::insert(const std::string& base, Worker worker,
+                                                     std::size_t bytes)
+{
+    std::vector<Worker> evicted;
+    auto it = index_.find(base);
+    if (it != index_.end())
+    {
+        bytes_ -= it->second->bytes_;
+        evicted.push_back(std::move(it->second->worker_));
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+
+    lru_.push_front(_Entry{base, std::move(worker), bytes});
+    index_.emplace(base, lru_.begin());
+    bytes_ += bytes;
+    _evict(evicted);
+    return evicted;
+}
+
+template<typename Worker>
+std::vector<Worker> SnapshotRegistry<Worker>::resize(const std::string& base,
+                                                     std::size_t bytes)
+{
+    std::vector<Worker> evicted;
+    auto it = index_.find(base);
+    if (it == index_.end()) return evicted;
+    bytes_ = bytes_ - it->second->bytes_ + bytes;
+    it->second->bytes_ = bytes;
+    _evict(evicted);
+    return evicted;
+}
+
+template<typename Worker>
+bool SnapshotRegistry<Worker>::erase(const std::string& base)
+{
+    auto it = index_.find(base);
+    if (it == index_.end()) return false;
+    bytes_ -= it->second->bytes_;
+    lru_.erase(it->second);
+    index_.erase(it);
+    return true;
+}
+
+template<typename Worker>
+std::vector<Worker> SnapshotRegistry<Worker>::set_budget(std::size_t budget_bytes)
+{
+    std::vector<Worker> evicted;
+    budget_ = budget_bytes;
+    _evict(evicted);
+    return evicted;
+}
+
+//------------------------------------------------------------------------------
+// Drop the least recently used snapshots until within budget, keeping the
+// most recently used one.
+// -----------------------------------------------------------------------------
+
+template<typename Worker>
+void SnapshotRegistry<Worker>::_evict(std::vector<Worker>& evicted)
+{
+    while (bytes_ > budget_ && lru_.size() > 1)
+    {
+        auto& victim = lru_.back();
+        bytes_ -= victim.bytes_;
+        evicted.push_back(std::move(victim.worker_));
+        index_.erase(victim.base_);
+        lru_.pop_back();
+        ++stats_.evicted;
+    }
+}
+
+}
+
+#endif // CLSERVER_SNAPSHOT_REGISTRY_HH
@@ -0,0 +1,164 @@
+//--------------------------------------------------------------------------------
+// Bounded lock-free single-producer/single-consumer queue.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SPSC_QUEUE_HH
+#define CLSERVER_SPSC_QUEUE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// SpscQueue is a fixed capacity ring buffer that is safe for exactly one thread
+// pushing and exactly one (possibly different) thread popping. Neither side
+// ever blocks or makes a system call; a full queue makes try_push() fail and an
+// empty queue makes try_pop() fail.
+//
+// The capacity is rounded up to a power of two. Element storage is allocated
+// once at construction so steady state push/pop never touches the heap.
+// -------------------------------------------------------------------------------
+
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(std::size_t capacity);
+
+    SpscQueue(SpscQueue&&) = delete;
+    SpscQueue(const SpscQueue&) = delete;
+    ~SpscQueue();
+
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side
+    bool try_push(T&& v);
+
+    // Consumer side
+    bool try_pop(T& v);
+    T* front();
+    void pop();
+
+    // Approximate when called from a thread that is neither producer nor consumer
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t capacity() const { return mask_ + 1; }
+
+private:
+    //---------------------------------------------------------------------------
+    // Definitions
+    //---------------------------------------------------------------------------
+
+    static constexpr std::size_t cacheline_size = 64;
+    using storage_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    static std::size_t _round_up(std::size_t n);
+    T* _slot(std::size_t i) { return reinterpret_cast<T*>(&slots_[i & mask_]); }
+
+    //---------------------------------------------------------------------------
+    // Internal member variables. The head and tail live on separate cache lines
+    // so the producer and consumer don't false-share. Each side also caches the
+    // last seen position of the other side to avoid touching the shared line on
+    // every operation.
+    // ---------------------------------------------------------------------------
+    const std::size_t mask_;
+    std::unique_ptr<storage_t[]> slots_;
+
+    alignas(cacheline_size) std::atomic<std::size_t> head_;   // consumer position
+    std::size_t tail_cache_;
+
+    alignas(cacheline_size) std::atomic<std::size_t> tail_;   // producer position
+    std::size_t head_cache_;
+};
+
+//-------------------------------------------------------------------------------
+// SpscQueue member functions
+//-------------------------------------------------------------------------------
+
+template<typename T>
+SpscQueue<T>::SpscQueue(std::size_t capacity) :
+    mask_{_round_up(capacity) - 1},
+    slots_{new storage_t[mask_ + 1]},
+    head_{0}, tail_cache_{0}, tail_{0}, head_cache_{0}
+{ }
+
+template<typename T>
+SpscQueue<T>::~SpscQueue()
+{
+    while (front()) pop();
+}
+
+template<typename T>
+std::size_t SpscQueue<T>::_round_up(std::size_t n)
+{
+    std::size_t r = 2;
+    while (r < n) r <<= 1;
+    return r;
+}
+
+template<typename T>
+bool SpscQueue<T>::try_push(T&& v)
+{
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_)
+    {
+        head_cache_ = head_.load(std::memory_order_acquire);
+        if (tail - head_cache_ > mask_) return false;
+    }
+    new (_slot(tail)) T(std::move(v));
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+T* SpscQueue<T>::front()
+{
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_)
+    {
+        tail_cache_ = tail_.load(std::memory_order_acquire);
+        if (head == tail_cache_) return nullptr;
+    }
+    return _slot(head);
+}
+
+template<typename T>
+void SpscQueue<T>::pop()
+{
+    auto head = head_.load(std::memory_order_relaxed);
+    _slot(head)->~T();
+    head_.store(head + 1, std::memory_order_release);
+}
+
+template<typename T>
+bool SpscQueue<T>::try_pop(T& v)
+{
+    T* f = front();
+    if (!f) return false;
+    v = std::move(*f);
+    pop();
+    return true;
+}
+
+template<typename T>
+bool SpscQueue<T>::empty() const
+{
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+}
+
+template<typename T>
+std::size_t SpscQueue<T>::size() const
+{
+    auto head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+}
+
+}
+
+#endif // CLSERVER_SPSC_QUEUE_HH
@@ -0,0 +1,244 @@
+//--------------------------------------------------------------------------------
+// Find the ends of complete statements in partly received program text.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_STATEMENT_SPLITTER_HH
+#define CLSERVER_STATEMENT_SPLITTER_HH
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// StatementSplitter scans clingo program text as it arrives and tracks the
+// offset just past the last complete statement, so that everything before it
+// can be given to clingo while the rest is still on the way. It knows enough
+// of the syntax to not be fooled by a '.' in a string, a comment, brackets,
+// an interval such as 1..3, the body of a #script block, or the '.' between
+// the body and the weight of a weak constraint, as in ":~ p. [1@2]".
+//
+// Offsets count from the start of all the text fed. A '.' is only known to end
+// a statement once the next byte has been seen, so the last statement is only
+// complete once finish() is called.
+//
+// Statements belong to the program part named by the last #program directive
+// before them. When the text is added to clingo in pieces, each piece after
+// the first must start with that directive, which program_directive() gives.
+// -------------------------------------------------------------------------------
+
+class StatementSplitter
+{
+public:
+    StatementSplitter() { reset(); }
+
+    // Scan more text and return boundary()
+    std::size_t feed(const char* data, std::size_t size);
+
+    // The end of the input: a final '.' ends a statement
+    std::size_t finish();
+
+    // Offset just past the last complete statement
+    std::size_t boundary() const { return boundary_; }
+
+    // Bytes fed so far
+    std::size_t scanned() const { return offset_; }
+
+    // The offsets of the last complete #program directive, or {0, 0}
+    std::pair<std::size_t, std::size_t> program_directive() const { return program_; }
+
+    void reset();
+
+private:
+    enum class _State : uint8_t { Top, String, Escape, LineComment, BlockComment, Script };
+
+    void _directive_char(char c);
+    void _end_statement();
+
+    static bool _blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    _State state_;
+    std::size_t offset_;
+    std::size_t boundary_;
+    int depth_;                    // Open brackets
+    char prev_;                    // Previous byte at the top level
+    bool star_;                    // Block comment: the previous byte was '*'
+    bool percent_;                 // Top level: the previous byte was an opening '%'
+    std::size_t dot_;              // Offset after a '.' that may end a statement, or 0
+    bool weak_;                    // The statement is a weak constraint
+    bool weight_;                  // Reading a weak constraint's [weight@priority]
+    bool in_directive_;            // Reading the name after a '#'
+    std::string directive_;
+    std::size_t hash_;             // Offset of the last '#'
+    std::size_t program_start_;    // Offset of an unfinished #program, plus 1
+    std::pair<std::size_t, std::size_t> program_;
+};
+
+//-------------------------------------------------------------------------------
+// StatementSplitter member functions
+//-------------------------------------------------------------------------------
+
+inline void StatementSplitter::reset()
+{
+    state_ = _State::Top;
+    offset_ = 0;
+    boundary_ = 0;
+    depth_ = 0;
+    prev_ = ' ';
+    star_ = false;
+    percent_ = false;
+    dot_ = 0;
+    weak_ = false;
+    weight_ = false;
+    in_directive_ = false;
+    directive_.clear();
+    hash_ = 0;
+    program_start_ = 0;
+    program_ = {0, 0};
+}
+
+inline std::size_t StatementSplitter::feed(const char* data, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; ++i, ++offset_)
+    {
+        char c = data[i];
+
+        // A '.' that isn't part of ".." ends the statement, unless it is the
+        // '.' of a weak constraint, which is followed by the weight. Blanks and
+        // comments are skipped until it is known which.
+        if (dot_ && weak_)
+        {
+            bool comment = state_ != _State::Top || percent_ || c == '%';
+            if (!comment && !_blank(c))
+            {
+                if (c == '[') weight_ = true;
+                else if (c != '.') _end_statement();
+                dot_ = 0;
+            }
+        }
+        else if (dot_)
+        {
+            if (c != '.') _end_statement();
+            dot_ = 0;
+        }
+
+        switch (state_)
+        {
+        case _State::String:
+            if (c == '\\') state_ = _State::Escape;
+            else if (c == '"') state_ = _State::Top;
+            continue;
+        case _State::Escape:
+            state_ = _State::String;
+            continue;
+        case _State::LineComment:
+            if (c == '\n') state_ = _State::Top;
+            continue;
+        case _State::BlockComment:
+            if (star_ && c == '%') state_ = _State::Top;
+            star_ = c == '*';
+            continue;
+        case _State::Script:
+            // Only "#end" is looked for. The byte that completes it is also
+            // scanned at the top level, as it may be the closing '.'.
+            _directive_char(c);
+            if (state_ == _State::Script) continue;
+            break;
+        case _State::Top:
+            break;
+        }
+
+        if (percent_)
+        {
+            percent_ = false;
+            if (c == '*')
+            {
+                state_ = _State::BlockComment;
+                star_ = false;
+                continue;
+            }
+            state_ = c == '\n' ? _State::Top : _State::LineComment;
+            continue;
+        }
+
+        _directive_char(c);
+        if (state_ != _State::Top) continue;
+
+        switch (c)
+        {
+        case '"': state_ = _State::String; break;
+        case '%': percent_ = true; break;
+        case '(': case '{': case '[': ++depth_; break;
+        case ')': case '}': if (depth_ > 0) --depth_; break;
+        case ']':
+            if (depth_ > 0) --depth_;
+            // The weight is the last part of a weak constraint
+            if (depth_ == 0 && weight_)
+            {
+                dot_ = offset_ + 1;
+                _end_statement();
+                dot_ = 0;
+            }
+            break;
+        case '~':
+            if (depth_ == 0 && prev_ == ':') weak_ = true;
+            break;
+        case '.':
+            if (depth_ == 0 && prev_ != '.' && !weight_) dot_ = offset_ + 1;
+            break;
+        default: break;
+        }
+        if (!_blank(c)) prev_ = c;
+    }
+    return boundary_;
+}
+
+inline std::size_t StatementSplitter::finish()
+{
+    if (dot_) _end_statement();
+    dot_ = 0;
+    return boundary_;
+}
+
+inline void StatementSplitter::_end_statement()
+{
+    boundary_ = dot_;
+    if (program_start_) program_ = {program_start_ - 1, boundary_};
+    program_start_ = 0;
+    weak_ = false;
+    weight_ = false;
+}
+
+//------------------------------------------------------------------------------
+// Track the name after a '#'. "#script" starts a script, whose body is not
+// ASP, and "#end" ends it. The start of a #program directive is kept until
+// the end of its statement.
+// -----------------------------------------------------------------------------
+
+inline void StatementSplitter::_directive_char(char c)
+{
+    if (in_directive_)
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        {
+            if (directive_.size() < 8) directive_ += c;
+            return;
+        }
+        in_directive_ = false;
+        if (state_ == _State::Top && directive_ == "script") state_ = _State::Script;
+        else if (state_ == _State::Top && directive_ == "program") program_start_ = hash_ + 1;
+        else if (state_ == _State::Script && directive_ == "end") state_ = _State::Top;
+    }
+    if (c == '#')
+    {
+        in_directive_ = true;
+        directive_.clear();
+        hash_ = offset_;
+    }
+}
+
+}
+
+#endif // CLSERVER_STATEMENT_SPLITTER_HH
@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------
+// Per-job symbol dictionaries: models sent as symbol IDs (model_msg.fbs).
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_SYMBOL_DICTIONARY_HH
+#define CLSERVER_SYMBOL_DICTIONARY_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <boost/utility/string_view.hpp>
+
+namespace clserver
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// SymbolInterner is the worker's side of a job's dictionary. It gives each
+// distinct symbol, identified by a 64-bit key such as a clingo_symbol_t, the
+// next ID in order, so the client can rebuild the same table from the
+// SymbolDictMsg updates that announce new symbols.
+//
+// The table is open addressed with linear probing and is only reallocated
+// when it grows, so interning the symbols of a model that are already known
+// does not allocate.
+// -------------------------------------------------------------------------------
+
+class SymbolInterner
+{
+public:
+    SymbolInterner() : size_{0} { _rehash(64); }
+
+    SymbolInterner(SymbolInterner&&) = delete;
+    SymbolInterner(const SymbolInterner&) = delete;
+
+    SymbolInterner& operator=(const SymbolInterner&) = delete;
+
+    // The ID of key; added is set if it is new
+    uint32_t intern(uint64_t key, bool& added);
+
+    // Number of symbols interned, which is also the next ID
+    std::size_t size() const { return size_; }
+
+    void clear();
+
+private:
+    static constexpr uint32_t empty_ = UINT32_MAX;
+
+    static std::size_t _hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return static_cast<std::size_t>(key);
+    }
+
+    void _rehash(std::size_t capacity);
+
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> ids_;        // empty_ marks a free slot
+    std::size_t size_;
+};
+
+//-------------------------------------------------------------------------------
+// SymbolDictionary is the client's side of a job's dictionary. Updates must be
+// applied in the order they were sent: each one continues from the ID where
+// the last one ended. The names are copied once into one buffer and looked up
+// only when asked for, so a model can be kept as the IDs it arrived as.
+// -------------------------------------------------------------------------------
+
+class SymbolDictionary
+{
+public:
+    SymbolDictionary() : offsets_{0} { }
+
+    SymbolDictionary(SymbolDictionary&&) = default;
+    SymbolDictionary(const SymbolDictionary&) = delete;
+
+    SymbolDictionary& operator=(SymbolDictionary&&) = default;
+    SymbolDictionary& operator=(const SymbolDictionary&) = delete;
+
+    // Add the symbol with the given ID, which must be size()
+    void add(uint32_t id, boost::string_view symbol, bsys::error_code& ec);
+
+    // Apply a ClingoServer::SymbolDictMsg, or anything with the same accessors
+    template<typename DictMsg>
+    void update(const DictMsg& msg, bsys::error_code& ec);
+
+    // The symbol with the given ID, which must be less than size()
+    boost::string_view symbol(uint32_t id) const
+    {
+        return boost::string_view{names_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]};
+    }
+
+    bool contains(uint32_t id) const { return id < size(); }
+    std::size_t size() const { return offsets_.size() - 1; }
+    std::size_t bytes() const { return names_.size(); }
+
+    void clear();
+
+private:
+    std::string names_;
+    std::vector<uint32_t> offsets_;    // Where each symbol starts, and the end
+};
+
+//-------------------------------------------------------------------------------
+// The symbols of a model received as IDs, resolved through the dictionary as
+// they are iterated over. It refers to the IDs in place, typically in the
+// received ModelMsg, and to the dictionary, so both must outlive it.
+// -------------------------------------------------------------------------------
+
+class ModelSymbols
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = boost::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const boost::string_view*;
+        using reference = boost::string_view;
+
+        iterator(const SymbolDictionary* dict, const uint32_t* id) : dict_{dict}, id_{id} { }
+
+        boost::string_view operator*() const { return dict_->symbol(*id_); }
+        iterator& operator++() { ++id_; return *this; }
+        iterator operator++(int) { auto it = *this; ++id_; return it; }
+        bool operator==(const iterator& o) const { return id_ == o.id_; }
+        bool operator!=(const iterator& o) const { return id_ != o.id_; }
+
+    private:
+        const SymbolDictionary* dict_;
+        const uint32_t* id_;
+    };
+
+    ModelSymbols(const SymbolDictionary& dict, const uint32_t* ids, std::size_t size) :
+        dict_{dict}, ids_{ids}, size_{size} { }
+
+    // Whether every ID is in the dictionary. Checked once, before iterating
+    // a model from an untrusted source.
+    bool valid() const;
+
+    std::size_t size() const { return size_; }
+    uint32_t id(std::size_t i) const { return ids_[i]; }
+    boost::string_view operator[](std::size_t i) const { return dict_.symbol(ids_[i]); }
+
+    iterator begin() const { return iterator{&dict_, ids_}; }
+    iterator end() const { return iterator{&dict_, ids_ + size_}; }
+
+private:
+    const SymbolDictionary& dict_;
+    const uint32_t* ids_;
+    std::size_t size_;
+};
+
+//-------------------------------------------------------------------------------
+// SymbolInterner member functions
+//-------------------------------------------------------------------------------
+
+inline uint32_t SymbolInterner::intern(uint64_t key, bool& added)
+{
+    std::size_t mask = keys_.size() - 1;
+    for (std::size_t i = _hash(key) & mask; ; i = (i + 1) & mask)
+    {
+        if (ids_[i] == empty_)
+        {
+            added = true;
+            auto id = static_cast<uint32_t>(size_++);
+            keys_[i] = key;
+            ids_[i] = id;
+            if (size_ * 2 > keys_.size()) _rehash(keys_.size() * 2);
+            return id;
+        }
+        if (keys_[i] == key)
+        {
+            added = false;
+            return ids_[i];
+        }
+    }
+}
+
+inline void SymbolInterner::clear()
+{
+    std::fill(ids_.begin(), ids_.end(), uint32_t{empty_});
+    size_ = 0;
+}
+
+inline void SymbolInterner::_rehash(std::size_t capacity)
+{
+    std::vector<uint64_t> keys(capacity);
+    std::vector<uint32_t> ids(capacity, uint32_t{empty_});
+    std::size_t mask = capacity - 1;
+    for (std::size_t j = 0; j < keys_.size(); ++j)
+    {
+        if (ids_[j] == empty_) continue;
+        std::size_t i = _hash(keys_[j]) & mask;
+        while (ids[i] != empty_) i = (i + 1) & mask;
+        keys[i] = keys_[j];
+        ids[i] = ids_[j];
+    }
+    keys_.swap(keys);
+    ids_.swap(ids);
+}
+
+//-------------------------------------------------------------------------------
+// SymbolDictionary member functions
+//-------------------------------------------------------------------------------
+
+inline void SymbolDictionary::add(uint32_t id, boost::string_view symbol, bsys::error_code& ec)
+{
+    if (id != size())
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return;
+    }
+    names_.append(symbol.data(), symbol.size());
+    offsets_.push_back(static_cast<uint32_t>(names_.size()));
+}
+
+template<typename DictMsg>
+void SymbolDictionary::update(const DictMsg& msg, bsys::error_code& ec)
+{
+    auto symbols = msg.symbols();
+    if (!symbols) return;
+    uint32_t id = msg.first_id();
+    for (std::size_t i = 0; i < symbols->size() && !ec; ++i, ++id)
+    {
+        auto s = symbols->Get(i);
+        add(id, s ? boost::string_view{s->c_str(), s->size()} : boost::string_view{}, ec);
+    }
+}
+
+inline void SymbolDictionary::clear()
+{
+    names_.clear();
+    offsets_.assign(1, 0);
+}
+
+//-------------------------------------------------------------------------------
+// ModelSymbols member functions
+//-------------------------------------------------------------------------------
+
+inline bool ModelSymbols::valid() const
+{
+    for (std::size_t i = 0; i < size_; ++i)
+        if (!dict_.contains(ids_[i])) return false;
+    return true;
+}
+
+}
+
+#endif // CLSERVER_SYMBOL_DICTIONARY_HH
@@ -0,0 +1,535 @@
+//--------------------------------------------------------------------------------
+// Persistent append-only log of the frames published to a topic.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_TOPIC_LOG_HH
+#define CLSERVER_TOPIC_LOG_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/shared_frame.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// TopicLog keeps the frames published to one topic in a directory of segment
+// files so that a client reconnecting to a running job can catch up on what it
+// missed without the server holding the history in memory.
+//
+// Each record is stored exactly as it goes on the wire, a 4-byte big-endian
+// size followed by the body, so a run of records can be written to a socket
+// straight from the page cache with sendfile() or, through a Connection, with
+// async_send_frames() on the mapped bytes. Records are numbered by a sequence
+// number starting at 0. A segment file is named after the sequence number of
+// its first record and is mapped into memory while it is open; only a 4-byte
+// offset per record is kept on the heap.
+//
+// Retention removes whole segments, oldest first, while the log is larger than
+// max_bytes or a segment's newest record is older than max_age. The segment
+// being appended to is never removed. Cursors keep their segment mapped, so
+// retention does not pull data out from under a reader.
+//
+// On open the records of existing segments are scanned to rebuild the index; a
+// record that was only partly written is discarded. A record's size is stored
+// only after its body, and the 4 bytes after the last record are kept zero, so
+// if the process dies part way through an append the scan stops where the
+// record would have started. After a crash of the machine only the records
+// before the last sync() are certain to be intact. TopicLog is not thread safe
+// and should be used from a single executor.
+// -------------------------------------------------------------------------------
+
+class TopicLog
+{
+    struct _Segment;
+
+public:
+    struct Options
+    {
+        std::size_t segment_bytes = 64 * 1024 * 1024;
+        std::size_t max_bytes = 1024 * 1024 * 1024;
+        std::chrono::seconds max_age{24 * 3600};
+    };
+
+    //---------------------------------------------------------------------------
+    // A read position in the log. frames() is the run of complete wire frames
+    // from the position to the end of its segment as currently written, and
+    // file_range() the same run as a range of the segment file for sendfile().
+    // advance() moves past records that have been sent.
+    // ---------------------------------------------------------------------------
+    class Cursor
+    {
+    public:
+        Cursor() : log_{nullptr}, seq_{0}, index_{0} { }
+
+        uint64_t seq() const { return seq_; }
+        bool at_end() const;
+
+        asio::const_buffer frames() const;
+        asio::const_buffer record() const;     // The next record's body
+        std::size_t frame_count() const;
+        bool file_range(int& fd, off_t& offset, std::size_t& count) const;
+
+        void advance(std::size_t n = 1);
+
+    private:
+        friend class TopicLog;
+        Cursor(const TopicLog* log, std::shared_ptr<_Segment> seg, uint64_t seq);
+        // Move on to the next segment once this one is read to its end
+        void _sync() const;
+
+        const TopicLog* log_;
+        mutable std::shared_ptr<_Segment> seg_;
+        mutable uint64_t seq_;
+        mutable std::size_t index_;
+    };
+
+    explicit TopicLog(const std::string& dir) : TopicLog{dir, Options{}} { }
+    TopicLog(const std::string& dir, Options opts);
+
+    TopicLog(TopicLog&&) = delete;
+    TopicLog(const TopicLog&) = delete;
+    ~TopicLog() { close(); }
+
+    TopicLog& operator=(const TopicLog&) = delete;
+
+    // Open the directory, which must exist, and recover any existing segments
+    void open(bsys::error_code& ec);
+    void close();
+
+    // Append a frame body and return its sequence number. Empty bodies are not
+    // allowed.
+    uint64_t append(const uint8_t* data, std::size_t size, bsys::error_code& ec);
+    uint64_t append(const SharedFrame& frame, bsys::error_code& ec)
+    { return append(frame.data(), frame.size(), ec); }
+
+    // Sequence numbers of the oldest retained record and of the next append
+    uint64_t first_seq() const;
+    uint64_t next_seq() const { return next_seq_; }
+
+    // Start reading at seq, or at first_seq() if it has been retired
+    Cursor cursor(uint64_t seq) const;
+
+    // Remove segments that are past the retention limits. Called on each
+    // segment roll, and may be called periodically so that age applies to an
+    // idle log. Returns the number of segments removed.
+    std::size_t apply_retention(std::chrono::system_clock::time_point now =
+                                std::chrono::system_clock::now());
+
+    // Flush the active segment to disk
+    void sync();
+
+    std::size_t size_bytes() const;
+    std::size_t segment_count() const { return segments_.size(); }
+
+private:
+    //---------------------------------------------------------------------------
+    // Inner classes
+    //---------------------------------------------------------------------------
+
+    // A mapped segment file. The mapping may be larger than the data written.
+    struct _Segment
+    {
+        uint64_t base_seq_;
+        std::string path_;
+        int fd_;
+        uint8_t* map_;
+        std::size_t capacity_;
+        std::size_t size_;
+        std::vector<uint32_t> offsets_;
+        std::chrono::system_clock::time_point last_write_;
+        bool removed_;
+
+        _Segment() : base_seq_{0}, fd_{-1}, map_{nullptr}, capacity_{0}, size_{0},
+                     removed_{false} { }
+        _Segment(const _Segment&) = delete;
+        ~_Segment();
+
+        uint64_t end_seq() const { return base_seq_ + offsets_.size(); }
+    };
+
+    //---------------------------------------------------------------------------
+    // Internal member functions
+    //---------------------------------------------------------------------------
+
+    std::string _segment_path(uint64_t base_seq) const;
+    std::shared_ptr<_Segment> _open_segment(const std::string& path, uint64_t base_seq,
+                                            std::size_t capacity, bool create,
+                                            bsys::error_code& ec);
+    void _roll(std::size_t min_capacity, bsys::error_code& ec);
+    void _seal(_Segment& seg);
+    std::shared_ptr<_Segment> _segment_after(const _Segment* seg) const;
+
+    static bsys::error_code _errno()
+    { return bsys::error_code{errno, bsys::system_category()}; }
+
+    //---------------------------------------------------------------------------
+    // Internal member variables
+    //---------------------------------------------------------------------------
+    std::string dir_;
+    Options opts_;
+    std::vector<std::shared_ptr<_Segment>> segments_;     // Oldest first
+    uint64_t next_seq_;
+};
+
+//-------------------------------------------------------------------------------
+// Write count bytes of a file to a stream socket with sendfile(), waiting for
+// the socket to become writable as needed. The handler is called as
+// handler(ec, bytes_written). Only available on Linux.
+// -------------------------------------------------------------------------------
+
+#if defined(__linux__)
+template<typename Socket, typename Handler>
+void async_sendfile(Socket& socket, int fd, off_t offset, std::size_t count,
+                    Handler h, std::size_t written = 0)
+{
+    if (!socket.non_blocking()) socket.non_blocking(true);
+    while (written < count)
+    {
+        off_t off = offset + static_cast<off_t>(written);
+        ssize_t n = ::sendfile(socket.native_handle(), fd, &off, count - written);
+        if (n > 0) { written += static_cast<std::size_t>(n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            socket.async_wait(Socket::wait_write,
+                              [&socket, fd, offset, count, h, written](const bsys::error_code& ec)
+                              {
+                                  if (ec) { h(ec, written); return; }
+                                  async_sendfile(socket, fd, offset, count, h, written);
+                              });
+            return;
+        }
+        h(n < 0 ? bsys::error_code{errno, bsys::system_category()}
+                : bsys::error_code{asio::error::eof}, written);
+        return;
+    }
+    h(bsys::error_code{}, written);
+}
+#endif
+
+//-------------------------------------------------------------------------------
+// TopicLog::_Segment member functions
+//-------------------------------------------------------------------------------
+
+inline TopicLog::_Segment::~_Segment()
+{
+    if (map_) ::munmap(map_, capacity_);
+    if (fd_ >= 0) ::close(fd_);
+    if (removed_) ::unlink(path_.c_str());
+}
+
+//-------------------------------------------------------------------------------
+// TopicLog::Cursor member functions
+//-------------------------------------------------------------------------------
+
+inline TopicLog::Cursor::Cursor(const TopicLog* log, std::shared_ptr<_Segment> seg,
+                                uint64_t seq) :
+    log_{log}, seg_{std::move(seg)}, seq_{seq}, index_{0}
+{
+    if (seg_) index_ = seq_ - seg_->base_seq_;
+}
+
+inline bool TopicLog::Cursor::at_end() const
+{
+    return !seg_ || seq_ >= log_->next_seq_;
+}
+
+inline std::size_t TopicLog::Cursor::frame_count() const
+{
+    _sync();
+    return seg_ ? seg_->offsets_.size() - index_ : 0;
+}
+
+inline asio::const_buffer TopicLog::Cursor::frames() const
+{
+    if (!frame_count()) return asio::const_buffer{};
+    std::size_t start = seg_->offsets_[index_];
+    return asio::const_buffer{seg_->map_ + start, seg_->size_ - start};
+}
+
+inline asio::const_buffer TopicLog::Cursor::record() const
+{
+    if (!frame_count()) return asio::const_buffer{};
+    std::size_t start = seg_->offsets_[index_];
+    std::size_t end = index_ + 1 < seg_->offsets_.size() ? seg_->offsets_[index_ + 1]
+                                                         : seg_->size_;
+    return asio::const_buffer{seg_->map_ + start + 4, end - start - 4};
+}
+
+inline bool TopicLog::Cursor::file_range(int& fd, off_t& offset, std::size_t& count) const
+{
+    if (!frame_count()) return false;
+    fd = seg_->fd_;
+    offset = static_cast<off_t>(seg_->offsets_[index_]);
+    count = seg_->size_ - seg_->offsets_[index_];
+    return true;
+}
+
+inline void TopicLog::Cursor::advance(std::size_t n)
+{
+    while (n)
+    {
+        std::size_t step = std::min(n, frame_count());
+        if (step == 0) return;
+        index_ += step;
+        seq_ += step;
+        n -= step;
+    }
+}
+
+inline void TopicLog::Cursor::_sync() const
+{
+    if (!seg_ || index_ < seg_->offsets_.size()) return;
+    auto next = log_->_segment_after(seg_.get());
+    if (!next) return;
+    seg_ = std::move(next);
+    seq_ = std::max(seq_, seg_->base_seq_);
+    index_ = seq_ - seg_->base_seq_;
+}
+
+//-------------------------------------------------------------------------------
+// TopicLog member functions
+//-------------------------------------------------------------------------------
+
+inline TopicLog::TopicLog(const std::string& dir, Options opts) :
+    dir_{dir}, opts_{opts}, next_seq_{0}
+{ }
+
+//------------------------------------------------------------------------------
+// Map the existing segments in sequence order and rebuild their record index.
+// The newest one becomes the active segment, or a new one is created.
+// -----------------------------------------------------------------------------
+
+inline void TopicLog::open(bsys::error_code& ec)
+{
+    close();
+    DIR* d = ::opendir(dir_.c_str());
+    if (!d) { ec = _errno(); return; }
+
+    std::vector<uint64_t> bases;
+    while (auto entry = ::readdir(d))
+    {
+        unsigned long long base;
+        char tail[8];
+        if (std::sscanf(entry->d_name, "%20llu.%7s", &base, tail) == 2 &&
+            std::strcmp(tail, "log") == 0)
+            bases.push_back(base);
+    }
+    ::closedir(d);
+    std::sort(bases.begin(), bases.end());
+
+    for (std::size_t i = 0; i < bases.size(); ++i)
+    {
+        bool last = i + 1 == bases.size();
+        auto seg = _open_segment(_segment_path(bases[i]), bases[i],
+                                 last ? opts_.segment_bytes : 0, false, ec);
+        if (ec) { close(); return; }
+        if (!last) _seal(*seg);
+        next_seq_ = seg->end_seq();
+        segments_.push_back(std::move(seg));
+    }
+
+    if (segments_.empty()) _roll(0, ec);
+}
+
+inline void TopicLog::close()
+{
+    if (!segments_.empty()) _seal(*segments_.back());
+    segments_.clear();
+    next_seq_ = 0;
+}
+
+inline uint64_t TopicLog::append(const uint8_t* data, std::size_t size, bsys::error_code& ec)
+{
+    if (size == 0 || size > UINT32_MAX - 4)
+    {
+        ec = asio::error::invalid_argument;
+        return next_seq_;
+    }
+    if (segments_.empty())
+    {
+        ec = asio::error::not_connected;
+        return next_seq_;
+    }
+
+    auto seg = segments_.back().get();
+    if (seg->size_ + 4 + size > seg->capacity_)
+    {
+        _roll(4 + size, ec);
+        if (ec) return next_seq_;
+        seg = segments_.back().get();
+    }
+
+    // The body and the zero that ends the segment's records first, then the
+    // size that makes the record part of the log
+    uint8_t* record = seg->map_ + seg->size_;
+    std::memcpy(record + 4, data, size);
+    if (seg->size_ + 8 + size <= seg->capacity_) std::memset(record + 4 + size, 0, 4);
+    std::atomic_signal_fence(std::memory_order_release);
+    uint32_t be = htonl(static_cast<uint32_t>(size));
+    std::memcpy(record, &be, 4);
+    seg->offsets_.push_back(static_cast<uint32_t>(seg->size_));
+    seg->size_ += 4 + size;
+    seg->last_write_ = std::chrono::system_clock::now();
+    return next_seq_++;
+}
+
+inline uint64_t TopicLog::first_seq() const
+{
+    return segments_.empty() ? next_seq_ : segments_.front()->base_seq_;
+}
+
+inline TopicLog::Cursor TopicLog::cursor(uint64_t seq) const
+{
+    if (segments_.empty()) return Cursor{};
+    seq = std::min(std::max(seq, first_seq()), next_seq_);
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), seq,
+                               [](uint64_t s, const std::shared_ptr<_Segment>& seg)
+                               { return s < seg->base_seq_; });
+    return Cursor{this, *std::prev(it), seq};
+}
+
+inline std::size_t TopicLog::apply_retention(std::chrono::system_clock::time_point now)
+{
+    std::size_t total = size_bytes();
+    std::size_t removed = 0;
+    while (segments_.size() > 1)
+    {
+        auto& seg = segments_.front();
+        if (total <= opts_.max_bytes && now - seg->last_write_ <= opts_.max_age) break;
+        total -= seg->size_;
+        seg->removed_ = true;
+        segments_.erase(segments_.begin());
+        ++removed;
+    }
+    return removed;
+}
+
+inline void TopicLog::sync()
+{
+    if (segments_.empty()) return;
+    auto& seg = *segments_.back();
+    ::msync(seg.map_, seg.size_, MS_SYNC);
+}
+
+inline std::size_t TopicLog::size_bytes() const
+{
+    std::size_t total = 0;
+    for (const auto& seg : segments_) total += seg->size_;
+    return total;
+}
+
+inline std::string TopicLog::_segment_path(uint64_t base_seq) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu.log",
+                  static_cast<unsigned long long>(base_seq));
+    return dir_ + "/" + name;
+}
+
+//------------------------------------------------------------------------------
+// Open and map a segment. An existing file is scanned for complete records;
+// the file is grown to capacity if that is larger than what it holds.
+// -----------------------------------------------------------------------------
+
+inline std::shared_ptr<TopicLog::_Segment>
+TopicLog::_open_segment(const std::string& path, uint64_t base_seq,
+                        std::size_t capacity, bool create, bsys::error_code& ec)
+{
+    auto seg = std::make_shared<_Segment>();
+    seg->base_seq_ = base_seq;
+    seg->path_ = path;
+    seg->fd_ = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (seg->fd_ < 0) { ec = _errno(); return nullptr; }
+
+    struct stat st;
+    if (::fstat(seg->fd_, &st) != 0) { ec = _errno(); return nullptr; }
+    std::size_t file_size = static_cast<std::size_t>(st.st_size);
+    seg->last_write_ = std::chrono::system_clock::from_time_t(st.st_mtime);
+
+    seg->capacity_ = std::max(capacity, file_size);
+    if (seg->capacity_ == 0) return seg;
+    if (seg->capacity_ > file_size &&
+        ::ftruncate(seg->fd_, static_cast<off_t>(seg->capacity_)) != 0)
+    {
+        ec = _errno();
+        return nullptr;
+    }
+    void* map = ::mmap(nullptr, seg->capacity_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       seg->fd_, 0);
+    if (map == MAP_FAILED) { ec = _errno(); return nullptr; }
+    seg->map_ = static_cast<uint8_t*>(map);
+
+    // A zero size marks the end of the written data
+    std::size_t offset = 0;
+    while (offset + 4 <= file_size)
+    {
+        uint32_t be;
+        std::memcpy(&be, seg->map_ + offset, 4);
+        std::size_t size = ntohl(be);
+        if (size == 0 || offset + 4 + size > file_size) break;
+        seg->offsets_.push_back(static_cast<uint32_t>(offset));
+        offset += 4 + size;
+    }
+    seg->size_ = offset;
+    return seg;
+}
+
+//------------------------------------------------------------------------------
+// Seal the active segment and start a new one big enough for the next record.
+// -----------------------------------------------------------------------------
+
+inline void TopicLog::_roll(std::size_t min_capacity, bsys::error_code& ec)
+{
+    if (!segments_.empty()) _seal(*segments_.back());
+    auto seg = _open_segment(_segment_path(next_seq_), next_seq_,
+                             std::max(opts_.segment_bytes, min_capacity), true, ec);
+    if (ec) return;
+    seg->last_write_ = std::chrono::system_clock::now();
+    segments_.push_back(std::move(seg));
+    apply_retention();
+}
+
+// Trim the file to the records written; the mapping past the end is not read
+inline void TopicLog::_seal(_Segment& seg)
+{
+    if (seg.fd_ < 0) return;
+    if (seg.map_) ::msync(seg.map_, seg.size_, MS_ASYNC);
+    if (::ftruncate(seg.fd_, static_cast<off_t>(seg.size_)) != 0) { }
+}
+
+inline std::shared_ptr<TopicLog::_Segment> TopicLog::_segment_after(const _Segment* seg) const
+{
+    for (std::size_t i = 0; i < segments_.size(); ++i)
+    {
+        if (segments_[i]->base_seq_ > seg->base_seq_) return segments_[i];
+    }
+    return nullptr;
+}
+
+}
+
+#endif // CLSERVER_TOPIC_LOG_HH
@@ -0,0 +1,295 @@
+//--------------------------------------------------------------------------------
+// A pool of started and validated workers waiting for jobs.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_WORKER_POOL_HH
+#define CLSERVER_WORKER_POOL_HH
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <boost/asio.hpp>
+
+namespace clserver
+{
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// WorkerPool counters. Spawn latency is the time from asking for a worker to
+// its handshake completing, counted in power of two buckets of microseconds:
+// bucket i holds latencies in [2^i, 2^(i+1)) us, the last bucket everything
+// above.
+// -------------------------------------------------------------------------------
+
+struct WorkerPoolStats
+{
+    std::size_t spawned = 0;       // Spawns requested
+    std::size_t ready = 0;         // Spawned workers that completed the handshake
+    std::size_t failed = 0;        // Spawns that failed or timed out
+    std::size_t hits = 0;          // acquire() served by a warm worker
+    std::size_t misses = 0;        // acquire() that had to wait for a spawn
+    std::size_t lost = 0;          // Warm workers that went away unused
+
+    std::chrono::microseconds latency_min{0};
+    std::chrono::microseconds latency_max{0};
+    std::chrono::microseconds latency_total{0};
+    std::array<std::size_t, 24> latency_buckets{};
+
+    double hit_rate() const
+    { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+
+    std::chrono::microseconds latency_mean() const
+    { return ready ? latency_total / static_cast<long>(ready) : std::chrono::microseconds{0}; }
+};
+
+//-------------------------------------------------------------------------------
+// WorkerPool keeps warm_size workers started and validated ahead of demand so
+// that a job can be given a worker without waiting for a process to start and
+// connect back. It does not start processes itself: spawn_fn, typically a
+// ForkServer, is called with a new instance name and sets its error_code if
+// the spawn fails, and the server calls worker_ready() once the worker with
+// that name has completed its Init handshake.
+//
+// acquire() hands out a warm worker at once; if there is none the request waits
+// for the next worker to become ready. Each acquire() then starts a spawn to
+// bring the pool back to size, so the cost of starting a worker is paid after
+// the job has its worker rather than before. A spawn that has not become ready
+// within spawn_timeout is counted as failed by check_timeouts() and replaced.
+// When a spawn fails outright, the waiting acquires that no pending spawn can
+// serve are failed with its error rather than left waiting for a worker that
+// isn't coming.
+//
+// Worker is whatever the server uses to refer to a connected worker, such as a
+// WorkerRegistry handle. WorkerPool is used from a single executor.
+// -------------------------------------------------------------------------------
+
+template<typename Worker>
+class WorkerPool
+{
+public:
+    using spawn_fn_t = std::function<void(const std::string& instance, bsys::error_code& ec)>;
+    using acquire_handler_t = std::function<void(const bsys::error_code&, Worker)>;
+    using clock_type = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::size_t warm_size = 4;
+        std::chrono::milliseconds spawn_timeout{10000};
+        std::string instance_prefix = "worker";
+    };
+
+    WorkerPool(spawn_fn_t spawn, Options opts);
+
+    WorkerPool(WorkerPool&&) = delete;
+    WorkerPool(const WorkerPool&) = delete;
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Start spawns until warm and pending workers cover warm_size plus the
+    // waiting acquires
+    void fill();
+
+    // Get a worker. The handler is called at once if one is warm, otherwise
+    // when one becomes ready, with the spawn error if no worker can be
+    // started for it, or with operation_aborted by cancel().
+    void acquire(acquire_handler_t h);
+
+    // A spawned worker has completed its handshake. Returns false if the
+    // instance was not spawned by this pool or its spawn has already timed
+    // out; the pool then keeps nothing and the caller must stop the worker.
+    bool worker_ready(const std::string& instance, Worker w,
+                      clock_type::time_point now = clock_type::now());
+
+    // A warm worker has gone away. Returns false if it was not warm.
+    bool worker_lost(const std::string& instance);
+
+    // Count spawns that are overdue as failed and replace them. Returns the
+    // number that timed out.
+    std::size_t check_timeouts(clock_type::time_point now = clock_type::now());
+
+    // Fail the waiting acquires with operation_aborted
+    void cancel();
+
+    std::size_t warm() const { return warm_.size(); }
+    std::size_t pending() const { return pending_.size(); }
+    std::size_t waiting() const { return waiting_.size(); }
+    const WorkerPoolStats& stats() const { return stats_; }
+
+private:
+    struct _Warm
+    {
+        std::string instance_;
+        Worker worker_;
+    };
+
+    bool _spawn(bsys::error_code& ec);
+    void _fail_unserved(const bsys::error_code& ec);
+    void _record_latency(std::chrono::microseconds latency);
+
+    spawn_fn_t spawn_;
+    Options opts_;
+    std::deque<_Warm> warm_;
+    std::unordered_map<std::string, clock_type::time_point> pending_;
+    std::deque<acquire_handler_t> waiting_;
+    uint64_t next_instance_;
+    WorkerPoolStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// WorkerPool member functions
+//-------------------------------------------------------------------------------
+
+template<typename Worker>
+WorkerPool<Worker>::WorkerPool(spawn_fn_t spawn, Options opts) :
+    spawn_{std::move(spawn)}, opts_{std::move(opts)}, next_instance_{1}
+{ }
+
+template<typename Worker>
+void WorkerPool<Worker>::fill()
+{
+    bsys::error_code ec;
+    while (warm_.size() + pending_.size() < opts_.warm_size + waiting_.size())
+        if (!_spawn(ec)) break;
+    if (ec) _fail_unserved(ec);
+}
+
+template<typename Worker>
+void WorkerPool<Worker>::acquire(acquire_handler_t h)
+{
+    if (warm_.empty())
+    {
+        ++stats_.misses;
+        waiting_.push_back(std::move(h));
+        fill();
+        return;
+    }
+
+    // The spawn that replaces the worker may block for a process start, so
+    // it comes after the handout
+    ++stats_.hits;
+    auto w = std::move(warm_.front());
+    warm_.pop_front();
+    h(bsys::error_code{}, std::move(w.worker_));
+    fill();
+}
+
+//------------------------------------------------------------------------------
+// A ready worker goes to the oldest waiting acquire, if any, or joins the warm
+// workers.
+// -----------------------------------------------------------------------------
+
+template<typename Worker>
+bool WorkerPool<Worker>::worker_ready(const std::string& instance, Worker w,
+                                      clock_type::time_point now)
+{
+    auto it = pending_.find(instance);
+    if (it == pending_.end()) return false;
+    ++stats_.ready;
+    _record_latency(std::chrono::duration_cast<std::chrono::microseconds>(now - it->second));
+    pending_.erase(it);
+
+    if (waiting_.empty())
+    {
+        warm_.push_back(_Warm{instance, std::move(w)});
+        return true;
+    }
+    auto h = std::move(waiting_.front());
+    waiting_.pop_front();
+    h(bsys::error_code{}, std::move(w));
+    return true;
+}
+
+template<typename Worker>
+bool WorkerPool<Worker>::worker_lost(const std::string& instance)
+{
+    for (auto it = warm_.begin(); it != warm_.end(); ++it)
+    {
+        if (it->instance_ != instance) continue;
+        warm_.erase(it);
+        ++stats_.lost;
+        fill();
+        return true;
+    }
+    return false;
+}
+
+template<typename Worker>
+std::size_t WorkerPool<Worker>::check_timeouts(clock_type::time_point now)
+{
+    std::size_t expired = 0;
+    for (auto it = pending_.begin(); it != pending_.end(); )
+    {
+        if (now - it->second < opts_.spawn_timeout) { ++it; continue; }
+        it = pending_.erase(it);
+        ++stats_.failed;
+        ++expired;
+    }
+    if (expired) fill();
+    return expired;
+}
+
+template<typename Worker>
+void WorkerPool<Worker>::cancel()
+{
+    auto waiting = std::move(waiting_);
+    waiting_.clear();
+    for (auto& h : waiting) h(asio::error::operation_aborted, Worker{});
+}
+
+//-------------------------------------------------------------------------------
+// WorkerPool internal member functions
+//-------------------------------------------------------------------------------
+
+// A spawn that fails outright is tried again on the next fill()
+template<typename Worker>
+bool WorkerPool<Worker>::_spawn(bsys::error_code& ec)
+{
+    auto instance = opts_.instance_prefix + "-" + std::to_string(next_instance_++);
+    ++stats_.spawned;
+    spawn_(instance, ec);
+    if (ec)
+    {
+        ++stats_.failed;
+        return false;
+    }
+    pending_.emplace(std::move(instance), clock_type::now());
+    return true;
+}
+
+// Ready workers go to the oldest acquires first, so the newest are the ones no
+// pending spawn will serve
+template<typename Worker>
+void WorkerPool<Worker>::_fail_unserved(const bsys::error_code& ec)
+{
+    std::deque<acquire_handler_t> failed;
+    while (waiting_.size() > pending_.size())
+    {
+        failed.push_front(std::move(waiting_.back()));
+        waiting_.pop_back();
+    }
+    for (auto& h : failed) h(ec, Worker{});
+}
+
+template<typename Worker>
+void WorkerPool<Worker>::_record_latency(std::chrono::microseconds latency)
+{
+    if (stats_.ready == 1 || latency < stats_.latency_min) stats_.latency_min = latency;
+    if (latency > stats_.latency_max) stats_.latency_max = latency;
+    stats_.latency_total += latency;
+
+    std::size_t bucket = 0;
+    for (auto us = latency.count(); us > 1 && bucket + 1 < stats_.latency_buckets.size(); us >>= 1)
+        ++bucket;
+    ++stats_.latency_buckets[bucket];
+}
+
+}
+
+#endif // CLSERVER_WORKER_POOL_HH
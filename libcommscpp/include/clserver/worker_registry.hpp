@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------------
+// Server side table of registered workers addressed by integer handles.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_WORKER_REGISTRY_HH
+#define CLSERVER_WORKER_REGISTRY_HH
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace clserver
+{
+
+//-------------------------------------------------------------------------------
+// WorkerRegistry maps the WorkerHandle carried by every worker Message to the
+// server's state for that worker. A worker registers its worker_instance string
+// once, in the Init message, and is given a handle in the InitReply. Routing a
+// message is then an index into a flat vector instead of a string hash.
+//
+// The low 24 bits of a handle are the slot index and the high 8 bits a
+// generation that is bumped whenever a slot is reused, so a handle kept by a
+// worker that has since been unregistered does not find the slot's new owner.
+// Handle 0 is never issued. Freed slots are reused most recently freed first.
+//
+// The registry also settles each worker's connection features. A worker offers
+// ConnectionFeature bits in its Init; the server accepts those of them it
+// supports and returns them in the InitReply, and only those are used on the
+// connection. A bit that the server doesn't know, from a newer worker, is
+// never accepted.
+// -------------------------------------------------------------------------------
+
+template<typename Entry>
+class WorkerRegistry
+{
+public:
+    static constexpr uint32_t invalid_handle = 0;
+    static constexpr uint32_t max_workers = 1u << 24;
+
+    explicit WorkerRegistry(std::size_t capacity = 64, uint32_t supported_features = 0);
+
+    WorkerRegistry(WorkerRegistry&&) = delete;
+    WorkerRegistry(const WorkerRegistry&) = delete;
+
+    WorkerRegistry& operator=(const WorkerRegistry&) = delete;
+
+    // Register a worker and return its handle. Returns invalid_handle if the
+    // instance is already registered or the table is full. The worker is given
+    // accept_features(offered_features).
+    uint32_t register_worker(const std::string& instance, Entry entry,
+                             uint32_t offered_features = 0);
+
+    // Remove a worker. Returns false if the handle is stale or unknown.
+    bool unregister(uint32_t handle);
+
+    // The entry for a handle or nullptr if the handle is stale or unknown
+    Entry* lookup(uint32_t handle);
+    const Entry* lookup(uint32_t handle) const;
+
+    // Registration time lookups by worker_instance
+    uint32_t find(const std::string& instance) const;
+    const std::string* instance(uint32_t handle) const;
+
+    // The features to put in an InitReply: those offered that are supported
+    uint32_t accept_features(uint32_t offered) const { return offered & supported_; }
+    uint32_t supported_features() const { return supported_; }
+
+    // The features accepted for a worker, or 0 if the handle is stale or unknown
+    uint32_t features(uint32_t handle) const;
+
+    std::size_t size() const { return by_instance_.size(); }
+
+private:
+    struct _Slot
+    {
+        uint32_t handle_;       // invalid_handle while the slot is free
+        uint32_t generation_;
+        uint32_t features_;
+        Entry entry_;
+        std::string instance_;
+    };
+
+    const _Slot* _slot(uint32_t handle) const;
+
+    std::vector<_Slot> slots_;
+    std::vector<uint32_t> free_;
+    std::unordered_map<std::string, uint32_t> by_instance_;
+    uint32_t supported_;
+};
+
+template<typename Entry> constexpr uint32_t WorkerRegistry<Entry>::invalid_handle;
+template<typename Entry> constexpr uint32_t WorkerRegistry<Entry>::max_workers;
+
+//-------------------------------------------------------------------------------
+// WorkerRegistry member functions
+//-------------------------------------------------------------------------------
+
+template<typename Entry>
+WorkerRegistry<Entry>::WorkerRegistry(std::size_t capacity, uint32_t supported_features) :
+    supported_{supported_features}
+{
+    slots_.reserve(capacity);
+    by_instance_.reserve(capacity);
+}
+
+template<typename Entry>
+uint32_t WorkerRegistry<Entry>::register_worker(const std::string& instance, Entry entry,
+                                                uint32_t offered_features)
+{
+    if (by_instance_.count(instance)) return invalid_handle;
+
+    uint32_t index;
+    if (!free_.empty())
+    {
+        index = free_.back();
+        free_.pop_back();
+    }
+    else
+    {
+        if (slots_.size() >= max_workers) return invalid_handle;
+        index = static_cast<uint32_t>(slots_.size());
+        slots_.push_back(_Slot{invalid_handle, 0, 0, Entry{}, std::string{}});
+    }
+
+    // Generations run 1..255 so that no handle is ever 0
+    auto& slot = slots_[index];
+    slot.generation_ = slot.generation_ % 255 + 1;
+    slot.handle_ = (slot.generation_ << 24) | index;
+    slot.features_ = accept_features(offered_features);
+    slot.entry_ = std::move(entry);
+    slot.instance_ = instance;
+    by_instance_.emplace(instance, slot.handle_);
+    return slot.handle_;
+}
+
+template<typename Entry>
+bool WorkerRegistry<Entry>::unregister(uint32_t handle)
+{
+    if (!_slot(handle)) return false;
+    auto& slot = slots_[handle & (max_workers - 1)];
+    by_instance_.erase(slot.instance_);
+    slot.handle_ = invalid_handle;
+    slot.entry_ = Entry{};
+    slot.instance_.clear();
+    free_.push_back(handle & (max_workers - 1));
+    return true;
+}
+
+template<typename Entry>
+Entry* WorkerRegistry<Entry>::lookup(uint32_t handle)
+{
+    auto slot = _slot(handle);
+    return slot ? &slots_[handle & (max_workers - 1)].entry_ : nullptr;
+}
+
+template<typename Entry>
+const Entry* WorkerRegistry<Entry>::lookup(uint32_t handle) const
+{
+    auto slot = _slot(handle);
+    return slot ? &slot->entry_ : nullptr;
+}
+
+template<typename Entry>
+uint32_t WorkerRegistry<Entry>::find(const std::string& instance) const
+{
+    auto it = by_instance_.find(instance);
+    return it == by_instance_.end() ? invalid_handle : it->second;
+}
+
+template<typename Entry>
+const std::string* WorkerRegistry<Entry>::instance(uint32_t handle) const
+{
+    auto slot = _slot(handle);
+    return slot ? &slot->instance_ : nullptr;
+}
+
+template<typename Entry>
+uint32_t WorkerRegistry<Entry>::features(uint32_t handle) const
+{
+    auto slot = _slot(handle);
+    return slot ? slot->features_ : 0;
+}
+
+template<typename Entry>
+auto WorkerRegistry<Entry>::_slot(uint32_t handle) const -> const _Slot*
+{
+    uint32_t index = handle & (max_workers - 1);
+    if (handle == invalid_handle || index >= slots_.size()) return nullptr;
+    const _Slot& slot = slots_[index];
+    return slot.handle_ == handle ? &slot : nullptr;
+}
+
+}
+
+#endif // CLSERVER_WORKER_REGISTRY_HH
@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------------
+// Replacement global operator new/delete that count per-thread allocations.
+// -------------------------------------------------------------------------------
+
+#include <cstdlib>
+#include <new>
+#include "alloc_counter.hpp"
+
+namespace
+{
+thread_local clserver_test::AllocStats tl_stats{0, 0, 0};
+
+void* counted_alloc(std::size_t size)
+{
+    ++tl_stats.allocations;
+    tl_stats.bytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+void counted_free(void* p)
+{
+    if (!p) return;
+    ++tl_stats.deallocations;
+    std::free(p);
+}
+}
+
+namespace clserver_test
+{
+AllocStats thread_alloc_stats() { return tl_stats; }
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = counted_alloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    void* p = counted_alloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
@@ -0,0 +1,48 @@
+//--------------------------------------------------------------------------------
+// Per-thread heap allocation counting for tests and benchmarks.
+//
+// Linking alloc_counter.cpp into an executable replaces the global operator
+// new/delete with versions that count calls on the calling thread. Only link it
+// into test and benchmark executables.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_TESTS_ALLOC_COUNTER_HH
+#define CLSERVER_TESTS_ALLOC_COUNTER_HH
+
+#include <cstddef>
+
+namespace clserver_test
+{
+
+struct AllocStats
+{
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t bytes;
+};
+
+// The counters for the calling thread
+AllocStats thread_alloc_stats();
+
+//-------------------------------------------------------------------------------
+// Count the allocations made by the current thread since construction.
+// -------------------------------------------------------------------------------
+
+class AllocCounter
+{
+public:
+    AllocCounter() : start_{thread_alloc_stats()} {}
+
+    void reset() { start_ = thread_alloc_stats(); }
+    std::size_t allocations() const
+    { return thread_alloc_stats().allocations - start_.allocations; }
+    std::size_t bytes() const
+    { return thread_alloc_stats().bytes - start_.bytes; }
+
+private:
+    AllocStats start_;
+};
+
+}
+
+#endif // CLSERVER_TESTS_ALLOC_COUNTER_HH
@@ -0,0 +1,173 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <cstring>
+#include <boost/asio.hpp>
+#include "worker_write_generated.h"
+#include "clserver/connection.hpp"
+#include "alloc_counter.hpp"
+
+// The flatbuffers namespaces
+namespace fbs=flatbuffers;
+namespace cs=ClingoServer;
+namespace bsys=boost::system;
+namespace asio=boost::asio;
+namespace sp=std::placeholders;
+
+using stream_socket = asio::local::stream_protocol::socket;
+using namespace clserver;
+using clserver_test::AllocCounter;
+
+//------------------------------------------------------------------------------
+// The server side of the validate-then-ping pattern in server_test.cpp. Every
+// received message is verified and echoed back from the same streambuf.
+// Checks are only recorded in the loop since Catch itself may allocate.
+//------------------------------------------------------------------------------
+
+struct EchoLoop
+{
+    Connection<stream_socket>& conn_;
+    asio::streambuf sb_;
+    bool failed_;
+
+    EchoLoop(Connection<stream_socket>& conn) : conn_{conn}, failed_{false}{ }
+
+    void start()
+    {
+        conn_.async_receive_message(sb_, std::bind(&EchoLoop::on_received,
+                                                   this, sp::_1, sp::_2));
+    }
+
+    void on_received(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        sb_.commit(s);
+        auto cbt = sb_.data();
+        fbs::Verifier verifier{static_cast<const uint8_t*>(cbt.data()), cbt.size()};
+        if (!cs::VerifyMessageBuffer(verifier)) failed_ = true;
+        conn_.async_send_message(sb_, std::bind(&EchoLoop::on_sent,
+                                                this, sp::_1, sp::_2));
+    }
+
+    void on_sent(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        sb_.consume(s);
+        start();
+    }
+};
+
+//------------------------------------------------------------------------------
+// The client side of client_test.cpp. Each message is a flatbuffer built in a
+// reused builder and sent straight from the builder's buffer. The allocation
+// counter is started once the warm up messages have been sent.
+//------------------------------------------------------------------------------
+
+struct PingLoop
+{
+    Connection<stream_socket>& conn_;
+    fbs::FlatBufferBuilder builder_;
+    asio::streambuf sbreceive_;
+    uint8_t payload_[256];
+    unsigned int i_;
+    unsigned int warmup_;
+    unsigned int total_;
+    AllocCounter counter_;
+    std::size_t steady_allocations_;
+    bool done_;
+    bool failed_;
+
+    PingLoop(Connection<stream_socket>& conn, unsigned int warmup, unsigned int total) :
+        conn_{conn}, builder_{1024}, i_{0}, warmup_{warmup}, total_{total},
+        steady_allocations_{0}, done_{false}, failed_{false}
+    {
+        std::memset(payload_, 'x', sizeof(payload_));
+    }
+
+    void start()
+    {
+        if (i_ == warmup_) counter_.reset();
+        if (i_ == total_)
+        {
+            steady_allocations_ = counter_.allocations();
+            done_ = true;
+            return;
+        }
+        ++i_;
+
+        builder_.Clear();
+        auto data = builder_.CreateVector(payload_, 1 + (i_ % sizeof(payload_)));
+        auto app = cs::CreateApplicationMsg(builder_, 1, data);
+        cs::WorkerHandle handle{1};
+        builder_.Finish(cs::CreateMessage(builder_, cs::Msg_App, app.Union(), &handle));
+
+        conn_.async_send_message(
+            asio::buffer(builder_.GetBufferPointer(), builder_.GetSize()),
+            std::bind(&PingLoop::on_sent, this, sp::_1, sp::_2));
+    }
+
+    void on_sent(const bsys::error_code& ec, std::size_t)
+    {
+        if (ec) return;
+        conn_.async_receive_message(sbreceive_, std::bind(&PingLoop::on_received,
+                                                          this, sp::_1, sp::_2));
+    }
+
+    void on_received(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        sbreceive_.commit(s);
+        auto cbt = sbreceive_.data();
+        fbs::Verifier verifier{static_cast<const uint8_t*>(cbt.data()), cbt.size()};
+        auto msg = cs::GetMessage(cbt.data());
+        if (!cs::VerifyMessageBuffer(verifier) || msg->msg_type() != cs::Msg_App ||
+            msg->msg_as_App()->data()->size() != 1 + (i_ % sizeof(payload_)))
+            failed_ = true;
+        sbreceive_.consume(s);
+        start();
+    }
+};
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("connection_steady_state_no_allocations")
+{
+    asio::io_context ioc{1};
+    stream_socket s1{ioc};
+    stream_socket s2{ioc};
+    asio::local::connect_pair(s1, s2);
+
+    Connection<stream_socket> conn1{std::move(s1), "clingoserver"};
+    Connection<stream_socket> conn2{std::move(s2), "clingoserver"};
+
+    // Warm up over the full range of message sizes so the buffers are grown
+    const unsigned int warmup = 512;
+    const unsigned int total = 10512;
+    PingLoop ping{conn1, warmup, total};
+    EchoLoop echo{conn2};
+
+    conn1.validate([&ping](const bsys::error_code& ec){ if (!ec) ping.start(); });
+    conn2.validate([&echo](const bsys::error_code& ec){ if (!ec) echo.start(); });
+
+    // Stop once the client is done; the echo side is still waiting to read
+    while (!ping.done_ && ioc.run_one()) {}
+
+    REQUIRE(ping.done_);
+    REQUIRE(!ping.failed_);
+    REQUIRE(!echo.failed_);
+    REQUIRE(ping.steady_allocations_ == 0);
+}
+
+TEST_CASE("inplace_function_no_allocations")
+{
+    struct Big { char data[48]; };
+    Big big{};
+    AllocCounter counter;
+    InplaceFunction<void(const bsys::error_code&, std::size_t)> f =
+        [big](const bsys::error_code&, std::size_t) { (void)big; };
+    auto g = f;
+    g(bsys::error_code{}, 0);
+    REQUIRE(counter.allocations() == 0);
+}
@@ -0,0 +1,49 @@
+#include "catch.hpp"
+
+#include <vector>
+#include "clserver/app_router.hpp"
+#include "clserver/msg_dispatch.hpp"
+
+namespace fbs=flatbuffers;
+namespace cs=ClingoServer;
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("app_router_subscribe_route")
+{
+    AppRouter router;
+    std::vector<int> calls;
+
+    auto s1 = router.subscribe(7, [&calls](const cs::ApplicationMsg& m, const cs::Message&)
+    {
+        calls.push_back(m.appid());
+    });
+    router.subscribe(7, [&calls](const cs::ApplicationMsg&, const cs::Message&)
+    {
+        calls.push_back(-1);
+    });
+    router.subscribe(65535, [&calls](const cs::ApplicationMsg& m, const cs::Message&)
+    {
+        calls.push_back(m.appid());
+    });
+
+    MsgDispatcher<AppRouter&> dispatcher{router};
+    fbs::FlatBufferBuilder b;
+    for (uint16_t appid : {7, 8, 65535})
+    {
+        b.Clear();
+        auto app = cs::CreateApplicationMsg(b, appid);
+        b.Finish(cs::CreateMessage(b, cs::Msg_App, app.Union()));
+        dispatcher(*cs::GetMessage(b.GetBufferPointer()));
+    }
+    REQUIRE(calls == std::vector<int>{7, -1, 65535});
+
+    REQUIRE(router.unsubscribe(7, s1));
+    REQUIRE(!router.unsubscribe(7, s1));
+    REQUIRE(router.has_subscribers(7));
+    REQUIRE(!router.has_subscribers(8));
+}
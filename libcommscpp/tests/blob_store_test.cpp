@@ -0,0 +1,183 @@
+#include "catch.hpp"
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "clserver/blob_store.hpp"
+#include "clserver/chunker.hpp"
+#include "test_helpers.hpp"
+
+using namespace clserver;
+using clserver_test::TempDir;
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+// A fact file of n lines
+std::string facts(std::size_t n, unsigned seed)
+{
+    std::mt19937 rng{seed};
+    std::string s;
+    for (std::size_t i = 0; i < n; ++i)
+        s += "edge(" + std::to_string(rng() % 100000) + "," + std::to_string(rng() % 100000) + ").\n";
+    return s;
+}
+
+std::set<std::string> hashes(const Manifest& m)
+{
+    std::set<std::string> out;
+    for (const auto& c : m.chunks) out.insert(c.hash);
+    return out;
+}
+
+void upload(BlobStore& store, const std::string& blob, const Manifest& m)
+{
+    std::size_t offset = 0;
+    auto missing = store.missing_chunks(m);
+    for (const auto& c : m.chunks)
+    {
+        if (std::find(missing.begin(), missing.end(), c.hash) != missing.end())
+        {
+            bsys::error_code ec;
+            store.put_chunk(c.hash, blob.data() + offset, c.size, ec);
+            REQUIRE(!ec);
+        }
+        offset += c.size;
+    }
+    bsys::error_code ec;
+    store.assemble(m, ec);
+    REQUIRE(!ec);
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("chunker_boundaries", "[blob_store]")
+{
+    ChunkerOptions opts;
+    opts.min_size = 256;
+    opts.avg_size = 1024;
+    opts.max_size = 4096;
+
+    auto blob = facts(20000, 1);
+    auto m = make_manifest(blob.data(), blob.size(), opts);
+    CHECK(m.id == Sha256::hex_digest(blob.data(), blob.size()));
+
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < m.chunks.size(); ++i)
+    {
+        total += m.chunks[i].size;
+        CHECK(m.chunks[i].size <= opts.max_size);
+        if (i + 1 < m.chunks.size()) CHECK(m.chunks[i].size >= opts.min_size);
+    }
+    CHECK(total == blob.size());
+    CHECK(m.chunks.size() > blob.size() / opts.max_size);
+
+    // An insertion in the middle only changes the chunks around it
+    auto edited = blob;
+    edited.insert(blob.size() / 2, "edge(1,2).\n");
+    auto m2 = make_manifest(edited.data(), edited.size(), opts);
+    auto before = hashes(m);
+    std::size_t changed = 0;
+    for (const auto& c : m2.chunks) changed += before.count(c.hash) == 0;
+    CHECK(changed <= 3);
+
+    CHECK(chunk_sizes(nullptr, 0, opts).empty());
+    CHECK(chunk_sizes("abc", 3, opts) == std::vector<std::size_t>{3});
+}
+
+TEST_CASE("blob_store_upload", "[blob_store]")
+{
+    TempDir dir{"blob_store"};
+    BlobStore store{dir.path() + "/store"};
+    bsys::error_code ec;
+    store.open(ec);
+    REQUIRE(!ec);
+
+    ChunkerOptions opts;
+    opts.min_size = 1024;
+    opts.avg_size = 4096;
+    opts.max_size = 16384;
+
+    auto blob = facts(10000, 2);
+    auto m = make_manifest(blob.data(), blob.size(), opts);
+    CHECK(store.missing_chunks(m).size() == hashes(m).size());
+    upload(store, blob, m);
+    CHECK(store.has_blob(m.id));
+    CHECK(store.missing_chunks(m).empty());
+
+    auto view = store.map(m.id, ec);
+    REQUIRE(!ec);
+    CHECK(std::string(reinterpret_cast<const char*>(view.data()), view.size()) == blob);
+
+    // A new version only needs its changed chunks
+    auto edited = blob;
+    edited.replace(blob.size() / 3, 5, "edge(");
+    edited.insert(2 * blob.size() / 3, "edge(7,7).\n");
+    auto m2 = make_manifest(edited.data(), edited.size(), opts);
+    auto need = store.missing_chunks(m2).size();
+    CHECK(need > 0);
+    CHECK(need <= 6);
+    auto stored = store.stats().chunks_stored;
+    upload(store, edited, m2);
+    CHECK(store.stats().chunks_stored == stored + need);
+    CHECK(store.stats().blobs_assembled == 2);
+
+    // Moving a view keeps the mapping
+    BlobView moved = std::move(view);
+    CHECK(moved.size() == blob.size());
+    CHECK(view.data() == nullptr);
+}
+
+TEST_CASE("blob_store_rejects_bad_input", "[blob_store]")
+{
+    TempDir dir{"blob_store"};
+    BlobStore store{dir.path()};
+    bsys::error_code ec;
+    store.open(ec);
+    REQUIRE(!ec);
+
+    // Content that doesn't match its hash, and names that aren't hashes
+    std::string data = "p(1).";
+    store.put_chunk(std::string(64, 'a'), data.data(), data.size(), ec);
+    CHECK(ec == bsys::errc::bad_message);
+    ec.clear();
+    store.put_chunk("../../etc/passwd", data.data(), data.size(), ec);
+    CHECK(ec == bsys::errc::bad_message);
+    CHECK(store.stats().chunks_rejected == 2);
+    ec.clear();
+    store.map("../x", ec);
+    CHECK(ec == bsys::errc::no_such_file_or_directory);
+
+    // A manifest whose chunks don't make up the blob
+    auto hash = Sha256::hex_digest(data.data(), data.size());
+    ec.clear();
+    store.put_chunk(hash, data.data(), data.size(), ec);
+    REQUIRE(!ec);
+    Manifest m{std::string(64, 'b'), data.size(), {ChunkInfo{hash, data.size()}}};
+    store.assemble(m, ec);
+    CHECK(ec == bsys::errc::bad_message);
+    CHECK(!store.has_blob(m.id));
+
+    // A missing chunk
+    ec.clear();
+    m.chunks.push_back(ChunkInfo{std::string(64, 'c'), 1});
+    store.assemble(m, ec);
+    CHECK(ec == bsys::errc::no_such_file_or_directory);
+
+    // Whole blobs are stored once
+    ec.clear();
+    auto id = store.put_blob(data.data(), data.size(), ec);
+    CHECK(id == hash);
+    CHECK(store.has_blob(id));
+    CHECK(store.put_blob(data.data(), data.size(), ec) == id);
+    CHECK(store.stats().blobs_assembled == 1);
+}
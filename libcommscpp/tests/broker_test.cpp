@@ -0,0 +1,183 @@
+#include "catch.hpp"
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/broker.hpp"
+#include "clserver/local_connection.hpp"
+#include "test_helpers.hpp"
+
+namespace fbs=flatbuffers;
+namespace bsys=boost::system;
+
+using namespace clserver;
+using clserver_test::make_frame;
+
+//------------------------------------------------------------------------------
+// A subscriber that records the frames it is given
+//------------------------------------------------------------------------------
+
+struct RecordingSubscriber : public SubscriberBase
+{
+    std::vector<std::string> frames;
+    void deliver(std::size_t, const SharedFrame& f) override
+    { frames.emplace_back(reinterpret_cast<const char*>(f.data()), f.size()); }
+    bool closed() const override { return false; }
+};
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("broker_topic_filters")
+{
+    REQUIRE(valid_topic_filter("job/42/models"));
+    REQUIRE(valid_topic_filter("job/+/stats"));
+    REQUIRE(valid_topic_filter("job/#"));
+    REQUIRE(valid_topic_filter("#"));
+    REQUIRE(!valid_topic_filter(""));
+    REQUIRE(!valid_topic_filter("job/#/stats"));
+    REQUIRE(!valid_topic_filter("job/4+"));
+
+    REQUIRE(topic_matches("job/42/models", "job/42/models"));
+    REQUIRE(!topic_matches("job/42/models", "job/43/models"));
+    REQUIRE(topic_matches("job/+/stats", "job/42/stats"));
+    REQUIRE(!topic_matches("job/+/stats", "job/42/models"));
+    REQUIRE(!topic_matches("job/+", "job"));
+    REQUIRE(!topic_matches("job/+", "job/42/stats"));
+    REQUIRE(topic_matches("job/#", "job"));
+    REQUIRE(topic_matches("job/#", "job/42/stats"));
+    REQUIRE(!topic_matches("job/#", "jobs/42"));
+    REQUIRE(topic_matches("#", "job/42"));
+    REQUIRE(!topic_matches("job", "job/42"));
+}
+
+TEST_CASE("broker_publish_fan_out")
+{
+    Broker broker;
+    auto s1 = std::make_shared<RecordingSubscriber>();
+    auto s2 = std::make_shared<RecordingSubscriber>();
+
+    auto id1 = broker.subscribe("job/42/models", s1);
+    broker.subscribe("job/+/stats", s1);
+    broker.subscribe("job/#", s2);
+    REQUIRE(id1 != 0);
+    REQUIRE(broker.subscribe("job/#/x", s2) == 0);
+
+    REQUIRE(broker.publish("job/42/models", make_frame("m1")) == 2);
+    REQUIRE(broker.publish("job/42/stats", make_frame("s1")) == 2);
+    REQUIRE(broker.publish("other", make_frame("o")) == 0);
+
+    REQUIRE(broker.unsubscribe(id1));
+    REQUIRE(!broker.unsubscribe(id1));
+    REQUIRE(broker.publish("job/42/models", make_frame("m2")) == 1);
+
+    REQUIRE(s1->frames == std::vector<std::string>{"m1", "s1"});
+    REQUIRE(s2->frames == std::vector<std::string>{"m1", "s1", "m2"});
+
+    REQUIRE(broker.unsubscribe_all(s1.get()) == 1);
+    REQUIRE(broker.publish("job/42/stats", make_frame("s2")) == 1);
+}
+
+TEST_CASE("broker_connection_subscribers_share_frame")
+{
+    asio::io_context ioc;
+    const int num = 3;
+    std::vector<std::unique_ptr<Connection<LocalStream>>> servers, clients;
+    for (int i = 0; i < num; ++i)
+    {
+        auto streams = make_local_stream_pair(ioc, ioc);
+        servers.emplace_back(new Connection<LocalStream>{std::move(streams.first), "cs"});
+        clients.emplace_back(new Connection<LocalStream>{std::move(streams.second), "cs"});
+        servers.back()->validate([](const bsys::error_code&){ });
+        clients.back()->validate([](const bsys::error_code&){ });
+    }
+
+    Broker broker;
+    std::vector<std::shared_ptr<Subscriber<LocalStream>>> subs;
+    for (auto& s : servers)
+    {
+        subs.push_back(Subscriber<LocalStream>::create(*s));
+        broker.subscribe("job/1/models", subs.back());
+    }
+
+    auto frame = make_frame("model");
+    REQUIRE(broker.publish("job/1/models", frame) == num);
+
+    std::vector<fbs::DetachedBuffer> received(num);
+    for (int i = 0; i < num; ++i)
+    {
+        clients[i]->async_receive_message(received[i], [](const bsys::error_code& ec, std::size_t)
+        {
+            REQUIRE(!ec);
+        });
+    }
+    ioc.run();
+
+    for (int i = 0; i < num; ++i)
+    {
+        REQUIRE(std::string(reinterpret_cast<const char*>(received[i].data()),
+                            received[i].size()) == "model");
+        REQUIRE(subs[i]->frames_sent() == 1);
+    }
+
+    // All sends have completed so only this copy of the frame remains
+    REQUIRE(frame.use_count() == 1);
+}
+
+TEST_CASE("broker_slow_subscriber_policies")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+    Connection<LocalStream> server{std::move(streams.first), "cs"};
+    Connection<LocalStream> client{std::move(streams.second), "cs"};
+    server.validate([](const bsys::error_code&){ });
+    client.validate([](const bsys::error_code&){ });
+
+    // Nothing runs the io_context while publishing, as if the client stalled
+    Subscriber<LocalStream>::Options opts;
+    opts.max_queued = 4;
+    opts.max_in_flight = 1;
+
+    Broker broker;
+    opts.policy = OverflowPolicy::DropOldest;
+    auto oldest = Subscriber<LocalStream>::create(server, opts);
+    opts.policy = OverflowPolicy::DropNewest;
+    auto newest = Subscriber<LocalStream>::create(server, opts);
+    opts.policy = OverflowPolicy::Conflate;
+    auto conflate = Subscriber<LocalStream>::create(server, opts);
+    bool disconnected = false;
+    opts.policy = OverflowPolicy::Disconnect;
+    opts.on_disconnect = [&disconnected]() { disconnected = true; };
+    auto disconnect = Subscriber<LocalStream>::create(server, opts);
+
+    for (auto s : {oldest, newest, conflate, disconnect}) broker.subscribe("job/#", s);
+
+    for (int i = 0; i < 10; ++i)
+        broker.publish(i % 2 ? "job/1/stats" : "job/1/models", make_frame(std::to_string(i)));
+
+    auto st = oldest->stats();
+    REQUIRE(st.queued == 4);
+    REQUIRE(st.dropped == 6);
+
+    st = newest->stats();
+    REQUIRE(st.queued == 4);
+    REQUIRE(st.dropped == 6);
+
+    // Only the latest frame of each topic is left
+    st = conflate->stats();
+    REQUIRE(st.queued == 2);
+    REQUIRE(st.conflated == 8);
+    REQUIRE(st.dropped == 0);
+
+    // The pumps and disconnect were dispatched to the stalled executor
+    ioc.poll();
+    REQUIRE(disconnected);
+    st = disconnect->stats();
+    REQUIRE(st.disconnected);
+    // The pump handed one frame to the connection before the disconnect
+    REQUIRE(st.dropped == 9);
+    REQUIRE(disconnect->closed());
+    REQUIRE(broker.publish("job/1/stats", make_frame("x")) == 3);
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/beast/_experimental/test/stream.hpp>
 #include "test_schema_generated.h"
 #include "clserver/connection.hpp"
@@ -39,7 +40,7 @@ struct TestSendReceive
         else return;
 
         auto cbt = sbsend_.data();
-        std::string msg{asio::buffers_begin(cbt), asio::buffers_end(cbt)};
+        boost::string_view msg{static_cast<const char*>(cbt.data()), cbt.size()};
         std::cerr << "Sending message: " <<  msg << std::endl;
         ++i_;
         conn_.async_send_message(sbsend_,
@@ -63,7 +64,7 @@ struct TestSendReceive
         sbreceive_.consume(sbreceive_.size());
         sbreceive_.commit(s);
         auto cbt = sbreceive_.data();
-        std::string msg{asio::buffers_begin(cbt), asio::buffers_end(cbt)};
+        boost::string_view msg{static_cast<const char*>(cbt.data()), cbt.size()};
         std::cerr << "Received message: " << msg << std::endl;
         start();
     }
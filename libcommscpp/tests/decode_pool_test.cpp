@@ -0,0 +1,77 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/decode_pool.hpp"
+#include "clserver/local_connection.hpp"
+
+namespace bsys=boost::system;
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// A decoder that is slow for large frames and returns the first byte
+//------------------------------------------------------------------------------
+
+struct SlowDecoder
+{
+    int operator()(const uint8_t* data, std::size_t size) const
+    {
+        if (size >= 1000) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        return size ? data[0] : -1;
+    }
+};
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("decoding_receiver_in_order")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    std::unique_ptr<Connection<LocalStream>> sender{
+        new Connection<LocalStream>{std::move(streams.first), "clingoserver"}};
+    Connection<LocalStream> receiver{std::move(streams.second), "clingoserver"};
+    sender->validate([](const bsys::error_code&){ });
+    receiver.validate([](const bsys::error_code&){ });
+
+    // Alternate large and small frames numbered by their first byte
+    const int num = 40;
+    std::vector<std::unique_ptr<asio::streambuf>> sbs;
+    for (int i = 0; i < num; ++i)
+    {
+        sbs.emplace_back(new asio::streambuf);
+        std::size_t size = (i % 3 == 0) ? 2000 : 10;
+        auto mbt = sbs.back()->prepare(size);
+        std::fill(asio::buffers_begin(mbt), asio::buffers_end(mbt), char(i));
+        sbs.back()->commit(size);
+        sender->async_send_message(*sbs.back(), [](const bsys::error_code&, std::size_t){});
+    }
+
+    DecodePool pool{2, 4};
+    DecodingReceiver<LocalStream, SlowDecoder> dr{receiver, pool, SlowDecoder{}, 1000};
+
+    std::vector<int> results;
+    bsys::error_code error;
+    dr.start([&](const bsys::error_code& ec, const uint8_t* data, std::size_t size,
+                 const int& result)
+    {
+        if (ec) { error = ec; return; }
+        REQUIRE(result == data[0]);
+        results.push_back(result);
+        if (results.size() == num) sender.reset();
+    });
+
+    // Closing the sender from the handler ends the receiver with eof
+    ioc.run();
+
+    REQUIRE(results.size() == num);
+    for (int i = 0; i < num; ++i) REQUIRE(results[i] == i);
+    REQUIRE(error == asio::error::eof);
+    REQUIRE(dr.offloaded() + dr.inlined() == num);
+    REQUIRE(dr.offloaded() > 0);
+}
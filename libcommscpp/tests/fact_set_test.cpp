@@ -0,0 +1,80 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/fact_set.hpp"
+
+using namespace clserver;
+using namespace ClingoServer;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("fact_set_builder_blocks", "[fact_set]")
+{
+    FactSetBuilder b;
+    auto edge = b.block("edge", {ArgType_Number, ArgType_Number});
+    b.add(edge, {1, 2});
+    b.add(edge, {2, -3});
+    b.add("edge", {FactSetBuilder::number(3), FactSetBuilder::number(1)});
+    b.add("node", {b.constant("a")});
+    b.add("label", {b.constant("a"), b.string("say \"hi\"\n")});
+    b.add("at", {b.function("pos", {FactSetBuilder::number(1), FactSetBuilder::number(2)}),
+                 b.tuple({b.constant("x")})}, true);
+    b.add("at", {b.function("pos", {FactSetBuilder::number(1), FactSetBuilder::number(2)}),
+                 b.tuple({b.constant("x"), b.function("f", {b.constant("y")})})}, true);
+    b.add("go", {});
+    CHECK(b.facts() == 8);
+
+    fbs::FlatBufferBuilder fbb;
+    b.finish(fbb);
+    fbs::Verifier verifier{fbb.GetBufferPointer(), fbb.GetSize()};
+    REQUIRE(VerifyFactSetBuffer(verifier));
+    REQUIRE(FactSetBufferHasIdentifier(fbb.GetBufferPointer()));
+    auto set = GetFactSet(fbb.GetBufferPointer());
+
+    // Names are stored once and same shaped facts share a block
+    CHECK(set->dictionary()->size() == 12);
+    CHECK(set->blocks()->size() == 5);
+    CHECK(set->blocks()->Get(0)->count() == 3);
+    CHECK(set->blocks()->Get(0)->values()->size() == 6);
+    CHECK(set->functions()->size() == 4);
+
+    std::string text;
+    REQUIRE(facts_to_text(*set, text));
+    CHECK(text ==
+          "edge(1,2).\n"
+          "edge(2,-3).\n"
+          "edge(3,1).\n"
+          "node(a).\n"
+          "label(a,\"say \\\"hi\\\"\\n\").\n"
+          "-at(pos(1,2),(x,)).\n"
+          "-at(pos(1,2),(x,f(y))).\n"
+          "go.\n");
+}
+
+TEST_CASE("fact_set_bad_references", "[fact_set]")
+{
+    FactSetBuilder b;
+    auto p = b.block("p", {ArgType_Constant});
+    b.add(p, {7});
+
+    fbs::FlatBufferBuilder fbb;
+    b.finish(fbb);
+    std::string text;
+    CHECK(!facts_to_text(*GetFactSet(fbb.GetBufferPointer()), text));
+
+    // A function can only refer to those before it
+    FactSetBuilder c;
+    auto q = c.block("q", {ArgType_Function});
+    c.add(q, {0});
+    fbs::FlatBufferBuilder fbb2;
+    c.finish(fbb2);
+    text.clear();
+    CHECK(!facts_to_text(*GetFactSet(fbb2.GetBufferPointer()), text));
+
+    b.clear();
+    CHECK(b.facts() == 0);
+}
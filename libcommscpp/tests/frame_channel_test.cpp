@@ -0,0 +1,139 @@
+#include "catch.hpp"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "clserver/frame_channel.hpp"
+
+using namespace clserver;
+
+namespace
+{
+
+uint32_t frame_value(const fbs::FlatBufferBuilder* b)
+{
+    uint32_t v = 0;
+    std::memcpy(&v, b->GetBufferPointer(), sizeof(v));
+    return v;
+}
+
+// Stands in for posting a drain to the I/O thread
+struct Wakeup
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool due = false;
+
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            due = true;
+        }
+        cv.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait(lock, [this]() { return due; });
+        due = false;
+    }
+};
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("frame_channel_single_thread", "[frame_channel]")
+{
+    FrameChannel channel{FrameChannel::Options{2, 64}};
+
+    auto b1 = channel.try_acquire();
+    auto b2 = channel.try_acquire();
+    REQUIRE(b1);
+    REQUIRE(b2);
+    CHECK(channel.try_acquire() == nullptr);
+
+    b1->PushElement(static_cast<uint32_t>(1));
+    b2->PushElement(static_cast<uint32_t>(2));
+
+    // Only the first of a run of frames needs a wakeup
+    CHECK(channel.publish(b1));
+    CHECK_FALSE(channel.publish(b2));
+
+    std::vector<fbs::FlatBufferBuilder*> sent;
+    channel.drain([&](fbs::FlatBufferBuilder* b) { sent.push_back(b); });
+    REQUIRE(sent.size() == 2);
+    CHECK(frame_value(sent[0]) == 1);
+    CHECK(frame_value(sent[1]) == 2);
+
+    channel.release(sent[0]);
+    auto b3 = channel.try_acquire();
+    CHECK(b3 == b1);
+    CHECK(b3->GetSize() == 0);
+
+    // Drained, so the next frame wakes the consumer again
+    CHECK(channel.publish(b3));
+    CHECK(channel.stats().published == 3);
+    CHECK(channel.stats().waits == 0);
+}
+
+TEST_CASE("frame_channel_threads", "[frame_channel]")
+{
+    const uint32_t count = 20000;
+    FrameChannel channel{FrameChannel::Options{4, 64}};
+    Wakeup wakeup;
+
+    std::thread producer{[&]()
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            auto b = channel.acquire();
+            if (!b) return;
+            b->PushElement(i);
+            if (channel.publish(b)) wakeup.notify();
+        }
+    }};
+
+    // Keep the last frame of each drain until the next one, as a send that
+    // completes later would
+    uint32_t next = 0;
+    bool in_order = true;
+    fbs::FlatBufferBuilder* held = nullptr;
+    while (next < count)
+    {
+        wakeup.wait();
+        channel.drain([&](fbs::FlatBufferBuilder* b)
+        {
+            if (frame_value(b) != next++) in_order = false;
+            if (held) channel.release(held);
+            held = b;
+        });
+    }
+    if (held) channel.release(held);
+    producer.join();
+
+    CHECK(in_order);
+    CHECK(next == count);
+    CHECK(channel.stats().published == count);
+}
+
+TEST_CASE("frame_channel_close", "[frame_channel]")
+{
+    FrameChannel channel{FrameChannel::Options{1, 64}};
+    auto b = channel.acquire();
+    REQUIRE(b);
+
+    fbs::FlatBufferBuilder* waited = b;
+    std::thread producer{[&]() { waited = channel.acquire(); }};
+    channel.close();
+    producer.join();
+    CHECK(waited == nullptr);
+    CHECK(channel.closed());
+    CHECK(channel.try_acquire() == nullptr);
+}
@@ -0,0 +1,126 @@
+#include "catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "clserver/inflight_jobs.hpp"
+#include "clserver/result_cache.hpp"
+#include "test_helpers.hpp"
+
+using namespace clserver;
+using clserver_test::make_frame;
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+struct JobSubscriber : public SubscriberBase
+{
+    std::vector<std::string> frames;
+    bool closed_ = false;
+    void deliver(std::size_t, const SharedFrame& f) override
+    { frames.emplace_back(reinterpret_cast<const char*>(f.data()), f.size()); }
+    bool closed() const override { return closed_; }
+};
+
+using strings = std::vector<std::string>;
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("inflight_jobs_single_flight", "[inflight_jobs]")
+{
+    InflightJobs jobs;
+    JobSpec spec{"p(1..3).", {}, {"0"}, "enumerate"};
+    auto key = spec.key();
+
+    auto s1 = std::make_shared<JobSubscriber>();
+    auto s2 = std::make_shared<JobSubscriber>();
+    auto s3 = std::make_shared<JobSubscriber>();
+
+    auto first = jobs.submit(key, s1);
+    CHECK(first.started);
+    CHECK(jobs.find(key) == first.job_id);
+    CHECK(jobs.publish(first.job_id, make_frame("m1")) == 1);
+    CHECK(jobs.publish(first.job_id, make_frame("m2")) == 1);
+
+    // A duplicate attaches and is caught up with the models so far
+    auto second = jobs.submit(key, s2);
+    CHECK(!second.started);
+    CHECK(second.job_id == first.job_id);
+    CHECK(s2->frames == strings{"m1", "m2"});
+
+    CHECK(jobs.publish(first.job_id, make_frame("m3")) == 2);
+    jobs.submit(key, s3);
+    CHECK(jobs.subscribers(first.job_id) == 3);
+
+    // A subscriber that goes away stops receiving
+    CHECK(jobs.detach(first.job_id, s2.get()) == 2);
+    s3->closed_ = true;
+    CHECK(jobs.publish(first.job_id, make_frame("end")) == 1);
+
+    CHECK(s1->frames == strings{"m1", "m2", "m3", "end"});
+    CHECK(s2->frames == strings{"m1", "m2", "m3"});
+    CHECK(s3->frames == strings{"m1", "m2", "m3"});
+
+    // The whole stream is handed back for the result cache
+    auto result = jobs.complete(first.job_id);
+    CHECK(result.complete);
+    CHECK(result.key == key);
+    CHECK(result.frames.size() == 4);
+    CHECK(jobs.size() == 0);
+    CHECK(jobs.find(key) == 0);
+
+    ResultCache cache{ResultCache::Options{}};
+    cache.insert(result.key, std::move(result.frames));
+    CHECK(cache.lookup(key)->size() == 4);
+
+    // Once finished the next submission starts a new job
+    auto third = jobs.submit(key, std::make_shared<JobSubscriber>());
+    CHECK(third.started);
+    CHECK(third.job_id != first.job_id);
+    CHECK(jobs.abort(third.job_id));
+    CHECK(!jobs.abort(third.job_id));
+    CHECK(jobs.find(key) == 0);
+
+    CHECK(jobs.stats().started == 2);
+    CHECK(jobs.stats().joined == 2);
+    CHECK(jobs.stats().caught_up == 5);
+    CHECK(jobs.stats().completed == 1);
+    CHECK(jobs.stats().aborted == 1);
+}
+
+TEST_CASE("inflight_jobs_record_limit", "[inflight_jobs]")
+{
+    InflightJobs::Options opts;
+    opts.max_record_bytes = 4;
+    InflightJobs jobs{opts};
+
+    auto s1 = std::make_shared<JobSubscriber>();
+    auto big = jobs.submit("k", s1);
+    jobs.publish(big.job_id, make_frame("aa"));
+    jobs.publish(big.job_id, make_frame("bbb"));
+
+    // Too much to replay, so a duplicate runs on its own
+    auto s2 = std::make_shared<JobSubscriber>();
+    auto other = jobs.submit("k", s2);
+    CHECK(other.started);
+    CHECK(s2->frames.empty());
+
+    // The first job still streams to its subscribers but can't be cached
+    CHECK(jobs.publish(big.job_id, make_frame("c")) == 1);
+    CHECK(s1->frames == strings{"aa", "bbb", "c"});
+    auto result = jobs.complete(big.job_id);
+    CHECK(!result.complete);
+    CHECK(result.frames.empty());
+
+    // and finishing it leaves the newer job joinable
+    CHECK(jobs.find("k") == other.job_id);
+    CHECK(jobs.stats().unshared == 1);
+}
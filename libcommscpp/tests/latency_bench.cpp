@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/busy_poll.hpp"
+#include "clserver/connection.hpp"
+
+namespace bsys=boost::system;
+namespace asio=boost::asio;
+namespace sp=std::placeholders;
+
+using boost::asio::ip::tcp;
+using namespace clserver;
+using bench_clock = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+// Round trip latency over a loopback TCP Connection. The echo side is the ping
+// loop of server_test.cpp. Each run mode is measured with its own pair of
+// threads: the default ioc.run() and run_busy_poll() with pinned threads.
+// The client finishes with "exit" which ends the echo loop, as in server_test.
+//
+// Busy polling needs a core per polling thread; with fewer than two cores the
+// two spinning threads compete and the busy-poll numbers are meaningless.
+//------------------------------------------------------------------------------
+
+enum class RunMode { Default, BusyPoll };
+
+static void run_ioc(asio::io_context& ioc, RunMode mode, int cpu)
+{
+    if (mode == RunMode::Default) { ioc.run(); return; }
+    BusyPollOptions opts;
+    if (std::thread::hardware_concurrency() >= 2) opts.cpu = cpu;
+    run_busy_poll(ioc, opts);
+}
+
+struct EchoLoop
+{
+    Connection<tcp::socket>& conn_;
+    asio::streambuf sb_;
+
+    EchoLoop(Connection<tcp::socket>& conn) : conn_{conn}{ }
+
+    void start()
+    {
+        conn_.async_receive_message(sb_, std::bind(&EchoLoop::on_received,
+                                                   this, sp::_1, sp::_2));
+    }
+
+    void on_received(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        sb_.commit(s);
+        auto cbt = sb_.data();
+        if (s == 4 && std::equal(asio::buffers_begin(cbt), asio::buffers_end(cbt), "exit"))
+            return;
+        conn_.async_send_message(sb_, std::bind(&EchoLoop::on_sent,
+                                                this, sp::_1, sp::_2));
+    }
+
+    void on_sent(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        sb_.consume(s);
+        start();
+    }
+};
+
+struct PingLoop
+{
+    Connection<tcp::socket>& conn_;
+    asio::streambuf sb_;
+    char payload_[64];
+    std::size_t remaining_;
+    bench_clock::time_point sent_at_;
+    std::vector<double> rtts_us_;
+
+    PingLoop(Connection<tcp::socket>& conn, std::size_t count) :
+        conn_{conn}, remaining_{count}
+    {
+        std::fill(payload_, payload_ + sizeof(payload_), 'p');
+        rtts_us_.reserve(count);
+    }
+
+    void start()
+    {
+        if (remaining_ == 0)
+        {
+            conn_.async_send_message(asio::buffer("exit", 4),
+                                     [](const bsys::error_code&, std::size_t){});
+            return;
+        }
+        --remaining_;
+        sent_at_ = bench_clock::now();
+        conn_.async_send_message(asio::buffer(payload_, sizeof(payload_)),
+                                 std::bind(&PingLoop::on_sent, this, sp::_1, sp::_2));
+    }
+
+    void on_sent(const bsys::error_code& ec, std::size_t)
+    {
+        if (ec) return;
+        conn_.async_receive_message(sb_, std::bind(&PingLoop::on_received,
+                                                   this, sp::_1, sp::_2));
+    }
+
+    void on_received(const bsys::error_code& ec, std::size_t s)
+    {
+        if (ec) return;
+        std::chrono::duration<double, std::micro> rtt = bench_clock::now() - sent_at_;
+        rtts_us_.push_back(rtt.count());
+        sb_.consume(s);
+        start();
+    }
+};
+
+static std::vector<double> measure(RunMode mode, std::size_t count)
+{
+    asio::io_context server_ioc{1};
+    asio::io_context client_ioc{1};
+    tcp::acceptor acceptor{server_ioc, tcp::endpoint(asio::ip::address_v4::loopback(), 0)};
+
+    tcp::socket server_socket{server_ioc};
+    tcp::socket client_socket{client_ioc};
+    client_socket.connect(acceptor.local_endpoint());
+    acceptor.accept(server_socket);
+
+    if (mode == RunMode::BusyPoll)
+    {
+        bsys::error_code server_ec, client_ec;
+        set_low_latency(server_socket, 50, server_ec);
+        set_low_latency(client_socket, 50, client_ec);
+        auto ec = server_ec ? server_ec : client_ec;
+        if (ec) std::cerr << "SO_BUSY_POLL not set: " << ec.message() << std::endl;
+    }
+    else
+    {
+        server_socket.set_option(tcp::no_delay(true));
+        client_socket.set_option(tcp::no_delay(true));
+    }
+
+    Connection<tcp::socket> server_conn{std::move(server_socket), "clingoserver"};
+    Connection<tcp::socket> client_conn{std::move(client_socket), "clingoserver"};
+    EchoLoop echo{server_conn};
+    PingLoop ping{client_conn, count};
+    server_conn.validate([&echo](const bsys::error_code& ec){ if (!ec) echo.start(); });
+    client_conn.validate([&ping](const bsys::error_code& ec){ if (!ec) ping.start(); });
+
+    std::thread server_thread{[&server_ioc, mode](){ run_ioc(server_ioc, mode, 0); }};
+    run_ioc(client_ioc, mode, 1);
+    server_thread.join();
+    return ping.rtts_us_;
+}
+
+static void report(const char* name, std::vector<double> rtts, std::size_t warmup)
+{
+    rtts.erase(rtts.begin(), rtts.begin() + std::min(warmup, rtts.size()));
+    if (rtts.empty()) { std::cout << name << ": no samples" << std::endl; return; }
+    std::sort(rtts.begin(), rtts.end());
+    double sum = 0;
+    for (auto r : rtts) sum += r;
+    std::cout << name << ": n=" << rtts.size()
+              << " mean=" << sum / rtts.size() << "us"
+              << " p50=" << rtts[rtts.size() / 2] << "us"
+              << " p99=" << rtts[rtts.size() * 99 / 100] << "us"
+              << " max=" << rtts.back() << "us" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// Usage: latency_bench [round_trips]
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+        std::size_t warmup = count / 10;
+        if (std::thread::hardware_concurrency() < 2)
+            std::cerr << "Warning: busy polling needs at least two cores" << std::endl;
+
+        report("ioc.run()      ", measure(RunMode::Default, count), warmup);
+        report("run_busy_poll()", measure(RunMode::BusyPoll, count), warmup);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,350 @@
+#include "catch.hpp"
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/local_connection.hpp"
+
+namespace fbs=flatbuffers;
+namespace bsys=boost::system;
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Helper functions to create and read test messages
+//------------------------------------------------------------------------------
+
+static fbs::DetachedBuffer make_buffer(const std::string& str)
+{
+    auto buf = new uint8_t[str.size()];
+    std::memcpy(buf, str.data(), str.size());
+    return fbs::DetachedBuffer(nullptr, false, buf, str.size(), buf, str.size());
+}
+
+static std::string to_string(const fbs::DetachedBuffer& db)
+{
+    return std::string(reinterpret_cast<const char*>(db.data()), db.size());
+}
+
+//------------------------------------------------------------------------------
+// Ping loop that bounces messages back until it receives "exit"
+//------------------------------------------------------------------------------
+
+struct LocalPingLoop
+{
+    Connection<LocalStream>& conn_;
+    fbs::DetachedBuffer db_;
+    unsigned int count_;
+
+    LocalPingLoop(Connection<LocalStream>& conn) : conn_{conn}, count_{0}{ }
+
+    void start()
+    {
+        conn_.async_receive_message(db_, [this](const bsys::error_code& ec, std::size_t)
+        {
+            if (ec || to_string(db_) == "exit") return;
+            ++count_;
+            conn_.async_send_message(std::move(db_),
+                                     [this](const bsys::error_code& ec, std::size_t)
+                                     { if (!ec) start(); });
+        });
+    }
+};
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("local_connection_validate")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    bsys::error_code validated_ec1 = asio::error::would_block;
+    bsys::error_code validated_ec2 = asio::error::would_block;
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+    conn1.validate(
+        [&validated_ec1](const bsys::error_code& e){ validated_ec1 = e; });
+    conn2.validate(
+        [&validated_ec2](const bsys::error_code& e){ validated_ec2 = e; });
+
+    ioc.run();
+    REQUIRE(validated_ec1.value() == 0);
+    REQUIRE(validated_ec2.value() == 0);
+}
+
+TEST_CASE("local_connection_validate_mismatch")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    bsys::error_code validated_ec;
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "somethingelse"};
+    conn1.validate([&validated_ec](const bsys::error_code& e){ validated_ec = e; });
+    conn2.validate([](const bsys::error_code&){ });
+
+    ioc.run();
+    REQUIRE(validated_ec == bsys::errc::make_error_code(bsys::errc::bad_message));
+}
+
+TEST_CASE("local_connection_send_receive")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc, 2);
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+    conn1.validate([](const bsys::error_code&){ });
+    conn2.validate([](const bsys::error_code&){ });
+
+    // Queue more messages than the channel capacity
+    const uint8_t* sent_ptr = nullptr;
+    for (int i = 0; i < 5; ++i)
+    {
+        auto db = make_buffer("msg" + std::to_string(i));
+        if (i == 0) sent_ptr = db.data();
+        conn1.async_send_message(std::move(db), [](const bsys::error_code&, std::size_t){});
+    }
+
+    // Zero-copy receive gets the same buffer that was sent
+    fbs::DetachedBuffer received;
+    std::string first;
+    conn2.async_receive_message(received, [&](const bsys::error_code& ec, std::size_t)
+    {
+        REQUIRE(!ec);
+        REQUIRE(received.data() == sent_ptr);
+        first = to_string(received);
+    });
+
+    // Streambuf receive follows the stream Connection contract
+    asio::streambuf sb;
+    std::vector<std::string> rest;
+    for (int i = 1; i < 5; ++i)
+    {
+        conn2.async_receive_message(sb, [&](const bsys::error_code& ec, std::size_t s)
+        {
+            REQUIRE(!ec);
+            sb.commit(s);
+            auto cbt = sb.data();
+            rest.emplace_back(asio::buffers_begin(cbt), asio::buffers_end(cbt));
+            sb.consume(s);
+        });
+    }
+
+    ioc.run();
+    REQUIRE(first == "msg0");
+    REQUIRE(rest == std::vector<std::string>{"msg1", "msg2", "msg3", "msg4"});
+}
+
+TEST_CASE("local_connection_pooled_copies")
+{
+    asio::io_context ioc;
+    fbs::DetachedBuffer kept;
+    {
+        auto streams = make_local_stream_pair(ioc, ioc);
+        Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+        Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+        conn1.validate([](const bsys::error_code&){ });
+        conn2.validate([](const bsys::error_code&){ });
+
+        // A copied message's buffer is reused once the receiver lets go of it,
+        // for any message of the same size class
+        std::vector<std::string> sent{"first", std::string(40, 's'), std::string(60, 't')};
+        std::vector<const uint8_t*> ptrs;
+        std::vector<std::string> texts;
+        fbs::DetachedBuffer received;
+        for (const auto& text : sent)
+        {
+            conn1.async_send_message(asio::buffer(text),
+                                     [](const bsys::error_code& ec, std::size_t)
+                                     { REQUIRE(!ec); });
+            conn2.async_receive_message(received, [&](const bsys::error_code& ec, std::size_t)
+            {
+                REQUIRE(!ec);
+                ptrs.push_back(received.data());
+                texts.push_back(to_string(received));
+                received = fbs::DetachedBuffer{};
+            });
+            ioc.run();
+            ioc.restart();
+        }
+        REQUIRE(texts == sent);
+        CHECK(ptrs[1] == ptrs[0]);
+        CHECK(ptrs[2] == ptrs[0]);
+
+        // Messages above the pooled sizes are copied as well
+        std::string big(LocalBufferPool::max_size + 1, 'x');
+        conn1.async_send_message(asio::buffer(big), [](const bsys::error_code&, std::size_t){ });
+        conn2.async_receive_message(kept, [](const bsys::error_code& ec, std::size_t)
+                                    { REQUIRE(!ec); });
+        ioc.run();
+        ioc.restart();
+        REQUIRE(to_string(kept) == big);
+
+        conn1.async_send_message(asio::buffer("last", 4), [](const bsys::error_code&, std::size_t){ });
+        conn2.async_receive_message(kept, [](const bsys::error_code&, std::size_t){ });
+        ioc.run();
+    }
+
+    // A received buffer outlives the connections and the pool it came from
+    REQUIRE(to_string(kept) == "last");
+    CHECK(LocalBufferPool::capacity(1) == 64);
+    CHECK(LocalBufferPool::capacity(65) == 128);
+    CHECK(LocalBufferPool::capacity(LocalBufferPool::max_size + 1) ==
+          LocalBufferPool::max_size + 1);
+}
+
+TEST_CASE("local_connection_send_latest")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc, 2);
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+    conn1.validate([](const bsys::error_code&){ });
+    conn2.validate([](const bsys::error_code&){ });
+
+    // Everything waits for validation so each key keeps only its latest frame
+    std::vector<std::string> frames{"bulk", "cost=10", "stats1", "cost=7", "cost=5"};
+    int aborted = 0;
+    auto h = [&aborted](const bsys::error_code& ec, std::size_t)
+    { if (ec == asio::error::operation_aborted) ++aborted; };
+    conn1.async_send_message(asio::buffer(frames[0]), h);
+    conn1.async_send_latest(2, 1, asio::buffer(frames[1]), h);
+    conn1.async_send_latest(2, 2, asio::buffer(frames[2]), h);
+    conn1.async_send_latest(2, 1, asio::buffer(frames[3]), h);
+    conn1.async_send_latest(2, 1, asio::buffer(frames[4]), h);
+    REQUIRE(conn1.conflated() == 2);
+
+    std::vector<std::string> received;
+    std::vector<fbs::DetachedBuffer> dbs(3);
+    for (auto& db : dbs)
+    {
+        conn2.async_receive_message(db, [&](const bsys::error_code& ec, std::size_t)
+        {
+            REQUIRE(!ec);
+            received.push_back(to_string(db));
+        });
+    }
+
+    ioc.run();
+    REQUIRE(received == std::vector<std::string>{"bulk", "cost=5", "stats1"});
+    REQUIRE(aborted == 2);
+}
+
+TEST_CASE("local_connection_peer_closed")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    bsys::error_code received_ec;
+    {
+        Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+        conn1.validate([](const bsys::error_code&){ });
+        conn2.validate([](const bsys::error_code&){ });
+        ioc.run();
+        ioc.restart();
+    }
+
+    asio::streambuf sb;
+    conn1.async_receive_message(sb, [&](const bsys::error_code& ec, std::size_t)
+                                { received_ec = ec; });
+    ioc.run();
+    REQUIRE(received_ec == asio::error::eof);
+}
+
+TEST_CASE("local_connection_threads")
+{
+    asio::io_context ioc1;
+    asio::io_context ioc2;
+    auto streams = make_local_stream_pair(ioc1, ioc2, 8);
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+
+    LocalPingLoop pl{conn2};
+    conn2.validate([&pl](const bsys::error_code& ec){ if (!ec) pl.start(); });
+
+    const int num = 1000;
+    int received = 0;
+    fbs::DetachedBuffer db;
+    std::function<void()> next = [&]()
+    {
+        auto msg = received < num ? "ping" + std::to_string(received) : std::string("exit");
+        conn1.async_send_message(make_buffer(msg), [](const bsys::error_code&, std::size_t){});
+        if (received == num) return;
+        conn1.async_receive_message(db, [&, msg](const bsys::error_code& ec, std::size_t)
+        {
+            REQUIRE(!ec);
+            REQUIRE(to_string(db) == msg);
+            ++received;
+            next();
+        });
+    };
+    conn1.validate([&next](const bsys::error_code& ec){ if (!ec) next(); });
+
+    std::thread t{[&ioc2](){ ioc2.run(); }};
+    ioc1.run();
+    t.join();
+
+    REQUIRE(received == num);
+    REQUIRE(pl.count_ == num);
+}
+
+// With room for one message each way both ends keep finding the inbox full,
+// so every message goes through the blocked handshake from both threads
+TEST_CASE("local_connection_threads_full_inbox")
+{
+    asio::io_context ioc1;
+    asio::io_context ioc2;
+    auto streams = make_local_stream_pair(ioc1, ioc2, 1);
+
+    Connection<LocalStream> conn1{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> conn2{std::move(streams.second), "clingoserver"};
+
+    const int num = 2000;
+    struct End
+    {
+        Connection<LocalStream>& conn_;
+        fbs::DetachedBuffer db_;
+        int received_ = 0;
+        bool in_order_ = true;
+
+        void receive()
+        {
+            conn_.async_receive_message(db_, [this](const bsys::error_code& ec, std::size_t)
+            {
+                if (ec) return;
+                if (to_string(db_) != std::to_string(received_)) in_order_ = false;
+                if (++received_ < num) receive();
+            });
+        }
+
+        void start()
+        {
+            receive();
+            for (int i = 0; i < num; ++i)
+                conn_.async_send_message(make_buffer(std::to_string(i)),
+                                         [](const bsys::error_code&, std::size_t){});
+        }
+    };
+    End end1{conn1};
+    End end2{conn2};
+    conn1.validate([&end1](const bsys::error_code& ec){ if (!ec) end1.start(); });
+    conn2.validate([&end2](const bsys::error_code& ec){ if (!ec) end2.start(); });
+
+    std::thread t{[&ioc2](){ ioc2.run(); }};
+    ioc1.run();
+    t.join();
+
+    REQUIRE(end1.received_ == num);
+    REQUIRE(end2.received_ == num);
+    REQUIRE(end1.in_order_);
+    REQUIRE(end2.in_order_);
+}
@@ -1,6 +1,8 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <functional>
+#include <string>
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/beast/_experimental/test/stream.hpp>
@@ -64,3 +66,101 @@ TEST_CASE("validate_connection")
               << validated_ec1.value() << std::endl;
     REQUIRE(validated_ec1.value() == 0);
 }
+
+TEST_CASE("send_latest_conflates")
+{
+    asio::io_context ioc;
+    bbtest::stream s1{ioc};
+    bbtest::stream s2{ioc};
+    s1.connect(s2);
+
+    Connection<bbtest::stream> conn1{std::move(s1), "clingoserver"};
+    Connection<bbtest::stream> conn2{std::move(s2), "clingoserver"};
+    conn1.validate([](const bsys::error_code&){ });
+    conn2.validate([](const bsys::error_code&){ });
+
+    // Nothing is sent until validated so p1 is replaced by p2 in its place
+    std::string bulk = "bulk", p1 = "progress1", s = "stats", p2 = "progress2";
+    std::vector<bsys::error_code> results(4);
+    conn1.async_send_message(asio::buffer(bulk),
+        [&results](const bsys::error_code& ec, std::size_t){ results[0] = ec; });
+    conn1.async_send_latest(1, 1, asio::buffer(p1),
+        [&results](const bsys::error_code& ec, std::size_t){ results[1] = ec; });
+    conn1.async_send_latest(1, 2, asio::buffer(s),
+        [&results](const bsys::error_code& ec, std::size_t){ results[2] = ec; });
+    conn1.async_send_latest(1, 1, asio::buffer(p2),
+        [&results](const bsys::error_code& ec, std::size_t){ results[3] = ec; });
+    REQUIRE(conn1.conflated() == 1);
+
+    std::vector<std::string> received;
+    asio::streambuf sb;
+    std::function<void()> receive = [&]()
+    {
+        conn2.async_receive_message(sb, [&](const bsys::error_code& ec, std::size_t n)
+        {
+            REQUIRE(!ec);
+            sb.commit(n);
+            auto cbt = sb.data();
+            received.emplace_back(asio::buffers_begin(cbt), asio::buffers_end(cbt));
+            sb.consume(n);
+            if (received.size() < 3) receive();
+        });
+    };
+    receive();
+    ioc.run();
+
+    REQUIRE(received == std::vector<std::string>{"bulk", "progress2", "stats"});
+    REQUIRE(results[1] == asio::error::operation_aborted);
+    REQUIRE(!results[0]);
+    REQUIRE(!results[2]);
+    REQUIRE(!results[3]);
+}
+
+TEST_CASE("send_latest_from_completion_handler")
+{
+    asio::io_context ioc;
+    bbtest::stream s1{ioc};
+    bbtest::stream s2{ioc};
+    s1.connect(s2);
+
+    Connection<bbtest::stream> conn1{std::move(s1), "clingoserver"};
+    Connection<bbtest::stream> conn2{std::move(s2), "clingoserver"};
+    conn1.validate([](const bsys::error_code&){ });
+    conn2.validate([](const bsys::error_code&){ });
+
+    // When bulk has been written p1 is at the front but not started, so the
+    // update queued by bulk's handler replaces it
+    std::string bulk = "bulk", p1 = "progress1", p2 = "progress2";
+    std::vector<bsys::error_code> results(3);
+    conn1.async_send_message(asio::buffer(bulk), [&](const bsys::error_code& ec, std::size_t)
+    {
+        results[0] = ec;
+        conn1.async_send_latest(1, 1, asio::buffer(p2),
+            [&results](const bsys::error_code& ec, std::size_t){ results[2] = ec; });
+    });
+    conn1.async_send_latest(1, 1, asio::buffer(p1),
+        [&results](const bsys::error_code& ec, std::size_t){ results[1] = ec; });
+
+    std::vector<std::string> received;
+    asio::streambuf sb;
+    std::function<void()> receive = [&]()
+    {
+        conn2.async_receive_message(sb, [&](const bsys::error_code& ec, std::size_t n)
+        {
+            REQUIRE(!ec);
+            sb.commit(n);
+            auto cbt = sb.data();
+            received.emplace_back(asio::buffers_begin(cbt), asio::buffers_end(cbt));
+            sb.consume(n);
+            if (received.size() < 2) receive();
+        });
+    };
+    receive();
+    ioc.run();
+
+    REQUIRE(received == std::vector<std::string>{"bulk", "progress2"});
+    REQUIRE(conn1.conflated() == 1);
+    REQUIRE(!results[0]);
+    REQUIRE(results[1] == asio::error::operation_aborted);
+    REQUIRE(!results[2]);
+}
@@ -0,0 +1,138 @@
+#include "catch.hpp"
+
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/local_connection.hpp"
+#include "clserver/message_batcher.hpp"
+#include "clserver/messages.hpp"
+
+namespace fbs=flatbuffers;
+namespace cs=ClingoServer;
+namespace bsys=boost::system;
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("message_batcher_batches_while_busy")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    Connection<LocalStream> worker{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> server{std::move(streams.second), "clingoserver"};
+    worker.validate([](const bsys::error_code&){ });
+    server.validate([](const bsys::error_code&){ });
+
+    MessageBatcher<LocalStream>::Options opts;
+    opts.max_delay = std::chrono::seconds(10);
+    MessageBatcher<LocalStream> batcher{worker, 42, opts};
+
+    // The first message goes out at once, the rest wait for it to be sent
+    for (uint8_t i = 0; i < 10; ++i) batcher.add_app(i, &i, 1);
+
+    std::vector<fbs::DetachedBuffer> frames(2);
+    std::vector<uint16_t> appids;
+    for (auto& db : frames)
+    {
+        server.async_receive_message(db, [&db, &appids](const bsys::error_code& ec, std::size_t)
+        {
+            REQUIRE(!ec);
+            REQUIRE(MessageDecoder{}(db.data(), db.size()) != nullptr);
+            auto msg = cs::GetMessage(db.data());
+            REQUIRE(msg->handle()->id() == 42);
+            for_each_msg(*msg, [&appids](cs::Msg type, const void* m)
+            {
+                REQUIRE(type == cs::Msg_App);
+                appids.push_back(static_cast<const cs::ApplicationMsg*>(m)->appid());
+            });
+        });
+    }
+
+    ioc.run();
+
+    REQUIRE(cs::GetMessage(frames[0].data())->msg_type() == cs::Msg_App);
+    REQUIRE(cs::GetMessage(frames[1].data())->msg_type() == cs::Msg_Batch);
+    REQUIRE(appids == std::vector<uint16_t>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    REQUIRE(batcher.frames_sent() == 2);
+    REQUIRE(batcher.messages_sent() == 10);
+}
+
+TEST_CASE("message_batcher_drops_after_error")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc, 2);
+
+    Connection<LocalStream> worker{std::move(streams.first), "clingoserver"};
+    std::unique_ptr<Connection<LocalStream>> server{
+        new Connection<LocalStream>{std::move(streams.second), "clingoserver"}};
+    worker.validate([](const bsys::error_code& ec){ REQUIRE(!ec); });
+    server->validate([](const bsys::error_code& ec){ REQUIRE(!ec); });
+    ioc.run();
+    ioc.restart();
+
+    MessageBatcher<LocalStream>::Options opts;
+    opts.max_delay = std::chrono::seconds(10);
+    MessageBatcher<LocalStream> batcher{worker, 42, opts};
+
+    // The first frame fills the peer's inbox, the second waits and the rest
+    // accumulate
+    for (uint8_t i = 0; i < 5; ++i)
+    {
+        batcher.add_app(i, &i, 1);
+        ioc.poll();
+    }
+    REQUIRE(batcher.frames_sent() == 2);
+
+    // Once the peer is gone the accumulated messages are dropped
+    server.reset();
+    ioc.restart();
+    ioc.run();
+    REQUIRE(batcher.error() == asio::error::broken_pipe);
+    REQUIRE(batcher.messages_dropped() == 3);
+    REQUIRE(batcher.messages_sent() == 2);
+}
+
+TEST_CASE("message_batcher_outlived_by_sends")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc, 2);
+
+    Connection<LocalStream> worker{std::move(streams.first), "clingoserver"};
+    Connection<LocalStream> server{std::move(streams.second), "clingoserver"};
+    worker.validate([](const bsys::error_code& ec){ REQUIRE(!ec); });
+    server.validate([](const bsys::error_code& ec){ REQUIRE(!ec); });
+    ioc.run();
+    ioc.restart();
+
+    // The batcher goes away with a frame waiting to be sent and its timer armed
+    {
+        MessageBatcher<LocalStream>::Options opts;
+        opts.max_delay = std::chrono::seconds(10);
+        MessageBatcher<LocalStream> batcher{worker, 42, opts};
+        for (uint8_t i = 0; i < 4; ++i)
+        {
+            batcher.add_app(i, &i, 1);
+            ioc.poll();
+        }
+    }
+
+    std::vector<fbs::DetachedBuffer> frames(2);
+    std::vector<uint16_t> appids;
+    for (auto& db : frames)
+    {
+        server.async_receive_message(db, [&db, &appids](const bsys::error_code& ec, std::size_t)
+        {
+            REQUIRE(!ec);
+            auto msg = cs::GetMessage(db.data());
+            REQUIRE(msg->msg_type() == cs::Msg_App);
+            appids.push_back(msg->msg_as_App()->appid());
+        });
+    }
+    ioc.restart();
+    ioc.run();
+    REQUIRE(appids == std::vector<uint16_t>{0, 1});
+}
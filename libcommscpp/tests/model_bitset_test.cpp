@@ -0,0 +1,82 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <vector>
+#include "clserver/model_bitset.hpp"
+
+using namespace clserver;
+
+namespace
+{
+
+std::vector<uint32_t> random_ids(std::size_t universe, int percent, std::mt19937& gen)
+{
+    std::vector<uint32_t> ids;
+    std::uniform_int_distribution<int> pick(0, 99);
+    for (uint32_t id = 0; id < universe; ++id)
+        if (pick(gen) < percent) ids.push_back(id);
+    return ids;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("bitset_roundtrip", "[model_bitset]")
+{
+    std::mt19937 gen{7};
+    std::vector<uint64_t> words;
+    std::vector<uint32_t> back;
+
+    // Sizes around the vector widths, and sparse models with long zero runs
+    for (std::size_t universe : {0, 1, 63, 64, 65, 127, 200, 255, 256, 1000, 5003})
+    {
+        for (int percent : {0, 1, 50, 100})
+        {
+            auto ids = random_ids(universe, percent, gen);
+            bitset_from_ids(ids.data(), ids.size(), universe, words);
+            CHECK(words.size() == bitset_words(universe));
+            CHECK(bitset_count(words.data(), words.size()) == ids.size());
+            back.clear();
+            bitset_to_ids(words.data(), words.size(), back);
+            CHECK(back == ids);
+        }
+    }
+
+    CHECK(prefer_bitset(100, 1000));
+    CHECK_FALSE(prefer_bitset(10, 1000));
+}
+
+TEST_CASE("bitset_and", "[model_bitset]")
+{
+    std::mt19937 gen{11};
+    const std::size_t universe = 3001;
+    auto a = random_ids(universe, 40, gen);
+    auto b = random_ids(universe, 30, gen);
+    std::vector<uint32_t> both;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(both));
+
+    std::vector<uint64_t> wa, wb;
+    bitset_from_ids(a.data(), a.size(), universe, wa);
+    bitset_from_ids(b.data(), b.size(), universe, wb);
+    CHECK(bitset_and_count(wa.data(), wb.data(), wa.size()) == both.size());
+
+    // In place, as for masking a model
+    bitset_and(wa.data(), wb.data(), wa.data(), wa.size());
+    std::vector<uint32_t> ids;
+    bitset_for_each(wa.data(), wa.size(), [&ids](uint32_t id) { ids.push_back(id); });
+    CHECK(ids == both);
+
+    // A mask built when the universe was smaller covers a prefix of the model
+    std::vector<uint32_t> query{3, 64, 100};
+    std::vector<uint64_t> mask;
+    bitset_from_ids(query.data(), query.size(), 128, mask);
+    bitset_from_ids(a.data(), a.size(), universe, wa);
+    std::size_t expected = 0;
+    for (auto id : query) expected += std::binary_search(a.begin(), a.end(), id) ? 1 : 0;
+    CHECK(bitset_and_count(wa.data(), mask.data(), mask.size()) == expected);
+}
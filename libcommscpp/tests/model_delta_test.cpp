@@ -0,0 +1,126 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "clserver/model_delta.hpp"
+
+using namespace clserver;
+
+namespace
+{
+
+std::vector<uint32_t> roundtrip(const std::vector<uint32_t>& ids)
+{
+    std::vector<uint8_t> coded;
+    encode_sorted_ids(ids.data(), ids.size(), coded);
+    std::vector<uint32_t> decoded;
+    REQUIRE(decode_sorted_ids(coded.data(), coded.size(), decoded));
+    return decoded;
+}
+
+// A model that shares most of its IDs with the last one
+std::vector<uint32_t> next_model(const std::vector<uint32_t>& last, std::mt19937& gen)
+{
+    std::vector<uint32_t> model;
+    std::uniform_int_distribution<int> keep(0, 9);
+    for (auto id : last)
+        if (keep(gen)) model.push_back(id);
+    std::uniform_int_distribution<uint32_t> id(0, 5000);
+    for (int i = 0; i < 20; ++i) model.push_back(id(gen));
+    std::sort(model.begin(), model.end());
+    model.erase(std::unique(model.begin(), model.end()), model.end());
+    return model;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("sorted_id_coding", "[model_delta]")
+{
+    // Long runs of single byte gaps, which are decoded 16 at a time
+    std::vector<uint32_t> dense;
+    for (uint32_t i = 0; i < 1000; ++i) dense.push_back(i * 3 + (i % 7));
+    CHECK(roundtrip(dense) == dense);
+
+    // Mixed with gaps that take several bytes
+    std::vector<uint32_t> mixed{0, 1, 2};
+    for (uint32_t i = 0; i < 40; ++i) mixed.push_back(mixed.back() + 1);
+    mixed.push_back(1u << 20);
+    for (uint32_t i = 0; i < 17; ++i) mixed.push_back(mixed.back() + 127);
+    mixed.push_back(UINT32_MAX);
+    CHECK(roundtrip(mixed) == mixed);
+    CHECK(roundtrip({}).empty());
+
+    // Truncated and oversized varints are refused
+    std::vector<uint8_t> coded;
+    std::vector<uint32_t> decoded;
+    coded = {0x05, 0x80};
+    CHECK_FALSE(decode_sorted_ids(coded.data(), coded.size(), decoded));
+    coded = {0xff, 0xff, 0xff, 0xff, 0x1f};
+    CHECK_FALSE(decode_sorted_ids(coded.data(), coded.size(), decoded));
+    coded = {0xff, 0xff, 0xff, 0xff, 0xff, 0x01};
+    CHECK_FALSE(decode_sorted_ids(coded.data(), coded.size(), decoded));
+}
+
+TEST_CASE("model_delta_sequence", "[model_delta]")
+{
+    ModelDeltaEncoder encoder{ModelDeltaEncoder::Options{8}};
+    ModelDeltaDecoder decoder;
+    std::mt19937 gen{42};
+    std::vector<uint8_t> added, removed;
+    bsys::error_code ec;
+
+    std::vector<uint32_t> model;
+    bool all = true;
+    for (uint64_t number = 1; number <= 100; ++number)
+    {
+        model = next_model(model, gen);
+        bool keyframe = encoder.encode(model.data(), model.size(), added, removed);
+        CHECK(decoder.apply(number, number - 1, keyframe, added.data(), added.size(),
+                            removed.data(), removed.size(), ec));
+        // Only look at some of the models, leaving deltas to pile up
+        if (number % 5 == 0 && decoder.model() != model) all = false;
+    }
+    CHECK(all);
+    CHECK(!ec);
+    CHECK(decoder.model() == model);
+    CHECK(decoder.pending() == 0);
+    CHECK(encoder.stats().keyframes >= 100 / 8);
+    CHECK(encoder.stats().deltas > encoder.stats().keyframes);
+}
+
+TEST_CASE("model_delta_resync", "[model_delta]")
+{
+    ModelDeltaEncoder encoder{ModelDeltaEncoder::Options{4}};
+    ModelDeltaDecoder decoder;
+    std::vector<uint8_t> added, removed;
+    bsys::error_code ec;
+
+    std::vector<std::vector<uint32_t>> models;
+    for (uint32_t i = 0; i < 8; ++i) models.push_back({1, 2, 3, 4, 5, 6, 7, 8, 100 + i});
+    for (uint64_t number = 1; number <= models.size(); ++number)
+    {
+        auto& model = models[number - 1];
+        bool keyframe = encoder.encode(model.data(), model.size(), added, removed);
+        CHECK(keyframe == (number == 1 || number == 5));
+        // Model 2 is lost, so 3 and 4 can't be applied
+        if (number == 2) continue;
+        bool applied = decoder.apply(number, number - 1, keyframe, added.data(), added.size(),
+                                     removed.data(), removed.size(), ec);
+        CHECK(applied == (number != 3 && number != 4));
+        CHECK(decoder.synced() == applied);
+        if (applied) CHECK(decoder.model() == model);
+    }
+    CHECK(!ec);
+    CHECK(decoder.number() == 8);
+
+    // Corrupt data leaves the decoder out of sync until the next keyframe
+    uint8_t bad[] = {0x80};
+    CHECK_FALSE(decoder.apply(9, 8, false, bad, 1, nullptr, 0, ec));
+    CHECK(ec == bsys::errc::bad_message);
+    CHECK_FALSE(decoder.synced());
+}
@@ -0,0 +1,124 @@
+#include "catch.hpp"
+
+#include <vector>
+#include <boost/asio.hpp>
+#include "clserver/local_connection.hpp"
+#include "clserver/msg_dispatch.hpp"
+
+namespace fbs=flatbuffers;
+namespace cs=ClingoServer;
+namespace bsys=boost::system;
+
+using namespace clserver;
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// A visitor that records what it was called with
+//------------------------------------------------------------------------------
+
+struct RecordingVisitor
+{
+    std::vector<uint16_t> appids;
+    std::vector<uint32_t> handles;
+    int stopped = 0;
+    bsys::error_code error;
+
+    void operator()(const cs::ApplicationMsg& m, const cs::Message& frame)
+    {
+        appids.push_back(m.appid());
+        handles.push_back(frame.handle()->id());
+    }
+    void operator()(const cs::WorkerStoppedMsg&) { ++stopped; }
+    void operator()(const bsys::error_code& ec) { error = ec; }
+};
+
+fbs::DetachedBuffer make_app_frame(uint16_t appid, uint32_t handle)
+{
+    fbs::FlatBufferBuilder b;
+    uint8_t byte = 0;
+    auto app = cs::CreateApplicationMsg(b, appid, b.CreateVector(&byte, 1));
+    cs::WorkerHandle wh{handle};
+    b.Finish(cs::CreateMessage(b, cs::Msg_App, app.Union(), &wh));
+    return b.Release();
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("msg_dispatch_single_and_batch")
+{
+    MsgDispatcher<RecordingVisitor> d;
+
+    auto single = make_app_frame(7, 3);
+    d(*cs::GetMessage(single.data()));
+
+    fbs::FlatBufferBuilder b;
+    std::vector<uint8_t> types;
+    std::vector<fbs::Offset<void>> msgs;
+    for (uint16_t i = 0; i < 3; ++i)
+    {
+        types.push_back(cs::Msg_App);
+        msgs.push_back(cs::CreateApplicationMsg(b, i).Union());
+    }
+    types.push_back(cs::Msg_Stopped);
+    msgs.push_back(cs::CreateWorkerStoppedMsg(b).Union());
+    types.push_back(cs::Msg_Ready);     // No handler so it is ignored
+    msgs.push_back(cs::CreateWorkerReadyMsg(b).Union());
+    auto batch = cs::CreateMessageBatch(b, b.CreateVector(types), b.CreateVector(msgs));
+    cs::WorkerHandle wh{4};
+    b.Finish(cs::CreateMessage(b, cs::Msg_Batch, batch.Union(), &wh));
+    d(*cs::GetMessage(b.GetBufferPointer()));
+
+    REQUIRE(d.visitor().appids == std::vector<uint16_t>{7, 0, 1, 2});
+    REQUIRE(d.visitor().handles == std::vector<uint32_t>{3, 4, 4, 4});
+    REQUIRE(d.visitor().stopped == 1);
+    REQUIRE(!d.visitor().error);
+}
+
+TEST_CASE("msg_dispatch_receive_handler")
+{
+    asio::io_context ioc;
+    auto streams = make_local_stream_pair(ioc, ioc);
+
+    std::unique_ptr<Connection<LocalStream>> sender{
+        new Connection<LocalStream>{std::move(streams.first), "clingoserver"}};
+    Connection<LocalStream> receiver{std::move(streams.second), "clingoserver"};
+    sender->validate([](const bsys::error_code&){ });
+    receiver.validate([](const bsys::error_code&){ });
+
+    std::vector<fbs::DetachedBuffer> frames;
+    for (uint16_t i = 0; i < 5; ++i) frames.push_back(make_app_frame(i, 1));
+    for (auto& f : frames)
+        sender->async_send_message(asio::buffer(f.data(), f.size()),
+                                   [](const bsys::error_code&, std::size_t){ });
+
+    // A frame that fails verification is reported as an error
+    asio::streambuf garbage;
+    garbage.commit(asio::buffer_copy(garbage.prepare(3), asio::buffer("xyz", 3)));
+    sender->async_send_message(garbage, [&sender](const bsys::error_code&, std::size_t)
+    {
+        sender.reset();
+    });
+
+    MsgDispatcher<RecordingVisitor> d;
+    asio::streambuf sb;
+    std::function<void()> receive = [&]()
+    {
+        auto h = d.receive_handler(sb);
+        receiver.async_receive_message(sb, [&, h](const bsys::error_code& ec, std::size_t s)
+        {
+            h(ec, s);
+            if (!ec && !d.visitor().error) receive();
+        });
+    };
+    receive();
+    ioc.run();
+
+    REQUIRE(d.visitor().appids == std::vector<uint16_t>{0, 1, 2, 3, 4});
+    REQUIRE(d.visitor().error == bsys::errc::bad_message);
+}
@@ -0,0 +1,48 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "clserver/rcu.hpp"
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("rcu_ptr_readers_see_complete_versions")
+{
+    RcuDomain domain;
+    RcuPtr<std::vector<int>> ptr{domain, std::unique_ptr<std::vector<int>>{
+            new std::vector<int>(100, 0)}};
+
+    // Every version holds 100 copies of the same value
+    std::atomic<bool> stop{false};
+    std::atomic<std::size_t> bad{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; ++i)
+    {
+        readers.emplace_back([&]()
+        {
+            while (!stop)
+            {
+                auto guard = domain.read_lock();
+                const auto* v = ptr.load();
+                for (int x : *v) if (x != v->front()) ++bad;
+            }
+        });
+    }
+
+    for (int i = 1; i <= 500; ++i)
+        ptr.modify([i](std::vector<int>& v){ std::fill(v.begin(), v.end(), i); });
+
+    stop = true;
+    for (auto& t : readers) t.join();
+
+    REQUIRE(bad == 0);
+    auto guard = domain.read_lock();
+    REQUIRE(ptr.load()->front() == 500);
+}
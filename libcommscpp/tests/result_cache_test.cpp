@@ -0,0 +1,172 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "clserver/result_cache.hpp"
+#include "test_helpers.hpp"
+
+using namespace clserver;
+using clserver_test::make_frame;
+using clserver_test::TempDir;
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+std::vector<std::string> texts(const ResultCache::result_t& r)
+{
+    std::vector<std::string> out;
+    if (!r) return out;
+    for (const auto& f : *r) out.emplace_back(reinterpret_cast<const char*>(f.data()), f.size());
+    return out;
+}
+
+std::string key(const std::string& c)
+{
+    return std::string(64, c[0]);
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("result_cache_job_key", "[result_cache]")
+{
+    JobSpec a{"p(1).\r\nq(X) :- p(X).  \n\n", {"e(1,2).", " e(0,1). ", "e(1,2)."},
+              {"--models=0", ""}, "enumerate"};
+    JobSpec b{"p(1).\nq(X) :- p(X).", {"e(0,1).", "e(1,2)."}, {" --models=0"}, "enumerate"};
+    CHECK(a.key() == b.key());
+    CHECK(a.key().size() == 64);
+
+    // Everything else that affects the result changes the key
+    auto c = b;
+    c.solve_mode = "optimize";
+    CHECK(c.key() != b.key());
+    c = b;
+    c.facts.push_back("e(2,3).");
+    CHECK(c.key() != b.key());
+    c = b;
+    c.options = {"--models=0", "--opt-mode=optN"};
+    CHECK(c.key() != b.key());
+    c = b;
+    c.program += " r.";
+    CHECK(c.key() != b.key());
+
+    // A fact can't be mistaken for part of the program
+    JobSpec d{"p(1).", {}, {}, ""};
+    JobSpec e{"", {"p(1)."}, {}, ""};
+    CHECK(d.key() != e.key());
+}
+
+TEST_CASE("result_cache_memory_lru", "[result_cache]")
+{
+    ResultCache::Options opts;
+    opts.max_bytes = 10;
+    ResultCache cache{opts};
+
+    CHECK(!cache.lookup(key("a")));
+    cache.insert(key("a"), {make_frame("m1"), make_frame("m2")});
+    cache.insert(key("b"), {make_frame("xxxx")});
+    CHECK(cache.bytes() == 8);
+
+    // Replays share the stored buffers
+    auto r = cache.lookup(key("a"));
+    CHECK(texts(r) == std::vector<std::string>{"m1", "m2"});
+    CHECK(r == cache.lookup(key("a")));
+
+    // b is now least recently used and makes room for c
+    cache.insert(key("c"), {make_frame("yyyy")});
+    CHECK(cache.size() == 2);
+    CHECK(!cache.lookup(key("b")));
+    CHECK(texts(cache.lookup(key("c"))) == std::vector<std::string>{"yyyy"});
+
+    // A result held by a client outlives its eviction
+    cache.insert(key("d"), {make_frame("zzzzzzzz")});
+    CHECK(texts(r) == std::vector<std::string>{"m1", "m2"});
+
+    CHECK(cache.stats().hits == 3);
+    CHECK(cache.stats().misses == 2);
+    CHECK(cache.stats().evicted == 3);
+    CHECK(cache.stats().spilled == 0);
+}
+
+TEST_CASE("result_cache_policy", "[result_cache]")
+{
+    ResultCache cache{ResultCache::Options{}};
+    using clock = ResultCache::clock_type;
+    auto now = clock::now();
+
+    // Bypass neither reads nor writes
+    cache.insert(key("a"), {make_frame("old")}, CachePolicy::Bypass);
+    CHECK(cache.size() == 0);
+    cache.insert(key("a"), {make_frame("old")});
+    CHECK(!cache.lookup(key("a"), CachePolicy::Bypass));
+
+    // Refresh skips the cached result and replaces it
+    CHECK(!cache.lookup(key("a"), CachePolicy::Refresh));
+    cache.insert(key("a"), {make_frame("new")}, CachePolicy::Refresh);
+    CHECK(texts(cache.lookup(key("a"))) == std::vector<std::string>{"new"});
+    CHECK(cache.stats().bypassed == 2);
+
+    CHECK(cache.invalidate(key("a")));
+    CHECK(!cache.invalidate(key("a")));
+    CHECK(!cache.lookup(key("a")));
+    CHECK(cache.stats().invalidated == 1);
+
+    // Expiry
+    ResultCache::Options opts;
+    opts.max_age = std::chrono::seconds{60};
+    ResultCache aging{opts};
+    aging.insert(key("b"), {make_frame("b")}, CachePolicy::Use, now);
+    CHECK(aging.lookup(key("b"), CachePolicy::Use, now + std::chrono::seconds{30}));
+    CHECK(!aging.lookup(key("b"), CachePolicy::Use, now + std::chrono::seconds{90}));
+    CHECK(aging.size() == 0);
+}
+
+TEST_CASE("result_cache_spill", "[result_cache]")
+{
+    TempDir dir{"result_cache"};
+    ResultCache::Options opts;
+    opts.max_bytes = 8;
+    opts.spill_dir = dir.path();
+    opts.max_spill_bytes = 40;
+
+    {
+        ResultCache cache{opts};
+        cache.insert(key("a"), {make_frame("a1"), make_frame(""), make_frame("a3")});
+        cache.insert(key("b"), {make_frame("bbbbbb")});
+        CHECK(cache.stats().spilled == 1);
+        CHECK(cache.spill_bytes() == 3 * 4 + 4);
+
+        // A disk hit is promoted back to memory, pushing b out to disk
+        auto r = cache.lookup(key("a"));
+        CHECK(texts(r) == std::vector<std::string>{"a1", "", "a3"});
+        CHECK(cache.stats().disk_hits == 1);
+        CHECK(cache.stats().spilled == 2);
+
+        cache.insert(key("c"), {make_frame("cccccc")});
+        CHECK(cache.stats().spilled == 3);
+    }
+
+    // Spilled results are found again by a new cache
+    ResultCache cache{opts};
+    CHECK(cache.size() == 0);
+    CHECK(texts(cache.lookup(key("b"))) == std::vector<std::string>{"bbbbbb"});
+    CHECK(texts(cache.lookup(key("a"))) == std::vector<std::string>{"a1", "", "a3"});
+    CHECK(cache.stats().disk_hits == 2);
+
+    // Invalidating removes the file as well
+    REQUIRE(cache.spill_bytes() > 0);
+    cache.clear();
+    CHECK(cache.size() == 0);
+    CHECK(cache.spill_bytes() == 0);
+    ResultCache empty{opts};
+    CHECK(!empty.lookup(key("c")));
+    CHECK(!empty.lookup(key("b")));
+}
@@ -1,6 +1,7 @@
 #include <vector>
 #include <iostream>
 #include <boost/asio.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/beast/_experimental/test/stream.hpp>
 #include "test_schema_generated.h"
 #include "clserver/connection.hpp"
@@ -40,7 +41,7 @@ struct PingLoop
         if (ec) { std::cerr << ec.message() << std::endl; return; }
         sb_.commit(s);
         auto cbt = sb_.data();
-        std::string msg{asio::buffers_begin(cbt), asio::buffers_end(cbt)};
+        boost::string_view msg{static_cast<const char*>(cbt.data()), cbt.size()};
         std::cerr << "Received message: " << msg << std::endl;
         if (msg == "exit"){ std::cerr << "Exiting" << std::endl; return; }
         conn_.async_send_message(sb_,
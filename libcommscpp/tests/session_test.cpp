@@ -0,0 +1,222 @@
+#include "catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast/_experimental/test/stream.hpp>
+#include "clserver/session.hpp"
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+namespace bbtest=boost::beast::test;
+
+using namespace clserver;
+
+using TestConnection = Connection<bbtest::stream>;
+using TestSession = Session<bbtest::stream>;
+using TestManager = SessionManager<bbtest::stream>;
+
+//------------------------------------------------------------------------------
+// A validated pair of connections. Sessions always have a read outstanding so
+// the io_context is polled rather than run.
+//------------------------------------------------------------------------------
+
+struct ConnectionPair
+{
+    std::unique_ptr<TestConnection> client;
+    std::unique_ptr<TestConnection> server;
+
+    explicit ConnectionPair(asio::io_context& ioc)
+    {
+        bbtest::stream s1{ioc};
+        bbtest::stream s2{ioc};
+        s1.connect(s2);
+        client = std::make_unique<TestConnection>(std::move(s1), "clingoserver");
+        server = std::make_unique<TestConnection>(std::move(s2), "clingoserver");
+        client->validate([](const bsys::error_code&){ });
+        server->validate([](const bsys::error_code&){ });
+    }
+};
+
+static void poll(asio::io_context& ioc)
+{
+    ioc.restart();
+    while (ioc.poll()) { }
+}
+
+static void send(TestSession& s, uint32_t channel, const std::string& text)
+{
+    bsys::error_code ec;
+    s.send(channel, asio::buffer(text), ec);
+    REQUIRE(!ec);
+}
+
+static TestSession::receive_handler_t recorder(std::vector<std::string>& out)
+{
+    return [&out](uint32_t, uint64_t seq, asio::const_buffer body)
+    {
+        out.push_back(std::to_string(seq) + ":" +
+                      std::string(static_cast<const char*>(body.data()), body.size()));
+    };
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("session_resume_retransmits_unacked_tail", "[session]")
+{
+    asio::io_context ioc;
+    TestSession::Options opts;
+    opts.ack_every = 2;
+    TestManager manager{opts};
+    TestSession client{opts};
+
+    std::vector<std::string> at_client, at_server;
+    client.on_receive(recorder(at_client));
+
+    TestSession* server = nullptr;
+    bool resumed = true;
+    auto accept = [&](const bsys::error_code& ec, TestSession* s, bool r)
+    {
+        REQUIRE(!ec);
+        if (!r) s->on_receive(recorder(at_server));
+        server = s;
+        resumed = r;
+    };
+
+    ConnectionPair first{ioc};
+    client.connect(*first.client, [&](const bsys::error_code& ec, bool r)
+                   { REQUIRE(!ec); CHECK(!r); });
+    manager.accept(*first.server, accept);
+    poll(ioc);
+    REQUIRE(server);
+    CHECK(!resumed);
+    CHECK(client.attached());
+    CHECK(client.token() != 0);
+    CHECK(client.token() == server->token());
+
+    for (int i = 1; i <= 3; ++i) send(client, 1, "c" + std::to_string(i));
+    for (int i = 1; i <= 5; ++i) send(*server, 7, "s" + std::to_string(i));
+    poll(ioc);
+    CHECK(at_server == std::vector<std::string>{"1:c1", "2:c2", "3:c3"});
+    CHECK(at_client.size() == 5);
+    CHECK(client.last_acked(1) == 2);
+    CHECK(client.unacked() == 1);
+    CHECK(server->last_acked(7) == 4);
+    CHECK(server->unacked() == 1);
+
+    // The connection is lost and both sides keep sending
+    client.detach();
+    server->detach();
+    CHECK(!client.attached());
+    send(client, 1, "c4");
+    send(client, 1, "c5");
+    send(*server, 7, "s6");
+    send(*server, 7, "s7");
+    poll(ioc);
+    CHECK(at_server.size() == 3);
+
+    // Only what the other side has not seen is delivered
+    ConnectionPair second{ioc};
+    bool client_resumed = false;
+    client.connect(*second.client, [&](const bsys::error_code& ec, bool r)
+                   { REQUIRE(!ec); client_resumed = r; });
+    manager.accept(*second.server, accept);
+    poll(ioc);
+    CHECK(client_resumed);
+    CHECK(resumed);
+    CHECK(manager.size() == 1);
+    CHECK(at_server == std::vector<std::string>{"1:c1", "2:c2", "3:c3", "4:c4", "5:c5"});
+    CHECK(at_client == std::vector<std::string>{"1:s1", "2:s2", "3:s3", "4:s4", "5:s5",
+                                                "6:s6", "7:s7"});
+    CHECK(client.retransmitted() == 2);
+    CHECK(server->retransmitted() == 2);
+
+    client.flush_acks();
+    server->flush_acks();
+    poll(ioc);
+    CHECK(client.unacked() == 0);
+    CHECK(client.unacked_bytes() == 0);
+    CHECK(server->unacked() == 0);
+
+    // A server that has forgotten the session starts a new one
+    auto old_token = client.token();
+    client.detach();
+    server->detach();
+    CHECK(manager.expire(std::chrono::seconds{0},
+                         std::chrono::steady_clock::now() + std::chrono::seconds{1}) == 1);
+    ConnectionPair third{ioc};
+    client_resumed = true;
+    client.connect(*third.client, [&](const bsys::error_code& ec, bool r)
+                   { REQUIRE(!ec); client_resumed = r; });
+    manager.accept(*third.server, accept);
+    poll(ioc);
+    CHECK(!client_resumed);
+    CHECK(!resumed);
+    CHECK(client.token() != old_token);
+    CHECK(client.last_received(7) == 0);
+}
+
+TEST_CASE("session_removed_with_operations_outstanding", "[session]")
+{
+    asio::io_context ioc;
+    TestManager manager;
+    TestSession client;
+    TestSession* server = nullptr;
+
+    ConnectionPair pair{ioc};
+    client.connect(*pair.client, [](const bsys::error_code& ec, bool) { REQUIRE(!ec); });
+    manager.accept(*pair.server, [&](const bsys::error_code& ec, TestSession* s, bool)
+                   {
+                       REQUIRE(!ec);
+                       server = s;
+                   });
+    poll(ioc);
+    REQUIRE(server);
+
+    // Writes are still queued and a read outstanding on the old connection
+    // when the session is dropped
+    for (int i = 1; i <= 4; ++i) send(*server, 1, "s" + std::to_string(i));
+    auto token = server->token();
+    server->detach();
+    CHECK(manager.remove(token));
+    poll(ioc);
+    send(client, 1, "c1");
+    poll(ioc);
+    CHECK(manager.size() == 0);
+
+    // A receive handler may remove its own session
+    ConnectionPair second{ioc};
+    TestSession other;
+    other.connect(*second.client, [](const bsys::error_code& ec, bool) { REQUIRE(!ec); });
+    manager.accept(*second.server, [&](const bsys::error_code& ec, TestSession* s, bool)
+                   {
+                       REQUIRE(!ec);
+                       auto t = s->token();
+                       s->on_receive([&manager, t](uint32_t, uint64_t, asio::const_buffer)
+                                     { manager.remove(t); });
+                   });
+    poll(ioc);
+    send(other, 1, "a");
+    send(other, 1, "b");
+    poll(ioc);
+    CHECK(manager.size() == 0);
+}
+
+TEST_CASE("session_unacked_limit", "[session]")
+{
+    TestSession::Options opts;
+    opts.max_unacked_bytes = 10;
+    TestSession session{opts};
+
+    bsys::error_code ec;
+    std::string text = "12345678";
+    CHECK(session.send(1, asio::buffer(text), ec) == 1);
+    CHECK(!ec);
+    session.send(1, asio::buffer(text), ec);
+    CHECK(ec == bsys::errc::no_buffer_space);
+    CHECK(session.unacked() == 1);
+    CHECK(session.unacked_bytes() == text.size());
+}
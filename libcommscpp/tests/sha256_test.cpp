@@ -0,0 +1,40 @@
+#include "catch.hpp"
+
+#include <string>
+#include "clserver/sha256.hpp"
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("sha256_known_digests", "[sha256]")
+{
+    CHECK(Sha256::hex_digest("", 0) ==
+          "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(Sha256::hex_digest("abc", 3) ==
+          "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    std::string two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    CHECK(Sha256::hex_digest(two_blocks.data(), two_blocks.size()) ==
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+    // Feeding the data in pieces gives the same digest
+    std::string million(1000000, 'a');
+    Sha256 h;
+    for (std::size_t i = 0; i < million.size(); i += 997)
+        h.update(million.data() + i, std::min<std::size_t>(997, million.size() - i));
+    CHECK(Sha256::hex(h.finish()) ==
+          "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST_CASE("sha256_fields", "[sha256]")
+{
+    Sha256 a, b;
+    a.add_field("ab");
+    a.add_field("c");
+    b.add_field("a");
+    b.add_field("bc");
+    CHECK(a.finish() != b.finish());
+}
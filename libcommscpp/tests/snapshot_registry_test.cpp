@@ -0,0 +1,48 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+#include "clserver/snapshot_registry.hpp"
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("snapshot_registry_lru_budget", "[snapshot_registry]")
+{
+    SnapshotRegistry<int> reg{100};
+
+    CHECK(reg.insert("a", 1, 40).empty());
+    CHECK(reg.insert("b", 2, 40).empty());
+    CHECK(reg.bytes() == 80);
+    CHECK(reg.lookup("x") == nullptr);
+
+    // Using a makes b the least recently used, so b goes to make room for c
+    REQUIRE(reg.lookup("a"));
+    CHECK(*reg.lookup("a") == 1);
+    CHECK(reg.insert("c", 3, 40) == std::vector<int>{2});
+    CHECK(reg.contains("a"));
+    CHECK(!reg.contains("b"));
+    CHECK(reg.bytes() == 80);
+
+    // A snapshot that grows once grounded can push others out
+    CHECK(reg.resize("c", 90) == std::vector<int>{1});
+    CHECK(reg.size() == 1);
+
+    // The newest snapshot is kept even when over budget on its own
+    CHECK(reg.set_budget(50).empty());
+    CHECK(reg.contains("c"));
+
+    // Replacing a snapshot returns the old worker
+    CHECK(reg.insert("c", 4, 10) == std::vector<int>{3});
+    CHECK(*reg.lookup("c") == 4);
+    CHECK(reg.erase("c"));
+    CHECK(!reg.erase("c"));
+    CHECK(reg.bytes() == 0);
+
+    CHECK(reg.stats().hits == 3);
+    CHECK(reg.stats().misses == 1);
+    CHECK(reg.stats().evicted == 2);
+}
@@ -0,0 +1,109 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+#include "clserver/statement_splitter.hpp"
+
+using namespace clserver;
+
+namespace
+{
+
+// The text before the boundary after feeding s in pieces of n bytes
+std::string complete(const std::string& s, std::size_t n, bool finish = false)
+{
+    StatementSplitter sp;
+    for (std::size_t i = 0; i < s.size(); i += n)
+        sp.feed(s.data() + i, std::min(n, s.size() - i));
+    if (finish) sp.finish();
+    return s.substr(0, sp.boundary());
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("statement_splitter_boundaries", "[statement_splitter]")
+{
+    // The last '.' isn't known to end a statement until more text arrives
+    CHECK(complete("a. b", 1) == "a.");
+    CHECK(complete("a. b.", 1) == "a.");
+    CHECK(complete("a. b.", 1, true) == "a. b.");
+    CHECK(complete("a. b.\n", 2) == "a. b.");
+
+    // Intervals, brackets, strings and comments
+    std::string text =
+        "p(X) :- X = 1..3.\n"
+        "q(\"a.b\\\". c\").\n"
+        "% a comment. with dots.\n"
+        "r(1;2) :- s(\"%\"), { t(1..2) }.\n"
+        "%* a block. comment *% u.\n"
+        "v";
+    auto want = text.substr(0, text.size() - 2);
+    for (std::size_t n : {1, 2, 3, 7, 100})
+        CHECK(complete(text, n) == want);
+
+    // Cut at the end of each statement as it arrives
+    CHECK(complete("p(X) :- X = 1..", 1) == "");
+    CHECK(complete("p(1..3) :- q(", 1) == "");
+    CHECK(complete("a :- \"b. c", 1) == "");
+    CHECK(complete("a. %* b. c", 1) == "a.");
+}
+
+TEST_CASE("statement_splitter_weak_constraints", "[statement_splitter]")
+{
+    // The '.' before the weight doesn't end a weak constraint
+    std::string text =
+        "x :- y(\"a.b\"). :~ q. [1@2]\n"
+        ":~ r(X), X = 1..3. %* w *% [X@1, X]\n"
+        ":~ s.\n  % weight below\n  [-1]z. a";
+    auto want = text.substr(0, text.size() - 2);
+    for (std::size_t n : {1, 2, 5, 100})
+        CHECK(complete(text, n) == want);
+
+    // Cut after the body, so the weight is still on the way
+    CHECK(complete("x :- y(\"a.b\"). :~ q.", 1, true) == "x :- y(\"a.b\"). :~ q.");
+    CHECK(complete("x :- y(\"a.b\"). :~ q. ", 100) == "x :- y(\"a.b\").");
+    CHECK(complete("x :- y(\"a.b\"). :~ q. [1@", 3) == "x :- y(\"a.b\").");
+    CHECK(complete("x :- y(\"a.b\"). :~ q. [1@2]", 3) == "x :- y(\"a.b\"). :~ q. [1@2]");
+
+    // The same boundaries when the text arrives split across two feeds
+    std::string split = "a. :~ b. [1@1] c.\n";
+    for (std::size_t cut = 0; cut <= split.size(); ++cut)
+    {
+        StatementSplitter sp;
+        sp.feed(split.data(), cut);
+        sp.feed(split.data() + cut, split.size() - cut);
+        CHECK(sp.boundary() == split.size() - 1);
+    }
+}
+
+TEST_CASE("statement_splitter_scripts", "[statement_splitter]")
+{
+    std::string text =
+        "a.\n"
+        "#script (python)\n"
+        "import clingo\n"
+        "def f(x): return x.number + 1.5\n"
+        "#end.\n"
+        "b(@f(1)).\n"
+        "c";
+    for (std::size_t n : {1, 4, 100})
+    {
+        CHECK(complete(text.substr(0, text.find("import") + 6), n) == "a.");
+        CHECK(complete(text, n) == text.substr(0, text.size() - 2));
+    }
+
+    StatementSplitter sp;
+    sp.feed("x.\n#program step(t).\ny(t). z", 27);
+    CHECK(sp.boundary() == 26);
+    CHECK(sp.scanned() == 27);
+    auto directive = sp.program_directive();
+    CHECK(std::string("x.\n#program step(t).\ny(t). z").substr(
+              directive.first, directive.second - directive.first) == "#program step(t).");
+    sp.reset();
+    CHECK(sp.boundary() == 0);
+    CHECK(sp.program_directive().second == 0);
+}
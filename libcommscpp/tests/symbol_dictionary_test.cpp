@@ -0,0 +1,105 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+#include "clserver/symbol_dictionary.hpp"
+
+using namespace clserver;
+
+namespace
+{
+
+// Stands in for a received ClingoServer::SymbolDictMsg
+struct FakeString
+{
+    std::string s;
+    const char* c_str() const { return s.c_str(); }
+    std::size_t size() const { return s.size(); }
+};
+
+struct FakeStrings
+{
+    std::vector<FakeString> v;
+    std::size_t size() const { return v.size(); }
+    const FakeString* Get(std::size_t i) const { return &v[i]; }
+};
+
+struct FakeDictMsg
+{
+    uint32_t first;
+    FakeStrings strings;
+    uint32_t first_id() const { return first; }
+    const FakeStrings* symbols() const { return &strings; }
+};
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("symbol_interner", "[symbol_dictionary]")
+{
+    SymbolInterner interner;
+    bool added = false;
+
+    CHECK(interner.intern(1000, added) == 0);
+    CHECK(added);
+    CHECK(interner.intern(7, added) == 1);
+    CHECK(added);
+    CHECK(interner.intern(1000, added) == 0);
+    CHECK_FALSE(added);
+
+    // IDs stay dense and stable as the table grows
+    for (uint64_t k = 0; k < 10000; ++k) interner.intern(k * 0x9e3779b97f4a7c15ULL, added);
+    CHECK(interner.size() == 10002);
+    CHECK(interner.intern(7, added) == 1);
+    CHECK(interner.intern(1000, added) == 0);
+    bool all = true;
+    for (uint64_t k = 0; k < 10000; ++k)
+        if (interner.intern(k * 0x9e3779b97f4a7c15ULL, added) != k + 2 || added) all = false;
+    CHECK(all);
+
+    interner.clear();
+    CHECK(interner.size() == 0);
+    CHECK(interner.intern(7, added) == 0);
+    CHECK(added);
+}
+
+TEST_CASE("symbol_dictionary_updates", "[symbol_dictionary]")
+{
+    SymbolDictionary dict;
+    bsys::error_code ec;
+
+    dict.update(FakeDictMsg{0, {{{"p(1)"}, {"q(a,b)"}}}}, ec);
+    REQUIRE(!ec);
+    dict.update(FakeDictMsg{2, {{{"r"}}}}, ec);
+    REQUIRE(!ec);
+    CHECK(dict.size() == 3);
+    CHECK(dict.symbol(1) == "q(a,b)");
+    CHECK(dict.bytes() == 11);
+
+    // An update that doesn't continue where the last one ended is refused
+    dict.update(FakeDictMsg{4, {{{"s"}}}}, ec);
+    CHECK(ec == bsys::errc::bad_message);
+    CHECK(dict.size() == 3);
+
+    // Models are resolved only as they are read
+    std::vector<uint32_t> ids{2, 0};
+    ModelSymbols model{dict, ids.data(), ids.size()};
+    CHECK(model.valid());
+    std::vector<std::string> names;
+    for (auto s : model) names.emplace_back(s.data(), s.size());
+    CHECK(names == (std::vector<std::string>{"r", "p(1)"}));
+    CHECK(model[1] == "p(1)");
+
+    ids.push_back(3);
+    CHECK_FALSE((ModelSymbols{dict, ids.data(), ids.size()}.valid()));
+
+    dict.clear();
+    CHECK(dict.size() == 0);
+    ec.clear();
+    dict.add(0, "x", ec);
+    CHECK(!ec);
+    CHECK(dict.symbol(0) == "x");
+}
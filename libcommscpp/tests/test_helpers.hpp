@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------
+// Fixtures shared by the test cases.
+// -------------------------------------------------------------------------------
+
+#ifndef CLSERVER_TESTS_TEST_HELPERS_HH
+#define CLSERVER_TESTS_TEST_HELPERS_HH
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "clserver/shared_frame.hpp"
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace clserver_test
+{
+
+//-------------------------------------------------------------------------------
+// A temporary directory under /tmp that is removed, with everything in it, when
+// it goes out of scope. name prefixes the directory's random name.
+// -------------------------------------------------------------------------------
+
+class TempDir
+{
+public:
+    explicit TempDir(const std::string& name)
+    {
+        std::string tmpl = "/tmp/" + name + "_XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        if (!::mkdtemp(buf.data()))
+            throw std::system_error{errno, std::generic_category(), "mkdtemp"};
+        path_ = buf.data();
+    }
+
+    TempDir(TempDir&&) = delete;
+    TempDir(const TempDir&) = delete;
+    ~TempDir() { ::nftw(path_.c_str(), &TempDir::_remove, 16, FTW_DEPTH | FTW_PHYS); }
+
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::string& path() const { return path_; }
+
+private:
+    static int _remove(const char* path, const struct stat*, int, struct FTW*)
+    {
+        ::remove(path);
+        return 0;
+    }
+
+    std::string path_;
+};
+
+// A frame holding the given text
+inline clserver::SharedFrame make_frame(const std::string& text)
+{
+    auto p = new uint8_t[text.size()];
+    std::copy(text.begin(), text.end(), p);
+    return clserver::SharedFrame{
+        flatbuffers::DetachedBuffer{nullptr, false, p, text.size(), p, text.size()}};
+}
+
+}
+
+#endif // CLSERVER_TESTS_TEST_HELPERS_HH
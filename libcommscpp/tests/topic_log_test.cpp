@@ -0,0 +1,287 @@
+#include "catch.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast/_experimental/test/stream.hpp>
+#include "clserver/connection.hpp"
+#include "clserver/topic_log.hpp"
+#include "test_helpers.hpp"
+
+#include <sys/wait.h>
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+namespace bbtest=boost::beast::test;
+
+using namespace clserver;
+using clserver_test::TempDir;
+
+static uint64_t append(TopicLog& log, const std::string& text)
+{
+    bsys::error_code ec;
+    auto seq = log.append(reinterpret_cast<const uint8_t*>(text.data()), text.size(), ec);
+    REQUIRE(!ec);
+    return seq;
+}
+
+static std::vector<std::string> read_all(TopicLog& log, uint64_t from)
+{
+    std::vector<std::string> out;
+    auto c = log.cursor(from);
+    while (!c.at_end())
+    {
+        auto r = c.record();
+        out.emplace_back(static_cast<const char*>(r.data()), r.size());
+        c.advance();
+    }
+    return out;
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("topic_log_append_and_recover", "[topic_log]")
+{
+    TempDir dir{"topic_log"};
+    TopicLog::Options opts;
+    opts.segment_bytes = 64;
+    bsys::error_code ec;
+    {
+        TopicLog log{dir.path(), opts};
+        log.open(ec);
+        REQUIRE(!ec);
+
+        // Empty bodies can't be told apart from the end of a segment
+        log.append(nullptr, 0, ec);
+        CHECK(ec == asio::error::invalid_argument);
+        ec = bsys::error_code{};
+
+        for (int i = 0; i < 20; ++i)
+            CHECK(append(log, "message " + std::to_string(i)) == static_cast<uint64_t>(i));
+        CHECK(log.next_seq() == 20);
+        CHECK(log.segment_count() > 1);
+
+        auto all = read_all(log, 0);
+        REQUIRE(all.size() == 20);
+        CHECK(all[7] == "message 7");
+        CHECK(read_all(log, 15).front() == "message 15");
+    }
+
+    // Reopening rebuilds the index and appends continue the sequence
+    TopicLog log{dir.path(), opts};
+    log.open(ec);
+    REQUIRE(!ec);
+    CHECK(log.first_seq() == 0);
+    CHECK(log.next_seq() == 20);
+    CHECK(append(log, "after") == 20);
+    auto all = read_all(log, 0);
+    REQUIRE(all.size() == 21);
+    CHECK(all[19] == "message 19");
+    CHECK(all[20] == "after");
+}
+
+//------------------------------------------------------------------------------
+// Appends that a crash cut short. A child process appends and exits without
+// closing the log, which leaves the segment as a crash would, and the parent
+// then writes what a crash part way through an append could leave behind.
+//------------------------------------------------------------------------------
+
+TEST_CASE("topic_log_partial_append", "[topic_log]")
+{
+    TempDir dir{"topic_log"};
+    TopicLog::Options opts;
+    opts.segment_bytes = 256;
+    bsys::error_code ec;
+    std::string path = dir.path() + "/00000000000000000000.log";
+
+    // Closing the log trims the segment, so only the child sees what the
+    // parent leaves past the last record
+    auto crash_after = [&dir, &opts](const std::string& text, uint64_t seq)
+    {
+        pid_t pid = ::fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0)
+        {
+            bsys::error_code ec;
+            TopicLog log{dir.path(), opts};
+            log.open(ec);
+            auto s = log.append(reinterpret_cast<const uint8_t*>(text.data()), text.size(), ec);
+            ::_exit(ec || s != seq ? 1 : 0);
+        }
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        REQUIRE((WIFEXITED(status) && WEXITSTATUS(status) == 0));
+    };
+    auto reopen = [&dir, &opts]()
+    {
+        bsys::error_code ec;
+        TopicLog log{dir.path(), opts};
+        log.open(ec);
+        REQUIRE(!ec);
+        return read_all(log, 0);
+    };
+    auto write_at = [&path](std::size_t offset, const std::string& bytes)
+    {
+        int fd = ::open(path.c_str(), O_WRONLY);
+        REQUIRE(fd >= 0);
+        CHECK(::pwrite(fd, bytes.data(), bytes.size(), static_cast<off_t>(offset)) ==
+              static_cast<ssize_t>(bytes.size()));
+        ::close(fd);
+    };
+
+    {
+        TopicLog log{dir.path(), opts};
+        log.open(ec);
+        REQUIRE(!ec);
+        append(log, "one");
+        append(log, "two");
+    }
+    crash_after("three", 2);
+    std::size_t end = 3 * 4 + 3 + 3 + 5;
+    CHECK(reopen() == (std::vector<std::string>{"one", "two", "three"}));
+
+    // The body of a record whose size was never stored. Part of it looks
+    // like a record of its own, where a shorter append will end.
+    write_at(end + 4, std::string{"xxxx\0\0\0\3zzz", 11});
+    crash_after("four", 3);
+    CHECK(reopen() == (std::vector<std::string>{"one", "two", "three", "four"}));
+    end += 8;
+
+    // A size whose body the file doesn't hold
+    CHECK(::truncate(path.c_str(), static_cast<off_t>(end)) == 0);
+    write_at(end, std::string{"\0\0\0\x64short", 9});
+    CHECK(reopen() == (std::vector<std::string>{"one", "two", "three", "four"}));
+
+    TopicLog log{dir.path(), opts};
+    log.open(ec);
+    REQUIRE(!ec);
+    CHECK(append(log, "five") == 4);
+    CHECK(read_all(log, 0).back() == "five");
+}
+
+TEST_CASE("topic_log_retention", "[topic_log]")
+{
+    TempDir dir{"topic_log"};
+    TopicLog::Options opts;
+    opts.segment_bytes = 64;
+    opts.max_bytes = 128;
+    bsys::error_code ec;
+    TopicLog log{dir.path(), opts};
+    log.open(ec);
+    REQUIRE(!ec);
+
+    // A cursor keeps its segment readable after retention removes it
+    append(log, "first");
+    auto early = log.cursor(0);
+
+    for (int i = 0; i < 50; ++i) append(log, "message " + std::to_string(i));
+    CHECK(log.first_seq() > 0);
+    CHECK(log.size_bytes() <= opts.max_bytes + opts.segment_bytes);
+    CHECK(std::string(static_cast<const char*>(early.record().data()),
+                      early.record().size()) == "first");
+
+    // A retired position starts from the oldest record kept
+    auto c = log.cursor(0);
+    CHECK(c.seq() == log.first_seq());
+
+    // Old segments age out, but the active one is always kept
+    auto removed = log.apply_retention(std::chrono::system_clock::now() +
+                                       opts.max_age + std::chrono::seconds{1});
+    CHECK(removed > 0);
+    CHECK(log.segment_count() == 1);
+    CHECK(read_all(log, 0).back() == "message 49");
+}
+
+TEST_CASE("topic_log_frames_and_sendfile", "[topic_log]")
+{
+    TempDir dir{"topic_log"};
+    bsys::error_code ec;
+    TopicLog log{dir.path()};
+    log.open(ec);
+    REQUIRE(!ec);
+    for (int i = 0; i < 5; ++i) append(log, "frame" + std::to_string(i));
+
+    // The mapped range holds complete wire frames
+    auto c = log.cursor(2);
+    CHECK(c.frame_count() == 3);
+    auto frames = c.frames();
+    REQUIRE(frames.size() == 3 * (4 + 6));
+    auto p = static_cast<const uint8_t*>(frames.data());
+    CHECK(p[3] == 6);
+    CHECK(std::string(reinterpret_cast<const char*>(p + 4), 6) == "frame2");
+
+#if defined(__linux__)
+    asio::io_context io;
+    asio::local::stream_protocol::socket a{io}, b{io};
+    asio::local::connect_pair(a, b);
+
+    int fd;
+    off_t offset;
+    std::size_t count;
+    REQUIRE(c.file_range(fd, offset, count));
+    CHECK(count == frames.size());
+
+    bool sent = false;
+    async_sendfile(a, fd, offset, count,
+                   [&](const bsys::error_code& ec, std::size_t n)
+                   {
+                       CHECK(!ec);
+                       CHECK(n == count);
+                       sent = true;
+                   });
+    io.run();
+    CHECK(sent);
+
+    std::string received(count, '\0');
+    asio::read(b, asio::buffer(&received[0], count));
+    CHECK(received == std::string(static_cast<const char*>(frames.data()), count));
+#endif
+}
+
+TEST_CASE("topic_log_catch_up_over_connection", "[topic_log]")
+{
+    TempDir dir{"topic_log"};
+    bsys::error_code ec;
+    TopicLog log{dir.path()};
+    log.open(ec);
+    REQUIRE(!ec);
+    for (int i = 0; i < 4; ++i) append(log, "update" + std::to_string(i));
+
+    asio::io_context ioc;
+    bbtest::stream s1{ioc};
+    bbtest::stream s2{ioc};
+    s1.connect(s2);
+    Connection<bbtest::stream> conn1{std::move(s1), "clingoserver"};
+    Connection<bbtest::stream> conn2{std::move(s2), "clingoserver"};
+    conn1.validate([](const bsys::error_code&){ });
+    conn2.validate([](const bsys::error_code&){ });
+
+    // The stored frames go out as they are and arrive as separate messages
+    auto c = log.cursor(1);
+    conn1.async_send_frames(c.frames(), [](const bsys::error_code& ec, std::size_t)
+                                        { REQUIRE(!ec); });
+    std::string live = "live";
+    conn1.async_send_message(asio::buffer(live), [](const bsys::error_code&, std::size_t){ });
+
+    std::vector<std::string> received;
+    asio::streambuf sb;
+    std::function<void()> receive = [&]()
+    {
+        conn2.async_receive_message(sb, [&](const bsys::error_code& ec, std::size_t n)
+        {
+            REQUIRE(!ec);
+            sb.commit(n);
+            auto cbt = sb.data();
+            received.emplace_back(asio::buffers_begin(cbt), asio::buffers_end(cbt));
+            sb.consume(n);
+            if (received.size() < 4) receive();
+        });
+    };
+    receive();
+    ioc.run();
+
+    REQUIRE(received == std::vector<std::string>{"update1", "update2", "update3", "live"});
+}
@@ -0,0 +1,153 @@
+#include "catch.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clserver/fork_server.hpp"
+#include "clserver/worker_pool.hpp"
+#include "test_helpers.hpp"
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+
+using namespace clserver;
+using clserver_test::TempDir;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("worker_pool_warm_and_cold", "[worker_pool]")
+{
+    std::vector<std::string> spawned;
+    WorkerPool<int>::Options opts;
+    opts.warm_size = 2;
+    WorkerPool<int> pool{[&](const std::string& instance, bsys::error_code&)
+                         { spawned.push_back(instance); }, opts};
+
+    pool.fill();
+    REQUIRE(spawned == std::vector<std::string>{"worker-1", "worker-2"});
+    CHECK(pool.pending() == 2);
+
+    // Workers the pool did not start are ignored
+    CHECK(!pool.worker_ready("other", 99));
+
+    auto start = WorkerPool<int>::clock_type::now();
+    CHECK(pool.worker_ready("worker-1", 1, start + std::chrono::microseconds{600}));
+    CHECK(pool.worker_ready("worker-2", 2, start + std::chrono::microseconds{3000}));
+    CHECK(pool.warm() == 2);
+
+    // A warm worker is handed out at once and replaced in the background
+    int got = 0;
+    pool.acquire([&](const bsys::error_code& ec, int w) { CHECK(!ec); got = w; });
+    CHECK(got == 1);
+    CHECK(spawned.size() == 3);
+
+    // With none warm the acquire waits for a spawn
+    pool.acquire([&](const bsys::error_code& ec, int w) { CHECK(!ec); got = w; });
+    CHECK(got == 2);
+    pool.acquire([&](const bsys::error_code& ec, int w) { CHECK(!ec); got = w; });
+    CHECK(got == 2);
+    CHECK(pool.waiting() == 1);
+    CHECK(pool.pending() == 3);
+    CHECK(pool.worker_ready("worker-3", 3));
+    CHECK(got == 3);
+
+    const auto& stats = pool.stats();
+    CHECK(stats.hits == 2);
+    CHECK(stats.misses == 1);
+    CHECK(stats.hit_rate() == Approx(2.0 / 3.0));
+    CHECK(stats.ready == 3);
+    CHECK(stats.latency_max >= std::chrono::microseconds{3000});
+    CHECK(stats.latency_buckets[9] == 1);       // 600us is in [512, 1024)
+    CHECK(stats.latency_buckets[11] == 1);      // 3000us is in [2048, 4096)
+
+    // Overdue spawns are replaced and waiting acquires can be cancelled
+    auto pending = pool.pending();
+    CHECK(pool.check_timeouts(WorkerPool<int>::clock_type::now() + std::chrono::hours{1})
+          == pending);
+    CHECK(pool.stats().failed == pending);
+    CHECK(pool.pending() == 2);
+
+    // A worker whose spawn timed out is not taken when it turns up late
+    CHECK(!pool.worker_ready("worker-4", 4));
+    CHECK(pool.warm() == 0);
+
+    // When no worker can be started the acquire fails instead of waiting
+    auto unavailable = bsys::errc::make_error_code(bsys::errc::resource_unavailable_try_again);
+    bsys::error_code failed;
+    WorkerPool<int> broken{[&](const std::string&, bsys::error_code& ec) { ec = unavailable; }, opts};
+    broken.acquire([&](const bsys::error_code& ec, int) { failed = ec; });
+    CHECK(failed == bsys::errc::resource_unavailable_try_again);
+    CHECK(broken.pending() == 0);
+    CHECK(broken.waiting() == 0);
+
+    bool aborted = false;
+    WorkerPool<int> slow{[](const std::string&, bsys::error_code&) { }, opts};
+    slow.acquire([&](const bsys::error_code& ec, int)
+                 { aborted = ec == asio::error::operation_aborted; });
+    CHECK(slow.pending() == 3);
+    CHECK(slow.waiting() == 1);
+    slow.cancel();
+    CHECK(aborted);
+}
+
+TEST_CASE("worker_pool_hands_out_before_spawning", "[worker_pool]")
+{
+    // The spawn function stands in for a blocking fork and exec
+    std::vector<std::string> events;
+    WorkerPool<int>::Options opts;
+    opts.warm_size = 1;
+    WorkerPool<int> pool{[&](const std::string& instance, bsys::error_code&)
+                         { events.push_back("spawn " + instance); }, opts};
+    pool.fill();
+    REQUIRE(pool.worker_ready("worker-1", 1));
+    events.clear();
+
+    pool.acquire([&](const bsys::error_code& ec, int w)
+                 { CHECK(!ec); events.push_back("got " + std::to_string(w)); });
+    CHECK(events == std::vector<std::string>{"got 1", "spawn worker-2"});
+    CHECK(pool.pending() == 1);
+}
+
+TEST_CASE("fork_server_spawns_workers", "[worker_pool]")
+{
+    TempDir tmp{"fork_server"};
+    const auto& dir = tmp.path();
+
+    ForkServer fs;
+    bsys::error_code ec;
+    fs.start("/bin/sh", {"-c", "printf %s \"$CLINGOSERVER_WORKER_INSTANCE\" > " + dir +
+                               "/$CLINGOSERVER_WORKER_INSTANCE"}, ec);
+    REQUIRE(!ec);
+    REQUIRE(fs.running());
+
+    auto pid = fs.spawn("worker-7", ec);
+    REQUIRE(!ec);
+    CHECK(pid > 0);
+
+    std::string contents;
+    for (int i = 0; i < 200 && contents.empty(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        std::ifstream in{dir + "/worker-7"};
+        std::getline(in, contents);
+    }
+    CHECK(contents == "worker-7");
+
+    fs.spawn("", ec);
+    CHECK(ec == bsys::errc::invalid_argument);
+
+    // A worker that can't be executed is reported
+    ForkServer missing;
+    ec = bsys::error_code{};
+    missing.start(dir + "/no_such_worker", {}, ec);
+    REQUIRE(!ec);
+    missing.spawn("worker-1", ec);
+    CHECK(ec == bsys::errc::no_such_file_or_directory);
+
+    fs.stop();
+    CHECK(!fs.running());
+}
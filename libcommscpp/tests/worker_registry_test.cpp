@@ -0,0 +1,90 @@
+#include "catch.hpp"
+
+#include <string>
+#include "clserver/worker_registry.hpp"
+#include "worker_handle_generated.h"
+
+using namespace clserver;
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("worker_registry_register_lookup")
+{
+    WorkerRegistry<int> reg;
+    using reg_t = WorkerRegistry<int>;
+
+    auto h1 = reg.register_worker("worker1", 1);
+    auto h2 = reg.register_worker("worker2", 2);
+    REQUIRE(h1 != reg_t::invalid_handle);
+    REQUIRE(h2 != reg_t::invalid_handle);
+    REQUIRE(h1 != h2);
+    REQUIRE(reg.size() == 2);
+
+    REQUIRE(*reg.lookup(h1) == 1);
+    REQUIRE(*reg.lookup(h2) == 2);
+    REQUIRE(*reg.instance(h2) == "worker2");
+    REQUIRE(reg.find("worker1") == h1);
+    REQUIRE(reg.find("worker3") == reg_t::invalid_handle);
+    REQUIRE(reg.lookup(reg_t::invalid_handle) == nullptr);
+
+    // An instance can only be registered once
+    REQUIRE(reg.register_worker("worker1", 3) == reg_t::invalid_handle);
+}
+
+TEST_CASE("worker_registry_stale_handle")
+{
+    WorkerRegistry<std::string> reg;
+    using reg_t = WorkerRegistry<std::string>;
+
+    auto h1 = reg.register_worker("worker1", "a");
+    REQUIRE(reg.unregister(h1));
+    REQUIRE(!reg.unregister(h1));
+    REQUIRE(reg.lookup(h1) == nullptr);
+    REQUIRE(reg.find("worker1") == reg_t::invalid_handle);
+    REQUIRE(reg.size() == 0);
+
+    // The slot is reused under a new generation
+    auto h2 = reg.register_worker("worker2", "b");
+    REQUIRE(h2 != h1);
+    REQUIRE((h2 & (reg_t::max_workers - 1)) == (h1 & (reg_t::max_workers - 1)));
+    REQUIRE(reg.lookup(h1) == nullptr);
+    REQUIRE(*reg.lookup(h2) == "b");
+
+    // Generations wrap without ever issuing handle 0
+    for (int i = 0; i < 600; ++i)
+    {
+        auto h = reg.register_worker("worker3", "c");
+        REQUIRE(h != reg_t::invalid_handle);
+        REQUIRE(reg.unregister(h));
+    }
+}
+
+TEST_CASE("worker_registry_features")
+{
+    using reg_t = WorkerRegistry<int>;
+    const uint32_t bitsets = ClingoServer::ConnectionFeature_ModelBitsets;
+    const uint32_t unknown = 1u << 31;     // From a newer worker
+
+    reg_t reg{64, bitsets};
+    CHECK(reg.supported_features() == bitsets);
+    CHECK(reg.accept_features(bitsets | unknown) == bitsets);
+    CHECK(reg.accept_features(unknown) == 0);
+
+    auto h1 = reg.register_worker("worker1", 1, bitsets | unknown);
+    auto h2 = reg.register_worker("worker2", 2);
+    CHECK(reg.features(h1) == bitsets);
+    CHECK(reg.features(h2) == 0);
+    CHECK(reg.features(reg_t::invalid_handle) == 0);
+
+    // A stale handle has no features, and a reused slot gets its new owner's
+    REQUIRE(reg.unregister(h1));
+    CHECK(reg.features(h1) == 0);
+    auto h3 = reg.register_worker("worker3", 3, unknown);
+    CHECK(reg.features(h3) == 0);
+
+    // A server that supports nothing accepts nothing
+    reg_t none;
+    CHECK(none.features(none.register_worker("worker1", 1, bitsets)) == 0);
+}
@@ -0,0 +1,158 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/system/system_error.hpp>
+#include <clingo.hh>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/fact_set.hpp"
+#include "clworker/fact_loader.hpp"
+
+namespace bsys=boost::system;
+
+using namespace clserver;
+using namespace clworker;
+using bench_clock = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+// Compare the two ways of giving a job generated facts: printing them as text
+// for clingo to parse, and encoding them as a FactSet that the worker adds
+// through the backend. The facts are edge(X,Y) over numbers and color(X,C)
+// over a few constants. Each path is timed from the facts in memory to a
+// grounded program, split into the client's encoding and the worker's
+// ingestion (parsing or loading, then grounding). Both paths must ground the
+// same number of atoms, or the run fails.
+//------------------------------------------------------------------------------
+
+static const char* program = "#show color/2.";
+static const char* colors[] = {"red", "green", "blue", "yellow", "cyan", "magenta", "black", "white"};
+
+struct Facts
+{
+    std::vector<int32_t> edges;        // Pairs
+    std::vector<int32_t> colors;       // Pairs of node and color index
+};
+
+static Facts make_facts(std::size_t count)
+{
+    std::mt19937 rng{42};
+    Facts f;
+    std::size_t nodes = count / 4 + 1;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto& v = i % 4 ? f.edges : f.colors;
+        v.push_back(static_cast<int32_t>(rng() % nodes));
+        v.push_back(static_cast<int32_t>(i % 4 ? rng() % nodes : rng() % 8));
+    }
+    return f;
+}
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static std::size_t count_atoms(Clingo::Control& ctl)
+{
+    std::size_t n = 0;
+    auto atoms = ctl.symbolic_atoms();
+    for (auto sig : {Clingo::Signature{"edge", 2}, Clingo::Signature{"color", 2}})
+        for (auto it = atoms.begin(sig); it != atoms.end(); ++it) ++n;
+    return n;
+}
+
+struct Result
+{
+    std::size_t bytes;
+    double encode;
+    double ingest;
+    std::size_t atoms;
+};
+
+static void report(const char* name, const Result& r)
+{
+    std::cout << name << ": bytes=" << r.bytes
+              << " encode=" << r.encode << "s"
+              << " ingest=" << r.ingest << "s"
+              << " total=" << r.encode + r.ingest << "s"
+              << " atoms=" << r.atoms << std::endl;
+}
+
+static Result text_path(const Facts& f)
+{
+    auto start = bench_clock::now();
+    std::string text;
+    for (std::size_t i = 0; i < f.edges.size(); i += 2)
+        text += "edge(" + std::to_string(f.edges[i]) + "," + std::to_string(f.edges[i + 1]) + ").\n";
+    for (std::size_t i = 0; i < f.colors.size(); i += 2)
+        text += "color(" + std::to_string(f.colors[i]) + "," + colors[f.colors[i + 1]] + ").\n";
+    text += program;
+    double encode = seconds_since(start);
+
+    start = bench_clock::now();
+    Clingo::Control ctl;
+    ctl.add("base", {}, text.c_str());
+    ctl.ground({{"base", {}}});
+    double ingest = seconds_since(start);
+    return Result{text.size(), encode, ingest, count_atoms(ctl)};
+}
+
+static Result binary_path(const Facts& f)
+{
+    auto start = bench_clock::now();
+    FactSetBuilder b;
+    auto edge = b.block("edge", {ClingoServer::ArgType_Number, ClingoServer::ArgType_Number});
+    for (std::size_t i = 0; i < f.edges.size(); i += 2) b.add(edge, &f.edges[i]);
+    auto color = b.block("color", {ClingoServer::ArgType_Number, ClingoServer::ArgType_Constant});
+    std::vector<int32_t> ids;
+    for (auto c : colors) ids.push_back(static_cast<int32_t>(b.intern(c)));
+    for (std::size_t i = 0; i < f.colors.size(); i += 2) b.add(color, {f.colors[i], ids[f.colors[i + 1]]});
+    fbs::FlatBufferBuilder fbb;
+    b.finish(fbb);
+    double encode = seconds_since(start);
+
+    start = bench_clock::now();
+    Clingo::Control ctl;
+    FactLoader loader;
+    bsys::error_code ec;
+    loader.load(ctl, fbb.GetBufferPointer(), fbb.GetSize(), ec);
+    if (ec) throw bsys::system_error{ec};
+    ctl.add("base", {}, program);
+    ctl.ground({{"base", {}}});
+    double ingest = seconds_since(start);
+    return Result{fbb.GetSize(), encode, ingest, count_atoms(ctl)};
+}
+
+//------------------------------------------------------------------------------
+// Usage: fact_ingest_bench [facts]
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        std::size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+        auto facts = make_facts(count);
+        auto text = text_path(facts);
+        report("text  ", text);
+        auto binary = binary_path(facts);
+        report("binary", binary);
+        std::cout << "binary/text: bytes=" << double(binary.bytes) / text.bytes
+                  << " ingest=" << binary.ingest / text.ingest
+                  << " total=" << (binary.encode + binary.ingest) / (text.encode + text.ingest)
+                  << std::endl;
+        if (binary.atoms != text.atoms)
+        {
+            std::cerr << "The paths ground different atoms" << std::endl;
+            return 1;
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
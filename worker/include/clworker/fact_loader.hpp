@@ -0,0 +1,249 @@
+//--------------------------------------------------------------------------------
+// Add the facts of a FactSet to clingo without parsing them.
+// -------------------------------------------------------------------------------
+
+#ifndef CLWORKER_FACT_LOADER_HH
+#define CLWORKER_FACT_LOADER_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <clingo.hh>
+#include <flatbuffers/flatbuffers.h>
+#include "facts_generated.h"
+
+namespace clworker
+{
+
+namespace bsys=boost::system;
+namespace fbs=flatbuffers;
+
+//-------------------------------------------------------------------------------
+// FactLoader adds the facts of a FactSet (facts.fbs) to a Control through its
+// backend. Each fact becomes an atom and a fact rule; the symbols are made
+// directly from the dictionary and the value arrays, so none of the text is
+// lexed or parsed. Atoms added this way take part in later grounding, which
+// needs clingo 5.5 or later, so the facts must be loaded before the program
+// that uses them is grounded:
+//
+//     FactLoader loader;
+//     loader.load(ctl, data, size, ec);
+//     ctl.add("base", {}, program);
+//     ctl.ground({{"base", {}}});
+//
+// The buffer is verified before anything is added, and a FactSet that refers
+// to a dictionary entry or function it doesn't have is rejected with
+// bad_message. A FactLoader can be reused; it keeps its buffers.
+// -------------------------------------------------------------------------------
+
+class FactLoader
+{
+public:
+    FactLoader() : facts_{0} { }
+
+    FactLoader(FactLoader&&) = delete;
+    FactLoader(const FactLoader&) = delete;
+
+    FactLoader& operator=(const FactLoader&) = delete;
+
+    // Verify a FactSet buffer and add its facts
+    void load(Clingo::Control& ctl, const uint8_t* data, std::size_t size,
+              bsys::error_code& ec);
+
+    // Add the facts of a FactSet that has already been verified
+    void load(Clingo::Control& ctl, const ClingoServer::FactSet& set, bsys::error_code& ec);
+
+    // Facts added by the last load
+    std::size_t facts() const { return facts_; }
+
+    // Whether a buffer looks like a FactSet rather than program text
+    static bool is_fact_set(const uint8_t* data, std::size_t size)
+    {
+        return size >= 8 && ClingoServer::FactSetBufferHasIdentifier(data);
+    }
+
+private:
+    // Index the dictionary and make the symbols of the function terms
+    bool _prepare(const ClingoServer::FactSet& set);
+
+    // Whether every value of a block refers to something that exists
+    bool _check(const fbs::Vector<uint8_t>* types, const fbs::Vector<int32_t>* values,
+                uint32_t limit) const;
+
+    // The symbol for an argument; limit bounds the functions it may refer to
+    bool _arg(uint8_t type, int32_t value, uint32_t limit, Clingo::Symbol& out);
+    bool _args(const fbs::Vector<uint8_t>* types, const fbs::Vector<int32_t>* values,
+               uint32_t offset, uint32_t n, uint32_t limit, std::vector<Clingo::Symbol>& out);
+
+    // Dictionary entries are made into constants and strings once, on first use
+    enum : uint8_t { _id = 1, _string = 2 };
+
+    std::vector<const char*> names_;
+    std::vector<Clingo::Symbol> ids_;
+    std::vector<Clingo::Symbol> strings_;
+    std::vector<uint8_t> made_;
+    std::vector<Clingo::Symbol> functions_;
+    std::vector<Clingo::Symbol> args_;
+    std::vector<Clingo::Symbol> nested_;
+    std::size_t facts_;
+};
+
+//-------------------------------------------------------------------------------
+// FactLoader member functions
+//-------------------------------------------------------------------------------
+
+inline void FactLoader::load(Clingo::Control& ctl, const uint8_t* data, std::size_t size,
+                             bsys::error_code& ec)
+{
+    fbs::Verifier verifier{data, size};
+    if (!is_fact_set(data, size) || !ClingoServer::VerifyFactSetBuffer(verifier))
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return;
+    }
+    load(ctl, *ClingoServer::GetFactSet(data), ec);
+}
+
+//------------------------------------------------------------------------------
+// Every reference is checked before the backend is opened, so a bad FactSet
+// adds nothing. Within a block only the argument values change from fact to
+// fact, so the argument vector is reused.
+// -----------------------------------------------------------------------------
+
+inline void FactLoader::load(Clingo::Control& ctl, const ClingoServer::FactSet& set,
+                             bsys::error_code& ec)
+{
+    facts_ = 0;
+    bool ok = _prepare(set);
+    auto limit = static_cast<uint32_t>(functions_.size());
+    if (ok && set.blocks())
+    {
+        for (auto b : *set.blocks())
+        {
+            uint64_t arity = b->types() ? b->types()->size() : 0;
+            uint64_t values = b->values() ? b->values()->size() : 0;
+            ok = b->name() < names_.size() && arity * b->count() == values &&
+                 _check(b->types(), b->values(), limit);
+            if (!ok) break;
+        }
+    }
+    if (!ok)
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::bad_message);
+        return;
+    }
+    if (!set.blocks()) return;
+
+    ctl.with_backend([&](Clingo::Backend& backend)
+    {
+        for (auto b : *set.blocks())
+        {
+            auto arity = b->types() ? b->types()->size() : 0;
+            auto name = names_[b->name()];
+            for (uint32_t row = 0; row < b->count(); ++row)
+            {
+                _args(b->types(), b->values(), row * arity, arity, limit, args_);
+                auto atom = backend.add_atom(
+                    Clingo::Function(name, Clingo::SymbolSpan{args_.data(), args_.size()},
+                                     !b->negative()));
+                backend.rule(false, Clingo::AtomSpan{&atom, 1}, Clingo::LiteralSpan{});
+            }
+            facts_ += b->count();
+        }
+    });
+}
+
+inline bool FactLoader::_prepare(const ClingoServer::FactSet& set)
+{
+    names_.clear();
+    functions_.clear();
+    if (set.dictionary())
+        for (auto s : *set.dictionary()) names_.push_back(s->c_str());
+    ids_.resize(names_.size());
+    strings_.resize(names_.size());
+    made_.assign(names_.size(), 0);
+
+    if (!set.functions()) return true;
+    for (uint32_t i = 0; i < set.functions()->size(); ++i)
+    {
+        auto f = set.functions()->Get(i);
+        auto n = f->types() ? f->types()->size() : 0;
+        if (f->name() >= names_.size() || n != (f->values() ? f->values()->size() : 0))
+            return false;
+        if (!_args(f->types(), f->values(), 0, n, i, nested_)) return false;
+        functions_.push_back(Clingo::Function(
+            names_[f->name()], Clingo::SymbolSpan{nested_.data(), nested_.size()}));
+    }
+    return true;
+}
+
+inline bool FactLoader::_check(const fbs::Vector<uint8_t>* types,
+                               const fbs::Vector<int32_t>* values, uint32_t limit) const
+{
+    auto arity = types ? types->size() : 0;
+    if (!arity) return true;
+    for (uint32_t i = 0, col = 0; i < values->size(); ++i, col = col + 1 == arity ? 0 : col + 1)
+    {
+        auto value = values->Get(i);
+        auto index = static_cast<uint32_t>(value);
+        switch (types->Get(col))
+        {
+        case ClingoServer::ArgType_Number:
+            break;
+        case ClingoServer::ArgType_String:
+        case ClingoServer::ArgType_Constant:
+            if (value < 0 || index >= names_.size()) return false;
+            break;
+        case ClingoServer::ArgType_Function:
+            if (value < 0 || index >= limit) return false;
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool FactLoader::_arg(uint8_t type, int32_t value, uint32_t limit, Clingo::Symbol& out)
+{
+    auto index = static_cast<uint32_t>(value);
+    switch (type)
+    {
+    case ClingoServer::ArgType_Number:
+        out = Clingo::Number(value);
+        return true;
+    case ClingoServer::ArgType_String:
+        if (value < 0 || index >= names_.size()) return false;
+        if (!(made_[index] & _string)) strings_[index] = Clingo::String(names_[index]);
+        made_[index] |= _string;
+        out = strings_[index];
+        return true;
+    case ClingoServer::ArgType_Constant:
+        if (value < 0 || index >= names_.size()) return false;
+        if (!(made_[index] & _id)) ids_[index] = Clingo::Id(names_[index]);
+        made_[index] |= _id;
+        out = ids_[index];
+        return true;
+    case ClingoServer::ArgType_Function:
+        if (value < 0 || index >= limit) return false;
+        out = functions_[index];
+        return true;
+    default:
+        return false;
+    }
+}
+
+inline bool FactLoader::_args(const fbs::Vector<uint8_t>* types,
+                              const fbs::Vector<int32_t>* values, uint32_t offset, uint32_t n,
+                              uint32_t limit, std::vector<Clingo::Symbol>& out)
+{
+    out.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+        if (!_arg(types->Get(i), values->Get(offset + i), limit, out[i])) return false;
+    return true;
+}
+
+}
+
+#endif // CLWORKER_FACT_LOADER_HH
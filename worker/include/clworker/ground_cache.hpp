@@ -0,0 +1,346 @@
+//--------------------------------------------------------------------------------
+// On-disk cache of ground programs in aspif format.
+// -------------------------------------------------------------------------------
+
+#ifndef CLWORKER_GROUND_CACHE_HH
+#define CLWORKER_GROUND_CACHE_HH
+
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <clingo.hh>
+#include <potassco/aspif.h>
+#include "clserver/sha256.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clworker
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// The inputs that determine a ground program. The key is a SHA-256 over all
+// of them and the clingo version, so a cached program is only reused for
+// exactly the same grounding.
+// -------------------------------------------------------------------------------
+
+struct GroundInputs
+{
+    std::vector<std::string> args;                           // clingo options
+    std::vector<std::pair<std::string, std::string>> constants;
+    std::vector<std::string> programs;                       // Program texts in order
+    std::vector<std::string> parts;                          // eg "base", "step(3)"
+
+    std::string key() const;
+};
+
+//-------------------------------------------------------------------------------
+// AspifRecorder observes a Control's grounding and writes the ground program
+// in aspif. It must be registered before grounding and outlive the Control.
+// Theory atoms are not recorded; a program using them is not cacheable.
+// -------------------------------------------------------------------------------
+
+class AspifRecorder : public Clingo::GroundProgramObserver
+{
+public:
+    AspifRecorder() : out_{os_}, cacheable_{true} { }
+
+    AspifRecorder(AspifRecorder&&) = delete;
+    AspifRecorder(const AspifRecorder&) = delete;
+
+    AspifRecorder& operator=(const AspifRecorder&) = delete;
+
+    bool cacheable() const { return cacheable_; }
+    std::string str() const { return os_.str(); }
+
+    void init_program(bool incremental) override { out_.initProgram(incremental); }
+    void begin_step() override { out_.beginStep(); }
+    void end_step() override { out_.endStep(); }
+
+    void rule(bool choice, Clingo::AtomSpan head, Clingo::LiteralSpan body) override;
+    void weight_rule(bool choice, Clingo::AtomSpan head, Clingo::weight_t lower_bound,
+                     Clingo::WeightedLiteralSpan body) override;
+    void minimize(Clingo::weight_t priority, Clingo::WeightedLiteralSpan literals) override;
+    void project(Clingo::AtomSpan atoms) override;
+    void output_atom(Clingo::Symbol symbol, Clingo::atom_t atom) override;
+    void output_term(Clingo::Symbol symbol, Clingo::LiteralSpan condition) override;
+    void external(Clingo::atom_t atom, Clingo::ExternalType type) override;
+    void assume(Clingo::LiteralSpan literals) override;
+    void heuristic(Clingo::atom_t atom, Clingo::HeuristicType type, int bias,
+                   unsigned priority, Clingo::LiteralSpan condition) override;
+    void acyc_edge(int node_u, int node_v, Clingo::LiteralSpan condition) override;
+
+    void theory_atom(Clingo::id_t, Clingo::id_t, Clingo::IdSpan) override
+    { cacheable_ = false; }
+    void theory_atom_with_guard(Clingo::id_t, Clingo::id_t, Clingo::IdSpan,
+                                Clingo::id_t, Clingo::id_t) override
+    { cacheable_ = false; }
+
+private:
+    static Potassco::AtomSpan _atoms(Clingo::AtomSpan s)
+    { return Potassco::toSpan(s.begin(), s.size()); }
+    static Potassco::LitSpan _lits(Clingo::LiteralSpan s)
+    { return Potassco::toSpan(s.begin(), s.size()); }
+    Potassco::WeightLitSpan _wlits(Clingo::WeightedLiteralSpan s);
+
+    std::ostringstream os_;
+    Potassco::AspifOutput out_;
+    std::vector<Potassco::WeightLit_t> wlits_;
+    bool cacheable_;
+};
+
+struct GroundCacheStats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t stored = 0;
+    std::size_t uncacheable = 0;   // Programs using theory atoms
+    std::size_t errors = 0;        // Failed reads or writes
+};
+
+//-------------------------------------------------------------------------------
+// GroundCache stores ground programs as aspif files named by their key. A hit
+// maps the file and adds it to the Control as the "base" part, which clingo
+// reads as aspif, so the job skips parsing and grounding the logic program.
+// Files end in a NUL byte so the mapping can be given to clingo without a
+// copy. Files are written under a temporary name and renamed into place, so
+// several workers can share a cache directory.
+// -------------------------------------------------------------------------------
+
+class GroundCache
+{
+public:
+    using ground_fn_t = std::function<void(Clingo::Control&)>;
+
+    // The worker caches ground programs in the directory this names, if set
+    static constexpr const char* dir_env = "CLINGOSERVER_GROUND_CACHE";
+
+    explicit GroundCache(const std::string& dir) : dir_{dir} { }
+
+    GroundCache(GroundCache&&) = delete;
+    GroundCache(const GroundCache&) = delete;
+
+    GroundCache& operator=(const GroundCache&) = delete;
+
+    // Load the cached program for key into ctl, or call ground and store what
+    // the recorder saw. The recorder must already be registered with ctl.
+    // Returns true on a hit.
+    bool load_or_ground(Clingo::Control& ctl, AspifRecorder& recorder,
+                        const std::string& key, const ground_fn_t& ground);
+
+    // Lower level access
+    bool load(Clingo::Control& ctl, const std::string& key);
+    void store(const std::string& key, const std::string& aspif, bsys::error_code& ec);
+
+    bool contains(const std::string& key) const;
+    const GroundCacheStats& stats() const { return stats_; }
+
+private:
+    std::string _path(const std::string& key) const { return dir_ + "/" + key + ".aspif"; }
+
+    std::string dir_;
+    GroundCacheStats stats_;
+};
+
+//-------------------------------------------------------------------------------
+// GroundInputs member functions
+//-------------------------------------------------------------------------------
+
+inline std::string GroundInputs::key() const
+{
+    clserver::Sha256 h;
+    h.add_field(CLINGO_VERSION);
+    for (const auto* list : {&args, &programs, &parts})
+    {
+        h.add_field(std::to_string(list->size()));
+        for (const auto& s : *list) h.add_field(s);
+    }
+    h.add_field(std::to_string(constants.size()));
+    for (const auto& c : constants)
+    {
+        h.add_field(c.first);
+        h.add_field(c.second);
+    }
+    return clserver::Sha256::hex(h.finish());
+}
+
+//-------------------------------------------------------------------------------
+// AspifRecorder member functions
+//-------------------------------------------------------------------------------
+
+inline void AspifRecorder::rule(bool choice, Clingo::AtomSpan head, Clingo::LiteralSpan body)
+{
+    out_.rule(choice ? Potassco::Head_t::Choice : Potassco::Head_t::Disjunctive,
+              _atoms(head), _lits(body));
+}
+
+inline void AspifRecorder::weight_rule(bool choice, Clingo::AtomSpan head,
+                                       Clingo::weight_t lower_bound,
+                                       Clingo::WeightedLiteralSpan body)
+{
+    out_.rule(choice ? Potassco::Head_t::Choice : Potassco::Head_t::Disjunctive,
+              _atoms(head), lower_bound, _wlits(body));
+}
+
+inline void AspifRecorder::minimize(Clingo::weight_t priority,
+                                    Clingo::WeightedLiteralSpan literals)
+{
+    out_.minimize(priority, _wlits(literals));
+}
+
+inline void AspifRecorder::project(Clingo::AtomSpan atoms)
+{
+    out_.project(_atoms(atoms));
+}
+
+// Atom 0 marks a symbol that is a fact, which is shown unconditionally
+inline void AspifRecorder::output_atom(Clingo::Symbol symbol, Clingo::atom_t atom)
+{
+    auto str = symbol.to_string();
+    Potassco::Lit_t lit = static_cast<Potassco::Lit_t>(atom);
+    out_.output(Potassco::toSpan(str.c_str(), str.size()),
+                atom ? Potassco::toSpan(&lit, 1) : Potassco::LitSpan{});
+}
+
+inline void AspifRecorder::output_term(Clingo::Symbol symbol, Clingo::LiteralSpan condition)
+{
+    auto str = symbol.to_string();
+    out_.output(Potassco::toSpan(str.c_str(), str.size()), _lits(condition));
+}
+
+inline void AspifRecorder::external(Clingo::atom_t atom, Clingo::ExternalType type)
+{
+    out_.external(atom, static_cast<Potassco::Value_t>(static_cast<int>(type)));
+}
+
+inline void AspifRecorder::assume(Clingo::LiteralSpan literals)
+{
+    out_.assume(_lits(literals));
+}
+
+inline void AspifRecorder::heuristic(Clingo::atom_t atom, Clingo::HeuristicType type, int bias,
+                                     unsigned priority, Clingo::LiteralSpan condition)
+{
+    out_.heuristic(atom, static_cast<Potassco::Heuristic_t>(static_cast<int>(type)),
+                   bias, priority, _lits(condition));
+}
+
+inline void AspifRecorder::acyc_edge(int node_u, int node_v, Clingo::LiteralSpan condition)
+{
+    out_.acycEdge(node_u, node_v, _lits(condition));
+}
+
+inline Potassco::WeightLitSpan AspifRecorder::_wlits(Clingo::WeightedLiteralSpan s)
+{
+    wlits_.clear();
+    for (const auto& wl : s) wlits_.push_back(Potassco::WeightLit_t{wl.literal(), wl.weight()});
+    return Potassco::toSpan(wlits_.data(), wlits_.size());
+}
+
+//-------------------------------------------------------------------------------
+// GroundCache member functions
+//-------------------------------------------------------------------------------
+
+inline bool GroundCache::load_or_ground(Clingo::Control& ctl, AspifRecorder& recorder,
+                                        const std::string& key, const ground_fn_t& ground)
+{
+    if (load(ctl, key)) return true;
+
+    ground(ctl);
+    if (!recorder.cacheable())
+    {
+        ++stats_.uncacheable;
+        return false;
+    }
+    bsys::error_code ec;
+    store(key, recorder.str(), ec);
+    return false;
+}
+
+inline bool GroundCache::load(Clingo::Control& ctl, const std::string& key)
+{
+    int fd = ::open(_path(key).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        ++stats_.misses;
+        return false;
+    }
+
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    // A file without its closing NUL was not written by store()
+    auto text = static_cast<const char*>(map);
+    if (map == MAP_FAILED || text[st.st_size - 1] != '\0')
+    {
+        if (map != MAP_FAILED) ::munmap(map, static_cast<std::size_t>(st.st_size));
+        ++stats_.errors;
+        ++stats_.misses;
+        return false;
+    }
+
+    ++stats_.hits;
+    try
+    {
+        ctl.add("base", {}, text);
+        ctl.ground({{"base", {}}});
+    }
+    catch (...)
+    {
+        ::munmap(map, static_cast<std::size_t>(st.st_size));
+        throw;
+    }
+    ::munmap(map, static_cast<std::size_t>(st.st_size));
+    return true;
+}
+
+inline void GroundCache::store(const std::string& key, const std::string& aspif,
+                               bsys::error_code& ec)
+{
+    auto path = _path(key);
+    auto tmp = path + ".tmp." + std::to_string(::getpid());
+    auto f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        ec = bsys::error_code{errno, bsys::system_category()};
+        ++stats_.errors;
+        return;
+    }
+    // Keep the first failure's errno: a later successful call may change it
+    int err = 0;
+    errno = 0;
+    if (std::fwrite(aspif.c_str(), 1, aspif.size() + 1, f) != aspif.size() + 1)
+        err = errno ? errno : EIO;
+    if (std::fclose(f) != 0 && !err) err = errno ? errno : EIO;
+    if (!err && std::rename(tmp.c_str(), path.c_str()) != 0) err = errno;
+    if (err)
+    {
+        ec = bsys::error_code{err, bsys::system_category()};
+        std::remove(tmp.c_str());
+        ++stats_.errors;
+        return;
+    }
+    ++stats_.stored;
+}
+
+inline bool GroundCache::contains(const std::string& key) const
+{
+    struct stat st;
+    return ::stat(_path(key).c_str(), &st) == 0;
+}
+
+}
+
+#endif // CLWORKER_GROUND_CACHE_HH
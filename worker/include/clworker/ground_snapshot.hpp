@@ -0,0 +1,189 @@
+//--------------------------------------------------------------------------------
+// Ground a base program once and fork jobs from it.
+// -------------------------------------------------------------------------------
+
+#ifndef CLWORKER_GROUND_SNAPSHOT_HH
+#define CLWORKER_GROUND_SNAPSHOT_HH
+
+#include <cerrno>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/system/error_code.hpp>
+#include <clingo.hh>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace clworker
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// GroundSnapshot holds a clingo Control with a base program already grounded.
+// fork_job() forks a child that shares the grounded program copy-on-write and
+// runs the job function, which adds the job's facts with ground_job() as the
+// "job" program part, grounding only that part, and typically solves and
+// reports its models to the server. Grounding is left to the job function so
+// that a job whose facts don't parse is reported like any other failed job.
+// The child exits with the value the function returns, or 1 if it throws.
+//
+// Grounding in later steps does not revisit the rules of the base, so the base
+// program must declare the predicates that jobs supply as #external, eg:
+//
+//     #external edge(X,Y) : node(X), node(Y).
+//
+// The parent must not have solved with the Control, or started any other
+// threads, before forking. The child starts with the parent's descriptors; it
+// should connect to the server under its own worker instance rather than use
+// the parent's connection.
+// -------------------------------------------------------------------------------
+
+class GroundSnapshot
+{
+public:
+    using job_fn_t = std::function<int(Clingo::Control&)>;
+
+    explicit GroundSnapshot(std::vector<std::string> args = {}) : args_{std::move(args)} { }
+
+    GroundSnapshot(GroundSnapshot&&) = delete;
+    GroundSnapshot(const GroundSnapshot&) = delete;
+    ~GroundSnapshot() = default;
+
+    GroundSnapshot& operator=(const GroundSnapshot&) = delete;
+
+    // Add and ground the base program. On error the clingo message is kept in
+    // error_message().
+    void load(const std::string& base, const std::string& program, bsys::error_code& ec);
+
+    // Fork a child that calls fn with the snapshot's Control
+    pid_t fork_job(job_fn_t fn, bsys::error_code& ec);
+
+    // In the child: add and ground a job's facts on top of the base. Throws
+    // clingo's error if they don't parse or ground.
+    static void ground_job(Clingo::Control& ctl, const std::string& facts);
+
+    // Collect the children that have exited, as (pid, exit status) pairs
+    std::vector<std::pair<pid_t, int>> reap();
+
+    bool loaded() const { return ctl_ != nullptr; }
+    const std::string& base() const { return base_; }
+    const std::string& error_message() const { return error_message_; }
+    std::size_t running() const { return children_.size(); }
+
+    // The resident size of this process, reported to the server so it can
+    // budget the memory held by snapshots
+    static std::size_t memory_bytes();
+
+private:
+    std::vector<std::string> args_;
+    std::unique_ptr<Clingo::Control> ctl_;
+    std::string base_;
+    std::string error_message_;
+    std::set<pid_t> children_;
+};
+
+//-------------------------------------------------------------------------------
+// GroundSnapshot member functions
+//-------------------------------------------------------------------------------
+
+inline void GroundSnapshot::load(const std::string& base, const std::string& program,
+                                 bsys::error_code& ec)
+{
+    std::vector<const char*> args;
+    for (const auto& a : args_) args.push_back(a.c_str());
+
+    try
+    {
+        auto ctl = std::make_unique<Clingo::Control>(
+            Clingo::StringSpan{args.data(), args.size()});
+        ctl->add("base", {}, program.c_str());
+        ctl->ground({{"base", {}}});
+        ctl_ = std::move(ctl);
+        base_ = base;
+        error_message_.clear();
+    }
+    catch (const std::exception& e)
+    {
+        error_message_ = e.what();
+        ec = bsys::errc::make_error_code(bsys::errc::invalid_argument);
+    }
+}
+
+inline pid_t GroundSnapshot::fork_job(job_fn_t fn, bsys::error_code& ec)
+{
+    if (!loaded())
+    {
+        ec = bsys::errc::make_error_code(bsys::errc::operation_not_permitted);
+        return -1;
+    }
+
+    std::fflush(nullptr);
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        ec = bsys::error_code{errno, bsys::system_category()};
+        return -1;
+    }
+    if (pid > 0)
+    {
+        children_.insert(pid);
+        return pid;
+    }
+
+    // The child never returns into the parent's code
+    int status = 1;
+    try
+    {
+        status = fn(*ctl_);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "job failed: %s\n", e.what());
+    }
+    std::fflush(nullptr);
+    ::_exit(status);
+}
+
+inline void GroundSnapshot::ground_job(Clingo::Control& ctl, const std::string& facts)
+{
+    ctl.add("job", {}, facts.c_str());
+    ctl.ground({{"job", {}}});
+}
+
+inline std::vector<std::pair<pid_t, int>> GroundSnapshot::reap()
+{
+    std::vector<std::pair<pid_t, int>> exited;
+    for (auto it = children_.begin(); it != children_.end(); )
+    {
+        int status;
+        if (::waitpid(*it, &status, WNOHANG) == *it)
+        {
+            exited.emplace_back(*it, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+            it = children_.erase(it);
+        }
+        else ++it;
+    }
+    return exited;
+}
+
+inline std::size_t GroundSnapshot::memory_bytes()
+{
+    std::size_t pages = 0, resident = 0;
+    auto f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2) resident = 0;
+    std::fclose(f);
+    return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+}
+
+#endif // CLWORKER_GROUND_SNAPSHOT_HH
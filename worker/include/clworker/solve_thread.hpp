@@ -0,0 +1,348 @@
+//--------------------------------------------------------------------------------
+// Run a job's solve on its own thread and encode its models for the I/O thread.
+// -------------------------------------------------------------------------------
+
+#ifndef CLWORKER_SOLVE_THREAD_HH
+#define CLWORKER_SOLVE_THREAD_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <clingo.hh>
+#include <flatbuffers/flatbuffers.h>
+#include "job_generated.h"
+#include "worker_write_generated.h"
+#include "clserver/frame_channel.hpp"
+#include "clserver/model_bitset.hpp"
+#include "clserver/model_delta.hpp"
+#include "clserver/symbol_dictionary.hpp"
+
+namespace clworker
+{
+
+namespace fbs=flatbuffers;
+
+struct SolveThreadStats
+{
+    uint64_t models = 0;
+    std::size_t paused = 0;        // Times the search waited for a free builder
+    bool exhausted = false;
+    bool interrupted = false;
+    std::size_t dictionary = 0;    // Distinct symbols sent under the Ids or Delta encoding
+    std::size_t keyframes = 0;     // Models sent whole under the Delta encoding
+    std::size_t bitsets = 0;       // Models sent as bitsets under the Ids encoding
+    ClingoServer::SolveResult result = ClingoServer::SolveResult_Unknown;
+    std::string error;
+};
+
+//-------------------------------------------------------------------------------
+// SolveThread runs one job on a thread of its own: it calls prepare, which adds
+// and grounds the program if that has not been done already, then solves and
+// encodes each model as a ModelMsg frame directly in a builder taken from the
+// FrameChannel. The I/O thread sends the frames; wake is called, on the solve
+// thread, whenever it has to be told to drain the channel. The last frame is a
+// SolveDoneMsg, after which on_finished is called, again on the solve thread.
+//
+// The solve yields after each model, so clingo's search is suspended while a
+// model is encoded. If the I/O thread falls behind and every builder is in use
+// the solve thread waits for one before resuming the search: back-pressure
+// pauses the search itself rather than blocking a model callback, and nothing
+// on the solve thread ever touches the connection.
+//
+// The Control must not be used by anything else until on_finished is called.
+// interrupt() may be called from any thread; closing the channel also stops
+// the solve, without sending the SolveDoneMsg.
+// -------------------------------------------------------------------------------
+
+class SolveThread
+{
+public:
+    using prepare_fn_t = std::function<void(Clingo::Control&)>;
+
+    struct Options
+    {
+        uint64_t job_id = 0;
+        uint32_t handle = 0;           // The WorkerHandle of every frame
+        ClingoServer::ModelEncoding encoding = ClingoServer::ModelEncoding_Ids;
+        std::size_t keyframe_interval = 64;
+        bool bitsets = false;          // Whether ModelBitsets was agreed
+        prepare_fn_t prepare;
+        std::function<void()> wake;
+        std::function<void()> on_finished;
+    };
+
+    SolveThread(Clingo::Control& ctl, clserver::FrameChannel& channel, Options opts);
+
+    SolveThread(SolveThread&&) = delete;
+    SolveThread(const SolveThread&) = delete;
+    ~SolveThread();
+
+    SolveThread& operator=(const SolveThread&) = delete;
+
+    void interrupt();
+
+    // Whether on_finished has been called
+    bool finished() const { return finished_.load(std::memory_order_acquire); }
+
+    // Only to be read once finished
+    const SolveThreadStats& stats() const { return stats_; }
+
+private:
+    void _run();
+    void _solve();
+    bool _publish(fbs::FlatBufferBuilder* b);
+    void _encode_model(fbs::FlatBufferBuilder& b, const Clingo::Model& m);
+    fbs::Offset<fbs::Vector<fbs::Offset<fbs::String>>>
+    _print_symbols(fbs::FlatBufferBuilder& b, const std::vector<clingo_symbol_t>& symbols);
+    void _encode_done(fbs::FlatBufferBuilder& b);
+
+    Clingo::Control& ctl_;
+    clserver::FrameChannel& channel_;
+    Options opts_;
+    ClingoServer::WorkerHandle handle_;
+    std::atomic<bool> interrupted_;
+    std::atomic<bool> finished_;
+    SolveThreadStats stats_;
+
+    // The job's symbol dictionary
+    clserver::SymbolInterner interner_;
+    clserver::ModelDeltaEncoder delta_;
+
+    // Reused for every model so that encoding does not allocate
+    std::vector<clingo_symbol_t> symbols_;
+    std::vector<clingo_symbol_t> fresh_;
+    std::vector<uint32_t> ids_;
+    std::vector<uint8_t> added_;
+    std::vector<uint8_t> removed_;
+    std::vector<uint64_t> bits_;
+    std::vector<int64_t> costs_;
+    std::vector<char> text_;
+    std::vector<fbs::Offset<fbs::String>> strings_;
+
+    std::thread thread_;
+};
+
+//-------------------------------------------------------------------------------
+// SolveThread member functions
+//-------------------------------------------------------------------------------
+
+inline SolveThread::SolveThread(Clingo::Control& ctl, clserver::FrameChannel& channel,
+                                Options opts) :
+    ctl_{ctl}, channel_{channel}, opts_{std::move(opts)}, handle_{opts_.handle},
+    interrupted_{false}, finished_{false},
+    delta_{clserver::ModelDeltaEncoder::Options{opts_.keyframe_interval}}
+{
+    thread_ = std::thread{[this]() { _run(); }};
+}
+
+inline SolveThread::~SolveThread()
+{
+    interrupt();
+    thread_.join();
+}
+
+inline void SolveThread::interrupt()
+{
+    interrupted_.store(true, std::memory_order_release);
+    ctl_.interrupt();
+}
+
+//------------------------------------------------------------------------------
+// The solve thread. Exceptions from clingo are grounding or solving errors and
+// are reported in the SolveDoneMsg.
+// -----------------------------------------------------------------------------
+
+inline void SolveThread::_run()
+{
+    auto waits = channel_.stats().waits;
+    try
+    {
+        if (opts_.prepare) opts_.prepare(ctl_);
+        _solve();
+    }
+    catch (const std::exception& e)
+    {
+        stats_.result = ClingoServer::SolveResult_Error;
+        stats_.error = e.what();
+    }
+    stats_.paused = channel_.stats().waits - waits;
+    stats_.dictionary = interner_.size();
+    stats_.keyframes = delta_.stats().keyframes;
+
+    if (auto b = channel_.acquire())
+    {
+        _encode_done(*b);
+        _publish(b);
+    }
+    finished_.store(true, std::memory_order_release);
+    if (opts_.on_finished) opts_.on_finished();
+}
+
+inline void SolveThread::_solve()
+{
+    if (interrupted_.load(std::memory_order_acquire))
+    {
+        stats_.interrupted = true;
+        return;
+    }
+
+    // Iterating the handle resumes the search only once the body has returned
+    auto handle = ctl_.solve(Clingo::LiteralSpan{}, nullptr, false, true);
+    for (auto& m : handle)
+    {
+        auto b = interrupted_.load(std::memory_order_acquire) ? nullptr : channel_.acquire();
+        if (!b)
+        {
+            handle.cancel();
+            stats_.interrupted = true;
+            return;
+        }
+        ++stats_.models;
+        _encode_model(*b, m);
+        _publish(b);
+    }
+
+    auto result = handle.get();
+    stats_.exhausted = result.is_exhausted();
+    stats_.interrupted = result.is_interrupted();
+    if (result.is_satisfiable()) stats_.result = ClingoServer::SolveResult_Satisfiable;
+    else if (result.is_unsatisfiable()) stats_.result = ClingoServer::SolveResult_Unsatisfiable;
+}
+
+inline bool SolveThread::_publish(fbs::FlatBufferBuilder* b)
+{
+    if (!channel_.publish(b)) return false;
+    if (opts_.wake) opts_.wake();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Build a ModelMsg in b. The symbols and costs are read through clingo's C API
+// into buffers kept from model to model, rather than through the C++ API's
+// vectors and strings.
+//
+// Under the Ids encoding a symbol is only printed the first time the job
+// shows it. The new symbols go into a SymbolDictMsg that is batched with the
+// model in the same frame, ahead of it, so the client always has the names
+// before the IDs that refer to them.
+//
+// Under Delta the IDs are sorted and coded against the previous model, with
+// a keyframe every keyframe_interval models. Under Ids, if bitsets were
+// agreed, a model that is dense in the dictionary is sent as a bitset.
+// -----------------------------------------------------------------------------
+
+inline void SolveThread::_encode_model(fbs::FlatBufferBuilder& b, const Clingo::Model& m)
+{
+    using Clingo::Detail::handle_error;
+
+    std::size_t n = 0;
+    handle_error(clingo_model_symbols_size(m.to_c(), clingo_show_type_shown, &n));
+    symbols_.resize(n);
+    handle_error(clingo_model_symbols(m.to_c(), clingo_show_type_shown, symbols_.data(), n));
+
+    fbs::Offset<ClingoServer::SymbolDictMsg> dict;
+    fbs::Offset<fbs::Vector<fbs::Offset<fbs::String>>> symbols;
+    fbs::Offset<fbs::Vector<uint32_t>> ids;
+    fbs::Offset<fbs::Vector<uint8_t>> added, removed;
+    fbs::Offset<fbs::Vector<uint64_t>> bits;
+    bool keyframe = false;
+    if (opts_.encoding == ClingoServer::ModelEncoding_Text)
+    {
+        symbols = _print_symbols(b, symbols_);
+    }
+    else
+    {
+        ids_.clear();
+        fresh_.clear();
+        for (auto sym : symbols_)
+        {
+            bool added = false;
+            ids_.push_back(interner_.intern(sym, added));
+            if (added) fresh_.push_back(sym);
+        }
+        if (!fresh_.empty())
+        {
+            auto first = static_cast<uint32_t>(interner_.size() - fresh_.size());
+            dict = ClingoServer::CreateSymbolDictMsg(b, opts_.job_id, first,
+                                                     _print_symbols(b, fresh_));
+        }
+        if (opts_.encoding == ClingoServer::ModelEncoding_Delta)
+        {
+            std::sort(ids_.begin(), ids_.end());
+            keyframe = delta_.encode(ids_.data(), ids_.size(), added_, removed_);
+            added = b.CreateVector(added_);
+            removed = b.CreateVector(removed_);
+        }
+        else if (opts_.bitsets && clserver::prefer_bitset(ids_.size(), interner_.size()))
+        {
+            clserver::bitset_from_ids(ids_.data(), ids_.size(), interner_.size(), bits_);
+            bits = b.CreateVector(bits_);
+            ++stats_.bitsets;
+        }
+        else ids = b.CreateVector(ids_);
+    }
+
+    std::size_t ncosts = 0;
+    handle_error(clingo_model_cost_size(m.to_c(), &ncosts));
+    costs_.resize(ncosts);
+    handle_error(clingo_model_cost(m.to_c(), costs_.data(), ncosts));
+    auto costs = b.CreateVector(costs_);
+
+    auto type = ClingoServer::ModelType_StableModel;
+    if (m.type() == Clingo::ModelType::BraveConsequences)
+        type = ClingoServer::ModelType_BraveConsequences;
+    else if (m.type() == Clingo::ModelType::CautiousConsequences)
+        type = ClingoServer::ModelType_CautiousConsequences;
+
+    uint64_t base = keyframe ? 0 : m.number() - 1;
+    auto model = ClingoServer::CreateModelMsg(b, opts_.job_id, m.number(), type,
+                                              m.optimality_proven(), costs, symbols, ids,
+                                              base, keyframe, added, removed, bits);
+    if (dict.IsNull())
+    {
+        b.Finish(ClingoServer::CreateMessage(b, ClingoServer::Msg_Model, model.Union(), &handle_));
+        return;
+    }
+    uint8_t types[] = {ClingoServer::Msg_Dict, ClingoServer::Msg_Model};
+    fbs::Offset<void> msgs[] = {dict.Union(), model.Union()};
+    auto batch = ClingoServer::CreateMessageBatch(b, b.CreateVector(types, 2), b.CreateVector(msgs, 2));
+    b.Finish(ClingoServer::CreateMessage(b, ClingoServer::Msg_Batch, batch.Union(), &handle_));
+}
+
+// Print each symbol straight into a reused buffer and from there into b
+inline fbs::Offset<fbs::Vector<fbs::Offset<fbs::String>>>
+SolveThread::_print_symbols(fbs::FlatBufferBuilder& b, const std::vector<clingo_symbol_t>& symbols)
+{
+    using Clingo::Detail::handle_error;
+
+    strings_.clear();
+    for (auto sym : symbols)
+    {
+        std::size_t len = 0;
+        handle_error(clingo_symbol_to_string_size(sym, &len));
+        if (text_.size() < len) text_.resize(len);
+        handle_error(clingo_symbol_to_string(sym, text_.data(), len));
+        strings_.push_back(b.CreateString(text_.data(), len - 1));
+    }
+    return b.CreateVector(strings_);
+}
+
+inline void SolveThread::_encode_done(fbs::FlatBufferBuilder& b)
+{
+    fbs::Offset<fbs::String> error;
+    if (!stats_.error.empty()) error = b.CreateString(stats_.error);
+    auto done = ClingoServer::CreateSolveDoneMsg(b, opts_.job_id, stats_.result, stats_.models,
+                                                 stats_.exhausted, stats_.interrupted, error,
+                                                 stats_.paused);
+    b.Finish(ClingoServer::CreateMessage(b, ClingoServer::Msg_Done, done.Union(), &handle_));
+}
+
+}
+
+#endif // CLWORKER_SOLVE_THREAD_HH
@@ -0,0 +1,272 @@
+//--------------------------------------------------------------------------------
+// Parse a job's input while it is still arriving, and ground when it is done.
+// -------------------------------------------------------------------------------
+
+#ifndef CLWORKER_STREAMING_LOADER_HH
+#define CLWORKER_STREAMING_LOADER_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <boost/system/error_code.hpp>
+#include <clingo.hh>
+#include "clserver/spsc_queue.hpp"
+#include "clserver/statement_splitter.hpp"
+#include "clworker/fact_loader.hpp"
+
+namespace clworker
+{
+
+namespace bsys=boost::system;
+
+//-------------------------------------------------------------------------------
+// A piece of a streamed job's input, from a JobChunk message (job.fbs). Text
+// may split a statement anywhere; facts is a whole FactSet.
+// -------------------------------------------------------------------------------
+
+struct StreamChunk
+{
+    std::string data;
+    bool facts;
+    bool last;
+};
+
+struct StreamingLoaderStats
+{
+    std::size_t chunks = 0;
+    std::size_t text_bytes = 0;
+    std::size_t pieces = 0;        // Calls to Control::add
+    std::size_t facts = 0;         // Facts added from FactSets
+};
+
+//-------------------------------------------------------------------------------
+// StreamingLoader overlaps receiving a job's input with parsing it. The thread
+// that reads the connection pushes each chunk as it arrives; a loader thread
+// adds every complete statement of the text received so far to the Control,
+// and FactSets through the backend, so by the time the last chunk arrives
+// only its own statements are left to parse. Grounding starts as soon as the
+// last chunk has been added, on the loader thread, and then on_done is
+// called there with the outcome.
+//
+// push() never blocks. When the queue is full it returns false and the reader
+// should stop reading the connection, so that the sender is held back by TCP,
+// and push the chunk again once on_space is called. on_space is called on the
+// loader thread and may be called when nothing is waiting.
+//
+// The Control must not be used by anything else until on_done has been
+// called. A parse error in one chunk stops further chunks from being added;
+// the error is reported through on_done once the last chunk has arrived.
+// -------------------------------------------------------------------------------
+
+class StreamingLoader
+{
+public:
+    using ground_fn_t = std::function<void(Clingo::Control&)>;
+    using done_fn_t = std::function<void(const bsys::error_code&, const std::string& message)>;
+
+    struct Options
+    {
+        std::size_t queue_size = 64;
+        std::string part = "base";     // The part that text is added to
+        ground_fn_t ground;            // Defaults to grounding part
+        done_fn_t on_done;
+        std::function<void()> on_space;
+    };
+
+    StreamingLoader(Clingo::Control& ctl, Options opts);
+
+    StreamingLoader(StreamingLoader&&) = delete;
+    StreamingLoader(const StreamingLoader&) = delete;
+    ~StreamingLoader();
+
+    StreamingLoader& operator=(const StreamingLoader&) = delete;
+
+    // Called from one thread only. Returns false, leaving the chunk as it was,
+    // if the queue is full.
+    bool push(StreamChunk&& chunk);
+
+    // Stop without grounding. on_done is not called.
+    void cancel();
+
+    // Whether on_done has been called
+    bool done() const { return done_.load(std::memory_order_acquire); }
+
+    // Only to be read once done
+    const StreamingLoaderStats& stats() const { return stats_; }
+
+private:
+    bool _pop(StreamChunk& chunk);
+    void _run();
+    void _add_text(const StreamChunk& chunk);
+    void _finish_text();
+    void _add_piece(std::size_t end);
+
+    Clingo::Control& ctl_;
+    Options opts_;
+    clserver::SpscQueue<StreamChunk> queue_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool cancelled_;
+    std::atomic<bool> refused_;
+    std::atomic<bool> done_;
+
+    // Only used by the loader thread
+    clserver::StatementSplitter splitter_;
+    std::string buffer_;           // Text received and not yet added
+    std::size_t consumed_;         // Offset of buffer_ in the whole text
+    std::string directive_;        // The #program directive in force
+    std::string piece_;
+    FactLoader facts_;
+    StreamingLoaderStats stats_;
+
+    std::thread thread_;
+};
+
+//-------------------------------------------------------------------------------
+// StreamingLoader member functions
+//-------------------------------------------------------------------------------
+
+inline StreamingLoader::StreamingLoader(Clingo::Control& ctl, Options opts) :
+    ctl_{ctl}, opts_{std::move(opts)}, queue_{opts_.queue_size},
+    cancelled_{false}, refused_{false}, done_{false}, consumed_{0}
+{
+    if (!opts_.ground)
+    {
+        auto part = opts_.part;
+        opts_.ground = [part](Clingo::Control& ctl) { ctl.ground({{part.c_str(), {}}}); };
+    }
+    thread_ = std::thread{[this]() { _run(); }};
+}
+
+inline StreamingLoader::~StreamingLoader()
+{
+    cancel();
+    thread_.join();
+}
+
+inline bool StreamingLoader::push(StreamChunk&& chunk)
+{
+    if (!queue_.try_push(std::move(chunk)))
+    {
+        // Space may have been made since; if not, the next pop will see the flag
+        refused_.store(true, std::memory_order_release);
+        if (!queue_.try_push(std::move(chunk))) return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+    }
+    cv_.notify_one();
+    return true;
+}
+
+inline void StreamingLoader::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        cancelled_ = true;
+    }
+    cv_.notify_one();
+}
+
+inline bool StreamingLoader::_pop(StreamChunk& chunk)
+{
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cv_.wait(lock, [this]() { return cancelled_ || !queue_.empty(); });
+        if (cancelled_) return false;
+    }
+    queue_.try_pop(chunk);
+    if (refused_.exchange(false, std::memory_order_acq_rel) && opts_.on_space) opts_.on_space();
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// The loader thread. Exceptions from clingo are parse or grounding errors.
+// -----------------------------------------------------------------------------
+
+inline void StreamingLoader::_run()
+{
+    bsys::error_code ec;
+    std::string message;
+    StreamChunk chunk;
+    while (_pop(chunk))
+    {
+        ++stats_.chunks;
+        if (!ec)
+        {
+            try
+            {
+                if (chunk.facts)
+                {
+                    facts_.load(ctl_, reinterpret_cast<const uint8_t*>(chunk.data.data()),
+                                chunk.data.size(), ec);
+                    stats_.facts += facts_.facts();
+                    if (ec) message = "invalid fact set in chunk " + std::to_string(stats_.chunks);
+                }
+                else _add_text(chunk);
+
+                if (!ec && chunk.last)
+                {
+                    _finish_text();
+                    opts_.ground(ctl_);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                ec = bsys::errc::make_error_code(bsys::errc::invalid_argument);
+                message = e.what();
+            }
+        }
+        if (chunk.last)
+        {
+            if (opts_.on_done) opts_.on_done(ec, message);
+            done_.store(true, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+inline void StreamingLoader::_add_text(const StreamChunk& chunk)
+{
+    stats_.text_bytes += chunk.data.size();
+    buffer_ += chunk.data;
+    _add_piece(splitter_.feed(chunk.data.data(), chunk.data.size()));
+}
+
+// Whatever is left goes to clingo, which reports any unfinished statement
+inline void StreamingLoader::_finish_text()
+{
+    splitter_.finish();
+    _add_piece(consumed_ + buffer_.size());
+}
+
+//------------------------------------------------------------------------------
+// Add the text up to end, which is at the end of a statement. It starts with
+// the #program directive in force, if any, so it goes to the same part as it
+// would in the whole text.
+// -----------------------------------------------------------------------------
+
+inline void StreamingLoader::_add_piece(std::size_t end)
+{
+    if (end <= consumed_) return;
+    auto n = end - consumed_;
+    piece_.assign(directive_);
+    piece_.append(buffer_, 0, n);
+    ctl_.add(opts_.part.c_str(), {}, piece_.c_str());
+    ++stats_.pieces;
+
+    auto d = splitter_.program_directive();
+    if (d.second > consumed_ && d.second <= end)
+        directive_ = buffer_.substr(d.first - consumed_, d.second - d.first) + "\n";
+    buffer_.erase(0, n);
+    consumed_ = end;
+}
+
+}
+
+#endif // CLWORKER_STREAMING_LOADER_HH
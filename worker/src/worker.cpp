@@ -0,0 +1,670 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <clingo.hh>
+#include <flatbuffers/flatbuffers.h>
+#include "init_connection_generated.h"
+#include "init_reply_generated.h"
+#include "job_generated.h"
+#include "worker_write_generated.h"
+#include "clserver/blob_store.hpp"
+#include "clserver/connection.hpp"
+#include "clserver/fork_server.hpp"
+#include "clserver/frame_channel.hpp"
+#include "clserver/message_batcher.hpp"
+#include "clworker/fact_loader.hpp"
+#include "clworker/ground_cache.hpp"
+#include "clworker/ground_snapshot.hpp"
+#include "clworker/solve_thread.hpp"
+#include "clworker/streaming_loader.hpp"
+
+#include <unistd.h>
+
+namespace asio=boost::asio;
+namespace bsys=boost::system;
+namespace fbs=flatbuffers;
+namespace sp=std::placeholders;
+
+using boost::asio::ip::tcp;
+using namespace clserver;
+using namespace clworker;
+
+//------------------------------------------------------------------------------
+// The clingo worker. It connects to the server, registers under the instance
+// name it was started with and then runs the jobs it is sent, one at a time.
+//
+// The main thread only does I/O. Each job is ground and solved on a
+// SolveThread, which encodes its models into the pooled builders of a
+// FrameChannel; the I/O thread is woken to send them and returns each builder
+// once its frame has been written. So a slow connection pauses the search, as
+// no builder is free, rather than blocking clingo inside a model callback, and
+// a burst of models never queues more than the channel holds. A streamed job's
+// input is parsed by a StreamingLoader as it arrives, and reading from the
+// server stops while the loader's queue is full.
+//
+// A job that is neither forked nor streamed may name blobs in the server's
+// store, whose directory CLINGOSERVER_BLOB_STORE names. They are mapped on the
+// I/O thread when the job arrives, so a missing blob fails the job at once,
+// and loaded on the solve thread: FactSets before the program is ground and
+// program text after the job's own program.
+//
+// If CLINGOSERVER_GROUND_CACHE names a directory, the ground program of each
+// job that is not streamed is kept there in aspif, keyed by the worker's
+// clingo options and the job's program, and a job with the same inputs loads
+// it instead of grounding again.
+//
+// The worker offers the ModelBitsets feature in its Init and sends dense
+// models as bitsets if the server accepts it in the InitReply.
+//
+// A SnapshotLoad makes the worker a snapshot worker: it grounds the base
+// program on the I/O thread, in a GroundSnapshot, and then runs each job that
+// names that base in a forked child. The child connects back to the server as
+// the job's instance and runs the job as a worker of its own, adding and
+// grounding the job's program on top of the base on its solve thread, so that
+// a program that doesn't parse is reported like any other job's. Forking
+// is only safe while the worker has no other threads, so a snapshot worker
+// does not run jobs of its own, and a worker that is running a job does not
+// load a snapshot. The parent stays ready while its children run, and reports
+// a job as failed if its child exits without having reported it.
+//------------------------------------------------------------------------------
+
+static const char* validate_id = "clingoserver";
+
+class Worker
+{
+public:
+    Worker(asio::io_context& ioc, tcp::socket socket, std::string host, std::string port,
+           std::string instance, std::vector<std::string> args);
+
+    Worker(Worker&&) = delete;
+    Worker(const Worker&) = delete;
+
+    Worker& operator=(const Worker&) = delete;
+
+    void start();
+
+    // Run only the given job, on the snapshot's Control, grounding its facts
+    // first, and stop once it has been reported. Called before start() in a
+    // forked child.
+    void run_forked(Clingo::Control& ctl, uint64_t job_id, ClingoServer::ModelEncoding encoding,
+                    std::string facts);
+
+    // Whether the forked job has been reported to the server
+    bool reported() const { return reported_; }
+
+private:
+    void _on_validated(const bsys::error_code& ec);
+    void _on_init_reply(const bsys::error_code& ec, std::size_t s);
+    void _receive();
+    void _on_received(const bsys::error_code& ec, std::size_t s);
+
+    void _submit(const ClingoServer::JobSubmit& job);
+    bool _chunk(const ClingoServer::JobChunk& chunk);
+    void _load(const ClingoServer::SnapshotLoad& load);
+    bool _map_blobs(const ClingoServer::JobSubmit& job);
+    void _load_blobs(Clingo::Control& ctl, const std::string& program);
+    void _fork(const ClingoServer::JobSubmit& job);
+    int _run_child(Clingo::Control& ctl, const std::string& instance, uint64_t job_id,
+                   ClingoServer::ModelEncoding encoding, const std::string& facts);
+    void _wait_children();
+    void _on_loaded(const bsys::error_code& ec, const std::string& message);
+    void _on_space();
+    void _start_solve(Clingo::Control& ctl, SolveThread::prepare_fn_t prepare);
+    void _drain();
+    void _on_finished();
+    void _finish_forked();
+
+    void _send_ready();
+    void _send_error(uint64_t job_id, const std::string& error);
+    void _stop(const bsys::error_code& ec);
+
+    asio::io_context& ioc_;
+    int fd_;                           // The connection's socket
+    Connection<tcp::socket> conn_;
+    std::string host_;
+    std::string port_;
+    std::string instance_;
+    std::vector<std::string> args_;
+    uint32_t handle_;
+    bool bitsets_;
+    bool stopped_;
+
+    fbs::FlatBufferBuilder init_;
+    asio::streambuf rsb_;
+    std::unique_ptr<MessageBatcher<tcp::socket>> batcher_;
+    FrameChannel channel_;
+
+    // The job being run
+    bool busy_;
+    uint64_t job_id_;
+    ClingoServer::ModelEncoding encoding_;
+    std::unique_ptr<AspifRecorder> recorder_;   // Outlives ctl_, which it observes
+    std::unique_ptr<Clingo::Control> ctl_;
+    std::unique_ptr<StreamingLoader> loader_;
+    std::unique_ptr<SolveThread> solve_;
+    std::vector<BlobView> blobs_;
+
+    // The server's blob store and the cache of ground programs, if enabled
+    std::unique_ptr<BlobStore> blob_store_;
+    std::unique_ptr<GroundCache> ground_cache_;
+
+    // A chunk that the loader had no room for
+    StreamChunk pending_;
+    bool has_pending_;
+
+    // Frames handed to the connection and not yet sent
+    std::size_t sending_;
+
+    // A snapshot worker's base and the jobs of its running children
+    std::unique_ptr<GroundSnapshot> snapshot_;
+    std::map<pid_t, uint64_t> children_;
+    asio::signal_set sigchld_;
+
+    // A forked child's job
+    Clingo::Control* forked_;
+    std::string forked_facts_;
+    bool reported_;
+};
+
+//------------------------------------------------------------------------------
+// Worker member functions
+//------------------------------------------------------------------------------
+
+Worker::Worker(asio::io_context& ioc, tcp::socket socket, std::string host, std::string port,
+               std::string instance, std::vector<std::string> args) :
+    ioc_{ioc}, fd_{socket.native_handle()}, conn_{std::move(socket), validate_id},
+    host_{std::move(host)}, port_{std::move(port)},
+    instance_{std::move(instance)}, args_{std::move(args)},
+    handle_{0}, bitsets_{false}, stopped_{false}, busy_{false}, job_id_{0},
+    encoding_{ClingoServer::ModelEncoding_Ids}, has_pending_{false}, sending_{0},
+    sigchld_{ioc}, forked_{nullptr}, reported_{false}
+{
+    if (auto dir = std::getenv(BlobStore::dir_env)) blob_store_.reset(new BlobStore{dir});
+    if (auto dir = std::getenv(GroundCache::dir_env)) ground_cache_.reset(new GroundCache{dir});
+}
+
+void Worker::run_forked(Clingo::Control& ctl, uint64_t job_id,
+                        ClingoServer::ModelEncoding encoding, std::string facts)
+{
+    forked_ = &ctl;
+    forked_facts_ = std::move(facts);
+    busy_ = true;
+    job_id_ = job_id;
+    encoding_ = encoding;
+}
+
+void Worker::start()
+{
+    conn_.validate(std::bind(&Worker::_on_validated, this, sp::_1));
+}
+
+void Worker::_on_validated(const bsys::error_code& ec)
+{
+    if (ec) { _stop(ec); return; }
+
+    ClingoServer::Version version{0, 1, 0};
+    init_.Finish(ClingoServer::CreateInit(init_, &version, init_.CreateString(instance_),
+                                          ClingoServer::ConnectionFeature_ModelBitsets));
+    conn_.async_send_message(asio::buffer(init_.GetBufferPointer(), init_.GetSize()),
+                             [this](const bsys::error_code& ec, std::size_t)
+                             {
+                                 if (ec) _stop(ec);
+                             });
+    conn_.async_receive_message(rsb_, std::bind(&Worker::_on_init_reply, this, sp::_1, sp::_2));
+}
+
+void Worker::_on_init_reply(const bsys::error_code& ec, std::size_t s)
+{
+    if (ec) { _stop(ec); return; }
+    rsb_.commit(s);
+    auto data = static_cast<const uint8_t*>(rsb_.data().data());
+    fbs::Verifier verifier{data, s};
+    if (!ClingoServer::VerifyInitReplyBuffer(verifier) ||
+        !ClingoServer::GetInitReply(data)->handle())
+    {
+        _stop(bsys::errc::make_error_code(bsys::errc::bad_message));
+        return;
+    }
+    auto reply = ClingoServer::GetInitReply(data);
+    handle_ = reply->handle()->id();
+    bitsets_ = (reply->features() & ClingoServer::ConnectionFeature_ModelBitsets) != 0;
+    rsb_.consume(s);
+
+    batcher_.reset(new MessageBatcher<tcp::socket>{conn_, handle_});
+    if (forked_)
+    {
+        _start_solve(*forked_, [this](Clingo::Control& ctl)
+        {
+            GroundSnapshot::ground_job(ctl, forked_facts_);
+        });
+    }
+    else _send_ready();
+    _receive();
+}
+
+void Worker::_receive()
+{
+    conn_.async_receive_message(rsb_, std::bind(&Worker::_on_received, this, sp::_1, sp::_2));
+}
+
+//------------------------------------------------------------------------------
+// Dispatch a JobMessage. Reading stops, until the loader makes room, if a
+// chunk could not be queued.
+//------------------------------------------------------------------------------
+
+void Worker::_on_received(const bsys::error_code& ec, std::size_t s)
+{
+    if (ec) { _stop(ec); return; }
+    rsb_.commit(s);
+    auto data = static_cast<const uint8_t*>(rsb_.data().data());
+    fbs::Verifier verifier{data, s};
+    bool more = true;
+    if (ClingoServer::VerifyJobMessageBuffer(verifier))
+    {
+        auto message = ClingoServer::GetJobMessage(data);
+        switch (message->job_type())
+        {
+        case ClingoServer::Job_Submit: _submit(*message->job_as_Submit()); break;
+        case ClingoServer::Job_Chunk: more = _chunk(*message->job_as_Chunk()); break;
+        case ClingoServer::Job_Load: _load(*message->job_as_Load()); break;
+        default: break;
+        }
+    }
+    else std::cerr << "Ignoring a message that failed verification" << std::endl;
+    rsb_.consume(s);
+    if (more) _receive();
+}
+
+void Worker::_submit(const ClingoServer::JobSubmit& job)
+{
+    if (busy_)
+    {
+        _send_error(job.job_id(), "the worker is already running a job");
+        return;
+    }
+    if (job.base() && job.base()->size())
+    {
+        _fork(job);
+        return;
+    }
+    if (snapshot_)
+    {
+        _send_error(job.job_id(), "a snapshot worker only runs jobs forked from its base");
+        return;
+    }
+
+    if (job.blobs() && job.blobs()->size() && !_map_blobs(job)) return;
+
+    std::vector<const char*> argv;
+    for (auto& a : args_) argv.push_back(a.c_str());
+    busy_ = true;
+    job_id_ = job.job_id();
+    encoding_ = job.encoding();
+    ctl_.reset(new Clingo::Control{Clingo::StringSpan{argv.data(), argv.size()}});
+    std::string program = job.program() ? job.program()->str() : std::string{};
+
+    if (!job.streamed())
+    {
+        auto ground = [this, program](Clingo::Control& ctl)
+        {
+            _load_blobs(ctl, program);
+            ctl.ground({{"base", {}}});
+        };
+        if (!ground_cache_)
+        {
+            _start_solve(*ctl_, ground);
+            return;
+        }
+
+        // The key is hashed on the solve thread, as the program may be large.
+        // A blob is named by the hash of its content, so its id stands for it.
+        GroundInputs inputs{args_, {}, {program}, {"base"}};
+        if (job.blobs())
+            for (auto id : *job.blobs()) inputs.programs.push_back(id->str());
+        recorder_.reset(new AspifRecorder);
+        ctl_->register_observer(*recorder_);
+        _start_solve(*ctl_, [this, inputs, ground](Clingo::Control& ctl)
+        {
+            ground_cache_->load_or_ground(ctl, *recorder_, inputs.key(), ground);
+        });
+        return;
+    }
+
+    StreamingLoader::Options opts;
+    opts.on_done = [this](const bsys::error_code& ec, const std::string& message)
+    {
+        asio::post(ioc_, [this, ec, message]() { _on_loaded(ec, message); });
+    };
+    opts.on_space = [this]() { asio::post(ioc_, [this]() { _on_space(); }); };
+    loader_.reset(new StreamingLoader{*ctl_, std::move(opts)});
+    if (!program.empty()) loader_->push(StreamChunk{std::move(program), false, false});
+}
+
+bool Worker::_chunk(const ClingoServer::JobChunk& chunk)
+{
+    if (!loader_ || chunk.job_id() != job_id_) return true;
+
+    auto data = chunk.data();
+    pending_.data.assign(data ? reinterpret_cast<const char*>(data->data()) : "",
+                         data ? data->size() : 0);
+    pending_.facts = chunk.kind() == ClingoServer::ChunkKind_Facts;
+    pending_.last = chunk.last();
+    has_pending_ = !loader_->push(std::move(pending_));
+    return !has_pending_;
+}
+
+//------------------------------------------------------------------------------
+// Map the blobs a job names. A job that can't have them is failed here.
+//------------------------------------------------------------------------------
+
+bool Worker::_map_blobs(const ClingoServer::JobSubmit& job)
+{
+    std::string error;
+    if (job.streamed()) error = "a streamed job can't use blobs";
+    else if (!blob_store_) error = std::string{BlobStore::dir_env} + " is not set";
+    else
+    {
+        for (auto id : *job.blobs())
+        {
+            bsys::error_code ec;
+            blobs_.push_back(blob_store_->map(id->str(), ec));
+            if (!ec) continue;
+            error = "blob " + id->str() + ": " + ec.message();
+            break;
+        }
+    }
+    if (error.empty()) return true;
+    blobs_.clear();
+    _send_error(job.job_id(), error);
+    return false;
+}
+
+// On the solve thread. FactSets are added through the backend, which must
+// happen before grounding; a text blob is copied, as clingo wants a string
+// that ends in a NUL byte and the mapping has none.
+void Worker::_load_blobs(Clingo::Control& ctl, const std::string& program)
+{
+    FactLoader facts;
+    for (auto& blob : blobs_)
+    {
+        if (!FactLoader::is_fact_set(blob.data(), blob.size())) continue;
+        bsys::error_code ec;
+        facts.load(ctl, blob.data(), blob.size(), ec);
+        if (ec) throw std::runtime_error{"a FactSet blob can't be loaded: " + ec.message()};
+    }
+    ctl.add("base", {}, program.c_str());
+    for (auto& blob : blobs_)
+    {
+        if (FactLoader::is_fact_set(blob.data(), blob.size())) continue;
+        std::string text{reinterpret_cast<const char*>(blob.data()), blob.size()};
+        ctl.add("base", {}, text.c_str());
+    }
+}
+
+//------------------------------------------------------------------------------
+// Ground a base program for jobs to fork from. It is ground on the I/O thread,
+// so that the worker never has a second thread that a fork could cut short.
+//------------------------------------------------------------------------------
+
+void Worker::_load(const ClingoServer::SnapshotLoad& load)
+{
+    std::string base = load.base() ? load.base()->str() : std::string{};
+    std::string error;
+    if (busy_) error = "the worker is running a job";
+    else if (snapshot_ && snapshot_->base() != base)
+        error = "the worker already holds the snapshot of " + snapshot_->base();
+    else if (!snapshot_)
+    {
+        bsys::error_code ec;
+        std::unique_ptr<GroundSnapshot> snapshot{new GroundSnapshot{args_}};
+        snapshot->load(base, load.program() ? load.program()->str() : std::string{}, ec);
+        if (ec) error = snapshot->error_message();
+        else
+        {
+            snapshot_ = std::move(snapshot);
+            sigchld_.add(SIGCHLD);
+            _wait_children();
+        }
+    }
+
+    auto& b = batcher_->builder();
+    auto msg = ClingoServer::CreateSnapshotReadyMsg(
+        b, b.CreateString(base), error.empty() ? GroundSnapshot::memory_bytes() : 0,
+        error.empty() ? 0 : b.CreateString(error));
+    batcher_->add(ClingoServer::Msg_Snapshot, msg.Union());
+}
+
+//------------------------------------------------------------------------------
+// Run a job in a child forked from the snapshot. The job's program is its
+// facts, ground on top of the base as the "job" part once the child has
+// connected to the server.
+//------------------------------------------------------------------------------
+
+void Worker::_fork(const ClingoServer::JobSubmit& job)
+{
+    std::string error;
+    if (!snapshot_ || snapshot_->base() != job.base()->str())
+        error = "the worker holds no snapshot of " + job.base()->str();
+    else if (job.streamed()) error = "a job forked from a snapshot can't be streamed";
+    else if (job.blobs() && job.blobs()->size())
+        error = "a job forked from a snapshot can't use blobs";
+    else if (!job.instance() || !job.instance()->size())
+        error = "a job forked from a snapshot needs an instance";
+    if (!error.empty())
+    {
+        _send_error(job.job_id(), error);
+        return;
+    }
+
+    std::string instance = job.instance()->str();
+    uint64_t job_id = job.job_id();
+    auto encoding = job.encoding();
+    bsys::error_code ec;
+    std::string facts = job.program() ? job.program()->str() : std::string{};
+    auto pid = snapshot_->fork_job([this, instance, job_id, encoding, facts](Clingo::Control& ctl)
+                                   { return _run_child(ctl, instance, job_id, encoding, facts); },
+                                   ec);
+    if (ec) _send_error(job_id, "fork failed: " + ec.message());
+    else children_[pid] = job_id;
+}
+
+// In the child: leave the parent's connection and reactor alone and connect
+// to the server as a worker of its own
+int Worker::_run_child(Clingo::Control& ctl, const std::string& instance, uint64_t job_id,
+                       ClingoServer::ModelEncoding encoding, const std::string& facts)
+{
+    std::signal(SIGCHLD, SIG_DFL);
+    ::close(fd_);
+    try
+    {
+        asio::io_context ioc;
+        tcp::socket socket{ioc};
+        tcp::resolver resolver{ioc};
+        asio::connect(socket, resolver.resolve(host_, port_));
+
+        Worker worker{ioc, std::move(socket), host_, port_, instance, args_};
+        worker.run_forked(ctl, job_id, encoding, facts);
+        worker.start();
+        ioc.run();
+        return worker.reported() ? 0 : 1;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Job " << job_id << ": " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+void Worker::_wait_children()
+{
+    sigchld_.async_wait([this](const bsys::error_code& ec, int)
+    {
+        if (ec) return;
+        for (auto& exited : snapshot_->reap())
+        {
+            auto it = children_.find(exited.first);
+            if (it == children_.end()) continue;
+            if (exited.second != 0)
+                _send_error(it->second, "the job's worker exited without reporting it");
+            children_.erase(it);
+        }
+        _wait_children();
+    });
+}
+
+void Worker::_on_loaded(const bsys::error_code& ec, const std::string& message)
+{
+    loader_.reset();
+    if (!ec)
+    {
+        _start_solve(*ctl_, nullptr);
+        return;
+    }
+    _send_error(job_id_, message);
+    ctl_.reset();
+    busy_ = false;
+    _send_ready();
+}
+
+void Worker::_on_space()
+{
+    if (!has_pending_ || !loader_) return;
+    if (!loader_->push(std::move(pending_))) return;
+    has_pending_ = false;
+    _receive();
+}
+
+//------------------------------------------------------------------------------
+// The solve thread wakes the I/O thread through the executor, and only when a
+// run of frames starts, so a steady stream of models costs one post per drain
+// rather than one per model.
+//------------------------------------------------------------------------------
+
+void Worker::_start_solve(Clingo::Control& ctl, SolveThread::prepare_fn_t prepare)
+{
+    SolveThread::Options opts;
+    opts.job_id = job_id_;
+    opts.handle = handle_;
+    opts.encoding = encoding_;
+    opts.bitsets = bitsets_;
+    opts.prepare = std::move(prepare);
+    opts.wake = [this]() { asio::post(ioc_, [this]() { _drain(); }); };
+    opts.on_finished = [this]() { asio::post(ioc_, [this]() { _on_finished(); }); };
+    solve_.reset(new SolveThread{ctl, channel_, std::move(opts)});
+}
+
+void Worker::_drain()
+{
+    channel_.drain([this](fbs::FlatBufferBuilder* b)
+    {
+        ++sending_;
+        conn_.async_send_message(asio::buffer(b->GetBufferPointer(), b->GetSize()),
+                                 [this, b](const bsys::error_code& ec, std::size_t)
+                                 {
+                                     channel_.release(b);
+                                     --sending_;
+                                     if (ec) _stop(ec);
+                                     if (forked_) _finish_forked();
+                                 });
+    });
+}
+
+void Worker::_on_finished()
+{
+    solve_.reset();
+    ctl_.reset();
+    recorder_.reset();
+    blobs_.clear();
+    busy_ = false;
+    if (forked_) _finish_forked();
+    else if (!stopped_) _send_ready();
+}
+
+// A forked child is done once the last frame of its job has been sent
+void Worker::_finish_forked()
+{
+    if (busy_ || (sending_ && !stopped_)) return;
+    reported_ = !stopped_;
+    ioc_.stop();
+}
+
+void Worker::_send_ready()
+{
+    auto& b = batcher_->builder();
+    batcher_->add(ClingoServer::Msg_Ready, ClingoServer::CreateWorkerReadyMsg(b).Union());
+}
+
+// A job that ends before it is solved
+void Worker::_send_error(uint64_t job_id, const std::string& error)
+{
+    auto& b = batcher_->builder();
+    auto msg = b.CreateString(error);
+    auto done = ClingoServer::CreateSolveDoneMsg(b, job_id, ClingoServer::SolveResult_Error,
+                                                 0, false, false, msg);
+    batcher_->add(ClingoServer::Msg_Done, done.Union());
+}
+
+//------------------------------------------------------------------------------
+// The connection has gone. Closing the channel stops the solve thread the next
+// time it needs a builder, as well as interrupting the search.
+//------------------------------------------------------------------------------
+
+void Worker::_stop(const bsys::error_code& ec)
+{
+    if (stopped_) return;
+    stopped_ = true;
+    if (ec != asio::error::eof) std::cerr << "Connection error: " << ec.message() << std::endl;
+    channel_.close();
+    if (solve_) solve_->interrupt();
+    if (loader_) loader_->cancel();
+    bsys::error_code ignored;
+    sigchld_.cancel(ignored);
+}
+
+//------------------------------------------------------------------------------
+// Usage: clingo_worker <host> <port> [clingo options]
+//
+// The instance name is taken from the environment variable set by the
+// ForkServer. The clingo options are given to every job's Control.
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <host> <port> [clingo options]" << std::endl;
+        return 1;
+    }
+    auto instance = std::getenv(ForkServer::instance_env);
+    if (!instance)
+    {
+        std::cerr << ForkServer::instance_env << " is not set" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        asio::io_context ioc;
+        tcp::socket socket{ioc};
+        tcp::resolver resolver{ioc};
+        asio::connect(socket, resolver.resolve(argv[1], argv[2]));
+
+        Worker worker{ioc, std::move(socket), argv[1], argv[2], instance,
+                      std::vector<std::string>(argv + 3, argv + argc)};
+        worker.start();
+        ioc.run();
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
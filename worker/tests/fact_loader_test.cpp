@@ -0,0 +1,176 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/fact_set.hpp"
+#include "clworker/fact_loader.hpp"
+
+using namespace clserver;
+using namespace clworker;
+using namespace ClingoServer;
+
+namespace
+{
+
+// Rules over every kind of argument the facts use
+const char* program =
+    "reach(X,Y) :- edge(X,Y).\n"
+    "reach(X,Z) :- reach(X,Y), edge(Y,Z).\n"
+    "named(N,S) :- label(N,S).\n"
+    "blocked(X) :- -at(pos(X,_),_).\n"
+    "inner(Y) :- -at(_,(_,f(Y))).\n"
+    "start :- go.\n";
+
+// Every symbolic atom, sorted
+std::vector<std::string> atoms(Clingo::Control& ctl)
+{
+    std::vector<std::string> out;
+    for (auto atom : ctl.symbolic_atoms()) out.push_back(atom.symbol().to_string());
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+void make_facts(FactSetBuilder& b)
+{
+    auto edge = b.block("edge", {ArgType_Number, ArgType_Number});
+    b.add(edge, {1, 2});
+    b.add(edge, {2, -3});
+    b.add(edge, {-3, 4});
+    b.add("node", {b.constant("a")});
+    b.add("label", {b.constant("a"), b.string("say \"hi\"\n")});
+    b.add("label", {b.constant("b"), b.string("")});
+    b.add("at", {b.function("pos", {FactSetBuilder::number(1), FactSetBuilder::number(2)}),
+                 b.tuple({b.constant("x")})}, true);
+    b.add("at", {b.function("pos", {FactSetBuilder::number(3), FactSetBuilder::number(2)}),
+                 b.tuple({b.constant("x"), b.function("f", {b.constant("y")})})}, true);
+    b.add("go", {});
+}
+
+// A FactSet made directly, for the encodings that FactSetBuilder never makes
+void finish_raw(fbs::FlatBufferBuilder& fbb, const std::vector<std::string>& dictionary,
+                const std::vector<std::vector<int32_t>>& function_values,
+                const std::vector<uint8_t>& block_types, const std::vector<int32_t>& block_values,
+                uint32_t count)
+{
+    std::vector<fbs::Offset<FunctionTerm>> functions;
+    for (const auto& v : function_values)
+    {
+        std::vector<uint8_t> types(v.size(), ArgType_Function);
+        functions.push_back(CreateFunctionTerm(fbb, 0, fbb.CreateVector(types),
+                                               fbb.CreateVector(v)));
+    }
+    std::vector<fbs::Offset<FactBlock>> blocks{
+        CreateFactBlock(fbb, 0, false, fbb.CreateVector(block_types),
+                        fbb.CreateVector(block_values), count)};
+    FinishFactSetBuffer(fbb, CreateFactSet(fbb, fbb.CreateVectorOfStrings(dictionary),
+                                           fbb.CreateVector(functions),
+                                           fbb.CreateVector(blocks)));
+}
+
+// The error of loading a buffer, and whether anything was added
+bsys::error_code load_error(const uint8_t* data, std::size_t size, bool& added)
+{
+    Clingo::Control ctl;
+    FactLoader loader;
+    bsys::error_code ec;
+    loader.load(ctl, data, size, ec);
+    ctl.ground({{"base", {}}});
+    added = !atoms(ctl).empty();
+    return ec;
+}
+
+bsys::error_code load_error(const fbs::FlatBufferBuilder& fbb, bool& added)
+{
+    return load_error(fbb.GetBufferPointer(), fbb.GetSize(), added);
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("fact_loader_matches_text", "[fact_loader]")
+{
+    FactSetBuilder b;
+    make_facts(b);
+    fbs::FlatBufferBuilder fbb;
+    b.finish(fbb);
+    REQUIRE(FactLoader::is_fact_set(fbb.GetBufferPointer(), fbb.GetSize()));
+
+    // The facts loaded through the backend take part in grounding the program
+    Clingo::Control binary;
+    FactLoader loader;
+    bsys::error_code ec;
+    loader.load(binary, fbb.GetBufferPointer(), fbb.GetSize(), ec);
+    REQUIRE(!ec);
+    CHECK(loader.facts() == b.facts());
+    binary.add("base", {}, program);
+    binary.ground({{"base", {}}});
+
+    std::string text;
+    REQUIRE(facts_to_text(*GetFactSet(fbb.GetBufferPointer()), text));
+    Clingo::Control parsed;
+    parsed.add("base", {}, (text + program).c_str());
+    parsed.ground({{"base", {}}});
+
+    auto want = atoms(parsed);
+    CHECK(atoms(binary) == want);
+    CHECK(std::count(want.begin(), want.end(), "reach(1,4)") == 1);
+    CHECK(std::count(want.begin(), want.end(), "blocked(3)") == 1);
+    CHECK(std::count(want.begin(), want.end(), "inner(y)") == 1);
+    CHECK(std::count(want.begin(), want.end(), "start") == 1);
+
+    // The loader keeps its buffers and can load again
+    Clingo::Control again;
+    loader.load(again, fbb.GetBufferPointer(), fbb.GetSize(), ec);
+    REQUIRE(!ec);
+    again.add("base", {}, program);
+    again.ground({{"base", {}}});
+    CHECK(atoms(again) == want);
+}
+
+TEST_CASE("fact_loader_rejects_bad_sets", "[fact_loader]")
+{
+    bool added = true;
+
+    // Program text is not a FactSet
+    std::string text = "p(1). q(2).";
+    CHECK(load_error(reinterpret_cast<const uint8_t*>(text.data()), text.size(), added) ==
+          bsys::errc::bad_message);
+    CHECK(!added);
+
+    // A constant past the end of the dictionary
+    fbs::FlatBufferBuilder dangling_name;
+    finish_raw(dangling_name, {"p"}, {}, {ArgType_Number, ArgType_Constant}, {1, 0, 2, 5}, 2);
+    CHECK(load_error(dangling_name, added) == bsys::errc::bad_message);
+    CHECK(!added);
+
+    // A function that isn't there, and one that refers to itself
+    fbs::FlatBufferBuilder dangling_function;
+    finish_raw(dangling_function, {"p"}, {}, {ArgType_Function}, {0}, 1);
+    CHECK(load_error(dangling_function, added) == bsys::errc::bad_message);
+    CHECK(!added);
+    fbs::FlatBufferBuilder self_reference;
+    finish_raw(self_reference, {"p"}, {{0}}, {ArgType_Number}, {1}, 1);
+    CHECK(load_error(self_reference, added) == bsys::errc::bad_message);
+    CHECK(!added);
+
+    // More or fewer values than the arity times the count
+    fbs::FlatBufferBuilder short_block;
+    finish_raw(short_block, {"p"}, {}, {ArgType_Number, ArgType_Number}, {1, 2, 3}, 2);
+    CHECK(load_error(short_block, added) == bsys::errc::bad_message);
+    CHECK(!added);
+    fbs::FlatBufferBuilder long_block;
+    finish_raw(long_block, {"p"}, {}, {ArgType_Number}, {1, 2, 3}, 2);
+    CHECK(load_error(long_block, added) == bsys::errc::bad_message);
+    CHECK(!added);
+
+    // The same encoding with the right count is accepted
+    fbs::FlatBufferBuilder good;
+    finish_raw(good, {"p"}, {}, {ArgType_Number}, {1, 2, 3}, 3);
+    CHECK(!load_error(good, added));
+    CHECK(added);
+}
@@ -0,0 +1,102 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "clworker/ground_cache.hpp"
+#include "test_helpers.hpp"
+
+using namespace clworker;
+using clserver_test::TempDir;
+
+namespace
+{
+
+// The shown symbols of each model, sorted
+std::vector<std::vector<std::string>> models(Clingo::Control& ctl)
+{
+    std::vector<std::vector<std::string>> out;
+    for (auto& m : ctl.solve())
+    {
+        out.emplace_back();
+        for (auto& sym : m.symbols()) out.back().push_back(sym.to_string());
+        std::sort(out.back().begin(), out.back().end());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+const char* program = "a. b :- a. { c(1..2) }. d(X) :- c(X), b. :- c(1), c(2).";
+
+void ground(Clingo::Control& ctl)
+{
+    ctl.add("base", {}, program);
+    ctl.ground({{"base", {}}});
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("ground_cache_round_trip", "[ground_cache]")
+{
+    TempDir dir{"ground_cache"};
+    GroundCache cache{dir.path()};
+    auto key = GroundInputs{{}, {}, {program}, {"base"}}.key();
+    CHECK(key != GroundInputs{{}, {}, {program}, {"step(1)"}}.key());
+
+    // A miss grounds the program and stores what the recorder saw
+    std::vector<std::vector<std::string>> want;
+    {
+        AspifRecorder recorder;
+        Clingo::Control ctl;
+        ctl.register_observer(recorder);
+        CHECK(!cache.load_or_ground(ctl, recorder, key, ground));
+        CHECK(recorder.cacheable());
+        want = models(ctl);
+    }
+    CHECK(want.size() == 3);
+    CHECK(cache.contains(key));
+    CHECK(cache.stats().misses == 1);
+    CHECK(cache.stats().stored == 1);
+
+    // A hit has the same models without grounding the program
+    {
+        AspifRecorder recorder;
+        Clingo::Control ctl;
+        ctl.register_observer(recorder);
+        bool grounded = false;
+        CHECK(cache.load_or_ground(ctl, recorder, key,
+                                   [&grounded](Clingo::Control&) { grounded = true; }));
+        CHECK(!grounded);
+        CHECK(models(ctl) == want);
+    }
+    CHECK(cache.stats().hits == 1);
+    CHECK(cache.stats().errors == 0);
+}
+
+TEST_CASE("ground_cache_errors", "[ground_cache]")
+{
+    TempDir dir{"ground_cache"};
+
+    // A file that store() didn't write is a miss
+    GroundCache cache{dir.path()};
+    auto f = std::fopen((dir.path() + "/bad.aspif").c_str(), "wb");
+    REQUIRE(f);
+    std::fputs("asp 1 0 0\n", f);
+    std::fclose(f);
+    Clingo::Control ctl;
+    CHECK(!cache.load(ctl, "bad"));
+    CHECK(cache.stats().errors == 1);
+
+    // The error of a store that can't be written
+    GroundCache missing{dir.path() + "/missing"};
+    bsys::error_code ec;
+    missing.store("key", "asp 1 0 0\n0\n", ec);
+    CHECK(ec == bsys::errc::no_such_file_or_directory);
+    CHECK(missing.stats().errors == 1);
+    CHECK(!missing.contains("key"));
+}
@@ -0,0 +1,119 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clworker/ground_snapshot.hpp"
+
+using namespace clworker;
+
+namespace
+{
+
+// The shown symbols of each model, sorted
+std::vector<std::vector<std::string>> models(Clingo::Control& ctl)
+{
+    std::vector<std::vector<std::string>> out;
+    for (auto& m : ctl.solve())
+    {
+        out.emplace_back();
+        for (auto& sym : m.symbols()) out.back().push_back(sym.to_string());
+        std::sort(out.back().begin(), out.back().end());
+    }
+    return out;
+}
+
+// Wait for every child and return their exit statuses by pid
+std::map<pid_t, int> wait_all(GroundSnapshot& snapshot)
+{
+    std::map<pid_t, int> exited;
+    for (int i = 0; i < 1000 && snapshot.running(); ++i)
+    {
+        for (auto& e : snapshot.reap()) exited[e.first] = e.second;
+        if (snapshot.running()) std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    return exited;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases. Each job checks its own models and exits with 0 if they are as
+// expected, as Catch can't report from the child.
+//------------------------------------------------------------------------------
+
+TEST_CASE("ground_snapshot_fork_jobs", "[ground_snapshot]")
+{
+    GroundSnapshot snapshot;
+    bsys::error_code ec;
+    snapshot.fork_job([](Clingo::Control&) { return 0; }, ec);
+    CHECK(ec == bsys::errc::operation_not_permitted);
+    ec.clear();
+
+    snapshot.load("graph", "#external e(X) : X = 1..3. p(X) :- e(X).", ec);
+    REQUIRE(!ec);
+    CHECK(snapshot.loaded());
+    CHECK(snapshot.base() == "graph");
+    CHECK(GroundSnapshot::memory_bytes() > 0);
+
+    // The children share the ground base but each sees only its own facts
+    std::map<pid_t, int> expected;
+    for (int k = 1; k <= 3; ++k)
+    {
+        auto facts = "e(" + std::to_string(k) + ").";
+        std::vector<std::string> want{"e(" + std::to_string(k) + ")",
+                                      "p(" + std::to_string(k) + ")"};
+        auto pid = snapshot.fork_job([facts, want](Clingo::Control& ctl)
+        {
+            GroundSnapshot::ground_job(ctl, facts);
+            auto found = models(ctl);
+            return found.size() == 1 && found.front() == want ? 0 : 2;
+        }, ec);
+        REQUIRE(!ec);
+        expected[pid] = 0;
+    }
+
+    // A job that doesn't parse fails in its child only, where the job
+    // function sees the error
+    auto bad = snapshot.fork_job([](Clingo::Control& ctl)
+    {
+        try { GroundSnapshot::ground_job(ctl, "e("); }
+        catch (const std::exception&) { return 3; }
+        return 0;
+    }, ec);
+    REQUIRE(!ec);
+    expected[bad] = 3;
+    auto thrown = snapshot.fork_job([](Clingo::Control& ctl)
+    {
+        GroundSnapshot::ground_job(ctl, "e(");
+        return 0;
+    }, ec);
+    REQUIRE(!ec);
+    expected[thrown] = 1;
+
+    CHECK(wait_all(snapshot) == expected);
+    CHECK(snapshot.running() == 0);
+
+    // The children's jobs leave the snapshot as it was, so it can fork again
+    auto again = snapshot.fork_job([](Clingo::Control& ctl)
+    {
+        GroundSnapshot::ground_job(ctl, "e(3).");
+        auto found = models(ctl);
+        return found.size() == 1 && found.front() == std::vector<std::string>{"e(3)", "p(3)"} ? 0 : 2;
+    }, ec);
+    REQUIRE(!ec);
+    CHECK(wait_all(snapshot) == (std::map<pid_t, int>{{again, 0}}));
+}
+
+TEST_CASE("ground_snapshot_load_error", "[ground_snapshot]")
+{
+    GroundSnapshot snapshot;
+    bsys::error_code ec;
+    snapshot.load("broken", "p(.", ec);
+    CHECK(ec == bsys::errc::invalid_argument);
+    CHECK_FALSE(snapshot.loaded());
+    CHECK_FALSE(snapshot.error_message().empty());
+}
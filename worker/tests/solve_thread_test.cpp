@@ -0,0 +1,387 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "clserver/frame_channel.hpp"
+#include "clserver/messages.hpp"
+#include "clworker/solve_thread.hpp"
+
+using namespace clserver;
+using namespace clworker;
+namespace cs=ClingoServer;
+
+namespace
+{
+
+// Set once, waited for with a timeout
+class Flag
+{
+public:
+    void set()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        set_ = true;
+        cv_.notify_all();
+    }
+
+    bool wait()
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        return cv_.wait_for(lock, std::chrono::seconds{10}, [this]() { return set_; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool set_ = false;
+};
+
+//------------------------------------------------------------------------------
+// What a job's frames said. Each frame is described by its messages, eg
+// {"dict 0", "model 1"}; models are decoded to their sorted symbols.
+//------------------------------------------------------------------------------
+
+struct Received
+{
+    std::vector<std::vector<std::string>> frames;
+    std::vector<uint32_t> handles;
+    std::vector<std::string> dictionary;
+    std::vector<std::vector<std::string>> models;
+    bool unknown_id = false;
+
+    bool done = false;
+    cs::SolveResult result = cs::SolveResult_Unknown;
+    uint64_t done_models = 0;
+    bool exhausted = false;
+    bool interrupted = false;
+    std::string error;
+    uint64_t paused = 0;
+
+    void add(const cs::Message& message)
+    {
+        frames.emplace_back();
+        handles.push_back(message.handle() ? message.handle()->id() : 0);
+        for_each_msg(message, [this](cs::Msg type, const void* msg)
+        {
+            switch (type)
+            {
+            case cs::Msg_Dict:
+                _dict(*static_cast<const cs::SymbolDictMsg*>(msg));
+                break;
+            case cs::Msg_Model:
+                _model(*static_cast<const cs::ModelMsg*>(msg));
+                break;
+            case cs::Msg_Done:
+                _done(*static_cast<const cs::SolveDoneMsg*>(msg));
+                break;
+            default:
+                frames.back().push_back("other");
+            }
+        });
+    }
+
+    // The models, in any order
+    std::vector<std::vector<std::string>> sorted_models() const
+    {
+        auto out = models;
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+private:
+    void _dict(const cs::SymbolDictMsg& m)
+    {
+        frames.back().push_back("dict " + std::to_string(m.first_id()));
+        if (m.first_id() != dictionary.size()) unknown_id = true;
+        if (m.symbols())
+            for (auto s : *m.symbols()) dictionary.push_back(s->str());
+    }
+
+    void _model(const cs::ModelMsg& m)
+    {
+        frames.back().push_back("model " + std::to_string(m.number()));
+        models.emplace_back();
+        if (m.symbols())
+            for (auto s : *m.symbols()) models.back().push_back(s->str());
+        if (m.ids())
+        {
+            for (auto id : *m.ids())
+            {
+                if (id < dictionary.size()) models.back().push_back(dictionary[id]);
+                else unknown_id = true;
+            }
+        }
+        std::sort(models.back().begin(), models.back().end());
+    }
+
+    void _done(const cs::SolveDoneMsg& m)
+    {
+        frames.back().push_back("done");
+        done = true;
+        result = m.result();
+        done_models = m.models();
+        exhausted = m.exhausted();
+        interrupted = m.interrupted();
+        if (m.error()) error = m.error()->str();
+        paused = m.paused();
+    }
+};
+
+//------------------------------------------------------------------------------
+// Drains a FrameChannel on a thread of its own, as the worker's I/O thread
+// does, taking delay over each frame before releasing its builder. on_frame is
+// called on that thread after each frame has been added to received.
+//------------------------------------------------------------------------------
+
+class Consumer
+{
+public:
+    using frame_fn_t = std::function<void(const Received&)>;
+
+    Consumer(FrameChannel& channel, std::chrono::milliseconds delay, frame_fn_t on_frame = {}) :
+        channel_{channel}, delay_{delay}, on_frame_{std::move(on_frame)},
+        woken_{false}, stopping_{false}, thread_{[this]() { _run(); }}
+    { }
+
+    ~Consumer() { stop(); }
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        woken_ = true;
+        cv_.notify_one();
+    }
+
+    // Drain what is left and stop
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopping_ = true;
+            cv_.notify_one();
+        }
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // Only to be read once stopped
+    const Received& received() const { return received_; }
+    bool bad_frame() const { return bad_frame_; }
+
+private:
+    void _run()
+    {
+        while (true)
+        {
+            bool stopping = false;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [this]() { return woken_ || stopping_; });
+                woken_ = false;
+                stopping = stopping_;
+            }
+            channel_.drain([this](fbs::FlatBufferBuilder* b)
+            {
+                auto message = MessageDecoder{}(b->GetBufferPointer(), b->GetSize());
+                if (message) received_.add(*message);
+                else bad_frame_ = true;
+                if (on_frame_) on_frame_(received_);
+                std::this_thread::sleep_for(delay_);
+                channel_.release(b);
+            });
+            if (stopping) return;
+        }
+    }
+
+    FrameChannel& channel_;
+    std::chrono::milliseconds delay_;
+    frame_fn_t on_frame_;
+    Received received_;
+    bool bad_frame_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool woken_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+SolveThread::Options solve_options(Consumer& consumer, Flag& finished, const char* program)
+{
+    SolveThread::Options opts;
+    opts.job_id = 9;
+    opts.handle = 3;
+    opts.prepare = [program](Clingo::Control& ctl)
+    {
+        ctl.add("base", {}, program);
+        ctl.ground({{"base", {}}});
+    };
+    opts.wake = [&consumer]() { consumer.wake(); };
+    opts.on_finished = [&finished]() { finished.set(); };
+    return opts;
+}
+
+// Every subset of {a,b,c}
+std::vector<std::vector<std::string>> subsets()
+{
+    std::vector<std::vector<std::string>> out;
+    for (int mask = 0; mask < 8; ++mask)
+    {
+        out.emplace_back();
+        for (int i = 0; i < 3; ++i)
+            if (mask & (1 << i)) out.back().push_back(std::string(1, static_cast<char>('a' + i)));
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("solve_thread_slow_consumer", "[solve_thread]")
+{
+    for (std::size_t builders : {1, 2})
+    {
+        for (auto encoding : {cs::ModelEncoding_Ids, cs::ModelEncoding_Text})
+        {
+            FrameChannel channel{FrameChannel::Options{builders, 64}};
+            Consumer consumer{channel, std::chrono::milliseconds{5}};
+            Flag finished;
+            auto opts = solve_options(consumer, finished, "{a;b;c}.");
+            opts.encoding = encoding;
+            Clingo::Control ctl;
+            SolveThread solve{ctl, channel, std::move(opts)};
+            REQUIRE(finished.wait());
+            consumer.stop();
+            REQUIRE(solve.finished());
+            auto& got = consumer.received();
+            REQUIRE(!consumer.bad_frame());
+
+            // The search yields for each model, which gets a frame of its own
+            // after any new symbols, and the SolveDoneMsg comes last
+            REQUIRE(got.frames.size() == 9);
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                auto model = "model " + std::to_string(i + 1);
+                auto& frame = got.frames[i];
+                CHECK(frame.back() == model);
+                if (frame.size() == 2) CHECK(frame.front().compare(0, 5, "dict ") == 0);
+                else CHECK(frame.size() == 1);
+                if (encoding == cs::ModelEncoding_Text) CHECK(frame.size() == 1);
+            }
+            CHECK(got.frames.back() == std::vector<std::string>{"done"});
+            CHECK(std::all_of(got.handles.begin(), got.handles.end(),
+                              [](uint32_t h) { return h == 3; }));
+            CHECK(!got.unknown_id);
+            CHECK(got.sorted_models() == subsets());
+
+            // The consumer is slower than the search, which had to wait
+            CHECK(got.result == cs::SolveResult_Satisfiable);
+            CHECK(got.done_models == 8);
+            CHECK(got.exhausted);
+            CHECK(!got.interrupted);
+            CHECK(got.paused > 0);
+            CHECK(got.paused == solve.stats().paused);
+            CHECK(solve.stats().models == 8);
+        }
+    }
+}
+
+TEST_CASE("solve_thread_channel_closed", "[solve_thread]")
+{
+    // Once the connection has gone the search stops and nothing more is sent
+    FrameChannel channel{FrameChannel::Options{1, 64}};
+    Consumer consumer{channel, std::chrono::milliseconds{5}, [&channel](const Received& got)
+    {
+        if (got.models.size() == 2) channel.close();
+    }};
+    Flag finished;
+    Clingo::Control ctl;
+    SolveThread solve{ctl, channel,
+                      solve_options(consumer, finished, "{a(1..20)}.")};
+    REQUIRE(finished.wait());
+    consumer.stop();
+    auto& got = consumer.received();
+    CHECK(!got.done);
+    CHECK(got.models.size() == 2);
+    CHECK(solve.stats().interrupted);
+    CHECK(!solve.stats().exhausted);
+}
+
+TEST_CASE("solve_thread_interrupt", "[solve_thread]")
+{
+    // Interrupted while it is solving
+    {
+        FrameChannel channel{FrameChannel::Options{2, 64}};
+        Flag seen;
+        Consumer consumer{channel, std::chrono::milliseconds{5}, [&seen](const Received& got)
+        {
+            if (got.models.size() == 3) seen.set();
+        }};
+        Flag finished;
+        Clingo::Control ctl;
+        SolveThread solve{ctl, channel,
+                          solve_options(consumer, finished, "{a(1..20)}.")};
+        REQUIRE(seen.wait());
+        solve.interrupt();
+        REQUIRE(finished.wait());
+        consumer.stop();
+        auto& got = consumer.received();
+        REQUIRE(got.done);
+        CHECK(got.frames.back() == std::vector<std::string>{"done"});
+        CHECK(got.interrupted);
+        CHECK(!got.exhausted);
+        CHECK(got.done_models == got.models.size());
+        CHECK(got.done_models < 10);
+    }
+
+    // Interrupted before it starts solving
+    {
+        FrameChannel channel{FrameChannel::Options{2, 64}};
+        Consumer consumer{channel, std::chrono::milliseconds{0}};
+        Flag finished;
+        Flag interrupted;
+        auto opts = solve_options(consumer, finished, "{a;b;c}.");
+        auto ground = opts.prepare;
+        opts.prepare = [ground, &interrupted](Clingo::Control& ctl)
+        {
+            ground(ctl);
+            interrupted.wait();
+        };
+        Clingo::Control ctl;
+        SolveThread solve{ctl, channel, std::move(opts)};
+        solve.interrupt();
+        interrupted.set();
+        REQUIRE(finished.wait());
+        consumer.stop();
+        auto& got = consumer.received();
+        REQUIRE(got.done);
+        CHECK(got.frames.size() == 1);
+        CHECK(got.interrupted);
+        CHECK(got.done_models == 0);
+    }
+}
+
+TEST_CASE("solve_thread_error", "[solve_thread]")
+{
+    FrameChannel channel{FrameChannel::Options{2, 64}};
+    Consumer consumer{channel, std::chrono::milliseconds{0}};
+    Flag finished;
+    Clingo::Control ctl;
+    SolveThread solve{ctl, channel, solve_options(consumer, finished, "p(.")};
+    REQUIRE(finished.wait());
+    consumer.stop();
+    auto& got = consumer.received();
+    REQUIRE(got.done);
+    CHECK(got.result == cs::SolveResult_Error);
+    CHECK(!got.error.empty());
+    CHECK(got.models.empty());
+}
@@ -0,0 +1,266 @@
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <flatbuffers/flatbuffers.h>
+#include "clserver/fact_set.hpp"
+#include "clworker/streaming_loader.hpp"
+
+using namespace clworker;
+
+namespace
+{
+
+// The shown symbols of each model, sorted
+std::vector<std::vector<std::string>> models(Clingo::Control& ctl)
+{
+    std::vector<std::vector<std::string>> out;
+    for (auto& m : ctl.solve())
+    {
+        out.emplace_back();
+        for (auto& sym : m.symbols()) out.back().push_back(sym.to_string());
+        std::sort(out.back().begin(), out.back().end());
+    }
+    return out;
+}
+
+// Collects the outcome of a load and lets the test wait for it
+struct Outcome
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool called = false;
+    bool space = false;
+    bsys::error_code ec;
+    std::string message;
+
+    StreamingLoader::Options options()
+    {
+        StreamingLoader::Options opts;
+        opts.on_done = [this](const bsys::error_code& e, const std::string& m)
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            called = true;
+            ec = e;
+            message = m;
+            cv.notify_all();
+        };
+        opts.on_space = [this]()
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            space = true;
+            cv.notify_all();
+        };
+        return opts;
+    }
+
+    bool wait()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        return cv.wait_for(lock, std::chrono::seconds{10}, [this]() { return called; });
+    }
+
+    bool wait_space()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        bool ok = cv.wait_for(lock, std::chrono::seconds{10}, [this]() { return space; });
+        space = false;
+        return ok;
+    }
+};
+
+// Push text split at the given offsets, the last piece marked as such
+void push_split(StreamingLoader& loader, const std::string& text, std::vector<std::size_t> cuts)
+{
+    cuts.push_back(text.size());
+    std::size_t start = 0;
+    for (auto cut : cuts)
+    {
+        bool last = cut == text.size();
+        REQUIRE(loader.push(StreamChunk{text.substr(start, cut - start), false, last}));
+        start = cut;
+    }
+}
+
+std::string fact_set(std::initializer_list<int> ps)
+{
+    clserver::FactSetBuilder b;
+    auto p = b.block("p", {ClingoServer::ArgType_Number});
+    for (auto n : ps) b.add(p, {n});
+    fbs::FlatBufferBuilder fbb;
+    b.finish(fbb);
+    return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()), fbb.GetSize());
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+TEST_CASE("streaming_loader_split_statements", "[streaming_loader]")
+{
+    const std::string text =
+        "p(1). q(X) :- p(X).\n"
+        "r(\"a. b\"). % not. a statement.\n"
+        "%* nor. this *% s(2..3).\n";
+
+    Clingo::Control whole;
+    whole.add("base", {}, text.c_str());
+    whole.ground({{"base", {}}});
+    auto want = models(whole);
+    REQUIRE(want.size() == 1);
+
+    // Cut inside a term, a rule, a string, a line comment and a block comment
+    std::vector<std::vector<std::size_t>> splits{
+        {}, {3}, {3, 12, 24, 40, 58}, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13}};
+    for (const auto& cuts : splits)
+    {
+        Clingo::Control ctl;
+        Outcome outcome;
+        {
+            StreamingLoader loader{ctl, outcome.options()};
+            push_split(loader, text, cuts);
+            REQUIRE(outcome.wait());
+            CHECK(loader.done());
+            CHECK(loader.stats().chunks == cuts.size() + 1);
+            CHECK(loader.stats().text_bytes == text.size());
+            CHECK(loader.stats().pieces >= 1);
+        }
+        CHECK(!outcome.ec);
+        CHECK(models(ctl) == want);
+    }
+}
+
+TEST_CASE("streaming_loader_program_directive", "[streaming_loader]")
+{
+    // The statements after the directive go to extra even when they arrive
+    // in a later piece than the directive
+    const std::string text = "p(1).\n#program extra.\nq(2).\nr(3).\n";
+    Clingo::Control ctl;
+    Outcome outcome;
+    {
+        StreamingLoader loader{ctl, outcome.options()};
+        push_split(loader, text, {8, 28, 31});
+        REQUIRE(outcome.wait());
+        CHECK(loader.stats().pieces >= 2);
+    }
+    CHECK(!outcome.ec);
+    CHECK(models(ctl) == (std::vector<std::vector<std::string>>{{"p(1)"}}));
+    ctl.ground({{"extra", {}}});
+    CHECK(models(ctl) == (std::vector<std::vector<std::string>>{{"p(1)", "q(2)", "r(3)"}}));
+}
+
+TEST_CASE("streaming_loader_back_pressure", "[streaming_loader]")
+{
+    Clingo::Control ctl;
+    Outcome outcome;
+    auto opts = outcome.options();
+    opts.queue_size = 1;
+    StreamingLoader loader{ctl, std::move(opts)};
+
+    // Pushing is faster than parsing, so the queue fills
+    int n = 0;
+    bool refused = false;
+    for (; n < 100000 && !refused; ++n)
+    {
+        StreamChunk chunk{"p(" + std::to_string(n) + "). ", false, false};
+        if (loader.push(std::move(chunk))) continue;
+        refused = true;
+        // A refused chunk is left as it was, to be pushed again on_space,
+        // which may also come when nothing was refused
+        CHECK(chunk.data == "p(" + std::to_string(n) + "). ");
+        do REQUIRE(outcome.wait_space());
+        while (!loader.push(std::move(chunk)));
+    }
+    REQUIRE(refused);
+    while (!loader.push(StreamChunk{"", false, true})) REQUIRE(outcome.wait_space());
+    REQUIRE(outcome.wait());
+    CHECK(!outcome.ec);
+    CHECK(loader.stats().chunks == static_cast<std::size_t>(n) + 1);
+
+    auto found = models(ctl);
+    REQUIRE(found.size() == 1);
+    CHECK(found.front().size() == static_cast<std::size_t>(n));
+}
+
+TEST_CASE("streaming_loader_fact_sets", "[streaming_loader]")
+{
+    // A FactSet can arrive in the middle of a statement of the text
+    Clingo::Control ctl;
+    Outcome outcome;
+    {
+        StreamingLoader loader{ctl, outcome.options()};
+        REQUIRE(loader.push(StreamChunk{"q(X) :- p(X). r(", false, false}));
+        REQUIRE(loader.push(StreamChunk{fact_set({1, 2}), true, false}));
+        REQUIRE(loader.push(StreamChunk{fact_set({3}), true, false}));
+        REQUIRE(loader.push(StreamChunk{"1).", false, true}));
+        REQUIRE(outcome.wait());
+        CHECK(loader.stats().chunks == 4);
+        CHECK(loader.stats().facts == 3);
+        CHECK(loader.stats().text_bytes == 19);
+    }
+    CHECK(!outcome.ec);
+    CHECK(models(ctl) == (std::vector<std::vector<std::string>>{
+        {"p(1)", "p(2)", "p(3)", "q(1)", "q(2)", "q(3)", "r(1)"}}));
+}
+
+TEST_CASE("streaming_loader_errors", "[streaming_loader]")
+{
+    // A parse error is only reported once the last chunk has arrived
+    {
+        Clingo::Control ctl;
+        Outcome outcome;
+        StreamingLoader loader{ctl, outcome.options()};
+        REQUIRE(loader.push(StreamChunk{"p(1). q).\n", false, false}));
+        REQUIRE(loader.push(StreamChunk{"r(2).\n", false, false}));
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        CHECK(!loader.done());
+        CHECK(!outcome.called);
+        REQUIRE(loader.push(StreamChunk{"s(3).\n", false, true}));
+        REQUIRE(outcome.wait());
+        CHECK(outcome.ec == bsys::errc::invalid_argument);
+        CHECK(!outcome.message.empty());
+        CHECK(loader.stats().chunks == 3);
+    }
+
+    // So is an unfinished statement, which only the end of the text shows
+    {
+        Clingo::Control ctl;
+        Outcome outcome;
+        StreamingLoader loader{ctl, outcome.options()};
+        push_split(loader, "p(1). q(", {3});
+        REQUIRE(outcome.wait());
+        CHECK(outcome.ec == bsys::errc::invalid_argument);
+    }
+
+    // A FactSet chunk that doesn't verify
+    {
+        Clingo::Control ctl;
+        Outcome outcome;
+        StreamingLoader loader{ctl, outcome.options()};
+        REQUIRE(loader.push(StreamChunk{"p(1).", false, false}));
+        REQUIRE(loader.push(StreamChunk{"not a fact set", true, false}));
+        REQUIRE(loader.push(StreamChunk{"", false, true}));
+        REQUIRE(outcome.wait());
+        CHECK(outcome.ec == bsys::errc::bad_message);
+        CHECK(outcome.message == "invalid fact set in chunk 2");
+    }
+
+    // A cancelled load never calls on_done
+    {
+        Clingo::Control ctl;
+        Outcome outcome;
+        {
+            StreamingLoader loader{ctl, outcome.options()};
+            REQUIRE(loader.push(StreamChunk{"p(1).", false, false}));
+            loader.cancel();
+        }
+        CHECK(!outcome.called);
+    }
+}